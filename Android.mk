@@ -9,8 +9,14 @@ LOCAL_SRC_FILES:= \
 	CameraCIMDevice.cpp \
 	CameraV4L2Device.cpp \
 	CameraCompressor.cpp \
+	CameraJpegTransform.cpp \
 	CameraColorConvert.cpp \
+	CameraConvertBackend.cpp \
+	CameraFrameCache.cpp \
+	CameraPrefault.cpp \
 	CameraFaceDetect.cpp \
+	CameraJpegEncodePool.cpp \
+	CameraHotplugMonitor.cpp \
 	CameraHalSelector.cpp \
 	CameraHWModule.cpp
 
@@ -65,6 +71,7 @@ LOCAL_CFLAGS += \
 ifeq ($(CAMERA_VERSION), 1)
 LOCAL_SRC_FILES += \
 	CameraHal1.cpp \
+	CameraZoomEngine.cpp \
 	JZCameraParameters.cpp \
 
 LOCAL_CFLAGS += \
@@ -118,12 +125,6 @@ LOCAL_SRC_FILES += \
 	CameraCompressorHW.cpp
 endif
 
-#config covert yuv to rgb
-ifeq ($(COVERT_WITH_SOFT), true)
-LOCAL_CFLAGS += \
-	-DSOFT_CONVERT
-endif
-
 #camera recording use memcpy config
 ifeq ($(CAMERA_COPY_MODE_RECORDING), true)
 LOCAL_CFLAGS += \
@@ -132,11 +132,7 @@ namespace android {
             preview_buffer.dmmu_info.vaddr = preview_buffer.common->data;
             preview_buffer.dmmu_info.size = preview_buffer.common->size;
 
-            for (int i = 0; i < (int)(preview_buffer.common->size); i += 0x1000) {
-                ((uint8_t*)(preview_buffer.common->data))[i] = 0xff;
-            }
-            ((uint8_t*)(preview_buffer.common->data))[preview_buffer.common->size - 1] = 0xff;
-            dmmu_map_user_memory(&(preview_buffer.dmmu_info));
+            CameraPrefault::mapBuffer(&(preview_buffer.dmmu_info));
 
             for (int i= 0; i < preview_buffer.nr; ++i) {
                 preview_buffer.yuvMeta[i].index = i;
@@ -232,13 +228,23 @@ namespace android {
         int size = 0;
         int flag = 1;
 
-        if ((buffer == NULL) && (preview_buffer.yuvMeta[0].yAddr > 0)) {
-            addr = preview_buffer.yuvMeta[0].yAddr;
-            size = preview_buffer.size * preview_buffer.nr;
+        /* NULL is the frame last returned by getCurrentFrame, the rest
+           of the pool still belongs to the cim */
+        if (buffer == NULL) {
+            for (int i = 0; i < preview_buffer.nr; ++i) {
+                if (preview_buffer.yuvMeta[i].index == preview_buffer.index) {
+                    addr = preview_buffer.yuvMeta[i].yAddr;
+                    size = preview_buffer.size;
+                    break;
+                }
+            }
         } else {
             addr = (uint32_t)buffer;
             size = buffer_size;
         }
+        if ((addr == 0) || (size <= 0)) {
+            return;
+        }
         cacheflush((long int)addr, (long int)((unsigned int)addr+size), flag);
     }
 
@@ -328,12 +334,7 @@ namespace android {
             capture_buffer.dmmu_info.vaddr = capture_buffer.common->data;
             capture_buffer.dmmu_info.size = capture_buffer.common->size;
 
-            for (int i = 0; i < (int)(capture_buffer.common->size); i += 0x1000) {
-                ((uint8_t*)(capture_buffer.common->data))[i] = 0xff;
-            }
-
-            ((uint8_t*)(capture_buffer.common->data))[capture_buffer.common->size - 1] = 0xff;
-            dmmu_map_user_memory(&(capture_buffer.dmmu_info));
+            CameraPrefault::mapBuffer(&(capture_buffer.dmmu_info));
 
             if (capture_use_pmem && (pmem_device_fd > 0)) {
                 struct pmem_region region;
@@ -27,8 +27,6 @@ namespace android {
     CameraColorConvert::CameraColorConvert ()
         :kClipMin(-278),
          kClipMax(535),
-         mtmp_uv_size(0),
-         mtmp_uv(NULL),
          msrc(NULL),
          csY_coeff_16(1.164383 * (1 << 16)),
          csU_blue_16(2.017232 * (1 << 16)),
@@ -38,8 +36,6 @@ namespace android {
 
         initClip();
         YUV422P_To_RGB24_init();
-        mtmp_uv_size = 2*1024*1024;
-        mtmp_uv = (uint8_t*)malloc(mtmp_uv_size);
         color_table = &_color_table[256];
         
         mCC_SMPThread = new ColorConvertSMPThread(this);
@@ -51,10 +47,6 @@ namespace android {
             delete[] mClip;
             mClip = NULL;
         }
-        if (mtmp_uv != NULL) {
-            free(mtmp_uv);
-            mtmp_uv = NULL;
-        }
         if (msrc != NULL) {
             free(msrc);
             msrc = NULL;
@@ -83,55 +75,116 @@ namespace android {
         return x;
     }
 
-    void CameraColorConvert::cimyu420b_to_ipuyuv420b(CameraYUVMeta* yuvMeta) {
+    /*
+     * The cim writes the chroma of a macroblock as 64 bytes of u and then
+     * 64 bytes of v, tile420 wants its 8 rows as 8 u followed by 8 v.
+     */
+    static void repack_cim_chroma(int32_t* dest, const int32_t* src, int mbs) {
 
-        if (yuvMeta->yAddr == 0) {
-            ALOGE("%s: data is null",__FUNCTION__);
+#ifdef COMPLIE_SUPPORT_MIPS_FOR_JZ
+        if (((int)dest & 31) == 0) {
+            /* a whole cache line per pass, so pref 30 never reads dest in */
+            int32_t* d = dest - 1;
+            for (int mb = 0; mb < mbs; ++mb) {
+                const int32_t* u = src;
+                const int32_t* v = src + 16;
+                i_pref(0, src, 128);
+                i_pref(0, src, 192);
+                for (int i = 0; i < 4; ++i) {
+                    i_pref(30, d, 4);
+                    S32LDD(xr1,u,0);
+                    S32LDD(xr2,u,4);
+                    S32LDD(xr3,v,0);
+                    S32LDD(xr4,v,4);
+                    S32LDD(xr5,u,8);
+                    S32LDD(xr6,u,12);
+                    S32LDD(xr7,v,8);
+                    S32LDD(xr8,v,12);
+                    S32SDI(xr1,d,4);
+                    S32SDI(xr2,d,4);
+                    S32SDI(xr3,d,4);
+                    S32SDI(xr4,d,4);
+                    S32SDI(xr5,d,4);
+                    S32SDI(xr6,d,4);
+                    S32SDI(xr7,d,4);
+                    S32SDI(xr8,d,4);
+                    u += 4;
+                    v += 4;
+                }
+                src += 32;
+            }
             return;
         }
+#endif
+        for (int mb = 0; mb < mbs; ++mb) {
+            const int32_t* u = src;
+            const int32_t* v = src + 16;
+            for (int i = 0; i < 8; ++i) {
+                dest[0] = u[0];
+                dest[1] = u[1];
+                dest[2] = v[0];
+                dest[3] = v[1];
+                dest += 4;
+                u += 2;
+                v += 2;
+            }
+            src += 32;
+        }
+    }
 
-        int y_size = yuvMeta->width * yuvMeta->height;
-        int image_size = y_size * 12 / 8;
-        int32_t* tmpdest = (int32_t*)(yuvMeta->yAddr + y_size);
-        int32_t* u = (int32_t*)(yuvMeta->yAddr + image_size);
-        int32_t* v = u + 16;
-        int32_t* last_ptr = (int32_t*)(yuvMeta->yAddr + y_size*2);
-
-        if ((mtmp_uv == NULL) || (y_size/2 > mtmp_uv_size)) {
-            ALOGE("%s: mtmp_uv is null, uv_num = %d, mtmp_uv_size = %d", 
-                  __FUNCTION__, y_size/2, mtmp_uv_size);
+    /* one macroblock row of chroma, dest may overlap src */
+    static void move_cim_chroma_row(uint8_t* dest, uint8_t* src, int mbs) {
+
+        int len = mbs * 128;
+
+        if ((dest + len <= src) || (src + len <= dest)) {
+            repack_cim_chroma((int32_t*)dest, (const int32_t*)src, mbs);
             return;
         }
 
-        int32_t* dest = (int32_t*)mtmp_uv;
-        while (1) {
-            for (int i = 0; i < 8; ++i) {
-                *dest++ = *u++;
-                *dest++ = *u++;
-                *dest++ = *v++;
-                *dest++ = *v++;
-            }
-            if ((int)v == (int)last_ptr)
-                break;
-            u += 16;
-            v += 16;
+        int32_t mb[32];
+        for (int i = 0; i < mbs; ++i) {
+            memcpy(mb, src + i * 128, sizeof(mb));
+            repack_cim_chroma((int32_t*)(src + i * 128), mb, 1);
         }
-        dest = (int32_t*)mtmp_uv;
+        memmove(dest, src, len);
+    }
 
-        tmpdest = (int32_t*)(((int)tmpdest + 4096 - 1) & ~(4096 -1));
-        int uv_stride = ((yuvMeta->width*8) + (2048-1)) & (~(2048-1));
-        int uv_line_len = yuvMeta->width*8;
-        int32_t* tmp_last_ptr = (int32_t*)(mtmp_uv + y_size/2);
+    /*
+     * Like cimyuv420b_to_tile420, but each macroblock row of chroma starts
+     * a 2048 aligned line from a 4096 aligned base. The lines spread out
+     * towards the cim chroma they come from, so the rows whose line starts
+     * before their source go first and the others back to front. Either
+     * way no row still to be read gets overwritten, so no scratch copy.
+     */
+    void CameraColorConvert::cimyu420b_to_ipuyuv420b(CameraYUVMeta* yuvMeta) {
 
-        while (1) {
-            if ((int)tmpdest >= (int)last_ptr)
-                break;
-            if ((int)dest >= (int)tmp_last_ptr)
-                break;
-            memcpy((int32_t*)tmpdest, (int32_t*)dest, uv_line_len/4);
-            tmpdest += (uv_stride/4);
-            dest += (uv_line_len/4);
+        if (yuvMeta->yAddr == 0) {
+            ALOGE("%s: data is null",__FUNCTION__);
+            return;
         }
+
+        int y_size = yuvMeta->width * yuvMeta->height;
+        int mbs = yuvMeta->width >> 4;
+        int lines = yuvMeta->height >> 4;
+        int uv_line_len = yuvMeta->width*8;
+        int uv_stride = (uv_line_len + (2048-1)) & (~(2048-1));
+        uint8_t* src = (uint8_t*)(yuvMeta->yAddr + y_size * 12 / 8);
+        uint8_t* dest = (uint8_t*)((yuvMeta->yAddr + y_size + 4096 - 1) & ~(4096 - 1));
+        uint8_t* last_ptr = (uint8_t*)(yuvMeta->yAddr + y_size*2);
+
+        /* lines that would run past the frame are dropped */
+        while ((lines > 0) && (dest + (lines - 1) * uv_stride + uv_line_len > last_ptr))
+            lines--;
+
+        int split = 0;
+        while ((split < lines) && (dest + split * uv_stride <= src + split * uv_line_len))
+            split++;
+
+        for (int k = 0; k < split; ++k)
+            move_cim_chroma_row(dest + k * uv_stride, src + k * uv_line_len, mbs);
+        for (int k = lines - 1; k >= split; --k)
+            move_cim_chroma_row(dest + k * uv_stride, src + k * uv_line_len, mbs);
     }
 
     void CameraColorConvert::cimvyuy_to_tile420_use_hardware(uint8_t* src_data,int srcwidth, int srcheight,
@@ -250,6 +303,7 @@ namespace android {
 #endif
    }
 
+    /* the tile chroma goes right below the cim chroma, so they never overlap */
     void CameraColorConvert::cimyuv420b_to_tile420(CameraYUVMeta* yuvMeta) {
 
         if (yuvMeta->yAddr == 0) {
@@ -259,23 +313,9 @@ namespace android {
 
         int y_size = yuvMeta->width * yuvMeta->height;
         int image_size = y_size * 12 / 8;
-        int32_t* dest = (int32_t*)(yuvMeta->yAddr + y_size);
-        int32_t* u = (int32_t*)(yuvMeta->yAddr + image_size);
-        int32_t* v = u + 16;
-        int32_t* last_ptr = (int32_t*)(yuvMeta->yAddr + y_size*2);
 
-        while (1) {
-            for (int i = 0; i < 8; ++i) {
-                *dest++ = *u++;
-                *dest++ = *u++;
-                *dest++ = *v++;
-                *dest++ = *v++;
-            }
-            if ((int)v == (int)last_ptr)
-                break;
-            u += 16;
-            v += 16;
-        }
+        repack_cim_chroma((int32_t*)(yuvMeta->yAddr + y_size),
+                          (const int32_t*)(yuvMeta->yAddr + image_size), y_size >> 8);
     }
 
     void CameraColorConvert::cimyuv420b_to_tile420(CameraYUVMeta* yuvMeta,uint8_t* dest_frame) {
@@ -287,25 +327,10 @@ namespace android {
 
         int y_size = yuvMeta->width * yuvMeta->height;
         int image_size = y_size * 12 / 8;
-        int32_t* dest = (int32_t*)(dest_frame+y_size);
-        int32_t* u = (int32_t*)(yuvMeta->yAddr + image_size);
-        int32_t* v = u + 16;
-        int32_t* last_ptr = (int32_t*)(yuvMeta->yAddr + y_size*2);
-
-        memcpy((int32_t*)dest_frame, (int32_t*)(yuvMeta->yAddr), y_size/4);
 
-        while (1) {
-            for (int i = 0; i < 8; ++i) {
-                *dest++ = *u++;
-                *dest++ = *u++;
-                *dest++ = *v++;
-                *dest++ = *v++;
-            }
-            if ((int)v == (int)last_ptr)
-                break;
-            u += 16;
-            v += 16;
-        }
+        memcpy(dest_frame, (uint8_t*)(yuvMeta->yAddr), y_size);
+        repack_cim_chroma((int32_t*)(dest_frame + y_size),
+                          (const int32_t*)(yuvMeta->yAddr + image_size), y_size >> 8);
     }
 
     /* 64 u 64 v -> yuv420p */
@@ -421,6 +446,11 @@ void CameraColorConvert::YUV422P_To_RGB24_init() {
 
 
 
+#define TILE_RGB565(ye, vr, uvg, ub)                                     \
+    (unsigned short)((((unsigned short)color_table[(ye) + (vr)] >> 3) << 11) \
+                     | (((unsigned short)color_table[(ye) + (uvg)] >> 2) << 5) \
+                     | ((unsigned short)color_table[(ye) + (ub)] >> 3))
+
 #if 1
     /*
     yuv to rgb888
@@ -434,92 +464,61 @@ void CameraColorConvert::YUV422P_To_RGB24_init() {
             ALOGE("%s: data is null",__FUNCTION__);
             return;
         }
-        int line = 0, col = 0;
-        int y0 = 0, y1 = 0, u = 0, v = 0;
-        int r0 = 0, g0 = 0, b0 = 0;
-        int r1 = 0, g1 = 0, b1 = 0;
-        const unsigned char *py = NULL, *pu = NULL, *pv = NULL;
+
         int width = yuvMeta->width;     //frame width
         int height = yuvMeta->height;   //frame height
         int ySize = width*height;       //space length of element y
         unsigned short* dst = (unsigned short*)dstAddr;
         if ((width % 2) != 0 || (height % 2) != 0){
-            for( line = 0; line < ySize; line++){
-                *dst++=0;
-            }
+            memset(dst, 0, ySize * sizeof(unsigned short));
             return;
         }
-        py = (unsigned char*)(yuvMeta->yAddr);  //start address of element y
-        pu = py + ySize;    //start address of element u
-        pv = pu + 8;        //start address of element v
-
-        //micro-block: 16*16 for element y, 8*8 for elements u&v
-        int iLoop = 0;  //horizontal offset in a micro-block (0,1,2...,16)
-        int jLoop = 0;  //number of micro-block in a frame's horizontal direction (0,1,2...,screen_width/16)
-        int kLoop = 0;  //line number in a micre-block (0,1,2...,15)
-        int dxy = 0;    //horizontal offset relative to dy
-        int stride_y = width<<4;
-        int stride_uv = width<<3;   //u&v_microblock: 8*8
 
-        //variables used to transform between yuv and rgb
-        int Ye0,Ye1,Ue_blue,Ue_green,Ve_green,Ve_red,UeVe_green;
+        /*
+         * A macroblock at a time: its 256 luma and 128 chroma bytes are
+         * read once, and each u v pair is looked up once for the 2x2
+         * pixels sharing it instead of once per line.
+         */
+        const unsigned char* py = (unsigned char*)(yuvMeta->yAddr);
+        const unsigned char* puv = py + ySize;
+        int mb_w = width >> 4;
+        int mb_h = height >> 4;
+
+        for (int mby = 0; mby < mb_h; ++mby) {
+            for (int mbx = 0; mbx < mb_w; ++mbx) {
+                const unsigned char* ty = py + ((mby * mb_w + mbx) << 8);
+                const unsigned char* tuv = puv + ((mby * mb_w + mbx) << 7);
+                unsigned short* d0 = dst + (mby * 16) * width + (mbx << 4);
 
-        for (line = 0; line < height; line++) {
-            for (col = 0; col < width; col += 2 ) {
-                if ( iLoop == 16 ){ //means ends of a micro-block in horizontal direction,will jump to next one
-                    jLoop++;
-                    iLoop = 0;
+#ifdef COMPLIE_SUPPORT_MIPS_FOR_JZ
+                i_pref(0, ty, 256);
+                i_pref(0, tuv, 128);
+#endif
+                for (int row = 0; row < 8; ++row) {
+                    unsigned short* d1 = d0 + width;
+                    for (int c = 0; c < 8; ++c) {
+                        int u = tuv[c];
+                        int v = tuv[c + 8];
+                        int Ue_blue = Um_blue_tableEx[u];
+                        int UeVe_green = Um_green_tableEx[u] + Vm_green_tableEx[v];
+                        int Ve_red = Vm_red_tableEx[v];
+                        int Ye;
+
+                        Ye = Ym_tableEx[ty[2*c]];
+                        d0[2*c] = TILE_RGB565(Ye, Ve_red, UeVe_green, Ue_blue);
+                        Ye = Ym_tableEx[ty[2*c + 1]];
+                        d0[2*c + 1] = TILE_RGB565(Ye, Ve_red, UeVe_green, Ue_blue);
+                        Ye = Ym_tableEx[ty[16 + 2*c]];
+                        d1[2*c] = TILE_RGB565(Ye, Ve_red, UeVe_green, Ue_blue);
+                        Ye = Ym_tableEx[ty[16 + 2*c + 1]];
+                        d1[2*c + 1] = TILE_RGB565(Ye, Ve_red, UeVe_green, Ue_blue);
+                    }
+                    ty += 32;
+                    tuv += 16;
+                    d0 += width << 1;
                 }
-                dxy = iLoop + jLoop * 256;
-                iLoop += 2;         //it will transform 2 pixels for a line in a loop
-
-                y0 = *(py+dxy);
-                y1 = *(py+dxy+1);
-                u = *(pu+dxy/2);
-                v = *(pv+dxy/2);
-                Ye0 = Ym_tableEx[y0];
-                Ye1 = Ym_tableEx[y1];
-                Ue_blue = Um_blue_tableEx[u];
-                Ue_green = Um_green_tableEx[u];
-                Ve_green = Vm_green_tableEx[v];
-                UeVe_green = Ue_green + Ve_green;
-                Ve_red = Vm_red_tableEx[v];
-
-                r0 = (int)color_table[(Ye0 + Ve_red)];
-                r1 = (int)color_table[(Ye1 + Ve_red)];
-                g0 = (int)color_table[(Ye0 + UeVe_green)];
-                g1 = (int)color_table[(Ye1 + UeVe_green)];
-                b0 = (int)color_table[(Ye0 + Ue_blue)];
-                b1 = (int)color_table[(Ye1 + Ue_blue)];
-
-                //before fill rgb data to dst,transform rgb888 to rgb565 first
-                *dst++= (((unsigned short)r0>>3)<<11)
-                    | (((unsigned short)g0>>2)<<5)
-                    | (((unsigned short)b0>>3)<<0);
-
-                *dst++= (((unsigned short)r1>>3)<<11)
-                    | (((unsigned short)g1>>2)<<5)
-                    | (((unsigned short)b1>>3)<<0);
-            } //end for (col = 0; col < width; col += 2 )
-
-            if ( kLoop > 0 && kLoop % 15 == 0 ) {
-                py += stride_y + 16 - 256;
-                pu += stride_uv + 16 - 128;
-                pv = pu + 8;
-                iLoop = 0; jLoop = 0; kLoop = 0;
             }
-            else if ( kLoop & 1 ) {
-                py += 16;
-                pu += 16;
-                pv = pu + 8;
-                iLoop = 0; jLoop = 0; kLoop++;
-            }
-            else {
-                py += 16;
-                iLoop = 0; jLoop = 0;
-                kLoop++;
-            }
-        } //end for (line = 0; line < height; line++)
+        }
     }
 
 #else
@@ -930,12 +929,18 @@ void CameraColorConvert::YUV422P_To_RGB24_init() {
 
     /* convert yuyv to YVU420P */
     /* This format assumes that the horizontal strides (luma and chroma) are multiple of 16 pixels */
-    void CameraColorConvert::yuyv_to_yvu420p(uint8_t *dst,int dstStride, int dstHeight, uint8_t *src, int srcStride, int width, int height)
+    void CameraColorConvert::yuyv_to_yvu420p(uint8_t *dst,int dstStride, int dstHeight, uint8_t *src, int srcStride, int width, int height, int transform)
     {
         ALOGV("%s: dstStride = %d, dstHeight = %d, srcStride = %d, size = %dx%d",
       __FUNCTION__, dstStride, dstHeight, srcStride,
                  width, height);
 
+        if (transform != 0) {
+            yuyv_to_transformed(dst, dstStride, dstHeight, src, srcStride,
+                                width, height, transform, LAYOUT_YVU420P);
+            return;
+        }
+
         // Calculate the chroma plane stride
         int dstVUStride = ((dstStride >> 1) + 15) & (-16);
 
@@ -978,11 +983,17 @@ void CameraColorConvert::YUV422P_To_RGB24_init() {
     }
 
     /* convert yuyv to YVU420SP */
-    void CameraColorConvert::yuyv_to_yvu420sp(uint8_t *dst,int dstStride, int dstHeight, uint8_t *src, int srcStride, int width, int height)
+    void CameraColorConvert::yuyv_to_yvu420sp(uint8_t *dst,int dstStride, int dstHeight, uint8_t *src, int srcStride, int width, int height, int transform)
     {
         ALOGV("%s: dstStride = %d, dstHeight = %d, srcStride = %d, size = %dx%d", 
                  __FUNCTION__,dstStride, dstHeight, srcStride,
                  width, height);
+
+        if (transform != 0) {
+            yuyv_to_transformed(dst, dstStride, dstHeight, src, srcStride,
+                                width, height, transform, LAYOUT_YVU420SP);
+            return;
+        }
         // Start of Y plane
         uint8_t* dstY = dst;
 
@@ -1016,91 +1027,250 @@ void CameraColorConvert::YUV422P_To_RGB24_init() {
             dstY  += dyvu;
         }
     }
- 
-    void CameraColorConvert::tile420_to_yuv420p(CameraYUVMeta* yuvMeta, uint8_t* dest) {
 
+    /* copy yuyv with a transform applied, dst is height x width when rotated */
+    void CameraColorConvert::yuyv_transform(uint8_t *dst, int dstStride, uint8_t *src, int srcStride,
+                                            int width, int height, int transform)
+    {
+        ALOGV("%s: dstStride = %d, srcStride = %d, size = %dx%d, transform = %d",
+              __FUNCTION__, dstStride, srcStride, width, height, transform);
 
-        if (yuvMeta->yAddr == 0) {
-            ALOGE("%s: data is null",__FUNCTION__);
+        if (transform == 0) {
+            for (int h = 0; h < height; ++h) {
+                memcpy(dst + h * dstStride, src + h * srcStride, width << 1);
+            }
             return;
         }
+        yuyv_to_transformed(dst, dstStride, 0, src, srcStride,
+                            width, height, transform, LAYOUT_YUYV);
+    }
 
-        char *y_p = (char*)dest;
-        int width = yuvMeta->width;
-        int height = yuvMeta->height;
-        unsigned int y_p_size = width*height;
-        char *u_p = y_p+y_p_size;
-        unsigned int u_p_size = y_p_size>>2;
-        char *v_p = u_p+u_p_size;
-        unsigned int v_p_size = u_p_size;
+    void CameraColorConvert::yuyv_scale(uint8_t *dst, int dstStride, int dstWidth, int dstHeight,
+                                        uint8_t *src, int srcStride, int srcWidth, int srcHeight)
+    {
+        ALOGV("%s: %dx%d -> %dx%d", __FUNCTION__, srcWidth, srcHeight, dstWidth, dstHeight);
 
-        char *y_t = (char*)(yuvMeta->yAddr);
-        unsigned int y_t_size = y_p_size;
-        char *uv_t = y_t + y_t_size;
-        unsigned int uv_t_size = u_p_size+v_p_size;
+        if ((dstWidth <= 0) || (dstHeight <= 0)) {
+            return;
+        }
 
-        int i_w, j_h;
-        int y_w_mcu = width>>4;
-        int y_h_mcu = height>>4;
+        /* 16.16 steps through the source */
+        int xstep = (srcWidth << 16) / dstWidth;
+        int ystep = (srcHeight << 16) / dstHeight;
+
+        for (int h = 0; h < dstHeight; ++h) {
+            uint8_t* line = src + ((h * ystep) >> 16) * srcStride;
+            uint8_t* out = dst + h * dstStride;
+            int sx = 0;
+            for (int w = 0; w < dstWidth; w += 2) {
+                int x0 = sx >> 16;
+                int x1 = (sx + xstep) >> 16;
+                uint8_t* pair = line + ((x0 & ~1) << 1);
+                if (x1 >= srcWidth)
+                    x1 = srcWidth - 1;
+                out[0] = line[x0 << 1];
+                out[1] = pair[1];
+                out[2] = line[x1 << 1];
+                out[3] = pair[3];
+                out += 4;
+                sx += xstep << 1;
+            }
+        }
+    }
 
-        int u_w_mcu = y_w_mcu;
-        int u_h_mcu = y_h_mcu;
+    static void scale_plane(uint8_t *dst, int dstWidth, int dstHeight,
+                            uint8_t *src, int srcWidth, int srcHeight)
+    {
+        int xstep = (srcWidth << 16) / dstWidth;
+        int ystep = (srcHeight << 16) / dstHeight;
 
-        int v_w_mcu = u_w_mcu;
-        int v_h_mcu = u_h_mcu;
+        for (int h = 0; h < dstHeight; ++h) {
+            uint8_t* line = src + ((h * ystep) >> 16) * srcWidth;
+            int sx = 0;
+            for (int w = 0; w < dstWidth; ++w) {
+                *dst++ = line[sx >> 16];
+                sx += xstep;
+            }
+        }
+    }
 
-        int i_mcu;
+    void CameraColorConvert::yuv420p_scale(uint8_t *dst, int dstWidth, int dstHeight,
+                                           uint8_t *src, int srcWidth, int srcHeight)
+    {
+        ALOGV("%s: %dx%d -> %dx%d", __FUNCTION__, srcWidth, srcHeight, dstWidth, dstHeight);
 
-        char *y_mcu = y_p;
-        char *u_mcu = u_p;
-        char *v_mcu = v_p;
-        char *y_tmp = y_p;
+        if ((dstWidth <= 0) || (dstHeight <= 0)) {
+            return;
+        }
 
-        char *y_t_tmp = y_t;
-        for(j_h = 0; j_h < y_h_mcu; j_h++)
-            {
-                y_mcu = y_p + j_h*y_w_mcu*256;
-                for(i_w = 0; i_w < y_w_mcu; i_w++)
-                    {
-                        y_tmp = y_mcu;
-                        for(i_mcu = 0; i_mcu < 16; i_mcu++)
-                            {
-                                memcpy(y_tmp, y_t_tmp, 16);
-                                y_t_tmp += 16;
-                                y_tmp += width;
-                            }
-                        y_mcu += 16;
-                    }
-            }
+        int src_y = srcWidth * srcHeight;
+        int dst_y = dstWidth * dstHeight;
 
-        char *u_tmp = u_p;
-        char *v_tmp = v_p;
-        char *u_uv_t_tmp = uv_t;
-        char *v_uv_t_tmp = uv_t+8;
-        for(j_h = 0; j_h < u_h_mcu; j_h++)
-            {
-                u_mcu = u_p + j_h*u_w_mcu*64;
-                v_mcu = v_p + j_h*v_w_mcu*64;
-                for(i_w = 0; i_w < u_w_mcu; i_w++)
-                    {
-                        u_tmp = u_mcu;
-                        v_tmp = v_mcu;
-                        for(i_mcu = 0; i_mcu < 8; i_mcu++)
-                            {
-                                memcpy(u_tmp, u_uv_t_tmp, 8);
-                                memcpy(v_tmp, v_uv_t_tmp, 8);
+        scale_plane(dst, dstWidth, dstHeight, src, srcWidth, srcHeight);
+        scale_plane(dst + dst_y, dstWidth >> 1, dstHeight >> 1,
+                    src + src_y, srcWidth >> 1, srcHeight >> 1);
+        scale_plane(dst + dst_y + (dst_y >> 2), dstWidth >> 1, dstHeight >> 1,
+                    src + src_y + (src_y >> 2), srcWidth >> 1, srcHeight >> 1);
+    }
 
-                                u_uv_t_tmp += 16;
-                                v_uv_t_tmp += 16;
+    int CameraColorConvert::mirror_transform(int rotation)
+    {
+        /* a sideways panel mirrors along what is the vertical axis of the sensor */
+        if (rotation == 90 || rotation == 270)
+            return HAL_TRANSFORM_FLIP_V;
+        return HAL_TRANSFORM_FLIP_H;
+    }
 
-                                u_tmp += width / 2;
-                                v_tmp += width / 2;
-                            }
+    /*
+     * Walks the destination in write order and reads the source pixel the
+     * transform maps there. Flips apply before the 90 degree turn, as in
+     * HAL_TRANSFORM_*, and the walk is linear so each step is two adds.
+     * Chroma comes from the source pixel pair of the first pixel written.
+     */
+    void CameraColorConvert::yuyv_to_transformed(uint8_t *dst, int dstStride, int dstHeight,
+                                                 uint8_t *src, int srcStride, int width, int height,
+                                                 int transform, int layout)
+    {
+        bool rot90 = (transform & HAL_TRANSFORM_ROT_90) != 0;
+        int outWidth = rot90 ? height : width;
+        int outHeight = rot90 ? width : height;
+
+        /* source position of output (0,0) and its step along x and along y */
+        int x0 = 0, y0 = 0;
+        int xdx = 1, ydx = 0;
+        int xdy = 0, ydy = 1;
+        if (rot90) {
+            y0 = height - 1;
+            xdx = 0; ydx = -1;
+            xdy = 1; ydy = 0;
+        }
+        if (transform & HAL_TRANSFORM_FLIP_H) {
+            x0 = width - 1 - x0;
+            xdx = -xdx;
+            xdy = -xdy;
+        }
+        if (transform & HAL_TRANSFORM_FLIP_V) {
+            y0 = height - 1 - y0;
+            ydx = -ydx;
+            ydy = -ydy;
+        }
 
-                        u_mcu += 8;
-                        v_mcu += 8;
+        uint8_t* dstY = dst;
+        uint8_t* dstV = dst + dstStride * dstHeight;
+        uint8_t* dstU = NULL;
+        int vuStride = dstStride;
+        if (layout == LAYOUT_YVU420P) {
+            vuStride = ((dstStride >> 1) + 15) & (-16);
+            dstU = dstV + (vuStride * dstHeight >> 1);
+        }
+
+        for (int y = 0; y < outHeight; ++y) {
+            int sx = x0 + y * xdy;
+            int sy = y0 + y * ydy;
+            uint8_t* row = dstY + y * dstStride;
+            uint8_t* vu = dstV + (y >> 1) * vuStride;
+            bool chroma = (y & 1) == 0;
+
+            for (int x = 0; x < outWidth; x += 2) {
+                uint8_t* p0 = src + sy * srcStride;
+                uint8_t* c0 = p0 + ((sx & ~1) << 1);
+                uint8_t y0v = p0[sx << 1];
+                sx += xdx;
+                sy += ydx;
+                uint8_t y1v = src[sy * srcStride + (sx << 1)];
+                sx += xdx;
+                sy += ydx;
+
+                switch (layout) {
+                case LAYOUT_YUYV:
+                    row[x << 1] = y0v;
+                    row[(x << 1) + 1] = c0[1];
+                    row[(x << 1) + 2] = y1v;
+                    row[(x << 1) + 3] = c0[3];
+                    break;
+                case LAYOUT_YVU420SP:
+                    row[x] = y0v;
+                    row[x + 1] = y1v;
+                    if (chroma) {
+                        vu[x] = c0[3];
+                        vu[x + 1] = c0[1];
+                    }
+                    break;
+                case LAYOUT_YVU420P:
+                    row[x] = y0v;
+                    row[x + 1] = y1v;
+                    if (chroma) {
+                        vu[x >> 1] = c0[3];
+                        dstU[(y >> 1) * vuStride + (x >> 1)] = c0[1];
                     }
+                    break;
+                }
             }
+        }
+    }
+ 
+    /* rows of 8 or 16 bytes out of a tile, a word at a time when dst allows */
+    static inline void copy_tile_rows(uint8_t* dst, int dstStride, const uint8_t* src,
+                                      int bytes, int rows, bool aligned) {
+        for (int r = 0; r < rows; ++r) {
+            if (aligned) {
+                const uint32_t* s = (const uint32_t*)src;
+                uint32_t* d = (uint32_t*)dst;
+                d[0] = s[0];
+                d[1] = s[1];
+                if (bytes == 16) {
+                    d[2] = s[2];
+                    d[3] = s[3];
+                }
+            } else {
+                memcpy(dst, src, bytes);
+            }
+            dst += dstStride;
+            src += 16;
+        }
+    }
+
+    /* a macroblock at a time, luma and both chroma planes together */
+    void CameraColorConvert::tile420_to_yuv420p(CameraYUVMeta* yuvMeta, uint8_t* dest) {
+
+        if (yuvMeta->yAddr == 0) {
+            ALOGE("%s: data is null",__FUNCTION__);
+            return;
+        }
+
+        int width = yuvMeta->width;
+        int height = yuvMeta->height;
+        int y_size = width*height;
+        int c_width = width >> 1;
+        int mb_w = width >> 4;
+        int mb_h = height >> 4;
+        bool aligned = ((int)dest & 3) == 0;
+
+        const uint8_t* y_t = (const uint8_t*)(yuvMeta->yAddr);
+        const uint8_t* uv_t = y_t + y_size;
+        uint8_t* y_p = dest;
+        uint8_t* u_p = y_p + y_size;
+        uint8_t* v_p = u_p + (y_size >> 2);
+
+        for (int mby = 0; mby < mb_h; ++mby) {
+            uint8_t* y_mb = y_p + mby * width * 16;
+            uint8_t* u_mb = u_p + mby * c_width * 8;
+            uint8_t* v_mb = v_p + mby * c_width * 8;
+            for (int mbx = 0; mbx < mb_w; ++mbx) {
+#ifdef COMPLIE_SUPPORT_MIPS_FOR_JZ
+                i_pref(0, y_t, 256);
+                i_pref(0, uv_t, 128);
+#endif
+                copy_tile_rows(y_mb, width, y_t, 16, 16, aligned);
+                copy_tile_rows(u_mb, c_width, uv_t, 8, 8, aligned);
+                copy_tile_rows(v_mb, c_width, uv_t + 8, 8, 8, aligned);
+                y_t += 256;
+                uv_t += 128;
+                y_mb += 16;
+                u_mb += 8;
+                v_mb += 8;
+            }
+        }
     }
 
     /* This format assumes that the horizontal strides (luma and chroma) are multiple of 16 pixels */
@@ -15,18 +15,11 @@
 #define DEBUG_COMPRESSOR 0
 
 #include "CameraCompressor.h"
+#include "CameraJpegTransform.h"
 
 namespace android {
 
-    CameraCompressor::CameraCompressor(compress_params_t* yuvImage,bool mirror,int rot) {
-
-        if (mirror) {
-            if (rot == 90 || rot == 270) {
-                yuyv_upturn(yuvImage->src,yuvImage->pictureWidth,yuvImage->pictureHeight);
-            } else if (rot == 0 || rot == 180) {
-                yuyv_mirror(yuvImage->src,yuvImage->pictureWidth,yuvImage->pictureHeight);
-            }
-        }
+    CameraCompressor::CameraCompressor(compress_params_t* yuvImage) {
 
         mSrc = yuvImage->src;
         mPictureWidth = yuvImage->pictureWidth;
@@ -46,6 +39,7 @@ namespace android {
             mThumbnailQuality = yuvImage->thumbnailQuality;
 
         mFormat = yuvImage->format;
+        mTransform = yuvImage->transform;
         mRequiredMem = yuvImage->requiredMem;
         mStrides[0] = 0;
         mStrides[1] = 0;
@@ -104,6 +98,31 @@ namespace android {
         }
     }
 
+    /*
+     * Replaces the jpeg in mStream with its transformed copy. On failure
+     * mStream is left empty, the exif already describes the turned
+     * picture so the untransformed one must not go out under it.
+     */
+    status_t CameraCompressor::transformCompressedImage(void) {
+
+        size_t size = getCompressedSize();
+        uint8_t* jpeg = (uint8_t*)malloc(size);
+        status_t ret = NO_ERROR;
+
+        if (jpeg == NULL) {
+            return NO_MEMORY;
+        }
+
+        getCompressedImage(jpeg);
+        resetSkstream();
+        ret = CameraJpegTransform::transform(jpeg, size, mTransform, &mStream);
+        if (ret != NO_ERROR) {
+            resetSkstream();
+        }
+        free(jpeg);
+        return ret;
+    }
+
     status_t CameraCompressor::compress_to_jpeg(ExifElementsTable* exif,camera_memory_t** jpegMem) {
         status_t ret = NO_ERROR;
         camera_memory_t* picJpegMem = NULL;
@@ -120,6 +139,10 @@ namespace android {
                 return ret;
             }
 
+            if ((mTransform != 0) && ((ret = transformCompressedImage()) != NO_ERROR)) {
+                ALOGE("%s: transform thumbnail fail",__FUNCTION__);
+                goto fail;
+            }
             thumb_size = getCompressedSize();
             thumbJpegMem = mRequiredMem(-1, thumb_size, 1, NULL);
             if (NULL !=  thumbJpegMem && thumbJpegMem->data !=NULL) {
@@ -141,6 +164,10 @@ namespace android {
             goto fail;
         }
 
+        if ((mTransform != 0) && ((ret = transformCompressedImage()) != NO_ERROR)) {
+            ALOGE("%s: transform picture fail",__FUNCTION__);
+            goto fail;
+        }
         jpeg_size = getCompressedSize();
         picJpegMem = mRequiredMem(-1, (jpeg_size + thumb_size*2), 1, NULL);
         if (NULL !=  picJpegMem && picJpegMem->data != NULL) {
@@ -156,6 +183,7 @@ namespace android {
         /* third, insert exif -> jpeg picture */
         if (NULL != exif) {
             Section_t* exif_section = NULL;
+            AutoMutex lock(ExifElementsTable::sJheadLock);
             if (NULL != picJpegMem && picJpegMem->data != NULL && jpeg_size > 0) {
                 /* fourth, insert exif thumnail image */
                 exif->insertExifToJpeg((unsigned char*)(picJpegMem->data),jpeg_size);
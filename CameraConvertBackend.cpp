@@ -0,0 +1,822 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LOG_TAG "CameraConvertBackend"
+//#define LOG_NDEBUG 0
+#include "CameraConvertBackend.h"
+#include "CameraZoomEngine.h"
+
+#ifndef PIXEL_FORMAT_YV16
+#define PIXEL_FORMAT_YV16  0x36315659 /* YCrCb 4:2:2 Planar */
+#endif
+
+namespace android {
+
+    static bool is_rgb_format(int format) {
+        switch (format) {
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_RGB_888:
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    //---------------------------- ipu ----------------------------
+
+    CameraIpuBackend::CameraIpuBackend(CameraDeviceCommon* device)
+        :CameraConvertBackend(device),
+         mipu(NULL),
+         mOpened(false),
+         mInitFirst(false),
+         mWidth(0),
+         mHeight(0),
+         mFormat(0) {
+    }
+
+    CameraIpuBackend::~CameraIpuBackend() {
+        close();
+    }
+
+    bool CameraIpuBackend::open(void) {
+
+        if (mOpened)
+            return true;
+
+        if (ipu_open(&mipu) < 0) {
+            ALOGE("ipu_open() failed ipuHandler");
+            if (mipu != NULL) ipu_close(&mipu);
+            mipu = NULL;
+            mOpened = false;
+            mInitFirst = true;
+            return false;
+        }
+
+        mOpened = true;
+        mInitFirst = true;
+        return true;
+    }
+
+    void CameraIpuBackend::close(void) {
+
+        if (mOpened == false)
+            return;
+
+        int err = 0;
+        if (mipu != NULL) err = ipu_close(&mipu);
+        if (err < 0) {
+            ALOGE("ipu_close failed ipuHalder = %p", mipu);
+        }
+        mipu = NULL;
+        mOpened = false;
+        mInitFirst = true;
+    }
+
+    bool CameraIpuBackend::canConvert(int srcFormat, int dstFormat) {
+
+        if (srcFormat != HAL_PIXEL_FORMAT_YCbCr_422_I
+            && srcFormat != HAL_PIXEL_FORMAT_JZ_YUV_420_B
+            && srcFormat != HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
+            return false;
+        }
+
+        return (dstFormat == HAL_PIXEL_FORMAT_RGB_565)
+            || (dstFormat == HAL_PIXEL_FORMAT_RGB_888)
+            || (dstFormat == HAL_PIXEL_FORMAT_RGBX_8888);
+    }
+
+    /*
+     * ipu_init only reprograms the resizer for a new input size, the
+     * device stays open. A zoom that keeps the crop size costs nothing,
+     * and the crop sizes convert() asks for are on the zoom index grid.
+     */
+    int CameraIpuBackend::init(int w, int h, int mat, int must_do, int zoomRatio) {
+
+        if (!mOpened)
+            return -1;
+
+        if (mInitFirst) {
+            mInitFirst = false;
+            mWidth = 0;
+            mHeight = 0;
+            mFormat = 0;
+        }
+
+        if (w != mWidth || h != mHeight || mat != mFormat || must_do != 0) {
+
+            mWidth = w;
+            mHeight = h;
+            mFormat = mat;
+
+            ALOGV("%s: width: %d, height: %d, format: 0x%x,must_do: %d",
+                  __FUNCTION__, mWidth, mHeight, mFormat,must_do);
+
+            if((zoomRatio == 200) && (must_do == 1) && (w == 800))
+                mInitFirst = true;
+
+            if (ipu_init(mipu) < 0) {
+                if (mipu != NULL) ipu_close(&mipu);
+                mipu = NULL;
+                mOpened = false;
+                mInitFirst = true;
+                ALOGE("%s: ipu init fail",__FUNCTION__);
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    status_t CameraIpuBackend::convert(const convert_request_t* req) {
+
+        CameraYUVMeta* yuvMeta = req->src;
+        uint8_t* dst_buf = req->dst;
+        struct source_data_info *srcInfo;
+        struct ipu_data_buffer* srcBuf;
+        struct dest_data_info* dstInfo;
+        struct ipu_data_buffer* dstBuf;
+
+        int err = 0;
+        int bytes_per_pixel = 2;
+        int cropLeft = 0;
+        int cropTop = 0;
+        int offset = 0;
+        int uvOffset = 0;
+        int map_size = 0;
+        int zoomRatio = 0;
+
+        if (mOpened == false) {
+            ALOGE("%s: open ipu error or not open it", __FUNCTION__);
+            return NO_INIT;
+        }
+
+        /* the ratios a smooth zoom passes between two indexes share a crop */
+        zoomRatio = ZOOM_RATIO_MIN + ((req->zoomRatio - ZOOM_RATIO_MIN + ZOOM_IPU_RATIO_STEP / 2)
+                                      / ZOOM_IPU_RATIO_STEP) * ZOOM_IPU_RATIO_STEP;
+        if (zoomRatio < ZOOM_RATIO_MIN) {
+            zoomRatio = ZOOM_RATIO_MIN;
+        }
+
+        map_size = req->dstStride * req->dstHeight;
+        mapDst(req, map_size);
+
+        srcInfo = &(mipu->src_info);
+        srcBuf = &(mipu->src_info.srcBuf);
+        memset(srcInfo, 0, sizeof(struct source_data_info));
+        srcInfo->fmt = yuvMeta->format;
+        srcInfo->is_virt_buf = 1;
+        srcInfo->width = num2even(yuvMeta->width * 100 / zoomRatio);
+        srcInfo->height = num2even(yuvMeta->height * 100 / zoomRatio);
+        srcInfo->stlb_base = mDevice->getTlbBase();
+
+        /* the crop window is centred in the frame */
+        cropLeft = num2even((yuvMeta->width - srcInfo->width) / 2);
+        cropLeft = (cropLeft < 0) ? 0 : cropLeft;
+        cropTop = num2even((yuvMeta->height - srcInfo->height) / 2);
+        cropTop = (cropTop < 0) ? 0 : cropTop;
+        if (yuvMeta->format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
+            offset = cropTop * yuvMeta->yStride + cropLeft * bytes_per_pixel;
+        } else if (yuvMeta->format == HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
+            offset = cropTop * yuvMeta->yStride + cropLeft;
+            uvOffset = (cropTop >> 1) * yuvMeta->uStride + (cropLeft >> 1);
+        }
+        ALOGV("srcInfo->width = %d, srcInfo->height = %d, cropLeft =%d, cropTop = %d, offset = %d, zoomRatio: %d",
+               srcInfo->width, srcInfo->height, cropLeft, cropTop, offset, zoomRatio);
+
+        if (yuvMeta->format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
+            srcBuf->y_buf_v = (void*)(yuvMeta->yAddr + offset);
+            srcBuf->u_buf_v = (void*)(yuvMeta->yAddr + offset);
+            srcBuf->v_buf_v = (void*)(yuvMeta->yAddr + offset);
+
+            if (mDevice->usePmem()) {
+                srcBuf->y_buf_phys = yuvMeta->yPhy + offset;
+                srcBuf->u_buf_phys = 0;
+                srcBuf->v_buf_phys = 0;
+            } else {
+                srcBuf->y_buf_phys = 0;
+                srcBuf->u_buf_phys = 0;
+                srcBuf->v_buf_phys = 0;
+            }
+
+            srcBuf->y_stride = yuvMeta->yStride;
+            srcBuf->u_stride = yuvMeta->uStride;
+            srcBuf->v_stride = yuvMeta->vStride;
+        } else if (yuvMeta->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
+            srcBuf->y_buf_v = (void*)yuvMeta->yAddr;
+            srcBuf->u_buf_v = (void*)(yuvMeta->yAddr + (yuvMeta->width*yuvMeta->height)) ;
+            srcBuf->v_buf_v = (void*)srcBuf->u_buf_v;
+            srcBuf->y_stride = yuvMeta->yStride;
+            srcBuf->u_stride = yuvMeta->uStride;
+            srcBuf->v_stride = yuvMeta->vStride;
+        } else if (yuvMeta->format ==  HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
+            srcBuf->y_buf_v = (void*)(yuvMeta->yAddr + offset);
+            srcBuf->u_buf_v = (void*)(yuvMeta->uAddr + uvOffset);
+            srcBuf->v_buf_v = (void*)(yuvMeta->vAddr + uvOffset);
+
+            if (mDevice->usePmem()) {
+                srcBuf->y_buf_phys = yuvMeta->yPhy + offset;
+                srcBuf->u_buf_phys = yuvMeta->uPhy + uvOffset;
+                srcBuf->v_buf_phys = yuvMeta->vPhy + uvOffset;
+            } else {
+                srcBuf->y_buf_phys = 0;
+                srcBuf->u_buf_phys = 0;
+                srcBuf->v_buf_phys = 0;
+            }
+
+            srcBuf->y_stride = yuvMeta->yStride;
+            srcBuf->u_stride = yuvMeta->uStride;
+            srcBuf->v_stride = yuvMeta->vStride;
+        } else {
+            ALOGE("%s: preview format %d not support",__FUNCTION__, yuvMeta->format);
+            unmapDst(req, map_size);
+            return BAD_VALUE;
+        }
+
+        dstInfo = &(mipu->dst_info);
+        dstBuf = &(dstInfo->dstBuf);
+        memset(dstInfo, 0, sizeof(struct dest_data_info));
+
+        dstInfo->dst_mode = IPU_OUTPUT_TO_FRAMEBUFFER | IPU_OUTPUT_BLOCK_MODE;
+        dstInfo->fmt = req->dstFormat;
+        dstInfo->dtlb_base = mDevice->getTlbBase();
+
+        dstInfo->left = 0;
+        dstInfo->top = 0;
+        dstInfo->width = req->dstWidth;
+        dstInfo->height = req->dstHeight;
+
+        dstInfo->out_buf_v = dst_buf;
+        dstBuf->y_buf_v = (void*)(dst_buf);
+        dstBuf->y_stride = req->dstStride;
+        err = init(srcInfo->width, srcInfo->height, yuvMeta->format, 0, zoomRatio);
+        if (err < 0) {
+            ALOGE("ipu init failed ipuHalder = %p", mipu);
+            unmapDst(req, map_size);
+            return UNKNOWN_ERROR;
+        }
+        ipu_postBuffer(mipu);
+        unmapDst(req, map_size);
+        return NO_ERROR;
+    }
+
+    status_t CameraIpuBackend::scale(uint8_t* dest, int dest_width, int dest_height,
+                                     uint8_t* src, int src_width, int src_height, int src_format,
+                                     int stride_mul, int src_stride, int zoomRatio) {
+
+        struct source_data_info *srcInfo;
+        struct ipu_data_buffer* srcBuf;
+        struct dest_data_info* dstInfo;
+        struct ipu_data_buffer* dstBuf;
+
+        int err = 0;
+        int stride_shift = 0;
+        int must_do = 0;
+        int map_size = 0;
+
+        if (mOpened == false) {
+            ALOGE("%s: open ipu error or not open it", __FUNCTION__);
+            return BAD_VALUE;
+        }
+
+        if (src_format != HAL_PIXEL_FORMAT_YCbCr_422_I
+            && src_format != HAL_PIXEL_FORMAT_JZ_YUV_420_P
+            && src_format != HAL_PIXEL_FORMAT_YV12
+            && src_format != HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
+            ALOGE("%s: don't support format 0x%x for up scale",__FUNCTION__,
+                  src_format);
+            return BAD_VALUE;
+        }
+
+        if(stride_mul == 2){
+            stride_shift = 1;
+            must_do = 1;
+        }else{
+            stride_shift = 0;
+            if((zoomRatio == 200) && (dest_width == 1600)) {
+                must_do = 1;
+            } else {
+                must_do = 0;
+            }
+        }
+
+        srcInfo = &(mipu->src_info);
+        srcBuf = &(mipu->src_info.srcBuf);
+        memset(srcInfo, 0, sizeof(struct source_data_info));
+        srcInfo->fmt = src_format;
+        srcInfo->is_virt_buf = 1;
+        srcInfo->width = src_width;
+        srcInfo->height = src_height;
+        srcInfo->stlb_base = mDevice->getTlbBase();
+
+        if (src_format == HAL_PIXEL_FORMAT_YV12
+            || src_format == HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
+            srcBuf->y_buf_v = (void*)src;
+            srcBuf->u_buf_v = (void*)(src + src_width*src_height);
+            srcBuf->v_buf_v = (void*)((uint8_t*)srcBuf->u_buf_v + (src_width*src_height>>2));
+            srcBuf->y_stride = src_width;
+            srcBuf->u_stride = src_width>>1;
+            srcBuf->v_stride = src_width>>1;
+        } else if (src_format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
+            srcBuf->y_buf_v = (void*)src;
+            srcBuf->u_buf_v = (void*)src;
+            srcBuf->v_buf_v = (void*)src;
+            srcBuf->y_stride = src_stride<<1 << stride_shift;
+            srcBuf->u_stride = src_stride<<1 << stride_shift;
+            srcBuf->v_stride = src_stride<<1 << stride_shift;
+        } else if (src_format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
+            srcBuf->y_buf_v = (void*)src;
+            srcBuf->u_buf_v = (void*)(src + (src_width*src_height));
+            srcBuf->v_buf_v = srcBuf->u_buf_v;
+            srcBuf->y_stride = src_width;
+            srcBuf->u_stride = src_width>>1;
+            srcBuf->v_stride = src_width>>1;
+        }
+        //-----------------------------
+        map_size = dest_width * dest_height * 2;
+        dmmu_map_memory((uint8_t*)dest,map_size);
+
+        /* the source may come straight from the cpu, push out what the ipu reads */
+        if (src_format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
+            mDevice->flushCache((void*)src, (src_stride << 1 << stride_shift) * src_height);
+        } else {
+            mDevice->flushCache((void*)src, src_width * src_height * 12 / 8);
+        }
+
+        dstInfo = &(mipu->dst_info);
+        dstBuf = &(dstInfo->dstBuf);
+        memset(dstInfo, 0, sizeof(struct dest_data_info));
+        dstInfo->dst_mode = IPU_OUTPUT_TO_FRAMEBUFFER
+            | IPU_OUTPUT_BLOCK_MODE;
+        dstInfo->fmt = src_format;
+        dstInfo->dtlb_base = mDevice->getTlbBase();
+
+        dstInfo->left = 0;
+        dstInfo->top = 0;
+        dstInfo->width = dest_width;
+        dstInfo->height = dest_height;
+        dstInfo->out_buf_v = dest;
+        if (src_format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
+            dstBuf->y_buf_v = (void*)(dest);
+            dstBuf->u_buf_v = (void*)(dest);
+            dstBuf->v_buf_v = (void*)(dest);
+            dstBuf->y_stride = dest_width<<1 << stride_shift;
+            dstBuf->u_stride = dest_width<<1 << stride_shift;
+            dstBuf->v_stride = dest_width<<1 << stride_shift;
+        } else if (src_format == HAL_PIXEL_FORMAT_JZ_YUV_420_P
+                   || src_format == HAL_PIXEL_FORMAT_YV12) {
+            dstBuf->y_buf_v = (void*)(dest);
+            dstBuf->u_buf_v = (void*)(dest + dest_width*dest_height);
+            dstBuf->v_buf_v = (void*)((uint8_t*)dstBuf->u_buf_v + (dest_width*dest_height>>2));
+            dstBuf->y_stride = dest_width;
+            dstBuf->u_stride = dest_width>>1;
+            dstBuf->v_stride = dest_width>>1;
+        } else if (src_format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
+            dstBuf->y_buf_v = (void*)(dest);
+            dstBuf->u_buf_v = (void*)(dest + dest_width*dest_height);
+            dstBuf->v_buf_v = dstBuf->u_buf_v;
+            dstBuf->y_stride = dest_width;
+            dstBuf->u_stride = dest_width>>1;
+            dstBuf->v_stride = dest_width>>1;
+        }
+
+        err = init(src_width,src_height,src_format, must_do, zoomRatio);
+        if (err < 0) {
+            ALOGE("ipu init failed ipuHalder = %p", mipu);
+            dmmu_unmap_memory((uint8_t*)dest,map_size);
+            return BAD_VALUE;
+        }
+
+        ipu_postBuffer(mipu);
+        dmmu_unmap_memory((uint8_t*)dest,map_size);
+        return NO_ERROR;
+    }
+
+    //---------------------------- x2d ----------------------------
+
+    bool CameraX2dBackend::open(void) {
+
+        if (mFd >= 0)
+            return true;
+
+        mFd = ::open(X2D_NAME, O_RDWR);
+        if (mFd < 0) {
+            ALOGE("%s: open %s error, %s",
+                  __FUNCTION__, X2D_NAME, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    void CameraX2dBackend::close(void) {
+
+        if (mFd >= 0) {
+            ::close(mFd);
+            mFd = -1;
+        }
+    }
+
+    bool CameraX2dBackend::canConvert(int srcFormat, int dstFormat) {
+
+        if (srcFormat != HAL_PIXEL_FORMAT_JZ_YUV_420_B
+            && srcFormat != HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
+            return false;
+        }
+        return is_rgb_format(dstFormat);
+    }
+
+    status_t CameraX2dBackend::convert(const convert_request_t* req) {
+
+        CameraYUVMeta* yuvMeta = req->src;
+        uint8_t* dst_buf = req->dst;
+        struct jz_x2d_config x2d_cfg;
+        int map_size = 0;
+        int ret = NO_ERROR;
+
+        if (mFd < 0) {
+            ALOGE("%s: open %s error or not open it", __FUNCTION__, X2D_NAME);
+            return NO_INIT;
+        }
+
+        map_size = req->dstStride * req->dstHeight;
+        mapDst(req, map_size);
+        /* set dst configs */
+        x2d_cfg.dst_address = (int)dst_buf;
+        x2d_cfg.dst_width = req->dstWidth;
+        x2d_cfg.dst_height = req->dstHeight;
+        if (req->dstFormat == HAL_PIXEL_FORMAT_RGB_565)
+            x2d_cfg.dst_format = X2D_OUTFORMAT_RGB565;
+        else if (req->dstFormat == HAL_PIXEL_FORMAT_RGBA_8888
+                 || req->dstFormat == HAL_PIXEL_FORMAT_RGBX_8888
+                 || req->dstFormat == HAL_PIXEL_FORMAT_BGRA_8888)
+            x2d_cfg.dst_format = X2D_OUTFORMAT_XRGB888;
+        else if (req->dstFormat == HAL_PIXEL_FORMAT_RGB_888)
+            x2d_cfg.dst_format = X2D_OUTFORMAT_ARGB888;
+        x2d_cfg.dst_stride = req->dstStride;
+        x2d_cfg.dst_back_en = 0;
+        x2d_cfg.dst_glb_alpha_en = 1;
+        x2d_cfg.dst_preRGB_en = 0;
+        x2d_cfg.dst_mask_en = 1;
+        x2d_cfg.dst_alpha_val = 0x80;
+        x2d_cfg.dst_bcground = 0xff0ff0ff;
+
+        x2d_cfg.tlb_base = mDevice->getTlbBase();
+
+        /* layer num */
+        x2d_cfg.layer_num = 1;
+
+        /* src yuv address */
+        if (yuvMeta->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
+            x2d_cfg.lay[0].addr = yuvMeta->yAddr;
+            x2d_cfg.lay[0].u_addr = yuvMeta->yAddr + (yuvMeta->width*yuvMeta->height);
+
+            x2d_cfg.lay[0].v_addr = (int)(x2d_cfg.lay[0].u_addr);
+            x2d_cfg.lay[0].y_stride = yuvMeta->yStride/16;
+            x2d_cfg.lay[0].v_stride = yuvMeta->vStride/16;
+
+            /* src data format */
+            x2d_cfg.lay[0].format = X2D_INFORMAT_TILE420;
+        } else if (yuvMeta->format ==  HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
+            x2d_cfg.lay[0].addr = yuvMeta->yAddr;
+            x2d_cfg.lay[0].u_addr = yuvMeta->uAddr;
+            x2d_cfg.lay[0].v_addr = yuvMeta->vAddr;
+            x2d_cfg.lay[0].y_stride = yuvMeta->yStride;
+            x2d_cfg.lay[0].v_stride = yuvMeta->vStride;
+
+            /* src data format */
+            x2d_cfg.lay[0].format = X2D_INFORMAT_YUV420SP;
+        } else {
+            ALOGE("%s: preview format %d not support",__FUNCTION__, yuvMeta->format);
+            unmapDst(req, map_size);
+            return BAD_VALUE;
+        }
+
+        /* src rotation degree */
+        x2d_cfg.lay[0].transform = X2D_ROTATE_0;
+
+        /* src input geometry && output geometry */
+        x2d_cfg.lay[0].in_width =  yuvMeta->width;
+        x2d_cfg.lay[0].in_height = yuvMeta->height;
+        x2d_cfg.lay[0].out_width = req->dstWidth;
+        x2d_cfg.lay[0].out_height = req->dstHeight;
+        x2d_cfg.lay[0].out_w_offset = 0;
+        x2d_cfg.lay[0].out_h_offset = 0;
+        x2d_cfg.lay[0].mask_en = 0;
+        x2d_cfg.lay[0].msk_val = 0xffffffff;
+        x2d_cfg.lay[0].glb_alpha_en = 1;
+        x2d_cfg.lay[0].global_alpha_val = 0xff;
+        x2d_cfg.lay[0].preRGB_en = 1;
+
+        /* src scale ratio set */
+        float v_scale, h_scale;
+        switch (x2d_cfg.lay[0].transform) {
+        case X2D_H_MIRROR:
+        case X2D_V_MIRROR:
+        case X2D_ROTATE_0:
+        case X2D_ROTATE_180:
+            h_scale = (float)x2d_cfg.lay[0].in_width / (float)x2d_cfg.lay[0].out_width;
+            v_scale = (float)x2d_cfg.lay[0].in_height / (float)x2d_cfg.lay[0].out_height;
+            x2d_cfg.lay[0].h_scale_ratio = (int)(h_scale * X2D_SCALE_FACTOR);
+            x2d_cfg.lay[0].v_scale_ratio = (int)(v_scale * X2D_SCALE_FACTOR);
+            break;
+        case X2D_ROTATE_90:
+        case X2D_ROTATE_270:
+            h_scale = (float)x2d_cfg.lay[0].in_width / (float)x2d_cfg.lay[0].out_height;
+            v_scale = (float)x2d_cfg.lay[0].in_height / (float)x2d_cfg.lay[0].out_width;
+            x2d_cfg.lay[0].h_scale_ratio = (int)(h_scale * X2D_SCALE_FACTOR);
+            x2d_cfg.lay[0].v_scale_ratio = (int)(v_scale * X2D_SCALE_FACTOR);
+            break;
+        default:
+            unmapDst(req, map_size);
+            ALOGE("%s %s %d:undefined rotation degree!!!!", __FILE__, __FUNCTION__, __LINE__);
+            return BAD_VALUE;
+        }
+
+        /* ioctl set configs */
+        ret = ioctl(mFd, IOCTL_X2D_SET_CONFIG, &x2d_cfg);
+        if (ret < 0) {
+            unmapDst(req, map_size);
+            ALOGE("%s %s %d: IOCTL_X2D_SET_CONFIG failed", __FILE__, __FUNCTION__, __LINE__);
+            return UNKNOWN_ERROR;
+        }
+
+        /* ioctl start compose */
+        ret = ioctl(mFd, IOCTL_X2D_START_COMPOSE);
+        if (ret < 0) {
+            unmapDst(req, map_size);
+            ALOGE("%s %s %d: IOCTL_X2D_START_COMPOSE failed", __FILE__, __FUNCTION__, __LINE__);
+            return UNKNOWN_ERROR;
+        }
+        unmapDst(req, map_size);
+        return NO_ERROR;
+    }
+
+    //---------------------------- soft ---------------------------
+
+    bool CameraSoftBackend::canConvert(int srcFormat, int dstFormat) {
+
+        if (srcFormat == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
+            return dstFormat == HAL_PIXEL_FORMAT_RGB_565;
+        }
+
+        if (srcFormat != HAL_PIXEL_FORMAT_YCbCr_422_I) {
+            return false;
+        }
+
+        switch (dstFormat) {
+        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        case HAL_PIXEL_FORMAT_YV12:
+        case PIXEL_FORMAT_YV16:
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+            return true;
+        default:
+            return is_rgb_format(dstFormat);
+        }
+    }
+
+    status_t CameraSoftBackend::convert(const convert_request_t* req) {
+
+        CameraYUVMeta* frame = req->src;
+        int srcStride = frame->yStride;
+        uint8_t* src = (uint8_t*)(frame->yAddr);
+        int srcWidth = frame->width;
+        int srcHeight = frame->height;
+        uint8_t* dst = req->dst;
+        int dstStride = req->dstStride;
+
+        if ((ccc == NULL) || !canConvert(frame->format, req->dstFormat)) {
+            return BAD_VALUE;
+        }
+
+        /* the rgb kernels don't scale, they write the whole source out */
+        if (is_rgb_format(req->dstFormat)
+            && ((srcWidth > req->dstWidth) || (srcHeight > req->dstHeight))) {
+            return BAD_VALUE;
+        }
+
+        switch (req->dstFormat) {
+        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            ccc->yuyv_to_yvu420sp(dst, req->dstWidth, req->dstHeight,
+                                  src, srcStride, srcWidth, srcHeight);
+            break;
+
+        case HAL_PIXEL_FORMAT_YV12:
+            ccc->yuyv_to_yvu420p(dst, dstStride, req->dstHeight,
+                                 src, srcStride, srcWidth, srcHeight);
+            break;
+
+        case PIXEL_FORMAT_YV16:
+            ccc->yuyv_to_yvu422p(dst, dstStride, req->dstHeight,
+                                 src, srcStride, srcWidth, srcHeight);
+            break;
+
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+            {
+                int width = (srcWidth < req->dstWidth) ? srcWidth : req->dstWidth;
+                int height = (srcHeight < req->dstHeight) ? srcHeight : req->dstHeight;
+                for (int h = 0; h < height; h++) {
+                    memcpy(dst + h * dstStride, src + h * srcStride, width<<1);
+                }
+            }
+            break;
+
+        case HAL_PIXEL_FORMAT_RGB_888:
+            ccc->yuyv_to_rgb24(src, srcStride, dst, dstStride, srcWidth, srcHeight);
+            break;
+
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+            ccc->yuyv_to_rgb32(src, srcStride, dst, dstStride, srcWidth, srcHeight);
+            break;
+
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            ccc->yuyv_to_bgr32(src, srcStride, dst, dstStride, srcWidth, srcHeight);
+            break;
+
+        case HAL_PIXEL_FORMAT_RGB_565:
+            if (frame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
+                ccc->tile420_to_rgb565(frame, dst);
+            } else {
+                ccc->yuyv_to_rgb565(src, srcStride, dst, dstStride, srcWidth, srcHeight);
+            }
+            break;
+
+        default:
+            return BAD_VALUE;
+        }
+        return NO_ERROR;
+    }
+
+    //-------------------------- converter -------------------------
+
+    CameraConverter::CameraConverter(CameraDeviceCommon* device, CameraColorConvert* convert)
+        :mLock("CameraConverter::lock"),
+         mIpu(NULL) {
+
+        /* the order breaks ties, hardware first */
+        mIpu = new CameraIpuBackend(device);
+        mBackends[CameraConvertBackend::BACKEND_IPU] = mIpu;
+        mBackends[CameraConvertBackend::BACKEND_X2D] = new CameraX2dBackend(device);
+        mBackends[CameraConvertBackend::BACKEND_SOFT] = new CameraSoftBackend(device, convert);
+    }
+
+    CameraConverter::~CameraConverter() {
+
+        close();
+        for (int i = 0; i < CameraConvertBackend::BACKEND_COUNT; ++i) {
+            delete mBackends[i];
+            mBackends[i] = NULL;
+        }
+        mIpu = NULL;
+    }
+
+    void CameraConverter::open(void) {
+        AutoMutex lock(mLock);
+
+        for (int i = 0; i < CameraConvertBackend::BACKEND_COUNT; ++i) {
+            bool opened = mBackends[i]->open();
+            ALOGV("%s: %s backend %s",__FUNCTION__, mBackends[i]->getName(),
+                  opened ? "available" : "not available");
+        }
+        /* what was measured or failed before may not hold any more */
+        mChoices.clear();
+    }
+
+    void CameraConverter::close(void) {
+        AutoMutex lock(mLock);
+
+        for (int i = 0; i < CameraConvertBackend::BACKEND_COUNT; ++i) {
+            mBackends[i]->close();
+        }
+    }
+
+    void CameraConverter::update_device(CameraDeviceCommon* device) {
+        AutoMutex lock(mLock);
+
+        for (int i = 0; i < CameraConvertBackend::BACKEND_COUNT; ++i) {
+            mBackends[i]->update_device(device);
+        }
+        mChoices.clear();
+    }
+
+    bool CameraConverter::isUsable(convert_choice_t* choice, int index,
+                                   const convert_request_t* req, bool zoomOnly) {
+
+        CameraConvertBackend* backend = mBackends[index];
+
+        if (choice->failedMask & (1 << index)) {
+            return false;
+        }
+        if (!backend->isOpened() || !backend->canConvert(req->src->format, req->dstFormat)) {
+            return false;
+        }
+        return !zoomOnly || backend->canZoom();
+    }
+
+    int CameraConverter::pickBackend(convert_choice_t* choice, const convert_request_t* req) {
+
+        int best = -1;
+        int i = 0;
+
+        /* a zoomed frame only looks right from a backend that crops */
+        bool zoomOnly = false;
+        if (req->zoomRatio != 100) {
+            for (i = 0; i < CameraConvertBackend::BACKEND_COUNT; ++i) {
+                if (isUsable(choice, i, req, true)) {
+                    zoomOnly = true;
+                    break;
+                }
+            }
+        }
+
+        if ((choice->backend >= 0) && isUsable(choice, choice->backend, req, zoomOnly)) {
+            return choice->backend;
+        }
+
+        for (i = 0; i < CameraConvertBackend::BACKEND_COUNT; ++i) {
+            if (!isUsable(choice, i, req, zoomOnly)) {
+                continue;
+            }
+            /* not timed yet, this frame measures it */
+            if (choice->cost[i] == 0) {
+                return i;
+            }
+            if ((best < 0) || (choice->cost[i] < choice->cost[best])) {
+                best = i;
+            }
+        }
+
+        if (best >= 0) {
+            ALOGV("%s: 0x%x -> 0x%x %dx%d uses %s",__FUNCTION__, req->src->format,
+                  req->dstFormat, req->dstWidth, req->dstHeight, mBackends[best]->getName());
+        }
+        choice->backend = best;
+        return best;
+    }
+
+    status_t CameraConverter::convert(const convert_request_t* req) {
+        AutoMutex lock(mLock);
+
+        if ((req == NULL) || (req->src == NULL) || (req->dst == NULL)) {
+            return BAD_VALUE;
+        }
+
+        String8 key = String8::format("%x:%x:%dx%d:%dx%d:%d", req->src->format, req->dstFormat,
+                                      req->src->width, req->src->height,
+                                      req->dstWidth, req->dstHeight, req->zoomRatio != 100);
+        ssize_t index = mChoices.indexOfKey(key);
+        if (index < 0) {
+            convert_choice_t choice;
+            memset(&choice, 0, sizeof(convert_choice_t));
+            choice.backend = -1;
+            index = mChoices.add(key, choice);
+        }
+        convert_choice_t& choice = mChoices.editValueAt(index);
+
+        for (;;) {
+            int i = pickBackend(&choice, req);
+            if (i < 0) {
+                ALOGE("%s: no backend for 0x%x -> 0x%x",__FUNCTION__,
+                      req->src->format, req->dstFormat);
+                return BAD_VALUE;
+            }
+
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            status_t res = mBackends[i]->convert(req);
+            if (res == NO_ERROR) {
+                /* the first run carries the setup, time the second one */
+                if ((choice.cost[i] == 0) && (choice.runs[i]++ > 0)) {
+                    nsecs_t cost = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+                    choice.cost[i] = (cost > 0) ? cost : 1;
+                }
+                return NO_ERROR;
+            }
+
+            ALOGE("%s: %s backend fail, ret = %d, fall back",__FUNCTION__,
+                  mBackends[i]->getName(), res);
+            choice.failedMask |= (1 << i);
+            choice.backend = -1;
+        }
+    }
+
+    status_t CameraConverter::scale(uint8_t* dest, int dest_width, int dest_height,
+                                    uint8_t* src, int src_width, int src_height, int src_format,
+                                    int stride_mul, int src_stride, int zoomRatio) {
+        AutoMutex lock(mLock);
+
+        return mIpu->scale(dest, dest_width, dest_height, src, src_width, src_height,
+                           src_format, stride_mul, src_stride, zoomRatio);
+    }
+};
@@ -16,26 +16,25 @@
 
 namespace android {
 
-    Mutex CameraFaceDetect::sLock;
-    CameraFaceDetect* CameraFaceDetect::sInstance = NULL;
-
-    CameraFaceDetect* CameraFaceDetect::getInstance() {
-        ALOGV("%s", __FUNCTION__);
-        Mutex::Autolock _l(sLock);
-        CameraFaceDetect* instance = sInstance;
-        if (instance == NULL) {
-            instance = new CameraFaceDetect();
-            sInstance = instance;
-        }
-        return instance;
-    }
-
-    CameraFaceDetect::CameraFaceDetect() {
+    CameraFaceDetect::CameraFaceDetect()
+        :mGrayBuffer(NULL),
+         mPendingBuffer(NULL),
+         mFramePending(false),
+         mPendingTimestamp(0),
+         mLastPostTime(0),
+         mDetectInterval(1000000000LL / FACE_DETECT_DEFAULT_FPS),
+         mColumnTable(NULL),
+         mTableWidth(0),
+         mTableHeight(0),
+         mTableFormat(0),
+         mTrackCount(0),
+         mNextFaceId(0),
+         mTrackInterval(FACE_DETECT_TRACK_INTERVAL),
+         mFramesSinceFull(0),
+         mTrackLost(false),
+         mCropBuffer(NULL) {
         memset(&mparam, 0, sizeof(struct face_detect_param));
-        mLeftEyeX = 0;
-        mLeftEyeY = 0;
-        mRightEyeX = 0;
-        mRightEyeY = 0;
+        memset(mTracks, 0, sizeof(mTracks));
     }
 
     CameraFaceDetect::~CameraFaceDetect() {
@@ -53,6 +52,30 @@ namespace android {
         int initDataSize = read(filedesc, initData, MAX_FILE_SIZE);
         close(filedesc);
 
+        /* w x h is the preview size, detect on a downscaled luma
+           plane of the same aspect ratio */
+        char prop[PROPERTY_VALUE_MAX];
+        int fd_width = FACE_DETECT_DEFAULT_WIDTH;
+        if (property_get("ro.board.camera.fd_width", prop, NULL) > 0) {
+            fd_width = atoi(prop);
+        }
+        if ((fd_width > 0) && (fd_width < w)) {
+            h = (h * fd_width / w) & ~1;
+            w = fd_width & ~1;
+        }
+
+        int fd_fps = FACE_DETECT_DEFAULT_FPS;
+        if (property_get("ro.board.camera.fd_fps", prop, NULL) > 0) {
+            fd_fps = atoi(prop);
+        }
+        setDetectRate(fd_fps);
+
+        int fd_track = FACE_DETECT_TRACK_INTERVAL;
+        if (property_get("ro.board.camera.fd_track", prop, NULL) > 0) {
+            fd_track = atoi(prop);
+        }
+        setTrackInterval(fd_track);
+
         btk_HSDK sdk = NULL;
         btk_SDKCreateParam sdkParam = btk_SDK_defaultParam();
         sdkParam.fpMalloc = malloc;
@@ -64,6 +87,34 @@ namespace android {
         mparam.h = h;
         mparam.maxFaces = maxFaces;
 
+        AutoMutex lock(mFrameLock);
+        if (mGrayBuffer != NULL)
+            free(mGrayBuffer);
+        if (mPendingBuffer != NULL)
+            free(mPendingBuffer);
+        if (mColumnTable != NULL)
+            free(mColumnTable);
+        if (mCropBuffer != NULL)
+            free(mCropBuffer);
+        mGrayBuffer = (uint8_t*)malloc(w * h);
+        mPendingBuffer = (uint8_t*)malloc(w * h);
+        mCropBuffer = (uint8_t*)malloc(w * h);
+        mColumnTable = (int32_t*)malloc(w * sizeof(int32_t));
+        mTrackCount = 0;
+        mFramesSinceFull = 0;
+        mTrackLost = false;
+        mFramePending = false;
+        mLastPostTime = 0;
+        mTableWidth = 0;
+        mTableHeight = 0;
+        mTableFormat = 0;
+        if (mGrayBuffer == NULL || mPendingBuffer == NULL
+            || mCropBuffer == NULL || mColumnTable == NULL) {
+            ALOGE("%s: alloc %dx%d gray buffer fail",__FUNCTION__, w, h);
+            free(initData);
+            return NO_MEMORY;
+        }
+
         btk_Status status = btk_SDK_create(&sdkParam, &sdk);
         if (status != btk_STATUS_OK) {
             ALOGE("%s: line (%d), btk_SDK_create error, init fail",__FUNCTION__, __LINE__);
@@ -97,38 +148,202 @@ namespace android {
 
     void CameraFaceDetect::deInitialize(void) {
 
-        btk_FaceFinder_close(mparam.fd);
+        if (mparam.fd != NULL) {
+            btk_FaceFinder_close(mparam.fd);
+            mparam.fd = NULL;
+        }
+
+        if (mparam.dcr != NULL) {
+            btk_DCR_close(mparam.dcr);
+            mparam.dcr = NULL;
+        }
 
-        btk_DCR_close(mparam.dcr);
+        if (mparam.sdk != NULL) {
+            btk_SDK_close(mparam.sdk);
+            mparam.sdk = NULL;
+        }
 
-        btk_SDK_close(mparam.sdk);
+        AutoMutex lock(mFrameLock);
+        if (mGrayBuffer != NULL) {
+            free(mGrayBuffer);
+            mGrayBuffer = NULL;
+        }
+
+        if (mPendingBuffer != NULL) {
+            free(mPendingBuffer);
+            mPendingBuffer = NULL;
+        }
+
+        if (mCropBuffer != NULL) {
+            free(mCropBuffer);
+            mCropBuffer = NULL;
+        }
+        mTrackCount = 0;
+        mFramePending = false;
+
+        if (mColumnTable != NULL) {
+            free(mColumnTable);
+            mColumnTable = NULL;
+        }
+        mTableWidth = 0;
+        mTableHeight = 0;
+        mTableFormat = 0;
     }
 
-    int CameraFaceDetect::detect(uint16_t* imge) {
+    void CameraFaceDetect::updateColumnTable(CameraYUVMeta* yuvMeta) {
+
+        int dw = mparam.w;
+        uint32_t xstep = ((uint32_t)yuvMeta->width << 16) / dw;
+        uint32_t sx = xstep >> 1;
+
+        for (int x = 0; x < dw; ++x, sx += xstep) {
+            int col = sx >> 16;
+            switch (yuvMeta->format) {
+            case HAL_PIXEL_FORMAT_YCbCr_422_I:
+                mColumnTable[x] = col << 1;
+                break;
+            case HAL_PIXEL_FORMAT_JZ_YUV_420_B:
+                /* 16x16 luma tiles, 256 bytes each, laid out row by row */
+                mColumnTable[x] = ((col >> 4) << 8) + (col & 15);
+                break;
+            default:
+                mColumnTable[x] = col;
+                break;
+            }
+        }
 
-        btk_HDCR hdcr = mparam.dcr;
-        btk_HFaceFinder hfd = mparam.fd;
-        u32 width = mparam.w;
-        u32 height = mparam.h;
-
-        uint8_t* bwbuffer = (uint8_t*)calloc(1, width*height);
-        uint8_t* dst = (uint8_t*)bwbuffer;
-
-        uint16_t const* src = imge;
-        int wpr = width;
-        for (u32 y=0; y < height; y++) {
-            for (u32 x=0; x<width; x++) {
-                uint16_t rgb = src[x];
-                int r = rgb >> 11;
-                int g2 = (rgb >> 5) & 0x3F;
-                int b = rgb & 0x1F;
-                int L = (r<<1) + (g2<<1) + (g2>>1) + b;
-                *dst++ = L;
+        mTableWidth = yuvMeta->width;
+        mTableHeight = yuvMeta->height;
+        mTableFormat = yuvMeta->format;
+    }
+
+    status_t CameraFaceDetect::downscaleLuma(CameraYUVMeta* yuvMeta) {
+
+        switch (yuvMeta->format) {
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+        case HAL_PIXEL_FORMAT_JZ_YUV_420_B:
+        case HAL_PIXEL_FORMAT_JZ_YUV_420_P:
+        case HAL_PIXEL_FORMAT_YV12:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+            break;
+        default:
+            ALOGE("%s: format 0x%x is not support",__FUNCTION__, yuvMeta->format);
+            return BAD_VALUE;
+        }
+
+        if (yuvMeta->width != mTableWidth
+            || yuvMeta->height != mTableHeight
+            || yuvMeta->format != mTableFormat) {
+            updateColumnTable(yuvMeta);
+        }
+
+        const uint8_t* src = (const uint8_t*)(yuvMeta->yAddr);
+        int srcStride = yuvMeta->yStride;
+        if (srcStride <= 0) {
+            srcStride = (yuvMeta->format == HAL_PIXEL_FORMAT_YCbCr_422_I)
+                ? (yuvMeta->width << 1) : yuvMeta->width;
+        }
+
+        int dw = mparam.w;
+        int dh = mparam.h;
+        uint32_t ystep = ((uint32_t)yuvMeta->height << 16) / dh;
+        uint32_t sy = ystep >> 1;
+        uint8_t* dst = mPendingBuffer;
+        const int32_t* cols = mColumnTable;
+
+        for (int y = 0; y < dh; ++y, sy += ystep) {
+            int row = sy >> 16;
+            const uint8_t* line = NULL;
+            if (yuvMeta->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
+                line = src + (((row >> 4) * yuvMeta->width) << 4) + ((row & 15) << 4);
+            } else {
+                line = src + row * srcStride;
+            }
+            for (int x = 0; x < dw; ++x) {
+                *dst++ = line[cols[x]];
             }
-            src += wpr;
         }
+        return NO_ERROR;
+    }
+
+    void CameraFaceDetect::setDetectRate(int fps) {
+        AutoMutex lock(mFrameLock);
+        mDetectInterval = (fps > 0) ? (1000000000LL / fps) : 0;
+    }
+
+    /* preview thread: keep only the newest frame, at the detect rate */
+    status_t CameraFaceDetect::postFrame(CameraYUVMeta* yuvMeta, nsecs_t timestamp) {
 
-        btk_DCR_assignGrayByteImage(hdcr, bwbuffer, width, height);
+        AutoMutex lock(mFrameLock);
+
+        if (yuvMeta == NULL || yuvMeta->yAddr == 0 || mPendingBuffer == NULL) {
+            return BAD_VALUE;
+        }
+
+        if ((mLastPostTime != 0) && (timestamp - mLastPostTime < mDetectInterval)) {
+            return WOULD_BLOCK;
+        }
+
+        status_t ret = downscaleLuma(yuvMeta);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+
+        if (mFramePending) {
+            ALOGV("%s: drop stale frame %lld",__FUNCTION__, mPendingTimestamp);
+        }
+        mFramePending = true;
+        mPendingTimestamp = timestamp;
+        mLastPostTime = timestamp;
+        return NO_ERROR;
+    }
+
+    /* detect thread: returns -1 when there is no new frame */
+    int CameraFaceDetect::detectPendingFrame(nsecs_t* timestamp) {
+
+        uint8_t* gray = NULL;
+        {
+            AutoMutex lock(mFrameLock);
+            if (!mFramePending || mGrayBuffer == NULL) {
+                return -1;
+            }
+            gray = mPendingBuffer;
+            mPendingBuffer = mGrayBuffer;
+            mGrayBuffer = gray;
+            mFramePending = false;
+            if (timestamp != NULL)
+                *timestamp = mPendingTimestamp;
+        }
+
+        return detect(gray);
+    }
+
+    void CameraFaceDetect::setTrackInterval(int interval) {
+        mTrackInterval = (interval > 0) ? interval : 1;
+        mFramesSinceFull = 0;
+    }
+
+    int CameraFaceDetect::detect(uint8_t* gray) {
+
+        if ((mTrackInterval <= 1) || (mTrackCount == 0) || mTrackLost
+            || (++mFramesSinceFull >= mTrackInterval)) {
+            mFramesSinceFull = 0;
+            mTrackLost = false;
+            return fullDetect(gray);
+        }
+        return trackFaces(gray);
+    }
+
+    int CameraFaceDetect::fullDetect(uint8_t* gray) {
+
+        btk_HDCR hdcr = mparam.dcr;
+        btk_HFaceFinder hfd = mparam.fd;
+        FaceData faces[FACE_DETECT_MAX_TRACKS];
+        int count = 0;
+
+        btk_FaceFinder_setRange(hfd, FACE_DETECT_MIN_EYE_DIST, mparam.w/2);
+        btk_DCR_assignGrayByteImage(hdcr, gray, mparam.w, mparam.h);
 
         int numberOfFaces = 0;
         if (btk_FaceFinder_putDCR(hfd, hdcr) == btk_STATUS_OK) {
@@ -136,60 +351,157 @@ namespace android {
         } else {
             ALOGE("ERROR: Return 0 faces because error exists in btk_FaceFinder_putDCR.\n");
         }
-        
-        if (bwbuffer != NULL) {
-            free(bwbuffer);
-            bwbuffer = NULL;
-        }
 
-        return numberOfFaces;
-    }
+        for (int i = 0; i < numberOfFaces && count < FACE_DETECT_MAX_TRACKS; ++i) {
+            btk_FaceFinder_getDCR(hfd, hdcr);
+            getFaceData(hdcr, &faces[count++]);
+        }
 
-    float CameraFaceDetect::get_confidence(void) {
-        return mConfidence;
+        updateTracks(faces, count);
+        return mTrackCount;
     }
 
-    void CameraFaceDetect::get_face(Rect* r, int index) {
+    /* search a window around every known face, at nearby scales only */
+    int CameraFaceDetect::trackFaces(uint8_t* gray) {
 
         btk_HDCR hdcr = mparam.dcr;
         btk_HFaceFinder hfd = mparam.fd;
+        int kept = 0;
+
+        for (int i = 0; i < mTrackCount; ++i) {
+            FaceData* fdata = &mTracks[i].data;
+            float radius = fdata->eyedist * 2.5f;
+
+            int x0 = (int)(fdata->midpointx - radius);
+            int y0 = (int)(fdata->midpointy - radius);
+            int x1 = (int)(fdata->midpointx + radius);
+            int y1 = (int)(fdata->midpointy + radius);
+            if (x0 < 0) x0 = 0;
+            if (y0 < 0) y0 = 0;
+            if (x1 > mparam.w) x1 = mparam.w;
+            if (y1 > mparam.h) y1 = mparam.h;
+
+            int cw = (x1 - x0) & ~1;
+            int ch = (y1 - y0) & ~1;
+            if (cw < FACE_DETECT_MIN_EYE_DIST * 2 || ch < FACE_DETECT_MIN_EYE_DIST * 2) {
+                mTrackLost = true;
+                continue;
+            }
 
-        FaceData faceData;
-        btk_FaceFinder_getDCR(hfd, hdcr);
-        getFaceData(hdcr, &faceData);
+            uint8_t* dst = mCropBuffer;
+            uint8_t* src = gray + y0 * mparam.w + x0;
+            for (int y = 0; y < ch; ++y) {
+                memcpy(dst, src, cw);
+                dst += cw;
+                src += mparam.w;
+            }
 
-        float rx = faceData.eyedist * 2.0;
-        float ry = rx;
-        float aspect = (float)((float)(mparam.w) / (float)(mparam.h));
-        if (aspect != -1.0) {
-            if (aspect > 1) {
-                rx = ry * aspect;
-            } else {
-                ry = rx / aspect;
+            u32 minDist = (u32)(fdata->eyedist * 0.75f);
+            u32 maxDist = (u32)(fdata->eyedist * 1.33f) + 1;
+            if (minDist < FACE_DETECT_MIN_EYE_DIST)
+                minDist = FACE_DETECT_MIN_EYE_DIST;
+            if (maxDist <= minDist)
+                maxDist = minDist + 1;
+            btk_FaceFinder_setRange(hfd, minDist, maxDist);
+            btk_DCR_assignGrayByteImage(hdcr, mCropBuffer, cw, ch);
+
+            if ((btk_FaceFinder_putDCR(hfd, hdcr) != btk_STATUS_OK)
+                || (btk_FaceFinder_faces(hfd) <= 0)) {
+                mTrackLost = true;
+                continue;
             }
+
+            FaceData found;
+            btk_FaceFinder_getDCR(hfd, hdcr);
+            getFaceData(hdcr, &found);
+            found.midpointx += x0;
+            found.midpointy += y0;
+            found.leftEyeX += (float)(x0 << 16);
+            found.leftEyeY += (float)(y0 << 16);
+            found.rightEyeX += (float)(x0 << 16);
+            found.rightEyeY += (float)(y0 << 16);
+
+            mTracks[kept].id = mTracks[i].id;
+            mTracks[kept].data = found;
+            kept++;
         }
 
-        r->left = (faceData.midpointx - rx) < 0 ? 0 : (faceData.midpointx - rx);
-        r->top = (faceData.midpointy - ry) < 0 ? 0 : (faceData.midpointy - ry);
-        r->right = (faceData.midpointx + rx) > mparam.w ? mparam.w : (faceData.midpointx + rx);
-        r->bottom = (faceData.midpointy + ry) > mparam.h ? mparam.h : (faceData.midpointy + ry); 
+        mTrackCount = kept;
+        return mTrackCount;
+    }
+
+    /* give each face the id of the nearest face of the last detection */
+    void CameraFaceDetect::updateTracks(FaceData* faces, int count) {
+
+        FaceTrack tracks[FACE_DETECT_MAX_TRACKS];
+        bool used[FACE_DETECT_MAX_TRACKS];
+
+        memset(used, 0, sizeof(used));
+        for (int i = 0; i < count; ++i) {
+            int best = -1;
+            float bestDist = 0;
+            for (int j = 0; j < mTrackCount; ++j) {
+                if (used[j])
+                    continue;
+                float dx = faces[i].midpointx - mTracks[j].data.midpointx;
+                float dy = faces[i].midpointy - mTracks[j].data.midpointy;
+                float dist = dx * dx + dy * dy;
+                float limit = mTracks[j].data.eyedist;
+                if ((dist < limit * limit) && (best < 0 || dist < bestDist)) {
+                    best = j;
+                    bestDist = dist;
+                }
+            }
 
-        if (aspect != -1.0) {
-            if (r->width() / r->height() > aspect) {
-                float w = r->height() * aspect;
-                r->left = (r->left + r->right - w) * 0.5f;
-                r->right = r->left + w;
+            if (best >= 0) {
+                used[best] = true;
+                tracks[i].id = mTracks[best].id;
             } else {
-                float h = r->width() / aspect;
-                r->top = (r->top + r->bottom - h) * 0.5f;
-                r->bottom = r->top + h;
+                tracks[i].id = mNextFaceId++;
             }
+            tracks[i].data = faces[i];
         }
 
-        r->left /= mparam.w;
-        r->right /= mparam.w;
-        r->top /= mparam.h;
-        r->bottom /= mparam.h;
+        memcpy(mTracks, tracks, count * sizeof(FaceTrack));
+        mTrackCount = count;
+    }
+
+    /* camera_face_t wants coordinates in -1000..1000 over the frame */
+    static inline int32_t toFaceCoord(float v, int size) {
+        int32_t c = (int32_t)(v * 2000.0f / size) - 1000;
+        return (c < -1000) ? -1000 : ((c > 1000) ? 1000 : c);
+    }
+
+    int CameraFaceDetect::getFaces(camera_face_t* faces, int capacity) {
+
+        int count = (mTrackCount < capacity) ? mTrackCount : capacity;
+        int w = mparam.w;
+        int h = mparam.h;
+
+        for (int i = 0; i < count; ++i) {
+            const FaceData* fdata = &mTracks[i].data;
+            camera_face_t* face = &faces[i];
+
+            /* same box as the framework's FaceDetector: 2 eye distances
+               each way from the eye midpoint */
+            float r = fdata->eyedist * 2.0f;
+            face->rect[0] = toFaceCoord(fdata->midpointx - r, w);
+            face->rect[1] = toFaceCoord(fdata->midpointy - r, h);
+            face->rect[2] = toFaceCoord(fdata->midpointx + r, w);
+            face->rect[3] = toFaceCoord(fdata->midpointy + r, h);
+
+            int score = (int)(fdata->confidence * 100.0f);
+            face->score = (score < 1) ? 1 : ((score > 100) ? 100 : score);
+            face->id = mTracks[i].id;
+
+            face->left_eye[0] = toFaceCoord(fdata->leftEyeX / (1 << 16), w);
+            face->left_eye[1] = toFaceCoord(fdata->leftEyeY / (1 << 16), h);
+            face->right_eye[0] = toFaceCoord(fdata->rightEyeX / (1 << 16), w);
+            face->right_eye[1] = toFaceCoord(fdata->rightEyeY / (1 << 16), h);
+            face->mouth[0] = -2000;
+            face->mouth[1] = -2000;
+        }
+        return count;
     }
 
     void CameraFaceDetect::getFaceData(btk_HDCR hdcr, FaceData* fdata) {
@@ -202,10 +514,9 @@ namespace android {
         fdata->midpointx = (float)(rightEye.x + leftEye.x) / (1 << 17);
         fdata->midpointy = (float)(rightEye.y + leftEye.y) / (1 << 17);
         fdata->confidence = (float)btk_DCR_confidence(hdcr) / (1 << 24);
-        mConfidence = fdata->confidence;
-        mRightEyeX = rightEye.x;
-        mRightEyeY = rightEye.y;
-        mLeftEyeX = leftEye.x;
-        mLeftEyeY = leftEye.y;
+        fdata->rightEyeX = rightEye.x;
+        fdata->rightEyeY = rightEye.y;
+        fdata->leftEyeX = leftEye.x;
+        fdata->leftEyeY = leftEye.y;
     }
 };
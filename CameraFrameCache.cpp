@@ -0,0 +1,321 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LOG_TAG "CameraFrameCache"
+//#define LOG_NDEBUG 0
+
+#include "CameraFrameCache.h"
+
+namespace android {
+
+    CameraFrameCache::CameraFrameCache(CameraColorConvert* convert)
+        :mLock("CameraFrameCache::lock"),
+         ccc(convert),
+         mFrame(NULL),
+         mSerial(1) {
+    }
+
+    CameraFrameCache::~CameraFrameCache() {
+        clear();
+    }
+
+    void CameraFrameCache::setFrame(CameraYUVMeta* frame) {
+
+        RWLock::AutoWLock frame_lock(mFrameLock);
+        AutoMutex lock(mLock);
+        mFrame = frame;
+        /* 0 is what a new entry starts with */
+        if (++mSerial == 0)
+            mSerial = 1;
+    }
+
+    void CameraFrameCache::clear(void) {
+
+        RWLock::AutoWLock frame_lock(mFrameLock);
+        AutoMutex lock(mLock);
+        for (size_t i = 0; i < mEntries.size(); ++i) {
+            cache_entry_t* entry = mEntries[i];
+            if (entry->data != NULL) {
+                free(entry->data);
+            }
+            delete entry;
+        }
+        mEntries.clear();
+        mFrame = NULL;
+    }
+
+    /* yv12 as gralloc lays it out, both strides 16 aligned */
+    static inline int yv12_y_stride(int width) {
+        return (width + 15) & (-16);
+    }
+
+    static inline int yv12_c_stride(int width) {
+        return ((yv12_y_stride(width) >> 1) + 15) & (-16);
+    }
+
+    /* the planes of a yuv420p frame into another set of strides, swap turns u/v into v/u */
+    static void copy_planes(uint8_t* dst, int dstYStride, int dstCStride,
+                            const uint8_t* src, int srcYStride, int srcCStride,
+                            int width, int height, bool swap) {
+
+        uint8_t* dst_first = dst + dstYStride * height;
+        uint8_t* dst_second = dst_first + dstCStride * (height >> 1);
+        const uint8_t* src_first = src + srcYStride * height;
+        const uint8_t* src_second = src_first + srcCStride * (height >> 1);
+
+        if (swap) {
+            uint8_t* tmp = dst_first;
+            dst_first = dst_second;
+            dst_second = tmp;
+        }
+        for (int h = 0; h < height; ++h) {
+            memcpy(dst + h * dstYStride, src + h * srcYStride, width);
+        }
+        for (int h = 0; h < (height >> 1); ++h) {
+            memcpy(dst_first + h * dstCStride, src_first + h * srcCStride, width >> 1);
+            memcpy(dst_second + h * dstCStride, src_second + h * srcCStride, width >> 1);
+        }
+    }
+
+    int CameraFrameCache::frameSize(int format, int width, int height) {
+
+        switch (format) {
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+            return width * height * 2;
+        case HAL_PIXEL_FORMAT_YV12:
+            return (yv12_y_stride(width) + yv12_c_stride(width)) * height;
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        case HAL_PIXEL_FORMAT_JZ_YUV_420_P:
+        case HAL_PIXEL_FORMAT_JZ_YUV_420_B:
+            return width * height * 3 / 2;
+        }
+        return 0;
+    }
+
+    /* called with mLock held */
+    CameraFrameCache::cache_entry_t* CameraFrameCache::findEntry(int format, int width, int height) {
+
+        for (size_t i = 0; i < mEntries.size(); ++i) {
+            cache_entry_t* entry = mEntries[i];
+            if ((entry->format == format) && (entry->width == width)
+                && (entry->height == height)) {
+                return entry;
+            }
+        }
+
+        cache_entry_t* entry = new cache_entry_t;
+        entry->format = format;
+        entry->width = width;
+        entry->height = height;
+        entry->size = frameSize(format, width, height);
+        entry->data = NULL;
+        entry->serial = 0;
+        mEntries.push_back(entry);
+        ALOGV("%s: new 0x%x %dx%d, %d cached",__FUNCTION__, format, width, height,
+              mEntries.size());
+        return entry;
+    }
+
+    const uint8_t* CameraFrameCache::get(int format, int width, int height) {
+
+        mFrameLock.readLock();
+        const uint8_t* img = lookup(format, width, height);
+        if (img == NULL) {
+            mFrameLock.unlock();
+        }
+        return img;
+    }
+
+    void CameraFrameCache::put(void) {
+        mFrameLock.unlock();
+    }
+
+    /* called with mFrameLock read held */
+    const uint8_t* CameraFrameCache::lookup(int format, int width, int height) {
+
+        CameraYUVMeta* frame = NULL;
+        cache_entry_t* entry = NULL;
+        uint32_t serial = 0;
+
+        if (frameSize(format, width, height) <= 0) {
+            return NULL;
+        }
+
+        {
+            AutoMutex lock(mLock);
+            frame = mFrame;
+            if ((frame == NULL) || (frame->yAddr == 0) || (ccc == NULL)) {
+                return NULL;
+            }
+
+            /* the frame itself is already what was asked for */
+            int natural = (frame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)
+                ? (frame->width << 1) : frame->width;
+            if ((format == frame->format) && (width == frame->width)
+                && (height == frame->height)
+                && ((frame->yStride <= 0) || (frame->yStride == natural))) {
+                return (const uint8_t*)(frame->yAddr);
+            }
+
+            serial = mSerial;
+            entry = findEntry(format, width, height);
+        }
+
+        AutoMutex entry_lock(entry->lock);
+        if (entry->serial != serial) {
+            if (derive(entry, frame) != NO_ERROR) {
+                return NULL;
+            }
+            entry->serial = serial;
+        }
+        return entry->data;
+    }
+
+    status_t CameraFrameCache::copyTo(int format, int width, int height, uint8_t* dst) {
+
+        const uint8_t* img = get(format, width, height);
+
+        if (img == NULL) {
+            return BAD_VALUE;
+        }
+        memcpy(dst, img, frameSize(format, width, height));
+        put();
+        return NO_ERROR;
+    }
+
+    /*
+     * called with entry->lock held, formats chain through lookup(). Another
+     * size than the frame is scaled once into the yuyv or yuv420p image of
+     * that size, and the other formats are converted from there.
+     */
+    status_t CameraFrameCache::derive(cache_entry_t* entry, CameraYUVMeta* frame) {
+
+        uint8_t* src = (uint8_t*)(frame->yAddr);
+        bool yuyv = (frame->format == HAL_PIXEL_FORMAT_YCbCr_422_I);
+        bool tile = (frame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B);
+        int srcStride = frame->yStride;
+        int width = entry->width;
+        int height = entry->height;
+        bool same_size = (frame->width == width) && (frame->height == height);
+        const uint8_t* yuv420p = NULL;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        if (srcStride <= 0) {
+            srcStride = yuyv ? (frame->width << 1) : frame->width;
+        }
+
+        if (!same_size && yuyv && (entry->format != HAL_PIXEL_FORMAT_YCbCr_422_I)) {
+            src = (uint8_t*)lookup(HAL_PIXEL_FORMAT_YCbCr_422_I, width, height);
+            if (src == NULL) {
+                goto unsupported;
+            }
+            srcStride = width << 1;
+        }
+
+        if (entry->data == NULL) {
+            /* zeroed, the stride padding of yv12 is never written */
+            entry->data = (uint8_t*)calloc(1, entry->size);
+            if (entry->data == NULL) {
+                ALOGE("%s: no memory for %d bytes",__FUNCTION__, entry->size);
+                return NO_MEMORY;
+            }
+        }
+
+        switch (entry->format) {
+        case HAL_PIXEL_FORMAT_RGB_565:
+            if (yuyv) {
+                ccc->yuyv_to_rgb565(src, srcStride, entry->data, width<<1, width, height);
+            } else if (tile && same_size) {
+                ccc->tile420_to_rgb565(frame, entry->data);
+            } else if (tile && ((yuv420p = lookup(HAL_PIXEL_FORMAT_JZ_YUV_420_P,
+                                                  width, height)) != NULL)) {
+                ccc->yuv420p_to_rgb565((uint8_t*)yuv420p, entry->data, width, height);
+            } else {
+                goto unsupported;
+            }
+            break;
+
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            if (yuyv) {
+                ccc->yuyv_to_yvu420sp(entry->data, width, height,
+                                      src, srcStride, width, height);
+            } else if (tile && ((yuv420p = lookup(HAL_PIXEL_FORMAT_JZ_YUV_420_P,
+                                                  width, height)) != NULL)) {
+                ccc->yuv420p_to_yuv420sp((uint8_t*)yuv420p, entry->data, width, height);
+            } else {
+                goto unsupported;
+            }
+            break;
+
+        case HAL_PIXEL_FORMAT_YV12:
+            if (yuyv) {
+                ccc->yuyv_to_yvu420p(entry->data, yv12_y_stride(width), height,
+                                     src, srcStride, width, height);
+            } else if (tile && ((yuv420p = lookup(HAL_PIXEL_FORMAT_JZ_YUV_420_P,
+                                                  width, height)) != NULL)) {
+                copy_planes(entry->data, yv12_y_stride(width), yv12_c_stride(width),
+                            yuv420p, width, width >> 1, width, height, true);
+            } else {
+                goto unsupported;
+            }
+            break;
+
+        case HAL_PIXEL_FORMAT_JZ_YUV_420_P:
+            /* packed planes, yuyv_to_yuv420p only writes those when the chroma rows are 16 aligned */
+            if (yuyv && (((width >> 1) & 15) == 0)) {
+                ccc->yuyv_to_yuv420p(entry->data, width, height,
+                                     src, srcStride, width, height);
+            } else if (yuyv && ((yuv420p = lookup(HAL_PIXEL_FORMAT_YV12, width, height)) != NULL)) {
+                copy_planes(entry->data, width, width >> 1, yuv420p,
+                            yv12_y_stride(width), yv12_c_stride(width), width, height, true);
+            } else if (tile && same_size) {
+                ccc->tile420_to_yuv420p(frame, entry->data);
+            } else if (tile && ((yuv420p = lookup(HAL_PIXEL_FORMAT_JZ_YUV_420_P,
+                                                  frame->width, frame->height)) != NULL)) {
+                ccc->yuv420p_scale(entry->data, width, height, (uint8_t*)yuv420p,
+                                   frame->width, frame->height);
+            } else {
+                goto unsupported;
+            }
+            break;
+
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+            if (!yuyv) {
+                goto unsupported;
+            }
+            if (same_size) {
+                for (int h = 0; h < height; ++h) {
+                    memcpy(entry->data + h * (width<<1), src + h * srcStride, width<<1);
+                }
+            } else {
+                ccc->yuyv_scale(entry->data, width<<1, width, height,
+                                src, srcStride, frame->width, frame->height);
+            }
+            break;
+
+        default:
+            goto unsupported;
+        }
+
+        ALOGV("%s: 0x%x %dx%d in %lld us",__FUNCTION__, entry->format, entry->width,
+              entry->height, (systemTime(SYSTEM_TIME_MONOTONIC) - start) / 1000LL);
+        return NO_ERROR;
+
+    unsupported:
+        ALOGE("%s: can't make 0x%x %dx%d from 0x%x %dx%d",__FUNCTION__,
+              entry->format, entry->width, entry->height,
+              frame->format, frame->width, frame->height);
+        return BAD_VALUE;
+    }
+};
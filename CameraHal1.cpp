@@ -16,6 +16,7 @@
 
 #include "CameraHalSelector.h"
 #include "CameraFaceDetect.h"
+#include "CameraJpegTransform.h"
 
 #ifndef PIXEL_FORMAT_YV16
 #define PIXEL_FORMAT_YV16  0x36315659 /* YCrCb 4:2:2 Planar */
@@ -24,11 +25,41 @@
 #define WAIT_TIME (1000000000LL * 60)
 #ifdef ENCODE_BY_HARDWARE
 #define START_CAMERA_COLOR_CONVET_THREAD
+/* what the recording conversion makes for the encoder */
+#define RECORDING_FORMAT HAL_PIXEL_FORMAT_JZ_YUV_420_B
+#else
+#define RECORDING_FORMAT HAL_PIXEL_FORMAT_JZ_YUV_420_P
 #endif
 //#define CONVERTER_PMON
 
 namespace android{
 
+    /*
+     * A converted frame in slot of mRecordingHeap, seen the way a capture
+     * buffer is. The heap is not contiguous, so there is no physical
+     * address and the encoder reaches it through the dmmu like the
+     * hardware jpeg encoder does.
+     */
+    static void recording_heap_meta(CameraYUVMeta* meta, uint8_t* dest, int slot,
+                                    int width, int height) {
+
+        int y_size = width * height;
+        bool tile = (RECORDING_FORMAT == HAL_PIXEL_FORMAT_JZ_YUV_420_B);
+
+        memset(meta, 0, sizeof(CameraYUVMeta));
+        meta->index = slot;
+        meta->width = width;
+        meta->height = height;
+        meta->yAddr = (int32_t)dest;
+        meta->uAddr = meta->yAddr + y_size;
+        meta->vAddr = tile ? meta->uAddr : (meta->uAddr + (y_size >> 2));
+        meta->yStride = width;
+        meta->uStride = tile ? width : (width >> 1);
+        meta->vStride = meta->uStride;
+        meta->count = RECORDING_BUFFER_NUM;
+        meta->format = RECORDING_FORMAT;
+    }
+
     CameraHal1::CameraHal1(int id, CameraDeviceCommon* device)
         :mlock("CameraHal1::lock"),
          mcamera_id(id),
@@ -54,10 +85,19 @@ namespace android{
          mPreviewFrameSize(0),
          mPreviewHeap(NULL),
          mPreviewIndex(0),
+         mPreviewSlotLock("CameraHal1::PreviewSlotLock"),
+         mPreviewCallbackBuffers(false),
+         mPreviewSlotBusy(0),
+         mPreviewFrameDrops(0),
          mPreviewEnabled(false),
          mRecordingFrameSize(0),
          mRecordingHeap(NULL),
          mRecordingindex(0),
+         mUseMetaDataBufferMode(false),
+         mRecordingMetaHeap(NULL),
+         mRecordingSlotLock("CameraHal1::RecordingSlotLock"),
+         mRecordingSlotBusy(0),
+         mRecordingFrameDrops(0),
          mVideoRecEnabled(false),
          mtotaltime(0),
          mtotalnum(0),
@@ -69,22 +109,38 @@ namespace android{
          mPreviewWinWidth(0),
          mPreviewWinHeight(0),
          mCurFrameTimestamp(0),
+         mPreviewStartTime(0),
          mCurrentFrame(NULL),
+         mFrameRepacked(false),
+         mCurrentFrameHeld(false),
          mFaceCount(0),
          mzoomVal(0),
          mzoomRadio(100),
          isSoftFaceDetectStart(false),
-         mipu(NULL),
-         ipu_open_status(false),
-         init_ipu_first(false),
-         x2d_fd(-1),
+         mFaceMetadataHeap(NULL),
+         mFaceDetect(NULL),
+         mConverter(NULL),
+         mFrameCache(NULL),
+         mWorkErrors(0),
+         mDropFrames(0),
+         mWorkTimeout(WAIT_TIME),
+         mWorkState(WorkThread::THREAD_IDLE),
          mreceived_cmd(false),
          mSensorListener(NULL),
+         mNextPreviewBuffer(NULL),
          mWorkerThread(NULL),
-         mFocusThread(NULL) {
+         mFocusThread(NULL),
+         mJpegEncodePool(NULL) {
 
+        memset(mPreviewSlotTime, 0, sizeof(mPreviewSlotTime));
+        for (int i = 0; i < RECORDING_BUFFER_NUM; ++i) {
+            mRecordingSlotFrame[i] = -1;
+        }
         if (NULL != mDevice) {
             ccc = new CameraColorConvert();
+            mConverter = new CameraConverter(mDevice, ccc);
+            mFrameCache = new CameraFrameCache(ccc);
+            mFaceDetect = new CameraFaceDetect();
 
             mCameraModuleDev = new camera_device_t();
             if (mCameraModuleDev != NULL) {
@@ -110,6 +166,16 @@ namespace android{
 
     CameraHal1::~CameraHal1() {
 
+        if (mConverter != NULL) {
+            delete mConverter;
+            mConverter = NULL;
+        }
+
+        if (mFrameCache != NULL) {
+            delete mFrameCache;
+            mFrameCache = NULL;
+        }
+
         if (ccc != NULL) {
             delete ccc;
             ccc = NULL;
@@ -129,12 +195,16 @@ namespace android{
         mFocusThread.clear();
         mFocusThread = NULL;
         mModuleOpened = false;
-        delete CameraFaceDetect::getInstance();
+        if (mFaceDetect != NULL) {
+            delete mFaceDetect;
+            mFaceDetect = NULL;
+        }
     }
 
     void CameraHal1::update_device(CameraDeviceCommon* device) {
         mDevice = device;
         mJzParameters->update_device(mDevice);
+        mConverter->update_device(mDevice);
     }
 
     int CameraHal1::module_open(const hw_module_t* module, const char* id, hw_device_t** device) {
@@ -187,18 +257,32 @@ namespace android{
         return ret;
     }
 
+    void CameraHal1::notifyDeviceRemoved(void) {
+
+        ALOGE("%s: camera %d device removed",__FUNCTION__, mcamera_id);
+        if ((mnotify_cb != NULL) && (mMesgEnabled & CAMERA_MSG_ERROR)) {
+            mnotify_cb(CAMERA_MSG_ERROR, CAMERA_ERROR_UNKNOWN, 0, mcamera_interface);
+        }
+    }
+
     status_t CameraHal1::initialize() {
         status_t ret = NO_ERROR;
         mDevice->connectDevice(mcamera_id);
         mJzParameters->initDefaultParameters(mirror?CAMERA_FACING_FRONT:CAMERA_FACING_BACK);
         getWorkThread()->startThread(false);
-        mWorkerQueue = new WorkQueue(10,false);
+        mJpegEncodePool = new CameraJpegEncodePool(JPEG_ENCODE_WORKERS, JPEG_ENCODE_MAX_JOBS);
+        if (mJpegEncodePool->start() != NO_ERROR) {
+            ALOGE("%s: could not start jpeg encode pool", __FUNCTION__);
+        }
 
         mHal1SignalThread = new Hal1SignalThread(this);
         mHal1SignalThread->Start("SignalThread",PRIORITY_DEFAULT, 0);
 
         mHal1SignalRecordingVideo = new Hal1SignalRecordingVideo(this);
         mHal1SignalRecordingVideo->Start("RecordingThread",PRIORITY_DEFAULT, 0);
+
+        mHal1SignalFaceDetect = new Hal1SignalFaceDetect(this);
+        mHal1SignalFaceDetect->Start("FaceDetectThread",PRIORITY_BACKGROUND, 0);
         //register for sensor events
         mSensorListener = new SensorListener();
         if (mSensorListener.get()) {
@@ -218,6 +302,10 @@ namespace android{
         AutoMutex lock(mlock);
         int preview_fps = mJzParameters->getCameraParameters().getPreviewFrameRate();
 
+        /* everything cached belongs to the window going away, and the
+           preview thread skips frames until the new one is set up */
+        swapPreviewWindow(NULL);
+
         if (window != NULL) {
             res = window->set_usage(window,GRALLOC_USAGE_SW_WRITE_OFTEN);
             if (mPreviewEnabled)
@@ -231,7 +319,7 @@ namespace android{
                       __FUNCTION__, res, strerror(res));
             }
         }
-        mPreviewWindow = window;
+        swapPreviewWindow(window);
         return res;
     }
 
@@ -271,7 +359,7 @@ namespace android{
         } else if ((msg_type & CAMERA_MSG_VIDEO_FRAME)
                    && strcmp("true",valstr)) {
             ALOGV("%s: reset preview because format is not yuv420b",__FUNCTION__);
-            mJzParameters->getCameraParameters().set(CameraParameters::KEY_RECORDING_HINT,"true");
+            mJzParameters->setParameter(CameraParameters::KEY_RECORDING_HINT,"true");
             //mHal1SignalThread->SetSignal(SIGNAL_RESET_PREVIEW);
         }
     }
@@ -312,6 +400,7 @@ namespace android{
         status_t res = NO_ERROR;
 
         AutoMutex lock(mlock);
+        mPreviewStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
         res = mDevice->connectDevice(mcamera_id);
         mDevice->getPreviewSize(&mRawPreviewWidth, &mRawPreviewHeight);
         mJzParameters->resetSizeChanged();
@@ -319,8 +408,12 @@ namespace android{
         if (res == NO_ERROR) {
             initVideoHeap(mRawPreviewWidth, mRawPreviewHeight);
             initPreviewHeap();
+            nsecs_t allocTime = systemTime(SYSTEM_TIME_MONOTONIC);
             res = mDevice->allocateStream(PREVIEW_BUFFER,mget_memory,mRawPreviewWidth, mRawPreviewHeight,
                                           mDevice->getPreviewFormat());
+            ALOGV("%s: preview stream %dx%d allocated in %lld us",__FUNCTION__,
+                  mRawPreviewWidth, mRawPreviewHeight,
+                  (systemTime(SYSTEM_TIME_MONOTONIC) - allocTime) / 1000LL);
         } else {
             ALOGE("%s: connect device error",__FUNCTION__);
             mPreviewEnabled = false;
@@ -374,9 +467,18 @@ namespace android{
         }
         ret = mDevice->stopDevice();
         ALOGV("%s",__FUNCTION__);
+        releasePreviewBuffers();
+        mFrameCache->clear();
+        {
+            AutoMutex slot_lock(mPreviewSlotLock);
+            if (mPreviewFrameDrops > 0) {
+                ALOGD("%s: %d preview callbacks dropped waiting for the app",__FUNCTION__,
+                      mPreviewFrameDrops);
+            }
+        }
         if (mPreviewHeap) {
             mPreviewFrameSize = 0;
-            mPreviewIndex = 0;
+            resetPreviewSlots();
             mPreviewWidth = 0;
             mPreviewHeight = 0;
             dmmu_unmap_memory((uint8_t*)mPreviewHeap->data,mPreviewHeap->size);
@@ -405,8 +507,23 @@ namespace android{
         return enable;
     }
 
+    /*
+     * In metadata mode a video frame is a recording_metadata_t describing
+     * the capture buffer itself, which the device keeps from the driver
+     * until the encoder releases it. A device that can't lend its buffers
+     * (cim) and a zoomed frame fall back to converting into a slot of
+     * mRecordingHeap and describing that instead.
+     */
     status_t CameraHal1::storeMetaDataInBuffers(int enable) {
-        return enable ? INVALID_OPERATION : NO_ERROR;
+
+        AutoMutex lock(mlock);
+        if (mVideoRecEnabled) {
+            ALOGE("%s: can't change the buffer mode while recording",__FUNCTION__);
+            return INVALID_OPERATION;
+        }
+        mUseMetaDataBufferMode = (enable != 0);
+        ALOGV("%s: metadata mode %s",__FUNCTION__, mUseMetaDataBufferMode ? "on" : "off");
+        return NO_ERROR;
     }
 
     status_t CameraHal1::startRecording() {
@@ -421,9 +538,14 @@ namespace android{
 #endif
             mVideoRecEnabled = true;
             mRecordingindex = 0;
+            mRecordingSlotBusy = 0;
+            mRecordingFrameDrops = 0;
             if (mRecordingHeap == NULL) {
                 initVideoHeap(mRawPreviewWidth, mRawPreviewHeight);
             }
+            if (mUseMetaDataBufferMode) {
+                initRecordingMetaHeap();
+            }
         }
 
         return NO_ERROR;
@@ -451,10 +573,12 @@ namespace android{
             }
 
             if (recordingData != NULL) {
-                if ((mRecordingHeap != NULL) && (mRecordingHeap->data != NULL) && ccc) {
+                int slot = -1;
+                if ((mRecordingHeap != NULL) && (mRecordingHeap->data != NULL) && ccc
+                    && ((slot = acquireRecordingSlot()) >= 0)) {
                     uint8_t* dest = (uint8_t*)((int)(mRecordingHeap->data)
-                                               + mRecordingFrameSize * mRecordingindex);
-                    if (mzoomVal != 0) {
+                                               + mRecordingFrameSize * slot);
+                    if (mzoomRadio != 100) {
                         if (mget_memory != NULL) {
                             tmpHeap = mget_memory(-1, getCurrentFrameSize(), 1, NULL);
                             if (tmpHeap != NULL) {
@@ -485,9 +609,19 @@ namespace android{
                     recordingData->release(recordingData);
                     recordingData = NULL;
                     int64_t timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
-                    mdata_cb_timestamp(timestamp,CAMERA_MSG_VIDEO_FRAME,
-                                       mRecordingHeap, mRecordingindex, mcamera_interface);
-                    mRecordingindex = (mRecordingindex+1)%RECORDING_BUFFER_NUM;
+                    if (mUseMetaDataBufferMode) {
+                        CameraYUVMeta meta;
+                        recording_heap_meta(&meta, dest, slot,
+                                            mCurrentFrame->width, mCurrentFrame->height);
+                        sendRecordingMetadata(slot, &meta, timestamp);
+                    } else {
+                        mdata_cb_timestamp(timestamp,CAMERA_MSG_VIDEO_FRAME,
+                                           mRecordingHeap, slot, mcamera_interface);
+                        mRecordingindex = (slot+1)%RECORDING_BUFFER_NUM;
+                    }
+                } else {
+                    recordingData->release(recordingData);
+                    recordingData = NULL;
                 }
             }
         } while (!mRecordingDataQueue.isEmpty());
@@ -513,6 +647,20 @@ namespace android{
                 mRecordingindex = 0;
             }
 
+            if (mRecordingFrameDrops > 0) {
+                ALOGD("%s: %d video frames dropped waiting for the encoder",__FUNCTION__,
+                      mRecordingFrameDrops);
+            }
+            releaseHeldRecordingFrames();
+            {
+                AutoMutex lock(mRecordingSlotLock);
+                mRecordingSlotBusy = 0;
+                if (mRecordingMetaHeap) {
+                    mRecordingMetaHeap->release(mRecordingMetaHeap);
+                    mRecordingMetaHeap = NULL;
+                }
+            }
+
             if (mRecordingHeap) {
                 dmmu_unmap_memory((uint8_t*)mRecordingHeap->data,mRecordingHeap->size);
                 mRecordingFrameSize = 0;
@@ -545,6 +693,25 @@ namespace android{
     }
 
     void CameraHal1::releaseRecordingFrame(const void* opaque) {
+
+        if (mUseMetaDataBufferMode) {
+            AutoMutex lock(mRecordingSlotLock);
+            if (mRecordingMetaHeap == NULL) {
+                return;
+            }
+            int offset = (int)opaque - (int)(mRecordingMetaHeap->data);
+            int slot = offset / (int)sizeof(recording_metadata_t);
+            if ((offset < 0) || (slot >= RECORDING_BUFFER_NUM)) {
+                ALOGE("%s: %p is not a recording frame",__FUNCTION__, opaque);
+                return;
+            }
+            mRecordingSlotBusy &= ~(1 << slot);
+            if (mRecordingSlotFrame[slot] >= 0) {
+                mDevice->releaseFrame(mRecordingSlotFrame[slot]);
+                mRecordingSlotFrame[slot] = -1;
+            }
+            return;
+        }
         getWorkThread()->threadResume();
         return ;
     }
@@ -633,6 +800,7 @@ namespace android{
         }
 
         camera_memory_t* takingPictureHeap = NULL;
+        sp<JpegEncodeJob> job = NULL;
         {
             AutoMutex lock(mlock);
             mDevice->sendCommand(STOP_PICTURE);
@@ -650,14 +818,19 @@ namespace android{
 
             int size = getCurrentFrameSize();
 
+            mFrameCache->setFrame(mCurrentFrame);
+            mDevice->flushCache((void*)mCurrentFrame->yAddr, size);
             if ((mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) && ccc) {
                 ccc->cimyuv420b_to_tile420(mCurrentFrame); //1- 4ms
+                flush_repacked_chroma(mDevice, mCurrentFrame);
             }
 
             takingPictureHeap = mget_memory(-1, size,1, NULL);
             memset(takingPictureHeap->data, 0, size);
             dmmu_map_memory((uint8_t*)takingPictureHeap->data,takingPictureHeap->size);
             status_t ret = NO_ERROR;
+            int transform = pictureTransform();
+            bool mirrored = false;
 
             if(mDevice->getSupportCaptureIncrease() && mCurrentFrame->width > 1600){
                 if(mCurrentFrame->width > 2048){
@@ -677,14 +850,20 @@ namespace android{
                 }
                 if (ret != NO_ERROR)
                     ALOGE("%s: ipu up scale error",__FUNCTION__);
-                if(mzoomVal != 0){
+                if(mzoomRadio != 100){
                     memcpy((uint8_t*)mCurrentFrame->yAddr, takingPictureHeap->data, size);
                     do_zoom((uint8_t*)takingPictureHeap->data,(uint8_t*)mCurrentFrame->yAddr);
                 }
             }else {
-                if(mzoomVal != 0)
+                if(mzoomRadio != 100)
                     do_zoom((uint8_t*)takingPictureHeap->data,(uint8_t*)mCurrentFrame->yAddr);
-                else
+                else if (transform != 0) {
+                    /* the copy mirrors as it goes, nothing left for the encoder */
+                    ccc->yuyv_transform((uint8_t*)takingPictureHeap->data, mCurrentFrame->width<<1,
+                                        (uint8_t*)mCurrentFrame->yAddr, mCurrentFrame->width<<1,
+                                        mCurrentFrame->width, mCurrentFrame->height, transform);
+                    mirrored = true;
+                } else
                     memcpy(takingPictureHeap->data,(uint8_t*)mCurrentFrame->yAddr,size);
             }
 
@@ -708,10 +887,11 @@ namespace android{
             if(file != NULL)
                 fclose(file);
 #endif
-            {
-                AutoMutex lock(mcapture_lock);
-                mListCaptureHeap.push_back(takingPictureHeap);
-            }
+            job = createJpegJob(takingPictureHeap, mirrored);
+
+            /* the frame now lives in takingPictureHeap, give the
+               capture buffer back before the encode even starts */
+            mDevice->deInitTakePicture();
         }
 
         if (mMesgEnabled & CAMERA_MSG_SHUTTER) {
@@ -730,10 +910,8 @@ namespace android{
             mdata_cb(CAMERA_MSG_RAW_IMAGE,takingPictureHeap, 0, NULL, mcamera_interface);
         }
 
-        if (mMesgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) {
-            ALOGV("%s start compress picture",__FUNCTION__);
-            mWorkerQueue->schedule(new PostJpegUnit(this));
-        }
+        ALOGV("%s start compress picture",__FUNCTION__);
+        scheduleJpegJob(job, CameraJpegEncodePool::PRIORITY_STILL);
 
         return NO_ERROR;
     }
@@ -746,18 +924,8 @@ namespace android{
             mTakingPicture = false;
         }
 
-        AutoMutex lock(mcapture_lock);
-        if (!mListCaptureHeap.empty()) {
-            List<camera_memory_t*>::iterator it = mListCaptureHeap.begin();
-            for (;it != mListCaptureHeap.end(); ++it) {
-                camera_memory_t* captureHeap = *it;
-                if (captureHeap != NULL) {
-                    dmmu_unmap_memory((uint8_t*)captureHeap->data,captureHeap->size);
-                    captureHeap->release(captureHeap);
-                    captureHeap = NULL;
-                }
-            }
-            mListCaptureHeap.clear();
+        if (mJpegEncodePool != NULL) {
+            mJpegEncodePool->cancelAll();
         }
         ALOGV("%s: line=%d",__FUNCTION__,__LINE__);
         return NO_ERROR;
@@ -773,7 +941,7 @@ namespace android{
 
     static char noParams = '\0';
     char* CameraHal1::getParameters() {
-        String8 params(mJzParameters->getCameraParameters().flatten());
+        String8 params(mJzParameters->getFlattenedParameters());
         char* ret_str = (char*)malloc(sizeof(char) * params.length()+1);
         memset(ret_str, 0, params.length()+1);
         if (ret_str != NULL) {
@@ -796,6 +964,29 @@ namespace android{
         AutoMutex lock(mlock);
         switch(cmd)
             {
+            case CAMERA_CMD_JZ_PREVIEW_CALLBACK_BUFFERS:
+                {
+                    char prop[PROPERTY_VALUE_MAX];
+                    property_get("ro.board.camera.cb_return", prop, "false");
+                    if ((arg1 != 0) && (strcmp(prop, "true") != 0)) {
+                        ALOGE("%s: app returned callback buffers are not enabled",__FUNCTION__);
+                        return INVALID_OPERATION;
+                    }
+                    AutoMutex slot_lock(mPreviewSlotLock);
+                    mPreviewCallbackBuffers = (arg1 != 0);
+                    mPreviewSlotBusy = 0;
+                    mPreviewFrameDrops = 0;
+                }
+                return res;
+            case CAMERA_CMD_JZ_RETURN_PREVIEW_BUFFER:
+                if ((arg1 < 0) || (arg1 >= PREVIEW_BUFFER_CONUT)) {
+                    return BAD_VALUE;
+                }
+                {
+                    AutoMutex slot_lock(mPreviewSlotLock);
+                    mPreviewSlotBusy &= ~(1 << arg1);
+                }
+                return res;
             case CAMERA_CMD_ENABLE_FOCUS_MOVE_MSG:
                 bool enable = static_cast<bool>(arg1);
                 AutoMutex lock(mlock);
@@ -814,16 +1005,15 @@ namespace android{
         switch(cmd)
             {
             case CAMERA_CMD_START_SMOOTH_ZOOM:
-                res = mDevice->sendCommand(START_ZOOM);
-                if (mMesgEnabled & CAMERA_MSG_ZOOM) {
-                    mnotify_cb(CAMERA_MSG_ZOOM,mzoomVal,1,mcamera_interface);
+                /* the preview thread walks the zoom and reports each step */
+                res = mZoomEngine.startSmoothZoom(arg1);
+                if (res == NO_ERROR) {
+                    mDevice->sendCommand(START_ZOOM);
                 }
                 break;
             case CAMERA_CMD_STOP_SMOOTH_ZOOM:
+                mZoomEngine.stopSmoothZoom();
                 res = mDevice->sendCommand(STOP_ZOOM);
-                if (mMesgEnabled & CAMERA_MSG_ZOOM) {
-                    mnotify_cb(CAMERA_MSG_ZOOM,mzoomVal,0,mcamera_interface);
-                }
                 break;
             case CAMERA_CMD_START_FACE_DETECTION:
                 res = softFaceDetectStart(arg1);
@@ -884,12 +1074,14 @@ namespace android{
 
     void CameraHal1::releaseCamera() {
 
-        if (mWorkerQueue != NULL) {
-            delete mWorkerQueue;
-            mWorkerQueue = NULL;
+        if (mJpegEncodePool != NULL) {
+            mJpegEncodePool->stop();
+            delete mJpegEncodePool;
+            mJpegEncodePool = NULL;
         }
 
         getWorkThread()->stopThread();
+        softFaceDetectStop();
 
         AutoMutex lock(mlock);
 
@@ -933,7 +1125,18 @@ namespace android{
         memset(buffer, 0, 256);
         snprintf(buffer, 256, "mVideoRecordingEnable=%s,",mVideoRecEnabled?"true":"false");
         msg.append(buffer);
-        msg.append(mJzParameters->getCameraParameters().flatten());
+        memset(buffer, 0, 256);
+        {
+            AutoMutex slot_lock(mPreviewSlotLock);
+            snprintf(buffer, 256, "mPreviewCallbackBuffers=%s,mPreviewFrameDrops=%d,",
+                     mPreviewCallbackBuffers?"true":"false", mPreviewFrameDrops);
+        }
+        msg.append(buffer);
+        memset(buffer, 0, 256);
+        snprintf(buffer, 256, "mUseMetaDataBufferMode=%s,mRecordingFrameDrops=%d,",
+                 mUseMetaDataBufferMode?"true":"false", mRecordingFrameDrops);
+        msg.append(buffer);
+        msg.append(mJzParameters->getFlattenedParameters());
         write(fd, msg.string(),msg.length());
 
         ALOGV("%s: line=%d",__FUNCTION__,__LINE__);
@@ -969,6 +1172,19 @@ namespace android{
             mHal1SignalRecordingVideo = NULL;
         }
 
+        if (mHal1SignalFaceDetect != NULL) {
+            mHal1SignalFaceDetect->release();
+            while(!mHal1SignalFaceDetect->IsTerminated()) {
+                usleep(SIG_WAITING_TICK);
+                if (--count < 0) {
+                    count = 100;
+                    break;
+                }
+            }
+            mHal1SignalFaceDetect.clear();
+            mHal1SignalFaceDetect = NULL;
+        }
+
         if (mSensorListener.get()) {
             mSensorListener->disableSensor(SensorListener::SENSOR_ORIENTATION);
             mSensorListener.clear();
@@ -986,6 +1202,9 @@ namespace android{
             return false;
         }
 
+        /* new geometry, new buffers */
+        releasePreviewBuffers();
+
         if (mRawPreviewWidth < mPreviewWidth || mRawPreviewHeight < mPreviewHeight) {
             mPreviewWinWidth = mRawPreviewWidth;
             mPreviewWinHeight = mRawPreviewHeight;
@@ -1002,6 +1221,22 @@ namespace android{
             mPreviewWinHeight = 0;
             return false;
         }
+        if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGB_565) {
+            mPrebytesPerPixel = 2;
+        } else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_JZ_YUV_420_P ||
+                   mPreviewWinFmt == HAL_PIXEL_FORMAT_YCbCr_422_SP ||
+                   mPreviewWinFmt == HAL_PIXEL_FORMAT_YCrCb_420_SP ||
+                   mPreviewWinFmt == HAL_PIXEL_FORMAT_YV12 ) {
+            mPrebytesPerPixel = 1;
+        } else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGB_888) {
+            mPrebytesPerPixel = 3;
+        } else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGBA_8888 ||
+                   mPreviewWinFmt == HAL_PIXEL_FORMAT_RGBX_8888 ||
+                   mPreviewWinFmt == HAL_PIXEL_FORMAT_BGRA_8888) {
+            mPrebytesPerPixel = 4;
+        } else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_YCbCr_422_I) {
+            mPrebytesPerPixel = 2;
+        }
         ALOGV("%s: previewWindow: %dx%d,format:0x%x",
               __FUNCTION__, mPreviewWinWidth,mPreviewWinHeight,mPreviewWinFmt);
         return true;
@@ -1045,6 +1280,178 @@ namespace android{
         }
     }
 
+    void CameraHal1::initRecordingMetaHeap(void) {
+
+        if (mRecordingMetaHeap != NULL) {
+            return;
+        }
+
+        if (mget_memory == NULL) {
+            ALOGE("No memory allocator available");
+            return;
+        }
+
+        mRecordingMetaHeap = mget_memory(-1, sizeof(recording_metadata_t),
+                                         RECORDING_BUFFER_NUM, NULL);
+        if ((mRecordingMetaHeap != NULL) && (mRecordingMetaHeap->data == NULL)) {
+            mRecordingMetaHeap->release(mRecordingMetaHeap);
+            mRecordingMetaHeap = NULL;
+        }
+        if (mRecordingMetaHeap == NULL) {
+            ALOGE("%s: no recording metadata heap",__FUNCTION__);
+        }
+    }
+
+    /*
+     * The slot a video frame goes out in. Without metadata mode the slots
+     * are reused in turn and the work thread waits for the release. In
+     * metadata mode the encoder holds a slot until it releases it, and a
+     * frame arriving while it holds them all is dropped.
+     */
+    int CameraHal1::acquireRecordingSlot(void) {
+
+        AutoMutex lock(mRecordingSlotLock);
+        if (!mUseMetaDataBufferMode) {
+            return mRecordingindex;
+        }
+
+        if (mRecordingMetaHeap != NULL) {
+            for (int i = 0; i < RECORDING_BUFFER_NUM; ++i) {
+                int slot = (mRecordingindex + i) % RECORDING_BUFFER_NUM;
+                if (!(mRecordingSlotBusy & (1 << slot))) {
+                    mRecordingSlotBusy |= (1 << slot);
+                    mRecordingindex = (slot + 1) % RECORDING_BUFFER_NUM;
+                    return slot;
+                }
+            }
+        }
+
+        if ((mRecordingFrameDrops++ % 30) == 0) {
+            ALOGD("%s: encoder holds every frame, %d frames dropped",__FUNCTION__,
+                  mRecordingFrameDrops);
+        }
+        return -1;
+    }
+
+    /* metadata mode on a device that lends its capture buffers */
+    bool CameraHal1::useHeldRecordingFrames(void) {
+
+        return mUseMetaDataBufferMode && (mzoomRadio == 100)
+            && (mDevice->getHeldFrameMax() > 0);
+    }
+
+    /*
+     * Once the preview is done with a held frame it goes to the encoder,
+     * which gives it back to the driver through releaseRecordingFrame().
+     * With no slot free it goes back right away.
+     */
+    void CameraHal1::finishHeldFrame(void) {
+
+        if (!mCurrentFrameHeld) {
+            return;
+        }
+        mCurrentFrameHeld = false;
+
+        int slot = -1;
+        if (mVideoRecEnabled && (mRecordingMetaHeap != NULL)) {
+            slot = acquireRecordingSlot();
+        }
+        if (slot < 0) {
+            mDevice->releaseFrame(mCurrentFrame->index);
+            return;
+        }
+
+        repackCurrentFrame();
+        {
+            /* stopRecording() may have taken the slots back meanwhile */
+            AutoMutex lock(mRecordingSlotLock);
+            if (mRecordingMetaHeap == NULL) {
+                mDevice->releaseFrame(mCurrentFrame->index);
+                return;
+            }
+            mRecordingSlotFrame[slot] = mCurrentFrame->index;
+        }
+        sendRecordingMetadata(slot, mCurrentFrame, mCurFrameTimestamp);
+    }
+
+    /* the encoder is gone, the driver gets back what it still held */
+    void CameraHal1::releaseHeldRecordingFrames(void) {
+
+        AutoMutex lock(mRecordingSlotLock);
+        for (int i = 0; i < RECORDING_BUFFER_NUM; ++i) {
+            if (mRecordingSlotFrame[i] >= 0) {
+                mDevice->releaseFrame(mRecordingSlotFrame[i]);
+                mRecordingSlotFrame[i] = -1;
+            }
+        }
+    }
+
+    void CameraHal1::sendRecordingMetadata(int slot, const CameraYUVMeta* frame,
+                                           nsecs_t timestamp) {
+
+        recording_metadata_t* data = (recording_metadata_t*)((int)(mRecordingMetaHeap->data)
+                                                             + sizeof(recording_metadata_t) * slot);
+        data->type = kMetadataBufferTypeCameraSource;
+        data->meta = *frame;
+        mdata_cb_timestamp(timestamp, CAMERA_MSG_VIDEO_FRAME,
+                           mRecordingMetaHeap, slot, mcamera_interface);
+    }
+
+    /*
+     * The slot of mPreviewHeap the next preview callback goes into. By
+     * default the slots are reused in turn whether or not the app still
+     * reads them. Once the app returns its slots, a frame is converted
+     * only into a free one and otherwise counted as dropped. A slot the
+     * app kept past PREVIEW_SLOT_TIMEOUT is taken back.
+     */
+    int CameraHal1::acquirePreviewSlot(void) {
+
+        AutoMutex lock(mPreviewSlotLock);
+        if (!mPreviewCallbackBuffers) {
+            return mPreviewIndex;
+        }
+
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < PREVIEW_BUFFER_CONUT; ++i) {
+            int slot = (mPreviewIndex + i) % PREVIEW_BUFFER_CONUT;
+            if ((mPreviewSlotBusy & (1 << slot))
+                && (now - mPreviewSlotTime[slot] > PREVIEW_SLOT_TIMEOUT)) {
+                ALOGW("%s: slot %d not returned in time, reuse it",__FUNCTION__, slot);
+                mPreviewSlotBusy &= ~(1 << slot);
+            }
+            if (!(mPreviewSlotBusy & (1 << slot))) {
+                mPreviewSlotBusy |= (1 << slot);
+                mPreviewSlotTime[slot] = now;
+                return slot;
+            }
+        }
+
+        if ((mPreviewFrameDrops++ % 30) == 0) {
+            ALOGD("%s: app holds every callback buffer, %d frames dropped",__FUNCTION__,
+                  mPreviewFrameDrops);
+        }
+        return -1;
+    }
+
+    /* a slot that was not handed to the app is free again at once */
+    void CameraHal1::finishPreviewSlot(int slot, bool delivered) {
+
+        AutoMutex lock(mPreviewSlotLock);
+        if (delivered) {
+            mPreviewIndex = (slot + 1) % PREVIEW_BUFFER_CONUT;
+        } else if (mPreviewCallbackBuffers) {
+            mPreviewSlotBusy &= ~(1 << slot);
+        }
+    }
+
+    /* the heap goes away, whatever the app held of it is gone with it */
+    void CameraHal1::resetPreviewSlots(void) {
+
+        AutoMutex lock(mPreviewSlotLock);
+        mPreviewIndex = 0;
+        mPreviewSlotBusy = 0;
+    }
+
     void CameraHal1::initPreviewHeap(void) {
 
         int how_preview_big = 0;
@@ -1091,7 +1498,7 @@ namespace android{
             mPreviewFrameSize = how_preview_big;
 
             if (mPreviewHeap) {
-                mPreviewIndex = 0;
+                resetPreviewSlots();
                 dmmu_unmap_memory((uint8_t*)mPreviewHeap->data, mPreviewHeap->size);
                 mPreviewHeap->release(mPreviewHeap);
                 mPreviewHeap = NULL;
@@ -1104,20 +1511,16 @@ namespace android{
 
     bool CameraHal1::thread_body(void) {
 
-        static int j = 0;
-        static int dropframe = 0;
-        static int64_t timeout = WAIT_TIME;
-        static int64_t startTime = 0;
-        static int64_t workTime = 0;
-        static int thread_state = WorkThread::THREAD_IDLE;
+        int64_t startTime = 0;
+        int64_t workTime = 0;
 
-        WorkThread::ControlCmd res = getWorkThread()->receiveCmd(-1,timeout);
+        WorkThread::ControlCmd res = getWorkThread()->receiveCmd(-1,mWorkTimeout);
 
         switch (res) {
 
         case WorkThread::THREAD_ERROR:
             {
-                if (j++ > 10) {
+                if (mWorkErrors++ > 10) {
                     ALOGE("%s: received cmd error, %s",__FUNCTION__, strerror(errno));
                     goto exit_thread;
                 }
@@ -1133,14 +1536,11 @@ namespace android{
         case WorkThread::THREAD_EXIT:
             {
             exit_thread:
-                j = 0;
-                close_x2d_dev();
-                close_ipu_dev();
-                thread_state = WorkThread::THREAD_EXIT;
-                timeout = WAIT_TIME;
-                startTime = 0;
-                dropframe = 0;
-                workTime = 0;
+                mWorkErrors = 0;
+                mConverter->close();
+                mWorkState = WorkThread::THREAD_EXIT;
+                mWorkTimeout = WAIT_TIME;
+                mDropFrames = 0;
                 ALOGV("%s: Worker thread has been exit.",__FUNCTION__);
                 return false;
             }
@@ -1153,8 +1553,8 @@ namespace android{
 
         case WorkThread::THREAD_IDLE:
             {
-                thread_state = WorkThread::THREAD_IDLE;
-                dropframe = 0;
+                mWorkState = WorkThread::THREAD_IDLE;
+                mDropFrames = 0;
                 {
                     AutoMutex lock(cmd_lock);
                     mreceived_cmd = true;
@@ -1167,7 +1567,7 @@ namespace android{
 
         case WorkThread::THREAD_READY:
             {
-                thread_state = WorkThread::THREAD_READY;
+                mWorkState = WorkThread::THREAD_READY;
                 {
                     AutoMutex lock(cmd_lock);
                     mreceived_cmd = true;
@@ -1178,264 +1578,303 @@ namespace android{
             }
         }
 
-        if (thread_state == WorkThread::THREAD_READY) {
+        if (mWorkState == WorkThread::THREAD_READY) {
 
             startTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
-            mDevice->flushCache(NULL,0);
-
             if (mJzParameters->is_preview_size_change() ||
                 mJzParameters->is_picture_size_change() ||
                 mJzParameters->is_video_size_change()) {
                 ALOGD("%s:SetSignal reset preview",__FUNCTION__);
-                thread_state = WorkThread::THREAD_IDLE;
+                mWorkState = WorkThread::THREAD_IDLE;
                 mDevice->sendCommand(STOP_PICTURE);
                 mHal1SignalThread->SetSignal(SIGNAL_RESET_PREVIEW);
                 return true;
             }
 
-            mCurrentFrame = (CameraYUVMeta*)mDevice->getCurrentFrame(); //40ms
+            mCurrentFrameHeld = false;
+            if (mVideoRecEnabled && (mMesgEnabled & CAMERA_MSG_VIDEO_FRAME)
+                && useHeldRecordingFrames()) {
+                /* NULL while the encoder holds all the device lends */
+                mCurrentFrame = (CameraYUVMeta*)mDevice->getHeldFrame();
+                mCurrentFrameHeld = (mCurrentFrame != NULL);
+            }
+            if (!mCurrentFrameHeld) {
+                mCurrentFrame = (CameraYUVMeta*)mDevice->getCurrentFrame(); //40ms
+            }
 
             if (mCurrentFrame == NULL) {
-                timeout = WAIT_TIME;
-                thread_state = WorkThread::THREAD_IDLE;
+                mWorkTimeout = WAIT_TIME;
+                mWorkState = WorkThread::THREAD_IDLE;
                 //CHECK(!"current frame is null");
                 return true;
             }
 
-            if ((mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) && ccc) {
-                ccc->cimyuv420b_to_tile420(mCurrentFrame); //1- 4ms
-            }
+            /* only the frame we now own, the rest of the pool is still the device's */
+            mDevice->flushCache(NULL,0);
+
+            /* repacked by the first consumer that reads its chroma */
+            mFrameRepacked = false;
+            mFrameCache->setFrame(mCurrentFrame);
 
             dump_data(false);
 
             mCurFrameTimestamp = systemTime(SYSTEM_TIME_MONOTONIC);
 
+            update_zoom();
+
+            if (mPreviewStartTime != 0) {
+                ALOGD("%s: first frame %lld ms after startPreview",__FUNCTION__,
+                      (mCurFrameTimestamp - mPreviewStartTime) / 1000000LL);
+                mPreviewStartTime = 0;
+            }
+
             postFrameForNotify(); // 5ms
-            if (dropframe == LOST_FRAME_NUM) {
+            if (mDropFrames == LOST_FRAME_NUM) {
                 postFrameForPreview(); // 5ms
             } else {
-                dropframe++;
+                mDropFrames++;
             }
+            finishHeldFrame();
 
             workTime = systemTime(SYSTEM_TIME_MONOTONIC) - mCurFrameTimestamp;
 
-            timeout = mPreviewAfter - workTime - (mCurFrameTimestamp - startTime); // 50ms - 12ms - (45 + 2) = -9ms
+            mWorkTimeout = mPreviewAfter - workTime - (mCurFrameTimestamp - startTime); // 50ms - 12ms - (45 + 2) = -9ms
         } else {
-            timeout = WAIT_TIME;
+            mWorkTimeout = WAIT_TIME;
         }
 
         return true;
     }
 
+    /*
+     * The cim chroma only has to become tile420 for someone reading it,
+     * a dropped frame or one only face detection looks at (luma only)
+     * never pays for the repack.
+     */
+    void CameraHal1::repackCurrentFrame(void) {
+
+        if (mFrameRepacked || (mCurrentFrame == NULL))
+            return;
+
+        mFrameRepacked = true;
+        if ((mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) && ccc) {
+            ccc->cimyuv420b_to_tile420(mCurrentFrame); //1- 4ms
+            flush_repacked_chroma(mDevice, mCurrentFrame);
+        }
+    }
+
     void CameraHal1::postFrameForPreview() {
 
         int res = NO_ERROR;
         if ((mPreviewEnabled == false) || mPreviewWindow == NULL)
             return ;
 
-        buffer_handle_t* buffer = NULL;
-        int stride = 0;
-        res = mPreviewWindow->dequeue_buffer(mPreviewWindow, &buffer, &stride);
-        if ((res != NO_ERROR) || (buffer == NULL)) {
-            CHECK(!"dequeue buffer error");
-            return ;
-        }
+        repackCurrentFrame();
 
-        res = mPreviewWindow->lock_buffer(mPreviewWindow,buffer);
-        if (res != NO_ERROR) {
-            mPreviewWindow->cancel_buffer(mPreviewWindow, buffer);
+        AutoMutex lock(mPreviewBufferLock);
+        /* setPreviewWindow may have taken it away meanwhile */
+        if (mPreviewWindow == NULL)
             return ;
+        buffer_handle_t* buffer = mNextPreviewBuffer;
+        mNextPreviewBuffer = NULL;
+        if (buffer == NULL) {
+            res = dequeuePreviewBuffer(&buffer);
+            if (res != NO_ERROR) {
+                CHECK(!"dequeue buffer error");
+                return ;
+            }
         }
 
-        void *img = NULL;
-        const Rect rect(mPreviewWinWidth,mPreviewWinHeight);
-        GraphicBufferMapper& mapper(GraphicBufferMapper::get());
-        res = mapper.lock(*buffer, GRALLOC_USAGE_SW_WRITE_OFTEN, rect, &img);
-        if (res != NO_ERROR) {
+        preview_buffer_t* cached = mapPreviewBuffer(buffer);
+        if (cached == NULL) {
             mPreviewWindow->cancel_buffer(mPreviewWindow, buffer);
             return ;
         }
 
-        res = fillCurrentFrame((uint8_t*)img,buffer);
+        res = fillCurrentFrame((uint8_t*)cached->img,buffer);
+        GraphicBufferMapper::get().unlock(*buffer);
         if (res == NO_ERROR) {
             mPreviewWindow->set_timestamp(mPreviewWindow, mCurFrameTimestamp);
             mPreviewWindow->enqueue_buffer(mPreviewWindow, buffer);
         } else {
             mPreviewWindow->cancel_buffer(mPreviewWindow, buffer);
         }
-        mapper.unlock(*buffer);
+
+        /* wait for the next buffer while the sensor fills the next frame */
+        if (dequeuePreviewBuffer(&mNextPreviewBuffer) != NO_ERROR) {
+            mNextPreviewBuffer = NULL;
+        }
     }
 
-    status_t CameraHal1::fillCurrentFrame(uint8_t* img,buffer_handle_t* buffer) {
+    status_t CameraHal1::dequeuePreviewBuffer(buffer_handle_t** buffer) {
 
-        int srcStride = mCurrentFrame->yStride;
-        uint8_t*src = (uint8_t*)(mCurrentFrame->yAddr);
-        int srcWidth = mCurrentFrame->width;
-        int srcHeight = mCurrentFrame->height;
-        camera_memory_t* tmp_mem = NULL;
-        int ret = NO_ERROR;
+        int stride = 0;
+        int res = mPreviewWindow->dequeue_buffer(mPreviewWindow, buffer, &stride);
+        if ((res != NO_ERROR) || (*buffer == NULL)) {
+            ALOGE("%s: dequeue buffer fail, ret = %d",__FUNCTION__, res);
+            *buffer = NULL;
+            return (res != NO_ERROR) ? res : NO_MEMORY;
+        }
 
-        int xStart = 0;
-        int yStart = 0;
+        res = mPreviewWindow->lock_buffer(mPreviewWindow, *buffer);
+        if (res != NO_ERROR) {
+            mPreviewWindow->cancel_buffer(mPreviewWindow, *buffer);
+            *buffer = NULL;
+            return res;
+        }
+        return NO_ERROR;
+    }
 
-        IMG_native_handle_t* dst_handle = NULL;
-        dst_handle = (IMG_native_handle_t*)(*buffer);
+    /*
+     * Locks buffer for writing, the caller unlocks it before it goes back
+     * to the window so a CPU written frame is flushed out for the
+     * compositor. The window only cycles through a few buffers, so the
+     * dmmu mapping of each one is made the first time it shows up and
+     * kept until the window or its geometry changes. Called with
+     * mPreviewBufferLock held.
+     */
+    preview_buffer_t* CameraHal1::mapPreviewBuffer(buffer_handle_t* buffer) {
 
-        ALOGV("src:%dx%d, preview: %dx%d, mPreWin:%dx%d",mCurrentFrame->width,
-               mCurrentFrame->height, mPreviewWidth, mPreviewHeight, mPreviewWinWidth, mPreviewWinHeight);
-        if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGB_565) {
-            mPrebytesPerPixel = 2;
-        } else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_JZ_YUV_420_P ||
-                   mPreviewWinFmt == HAL_PIXEL_FORMAT_YCbCr_422_SP ||
-                   mPreviewWinFmt == HAL_PIXEL_FORMAT_YCrCb_420_SP ||
-                   mPreviewWinFmt == HAL_PIXEL_FORMAT_YV12 ) {
-            mPrebytesPerPixel = 1;
-        } else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGB_888) {
-            mPrebytesPerPixel = 3;
-        } else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGBA_8888 ||
-                   mPreviewWinFmt == HAL_PIXEL_FORMAT_RGBX_8888 ||
-                   mPreviewWinFmt == HAL_PIXEL_FORMAT_BGRA_8888) {
-            mPrebytesPerPixel = 4;
-        } else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_YCbCr_422_I) {
-            mPrebytesPerPixel = 2;
+        int mapSize = mPreviewWinWidth * mPreviewWinHeight * mPrebytesPerPixel;
+        if (mapSize <= 0) {
+            return NULL;
         }
-        int dest_size = mPreviewWinWidth * mPreviewWinHeight * mPrebytesPerPixel;
-        int dstStride = mPrebytesPerPixel * mPreviewWinWidth;
-        uint8_t* dst = ((uint8_t*)img) + (xStart*mPrebytesPerPixel) + (dstStride*yStart);
-
-        switch (mPreviewWinFmt) {
-        case HAL_PIXEL_FORMAT_YCbCr_422_SP:
-            if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I))
-                ccc->yuyv_to_yvu420sp(dst,mPreviewWinWidth,
-                                      mPreviewWinHeight, src, srcStride, srcWidth, srcHeight);
-            break;
-
-        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
-            if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I))
-                ccc->yuyv_to_yvu420sp(dst,mPreviewWinWidth,
-                                      mPreviewWinHeight,src, srcStride, srcWidth, srcHeight);
-            break;
-
-        case HAL_PIXEL_FORMAT_YV12:
-            if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I))
-                ccc->yuyv_to_yvu420p( dst, dstStride, mPreviewWinHeight, 
-                                      src, srcStride, srcWidth, srcHeight);
-            break;
-
-        case PIXEL_FORMAT_YV16:
-            if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I))
-                ccc->yuyv_to_yvu422p(dst, dstStride, mPreviewWinHeight, 
-                                     src, srcStride, srcWidth, srcHeight);
-            break;
-
-        case HAL_PIXEL_FORMAT_YCbCr_422_I:
-            {
-                uint8_t* pdst = dst;
-                uint8_t* psrc = src;
-                int h;
-                for (h=0; h<srcHeight; h++) {
-                    memcpy(pdst, psrc, srcWidth<<1);
-                    pdst += dstStride;
-                    psrc += srcStride;
-                }
-            }
-            break;
-        case HAL_PIXEL_FORMAT_RGB_888:
-            if (ipu_open_status) {
-                ipu_convert_dataformat(mCurrentFrame,dst,buffer);
-            } else if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)) {
-                ccc->yuyv_to_rgb24(src, srcStride, dst, dstStride, srcWidth, srcHeight);
-            }
-            break;
 
-        case HAL_PIXEL_FORMAT_RGBA_8888:
-            if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I))
-                ccc->yuyv_to_rgb32(src, srcStride, dst, dstStride, srcWidth, srcHeight);
-            break;
+        void* img = NULL;
+        const Rect rect(mPreviewWinWidth,mPreviewWinHeight);
+        GraphicBufferMapper& mapper(GraphicBufferMapper::get());
+        if (mapper.lock(*buffer, GRALLOC_USAGE_SW_WRITE_OFTEN, rect, &img) != NO_ERROR) {
+            ALOGE("%s: lock window buffer fail",__FUNCTION__);
+            return NULL;
+        }
 
-        case HAL_PIXEL_FORMAT_RGBX_8888:
-            if (ipu_open_status) {
-                ipu_convert_dataformat(mCurrentFrame,dst,buffer);
-            } else if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)) {
-                ccc->yuyv_to_rgb32(src, srcStride, dst, dstStride, srcWidth, srcHeight);
+        ssize_t index = mPreviewBuffers.indexOfKey(*buffer);
+        if (index >= 0) {
+            preview_buffer_t* cached = &(mPreviewBuffers.editValueAt(index));
+            if (cached->img == img) {
+                return cached;
             }
+            /* mapped somewhere else this time */
+            dmmu_unmap_memory((uint8_t*)cached->img, cached->mapSize);
+            mPreviewBuffers.removeItemsAt(index);
+        }
 
-            break;
+        if (mPreviewBuffers.size() >= PREVIEW_BUFFER_CACHE_MAX) {
+            ALOGE("%s: %d window buffers seen, drop the cache",__FUNCTION__,
+                  mPreviewBuffers.size());
+            clearPreviewBufferCache();
+        }
 
-        case HAL_PIXEL_FORMAT_BGRA_8888:
-            if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)) {
-                ccc->yuyv_to_bgr32(src, srcStride, dst, dstStride, srcWidth, srcHeight);
-            }
-            break;
+        preview_buffer_t cached;
+        cached.img = img;
+        cached.mapSize = mapSize;
+        dmmu_map_memory((uint8_t*)cached.img, cached.mapSize);
 
-        case HAL_PIXEL_FORMAT_RGB_565:
-#ifdef SOFT_CONVERT
-            if (mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
-                ccc->tile420_to_rgb565(mCurrentFrame, dst);
-            } else if (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I){
-                ipu_convert_dataformat(mCurrentFrame,dst,buffer);
-                //ccc->yuyv_to_rgb565(src, srcStride, dst, dstStride, srcWidth, srcHeight);
-            }
-#else
-            ipu_convert_dataformat(mCurrentFrame,dst,buffer);
-#endif
-            break;
+        index = mPreviewBuffers.add(*buffer, cached);
+        return &(mPreviewBuffers.editValueAt(index));
+    }
 
-        default:
-            ALOGE("Unhandled pixel format");
-            goto preview_win_format_error;
+    /* none of the cached buffers is locked between frames */
+    void CameraHal1::clearPreviewBufferCache(void) {
+
+        for (size_t i = 0; i < mPreviewBuffers.size(); ++i) {
+            const preview_buffer_t& cached = mPreviewBuffers.valueAt(i);
+            dmmu_unmap_memory((uint8_t*)cached.img, cached.mapSize);
         }
+        mPreviewBuffers.clear();
+    }
 
-        if (isSoftFaceDetectStart == true && ccc) {
-            if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGB_565) {
-                mFaceCount = CameraFaceDetect::getInstance()->detect((uint16_t*)dst);
-            } else {
-                camera_memory_t* rgb565 = mget_memory(-1, (srcWidth*srcHeight*2), 1, NULL);
-                if ((rgb565 != NULL) && (rgb565->data != NULL)) {
-                    if (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
-                        ccc->yuyv_to_rgb565(src, srcStride, (uint8_t*)(rgb565->data),
-                                            mPreviewWinWidth*2, srcWidth, srcHeight);
-                        mFaceCount = CameraFaceDetect::getInstance()->detect((uint16_t*)rgb565->data);
-                    } else if (mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
-#ifdef SOFT_CONVERT
-                        ccc->tile420_to_rgb565(mCurrentFrame, (uint8_t*)(rgb565->data));
-#else
-#ifdef USE_X2D
-                        x2d_convert_dataformat(mCurrentFrame, 
-                                               (uint8_t*)(rgb565->data), buffer);
-#else
-                        if (ipu_open_status)
-                            ipu_convert_dataformat(mCurrentFrame,(uint8_t*)(rgb565->data), buffer);
-#endif
-#endif
-                        mFaceCount = CameraFaceDetect::getInstance()->detect((uint16_t*)rgb565->data);
-                    } else if (mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
-                        ccc->yuv420p_to_rgb565(src, (uint8_t*)(rgb565->data),srcWidth, srcHeight);
-                        mFaceCount = CameraFaceDetect::getInstance()->detect((uint16_t*)rgb565->data);
-                    }
-                    rgb565->release(rgb565);
-                    rgb565 = NULL;
-                }
-            }
+    void CameraHal1::releasePreviewBuffers(void) {
+
+        AutoMutex lock(mPreviewBufferLock);
+        if ((mNextPreviewBuffer != NULL) && (mPreviewWindow != NULL)) {
+            mPreviewWindow->cancel_buffer(mPreviewWindow, mNextPreviewBuffer);
         }
-    preview_win_format_error:
-        if (tmp_mem != NULL) {
-            tmp_mem->release(tmp_mem);
-            tmp_mem = NULL;
+        mNextPreviewBuffer = NULL;
+        clearPreviewBufferCache();
+    }
+
+    /* drops what belongs to the old window and installs window in one go */
+    void CameraHal1::swapPreviewWindow(struct preview_stream_ops* window) {
+
+        AutoMutex lock(mPreviewBufferLock);
+        if ((mNextPreviewBuffer != NULL) && (mPreviewWindow != NULL)) {
+            mPreviewWindow->cancel_buffer(mPreviewWindow, mNextPreviewBuffer);
         }
-        return NO_ERROR;
+        mNextPreviewBuffer = NULL;
+        clearPreviewBufferCache();
+        mPreviewWindow = window;
+    }
+
+    status_t CameraHal1::fillCurrentFrame(uint8_t* img,buffer_handle_t* buffer) {
+
+        convert_request_t req;
+
+        ALOGV("src:%dx%d, preview: %dx%d, mPreWin:%dx%d",mCurrentFrame->width,
+               mCurrentFrame->height, mPreviewWidth, mPreviewHeight, mPreviewWinWidth, mPreviewWinHeight);
+
+        memset(&req, 0, sizeof(convert_request_t));
+        req.src = mCurrentFrame;
+        req.dst = (uint8_t*)img;
+        req.dstFormat = mPreviewWinFmt;
+        req.dstWidth = mPreviewWinWidth;
+        req.dstHeight = mPreviewWinHeight;
+        req.dstStride = mPrebytesPerPixel * mPreviewWinWidth;
+        req.zoomRatio = mzoomRadio;
+        req.dstMapped = true;
+
+        status_t res = mConverter->convert(&req);
+        if (res != NO_ERROR) {
+            ALOGE("%s: can't put 0x%x into a 0x%x window",__FUNCTION__,
+                  mCurrentFrame->format, mPreviewWinFmt);
+        }
+        return res;
+    }
+
+    /* once per frame, on the preview thread */
+    void CameraHal1::update_zoom(void) {
+
+        int index = mJzParameters->getCameraParameters().getInt(CameraParameters::KEY_ZOOM);
+        bool stopped = false;
+
+        if (!mZoomEngine.isSmoothZooming() && (index != mZoomEngine.getZoom())) {
+            mZoomEngine.setZoom(index);
+        }
+
+        if (mZoomEngine.advance(&index, &stopped)) {
+            char value[8];
+            snprintf(value, sizeof(value), "%d", index);
+            mJzParameters->setParameter(CameraParameters::KEY_ZOOM, value);
+            if (mMesgEnabled & CAMERA_MSG_ZOOM) {
+                mnotify_cb(CAMERA_MSG_ZOOM, index, stopped ? 1 : 0, mcamera_interface);
+            }
+        }
+
+        mzoomVal = mZoomEngine.getZoom();
+        mzoomRadio = mZoomEngine.getRatio();
     }
 
     void CameraHal1::postFrameForNotify() {
 
-        if ((mMesgEnabled & CAMERA_MSG_VIDEO_FRAME) && mVideoRecEnabled) {
+        if ((mMesgEnabled & CAMERA_MSG_VIDEO_FRAME) && mVideoRecEnabled
+            && !mCurrentFrameHeld && useHeldRecordingFrames()) {
+            AutoMutex lock(mRecordingSlotLock);
+            if ((mRecordingFrameDrops++ % 30) == 0) {
+                ALOGD("%s: encoder holds every frame, %d frames dropped",__FUNCTION__,
+                      mRecordingFrameDrops);
+            }
+        } else if ((mMesgEnabled & CAMERA_MSG_VIDEO_FRAME) && mVideoRecEnabled
+                   && !mCurrentFrameHeld) {
+            repackCurrentFrame();
 #ifdef START_CAMERA_COLOR_CONVET_THREAD
+            int video_slot = -1;
             if ((NULL != mRecordingHeap)
                 && (mRecordingHeap->data != NULL)
-                && ccc) {
+                && ccc
+                && ((video_slot = acquireRecordingSlot()) >= 0)) {
                 uint8_t* dest = (uint8_t*)((int)(mRecordingHeap->data)
-                                           + mRecordingFrameSize * mRecordingindex);
+                                           + mRecordingFrameSize * video_slot);
 #ifdef CONVERTER_PMON
                 int time0 = GetTimer();
 #endif
@@ -1454,10 +1893,17 @@ namespace android{
                 mtotalnum ++;
                 ALOGV("Dualll CONVERT TIME=%d,gettid=%d",time_use,gettid());
 #endif
-                mdata_cb_timestamp(mCurFrameTimestamp,CAMERA_MSG_VIDEO_FRAME,
-                                   mRecordingHeap, mRecordingindex, mcamera_interface);
-                mRecordingindex = (mRecordingindex+1)%RECORDING_BUFFER_NUM;
-                getWorkThread()->threadPause();
+                if (mUseMetaDataBufferMode) {
+                    CameraYUVMeta meta;
+                    recording_heap_meta(&meta, dest, video_slot,
+                                        mCurrentFrame->width, mCurrentFrame->height);
+                    sendRecordingMetadata(video_slot, &meta, mCurFrameTimestamp);
+                } else {
+                    mdata_cb_timestamp(mCurFrameTimestamp,CAMERA_MSG_VIDEO_FRAME,
+                                       mRecordingHeap, video_slot, mcamera_interface);
+                    mRecordingindex = (video_slot+1)%RECORDING_BUFFER_NUM;
+                    getWorkThread()->threadPause();
+                }
             }
 #else
             if (mget_memory) {
@@ -1473,7 +1919,22 @@ namespace android{
 #endif
         }
 
+        /* a frame with no slot to go into is dropped before any work on it */
+        int slot = -1;
         if (mMesgEnabled & CAMERA_MSG_PREVIEW_FRAME) {
+            if (mJzParameters->is_preview_size_change()) {
+                ALOGV("%s:reset preview heap android format",__FUNCTION__);
+                initPreviewHeap();
+                NegotiatePreviewFormat(mPreviewWindow);
+            }
+            if ((mPreviewHeap != NULL) && (mPreviewHeap->data != NULL)) {
+                slot = acquirePreviewSlot();
+            }
+        }
+
+        if (slot >= 0) {
+
+            repackCurrentFrame();
 
             int srcWidth = mCurrentFrame->width;
             int srcHeight = mCurrentFrame->height;
@@ -1482,12 +1943,6 @@ namespace android{
             bool convert_result = true;
             int ret = NO_ERROR;
 
-            if (mJzParameters->is_preview_size_change()) {
-                ALOGV("%s:reset preview heap android format",__FUNCTION__);
-                initPreviewHeap();
-                NegotiatePreviewFormat(mPreviewWindow);
-            }
-
             int cwidth = mPreviewWidth;
             int cheight = mPreviewHeight;
             int cFrameSize = mPreviewFrameSize;
@@ -1509,31 +1964,31 @@ namespace android{
                 }
             }
 
-            //modify for weixin video chat mirror, rotation src data
+            /*
+             * weixin video chat mirror, done by the conversion while it
+             * writes dest so the shared frame stays as captured
+             */
             int rot = 0;
-            if (mirror && ccc ) {
+            int transform = 0;
+            if (mirror && ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)) {
                 rot = mSensorListener->getOrientationCompensation();
-                if (rot == 90 || rot == 270) {
-                    ccc->yuyv_upturn(src,srcWidth, srcHeight);
-                } else if (rot == 0 || rot == 180) {
-                    ccc->yuyv_mirror(src, srcWidth, srcHeight);
-                }
+                transform = CameraColorConvert::mirror_transform(rot);
             }
 
             ALOGV("preview size:%dx%d, raw size:%dx%d, dest format:0x%x, src fromat:0x%x, rot: %d",
                   cwidth, cheight, mCurrentFrame->width, mCurrentFrame->height,cFormat, mCurrentFrame->format, rot);
             if ((mPreviewHeap != NULL) && (mPreviewHeap->data != NULL)) {
-                void* dest = (void*)((int)(mPreviewHeap->data) + mPreviewFrameSize*mPreviewIndex);
+                void* dest = (void*)((int)(mPreviewHeap->data) + mPreviewFrameSize*slot);
                 switch(cFormat) {
 
                 case HAL_PIXEL_FORMAT_YCbCr_422_SP:
                     if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)) {
                         ccc->yuyv_to_yvu420sp((uint8_t*)(dest),
                                               cwidth, cheight, src, 
-                                              srcWidth<<1, srcWidth, srcHeight);
+                                              srcWidth<<1, srcWidth, srcHeight, transform);
                     } else if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B)) {
-                        ccc->tile420_to_yuv420p(mCurrentFrame, (uint8_t*)(dest));
-                        ccc->yuv420p_to_yuv420sp(src,(uint8_t*)(dest),srcWidth, srcHeight);
+                        convert_result = (mFrameCache->copyTo(HAL_PIXEL_FORMAT_YCrCb_420_SP,
+                                                              cwidth, cheight, (uint8_t*)dest) == NO_ERROR);
                     } else if (ccc && ((mCurrentFrame->format == HAL_PIXEL_FORMAT_YCrCb_420_SP) ||
                                        (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_SP))) {
                         if (cwidth*cheight > mCurrentFrame->width * mCurrentFrame->height) {
@@ -1551,10 +2006,10 @@ namespace android{
                     break;
                 case HAL_PIXEL_FORMAT_YCrCb_420_SP:
                     if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)) {
-                        ccc->yuyv_to_yvu420sp((uint8_t*)(dest), cwidth, cheight, src, srcWidth<<1 ,srcWidth,srcHeight);
+                        ccc->yuyv_to_yvu420sp((uint8_t*)(dest), cwidth, cheight, src, srcWidth<<1 ,srcWidth,srcHeight, transform);
                     } else if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B)) {
-                        ccc->tile420_to_yuv420p(mCurrentFrame, (uint8_t*)(dest));
-                        ccc->yuv420p_to_yuv420sp(src,(uint8_t*)(dest), srcWidth, srcHeight);
+                        convert_result = (mFrameCache->copyTo(HAL_PIXEL_FORMAT_YCrCb_420_SP,
+                                                              cwidth, cheight, (uint8_t*)dest) == NO_ERROR);
                     } else if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCrCb_420_SP)) {
                         if (cwidth*cheight > mCurrentFrame->width * mCurrentFrame->height) {
                             memcpy((uint8_t*)(dest), src, mCurrentFrame->width * mCurrentFrame->height*12/8);
@@ -1572,9 +2027,10 @@ namespace android{
                     break;
                 case HAL_PIXEL_FORMAT_YV12:
                     if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)) {
-                        ccc->yuyv_to_yvu420p((uint8_t*)(dest),cwidth, cheight, src,srcWidth<<1, srcWidth, srcHeight);
+                        ccc->yuyv_to_yvu420p((uint8_t*)(dest),cwidth, cheight, src,srcWidth<<1, srcWidth, srcHeight, transform);
                     } else if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B)) {
-                        ccc->tile420_to_yuv420p(mCurrentFrame, (uint8_t*)(dest));
+                        convert_result = (mFrameCache->copyTo(HAL_PIXEL_FORMAT_YV12,
+                                                              cwidth, cheight, (uint8_t*)dest) == NO_ERROR);
                     } else if (ccc && ((mCurrentFrame->format == HAL_PIXEL_FORMAT_YV12) ||
                                        (mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_P))) {
                         if (cwidth*cheight > mCurrentFrame->width * mCurrentFrame->height) {
@@ -1595,7 +2051,18 @@ namespace android{
                         ccc->tile420_to_yuv420p(mCurrentFrame, (uint8_t*)(dest));
                         //ccc->yuv420p_to_yuyv(mCurrentFrame, (uint8_t*)(dest));
                     } else if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)) {
-                        if (cwidth*cheight > mCurrentFrame->width * mCurrentFrame->height) {
+                        if (transform != 0) {
+                            /* the turned frame, cropped to fit the cwidth x cheight slot */
+                            bool rot90 = (transform & HAL_TRANSFORM_ROT_90) != 0;
+                            int width = rot90 ? cheight : cwidth;
+                            int height = rot90 ? cwidth : cheight;
+                            if (width > srcWidth)
+                                width = srcWidth;
+                            if (height > srcHeight)
+                                height = srcHeight;
+                            ccc->yuyv_transform((uint8_t*)(dest), cwidth<<1, src, srcWidth<<1,
+                                                width, height, transform);
+                        } else if (cwidth*cheight > mCurrentFrame->width * mCurrentFrame->height) {
                             memcpy((uint8_t*)(dest), src, mCurrentFrame->width * mCurrentFrame->height*2);
                         } else {
                             memcpy((uint8_t*)(dest), src, mPreviewFrameSize);
@@ -1619,7 +2086,8 @@ namespace android{
                     if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)) {
                         ccc->yuyv_to_yvu420p((uint8_t*)(dest),cwidth, cheight, src,srcWidth<<1,srcWidth, srcHeight);
                     } else if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B)) {
-                        ccc->tile420_to_yuv420p(mCurrentFrame, (uint8_t*)(dest));
+                        convert_result = (mFrameCache->copyTo(HAL_PIXEL_FORMAT_JZ_YUV_420_P,
+                                                              cwidth, cheight, (uint8_t*)dest) == NO_ERROR);
                     } else if (ccc && ((mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_P) ||
                                        (mCurrentFrame->format == HAL_PIXEL_FORMAT_YV12))) {
                         if (cwidth*cheight > mCurrentFrame->width * mCurrentFrame->height) {
@@ -1639,12 +2107,12 @@ namespace android{
                     ALOGE("Unhandled pixel format");
                 }
                 if (convert_result) {
-                    mdata_cb(CAMERA_MSG_PREVIEW_FRAME, mPreviewHeap, mPreviewIndex, 
+                    mdata_cb(CAMERA_MSG_PREVIEW_FRAME, mPreviewHeap, slot,
                              NULL,mcamera_interface);
-                    mPreviewIndex = (mPreviewIndex+1)%PREVIEW_BUFFER_CONUT;
                 } else {
                     ALOGE("%s: format 0x%x is not support",__FUNCTION__,cFormat);
                 }
+                finishPreviewSlot(slot, convert_result);
                 if (tmp_mem != NULL) {
                     tmp_mem->release(tmp_mem);
                     tmp_mem = NULL;
@@ -1653,82 +2121,9 @@ namespace android{
         }
 
         if ((mMesgEnabled & CAMERA_MSG_PREVIEW_METADATA) && (isSoftFaceDetectStart == true)) {
-            Rect **faceRect = NULL;
-            camera_frame_metadata_t frame_metadata;
-            int maxFaces = mJzParameters->getCameraParameters()
-                .getInt(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_HW);
-            status_t ret = NO_ERROR;
-            float lx = 0, ly = 0, rx = 0, ry = 0;
-            float fl = 0, fr = 0, ft = 0, fb = 0;
-
-            if (mFaceCount > 0) {
-                if (mFaceCount > maxFaces)
-                    mFaceCount = maxFaces;
-                faceRect = new Rect*[mFaceCount];
-                frame_metadata.faces = (camera_face_t*)calloc(mFaceCount, sizeof(camera_face_t));
-                frame_metadata.number_of_faces = mFaceCount;
-                for (int i = 0; i < mFaceCount; ++i) {
-                    faceRect[i] = new Rect();
-                    CameraFaceDetect::getInstance()->get_face(faceRect[i],i);
-                    fl = faceRect[i]->left;
-                    fr = faceRect[i]->right;
-                    ft = faceRect[i]->top;
-                    fb = faceRect[i]->bottom;
-
-                    if (fl >= -1000 && fl <= 1000) {
-                        ;
-                    } else {
-                        fl = fl - 1000;
-                        fr = fr - 1000;
-                        ft = ft - 1000;
-                        fb = fb - 1000;
-                    }
-
-                    frame_metadata.faces[i].rect[0] = (int32_t)fl;
-                    frame_metadata.faces[i].rect[1] = (int32_t)fr;
-                    frame_metadata.faces[i].rect[2] = (int32_t)ft;
-                    frame_metadata.faces[i].rect[3] = (int32_t)fb;
-
-                    frame_metadata.faces[i].id = i;
-                    frame_metadata.faces[i].score = CameraFaceDetect::getInstance()->get_confidence();
-                    frame_metadata.faces[i].mouth[0] = -2000; frame_metadata.faces[i].mouth[1] = -2000;
-                    lx = CameraFaceDetect::getInstance()->getLeftEyeX();
-                    ly = CameraFaceDetect::getInstance()->getLeftEyeY();
-                    rx = CameraFaceDetect::getInstance()->getRightEyeX();
-                    ry = CameraFaceDetect::getInstance()->getRightEyeY();
-                    if ((lx >= -1000 && lx <= 1000)) {
-                        ;
-                    } else {
-                        lx = lx - 1000;
-                        ly = ly - 1000;
-                        rx = rx - 1000;
-                        ry = ry - 1000;
-                    }
-                    frame_metadata.faces[i].left_eye[0] = (int32_t)lx;
-                    frame_metadata.faces[i].left_eye[1] = (int32_t)ly;
-                    frame_metadata.faces[i].right_eye[0] = (int32_t)rx;
-                    frame_metadata.faces[i].right_eye[1] = (int32_t)ry;
-                }
-
-                camera_memory_t *tmpBuffer = mget_memory(-1, 1, 1, NULL);
-                mdata_cb(CAMERA_MSG_PREVIEW_METADATA, tmpBuffer, 0, &frame_metadata,mcamera_interface);
-
-                if ( NULL != tmpBuffer ) {
-                    tmpBuffer->release(tmpBuffer);
-                    tmpBuffer = NULL;
-                }
-
-                for (int i = 0; i < mFaceCount; ++i) {
-                    delete faceRect[i];
-                    faceRect[i] = NULL;
-                }
-                delete [] faceRect;
-                faceRect = NULL;
-                   
-                if (frame_metadata.faces != NULL) {
-                    free(frame_metadata.faces);
-                    frame_metadata.faces = NULL;
-                }
+            if ((mFaceDetect->postFrame(mCurrentFrame, mCurFrameTimestamp) == NO_ERROR)
+                && (mHal1SignalFaceDetect != NULL)) {
+                mHal1SignalFaceDetect->SetSignal(SIGNAL_FACE_DETECT);
             }
         }
 
@@ -1741,21 +2136,35 @@ namespace android{
             }
 
             mTakingPicture = false;
+            repackCurrentFrame();
             int size = getCurrentFrameSize();
 
             camera_memory_t* takingPictureHeap = mget_memory(-1, size,1, NULL);
             memset(takingPictureHeap->data, 0, size);
             dmmu_map_memory((uint8_t*)takingPictureHeap->data,takingPictureHeap->size);
 
-            if(mzoomVal != 0){
+            int transform = 0;
+            bool mirrored = false;
+            {
+                AutoMutex lock(mlock);
+                transform = pictureTransform();
+            }
+
+            if(mzoomRadio != 100){
                 do_zoom((uint8_t*)takingPictureHeap->data,(uint8_t*)mCurrentFrame->yAddr);
+            } else if (transform != 0) {
+                ccc->yuyv_transform((uint8_t*)takingPictureHeap->data, mCurrentFrame->width<<1,
+                                    (uint8_t*)mCurrentFrame->yAddr, mCurrentFrame->width<<1,
+                                    mCurrentFrame->width, mCurrentFrame->height, transform);
+                mirrored = true;
             } else {
                 memcpy(takingPictureHeap->data, (uint8_t*)mCurrentFrame->yAddr,size);
             }
 
+            sp<JpegEncodeJob> job = NULL;
             {
-                AutoMutex lock(mcapture_lock);
-                mListCaptureHeap.push_back(takingPictureHeap);
+                AutoMutex lock(mlock);
+                job = createJpegJob(takingPictureHeap, mirrored);
             }
 
             if (mMesgEnabled & CAMERA_MSG_SHUTTER)
@@ -1772,137 +2181,259 @@ namespace android{
                 mdata_cb(CAMERA_MSG_RAW_IMAGE,takingPictureHeap, 0, NULL, mcamera_interface);
             }
 
-            if (mMesgEnabled & CAMERA_MSG_COMPRESSED_IMAGE)
-                mWorkerQueue->schedule(new PostJpegUnit(this));
+            scheduleJpegJob(job, CameraJpegEncodePool::PRIORITY_VIDEO_SNAPSHOT);
         }
 
         return;
     }
 
-    void CameraHal1::postJpegDataToApp(void) {
+    /* the front camera mirror when it can ride along with the copy of a yuyv still */
+    int CameraHal1::pictureTransform(void) {
 
-        if ((mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) && ccc) {
-            hardCompressJpeg();
-        } else if (mCurrentFrame->format == HAL_PIXEL_FORMAT_YCbCr_422_I
-                   || mCurrentFrame->format == HAL_PIXEL_FORMAT_YV12
-                   || mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
-            softCompressJpeg();
+        if (!mirror || ccc == NULL || mCurrentFrame == NULL
+            || mCurrentFrame->format != HAL_PIXEL_FORMAT_YCbCr_422_I) {
+            return 0;
+        }
+        const CameraParameters& params = mJzParameters->getCameraParameters();
+        return CameraColorConvert::mirror_transform(params.getInt(CameraParameters::KEY_ROTATION));
+    }
+
+    sp<CameraHal1::JpegEncodeJob> CameraHal1::createJpegJob(camera_memory_t* captureHeap, bool mirrored) {
+
+        if (captureHeap == NULL || mCurrentFrame == NULL) {
+            return NULL;
+        }
+
+        /* snapshot everything the encode needs now, the frame and the
+           parameters may both change before a worker picks this up */
+        sp<JpegEncodeJob> job = new JpegEncodeJob(this);
+        const CameraParameters& params = mJzParameters->getCameraParameters();
+
+        job->captureHeap = captureHeap;
+        job->width = mCurrentFrame->width;
+        job->height = mCurrentFrame->height;
+        job->format = mCurrentFrame->format;
+        job->pictureQuality = params.getInt(CameraParameters::KEY_JPEG_QUALITY);
+        job->thumbnailWidth = params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
+        job->thumbnailHeight = params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
+        job->thumbnailQuality = params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY);
+        job->rotation = params.getInt(CameraParameters::KEY_ROTATION);
+        if (job->thumbnailWidth < 0 || job->thumbnailHeight < 0) {
+            job->thumbnailWidth = 0;
+            job->thumbnailHeight = 0;
+        }
+
+        /*
+         * The mirror always ends up in the picture itself, viewers ignore
+         * the mirrored exif orientations. What the yuv copy did not do is
+         * done on the jpeg blocks, and the rotation is either tagged or
+         * done there too. The hardware encoder has no jpeg to transform,
+         * so it only tags the rotation and its pictures stay unmirrored.
+         */
+        int view = CameraJpegTransform::fromDegrees(job->rotation);
+        int flip = (mirror && !mirrored)
+            ? CameraColorConvert::mirror_transform(job->rotation) : 0;
+        if (job->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
+            job->transform = 0;
+        } else if (mJzParameters->is_picture_orientation_exif()) {
+            job->transform = flip;
+        } else {
+            job->transform = CameraJpegTransform::compose(flip, view);
+            view = 0;
+        }
+
+        job->exif = new ExifElementsTable();
+        if (NULL != job->exif) {
+            mJzParameters->setUpEXIF(job->exif, view,
+                                     (job->transform & HAL_TRANSFORM_ROT_90) != 0);
+        }
+        return job;
+    }
+
+    status_t CameraHal1::scheduleJpegJob(const sp<JpegEncodeJob>& job, int priority) {
+
+        if (job == NULL) {
+            return BAD_VALUE;
+        }
+
+        if (!(mMesgEnabled & CAMERA_MSG_COMPRESSED_IMAGE)) {
+            releaseJpegJob(job.get());
+            return NO_ERROR;
+        }
+
+        status_t ret = INVALID_OPERATION;
+        if (mJpegEncodePool != NULL) {
+            ret = mJpegEncodePool->schedule(job, priority);
+        }
+
+        if (ret != NO_ERROR) {
+            ALOGE("%s: schedule jpeg job fail, ret = %d",__FUNCTION__, ret);
+            releaseJpegJob(job.get());
+            if (mVideoRecEnabled) {
+                mDevice->sendCommand(STOP_PICTURE);
+            }
+            if (mMesgEnabled & CAMERA_MSG_ERROR) {
+                mnotify_cb(CAMERA_MSG_ERROR, CAMERA_ERROR_UNKNOWN, 0, mcamera_interface);
+            }
+        }
+        return ret;
+    }
+
+    status_t CameraHal1::encodeJpegJob(JpegEncodeJob* job) {
+
+        status_t ret = BAD_VALUE;
+
+        if ((job->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) && ccc) {
+            ret = hardCompressJpeg(job);
+        } else if (job->format == HAL_PIXEL_FORMAT_YCbCr_422_I
+                   || job->format == HAL_PIXEL_FORMAT_YV12
+                   || job->format == HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
+            ret = softCompressJpeg(job);
         } else {
             ALOGE("%s: don't support other format: 0x%x for compress jpeg",
-                  __FUNCTION__,mCurrentFrame->format);
+                  __FUNCTION__,job->format);
+        }
+        return ret;
+    }
+
+    void CameraHal1::deliverJpegJob(JpegEncodeJob* job, status_t status) {
+
+        if (status == NO_ERROR && job->jpegHeap != NULL && job->jpegHeap->data != NULL
+            && (mMesgEnabled & CAMERA_MSG_COMPRESSED_IMAGE)) {
+            mdata_cb(CAMERA_MSG_COMPRESSED_IMAGE, job->jpegHeap, 0, NULL, mcamera_interface);
+        } else if ((status != NO_ERROR) && (mMesgEnabled & CAMERA_MSG_ERROR)) {
+            mnotify_cb(CAMERA_MSG_ERROR, CAMERA_ERROR_UNKNOWN, 0, mcamera_interface);
         }
-        mDevice->deInitTakePicture();
+        releaseJpegJob(job);
+
         if (mVideoRecEnabled) {
             mDevice->sendCommand(STOP_PICTURE);
         }
-        return;
     }
 
-    void CameraHal1::softCompressJpeg(void) {
+    void CameraHal1::releaseJpegJob(JpegEncodeJob* job) {
+
+        if (job->captureHeap != NULL) {
+            dmmu_unmap_memory((uint8_t*)job->captureHeap->data,job->captureHeap->size);
+            job->captureHeap->release(job->captureHeap);
+            job->captureHeap = NULL;
+        }
+
+        if (job->jpegHeap != NULL) {
+            job->jpegHeap->release(job->jpegHeap);
+            job->jpegHeap = NULL;
+        }
+
+        if (job->exif != NULL) {
+            delete job->exif;
+            job->exif = NULL;
+        }
+    }
+
+    status_t CameraHal1::softCompressJpeg(JpegEncodeJob* job) {
 
         ALOGV("%s: Enter", __FUNCTION__);
 
         camera_memory_t* jpeg_buff = NULL;
-        int ret = convertCurrentFrameToJpeg(&jpeg_buff);
+        status_t ret = convertFrameToJpeg(job, &jpeg_buff);
 
         if (ret == NO_ERROR && jpeg_buff != NULL && jpeg_buff->data != NULL) {
-            mdata_cb(CAMERA_MSG_COMPRESSED_IMAGE, jpeg_buff, 0, NULL, mcamera_interface);
-            jpeg_buff->release(jpeg_buff);
-        } else if (jpeg_buff != NULL && jpeg_buff->data != NULL) {
-            jpeg_buff->release(jpeg_buff);
+            job->jpegHeap = jpeg_buff;
+        } else {
+            if (jpeg_buff != NULL && jpeg_buff->data != NULL) {
+                jpeg_buff->release(jpeg_buff);
+            }
+            if (ret == NO_ERROR)
+                ret = NO_MEMORY;
         }
+        return ret;
     }
 
-    void CameraHal1::hardCompressJpeg(void) {
+    status_t CameraHal1::hardCompressJpeg(JpegEncodeJob* job) {
 
         ALOGV("%s: Enter",__FUNCTION__);
 
         status_t ret = UNKNOWN_ERROR;
 
-        if (mListCaptureHeap.empty()) {
+        if (job->captureHeap == NULL) {
             ALOGE("%s: don't have capture heap",__FUNCTION__);
-            return;
+            return ret;
         }
 
-        int picQuality = mJzParameters->getCameraParameters().getInt(CameraParameters::KEY_JPEG_QUALITY);
-        int thumQuality = mJzParameters->getCameraParameters()
-            .getInt(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY);
+        int picQuality = job->pictureQuality;
+        int thumQuality = job->thumbnailQuality;
         if (picQuality <= 0 || picQuality == 100) picQuality = 90;
         if (thumQuality <= 0 || thumQuality == 100) thumQuality = 90;
 
-        int csize = getCurrentFrameSize();
-        int th_width = mJzParameters->getCameraParameters().
-            getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
-        int th_height =  mJzParameters->getCameraParameters().
-            getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
+        int csize = job->captureHeap->size;
+        int th_width = job->thumbnailWidth;
+        int th_height = job->thumbnailHeight;
         int ctnsize = th_width * th_height;
 
+#ifdef CAMERA_SUPPORT_VIDEOSNAPSHORT
         int jpeg_size = csize;
         int thumb_size = ctnsize;
         camera_memory_t* jpeg_buff = mget_memory(-1,csize+1000 ,1,NULL);
         camera_memory_t* jpeg_tn_buff = (ctnsize == 0) ? NULL : (mget_memory(-1, ctnsize, 1, NULL));
-        camera_memory_t* jpegMem = NULL;
-        camera_memory_t* captureHeap = NULL;
-        {
-            AutoMutex lock(mcapture_lock);
-            captureHeap = *(mListCaptureHeap.begin());
-            mListCaptureHeap.erase(mListCaptureHeap.begin());
-        }
+        camera_memory_t* captureHeap = job->captureHeap;
 
-#ifdef CAMERA_SUPPORT_VIDEOSNAPSHORT
-        CameraCompressorHW ccHW;
-        compress_params_hw_t hw_cinfo;
-        memset(&hw_cinfo, 0, sizeof(compress_params_hw_t));
-        hw_cinfo.pictureYUV420_y = (uint8_t*)(captureHeap->data);
-        hw_cinfo.pictureYUV420_c = (uint8_t*)((uint8_t*)captureHeap->data
-                                              + (mCurrentFrame->width*mCurrentFrame->height));
-        hw_cinfo.pictureWidth = mCurrentFrame->width;
-        hw_cinfo.pictureHeight = mCurrentFrame->height;
-        hw_cinfo.pictureQuality = picQuality;
-        hw_cinfo.thumbnailWidth = th_width;
-        hw_cinfo.thumbnailHeight = th_height;
-        hw_cinfo.thumbnailQuality = thumQuality;
-        hw_cinfo.format = HAL_PIXEL_FORMAT_JZ_YUV_420_B;
-        hw_cinfo.jpeg_out = (unsigned char*)(jpeg_buff->data);
-        hw_cinfo.jpeg_size = &jpeg_size;
-        hw_cinfo.th_jpeg_out = (jpeg_tn_buff==NULL) ? NULL : ((unsigned char*)(jpeg_tn_buff->data));
-        hw_cinfo.th_jpeg_size = &thumb_size;
-        hw_cinfo.tlb_addr = mDevice->getTlbBase();
-        hw_cinfo.requiredMem = mget_memory;
-
-        ccHW.setPrameters(&hw_cinfo);
-        ccHW.hw_compress_to_jpeg();
-
-        ExifElementsTable* exif = new ExifElementsTable();
-        if (NULL != exif) {
-            mJzParameters->setUpEXIF(exif);
+        {
+            /* there is only one vpu, encodes queue up here */
+            AutoMutex lock(mhwjpeg_lock);
+            CameraCompressorHW ccHW;
+            compress_params_hw_t hw_cinfo;
+            memset(&hw_cinfo, 0, sizeof(compress_params_hw_t));
+            hw_cinfo.pictureYUV420_y = (uint8_t*)(captureHeap->data);
+            hw_cinfo.pictureYUV420_c = (uint8_t*)((uint8_t*)captureHeap->data
+                                                  + (job->width*job->height));
+            hw_cinfo.pictureWidth = job->width;
+            hw_cinfo.pictureHeight = job->height;
+            hw_cinfo.pictureQuality = picQuality;
+            hw_cinfo.thumbnailWidth = th_width;
+            hw_cinfo.thumbnailHeight = th_height;
+            hw_cinfo.thumbnailQuality = thumQuality;
+            hw_cinfo.format = HAL_PIXEL_FORMAT_JZ_YUV_420_B;
+            hw_cinfo.jpeg_out = (unsigned char*)(jpeg_buff->data);
+            hw_cinfo.jpeg_size = &jpeg_size;
+            hw_cinfo.th_jpeg_out = (jpeg_tn_buff==NULL) ? NULL : ((unsigned char*)(jpeg_tn_buff->data));
+            hw_cinfo.th_jpeg_size = &thumb_size;
+            hw_cinfo.tlb_addr = mDevice->getTlbBase();
+            hw_cinfo.requiredMem = mget_memory;
+
+            ccHW.setPrameters(&hw_cinfo);
+            ccHW.hw_compress_to_jpeg();
+
+            if (NULL != jpeg_tn_buff && jpeg_tn_buff->data != NULL
+                && th_width*th_height < job->width*job->height) {
+                ccHW.rgb565_to_jpeg((uint8_t*)jpeg_tn_buff->data,
+                                    &thumb_size,(uint8_t*)(captureHeap->data),
+                                    th_width, th_height,thumQuality);
+            }
+        }
+
+        if (NULL != job->exif) {
+            AutoMutex lock(ExifElementsTable::sJheadLock);
+            ExifElementsTable* exif = job->exif;
             exif->insertExifToJpeg((unsigned char*)(jpeg_buff->data),jpeg_size);
             if (NULL != jpeg_tn_buff
                 && jpeg_tn_buff->data != NULL) {
-                if (th_width*th_height >= mCurrentFrame->width*mCurrentFrame->height) {
+                if (th_width*th_height >= job->width*job->height) {
                     exif->insertExifThumbnailImage((const char*)(jpeg_buff->data), (int)jpeg_size);
                 } else {
-                    ccHW.rgb565_to_jpeg((uint8_t*)jpeg_tn_buff->data,
-                                        &thumb_size,(uint8_t*)(captureHeap->data),
-                                        th_width, th_height,thumQuality);
                     exif->insertExifThumbnailImage((const char*)(jpeg_tn_buff->data), (int)thumb_size);
                 }
             }
             Section_t* exif_section = NULL;
             exif_section = FindSection(M_EXIF);
             if (NULL != exif_section) {
-                jpegMem = mget_memory(-1, (jpeg_size + exif_section->Size), 1, NULL);
+                camera_memory_t* jpegMem = mget_memory(-1, (jpeg_size + exif_section->Size), 1, NULL);
                 if ((NULL != jpegMem) && (jpegMem->data != NULL)) {
                     exif->saveJpeg((unsigned char*)(jpegMem->data),(jpeg_size + exif_section->Size));
-                    mdata_cb(CAMERA_MSG_COMPRESSED_IMAGE, jpegMem, 0, NULL, mcamera_interface);
-                    jpegMem->release(jpegMem);
-                    jpegMem = NULL;
+                    job->jpegHeap = jpegMem;
+                    ret = NO_ERROR;
                 }
             }
         }
-#else
-        mdata_cb(CAMERA_MSG_COMPRESSED_IMAGE, captureHeap, 0, NULL, mcamera_interface);
-#endif
 
         if (jpeg_buff != NULL) {
             jpeg_buff->release(jpeg_buff);
@@ -1913,81 +2444,63 @@ namespace android{
             jpeg_tn_buff->release(jpeg_tn_buff);
             jpeg_tn_buff = NULL;
         }
-
-        if (jpegMem) {
-            jpegMem->release(jpegMem);
-            jpegMem = NULL;
-        }
-
-        if (captureHeap != NULL) {
-            dmmu_unmap_memory((uint8_t*)captureHeap->data,captureHeap->size);
-            captureHeap->release(captureHeap);
-            captureHeap = NULL;
-        }
+#else
+        /* no encoder for tile420, hand the raw frame over as before */
+        job->jpegHeap = job->captureHeap;
+        dmmu_unmap_memory((uint8_t*)job->captureHeap->data,job->captureHeap->size);
+        job->captureHeap = NULL;
+        ret = NO_ERROR;
+#endif
+        return ret;
     }
 
-    status_t CameraHal1::convertCurrentFrameToJpeg(camera_memory_t** jpeg_buff) {
+    status_t CameraHal1::convertFrameToJpeg(JpegEncodeJob* job, camera_memory_t** jpeg_buff) {
 
         status_t ret = UNKNOWN_ERROR;
         camera_memory_t* tmp_buf = NULL;
+        camera_memory_t* captureHeap = job->captureHeap;
 
-        if (mListCaptureHeap.empty()) {
+        if (captureHeap == NULL) {
             ALOGE("%s: don't have capture heap",__FUNCTION__);
             return ret;
         }
 
-        int picQuality = mJzParameters->getCameraParameters().getInt(CameraParameters::KEY_JPEG_QUALITY);
-        int thumQuality = mJzParameters->getCameraParameters()
-            .getInt(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY);
+        int picQuality = job->pictureQuality;
+        int thumQuality = job->thumbnailQuality;
         if (picQuality <= 0 || picQuality == 100) picQuality = 75;
         if (thumQuality <= 0 || thumQuality == 100) thumQuality = 75;
 
         compress_params_t params;
         memset(&params, 0, sizeof(compress_params_t));
-        camera_memory_t* captureHeap = NULL;
-        {
-            AutoMutex lock(mcapture_lock);
-            captureHeap = *(mListCaptureHeap.begin());
-            mListCaptureHeap.erase(mListCaptureHeap.begin());
-        }
-        if (ccc && (mCurrentFrame->format == HAL_PIXEL_FORMAT_YV12
-                    || mCurrentFrame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_P)) {
+        if (ccc && (job->format == HAL_PIXEL_FORMAT_YV12
+                    || job->format == HAL_PIXEL_FORMAT_JZ_YUV_420_P)) {
             tmp_buf = mget_memory(-1,captureHeap->size,1,NULL);
             ccc->yuv420p_to_yuv420sp((uint8_t*)(captureHeap->data),
-                                     (uint8_t*)tmp_buf->data,mCurrentFrame->width,mCurrentFrame->height);
+                                     (uint8_t*)tmp_buf->data,job->width,job->height);
             params.src = (uint8_t*)(tmp_buf->data);
             params.format = HAL_PIXEL_FORMAT_YCrCb_420_SP;
         } else {
             params.src = (uint8_t*)(captureHeap->data);
-            params.format = mCurrentFrame->format;
+            params.format = job->format;
         }
-        params.pictureWidth = mCurrentFrame->width;
-        params.pictureHeight = mCurrentFrame->height;
+        params.pictureWidth = job->width;
+        params.pictureHeight = job->height;
         params.pictureQuality = picQuality;
-        params.thumbnailWidth =
-            mJzParameters->getCameraParameters()
-            .getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
-        params.thumbnailHeight =
-            mJzParameters->getCameraParameters()
-            .getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
+        params.thumbnailWidth = job->thumbnailWidth;
+        params.thumbnailHeight = job->thumbnailHeight;
         params.thumbnailQuality = thumQuality;
         params.jpegSize = 0;
+        params.transform = job->transform;
         params.requiredMem = mget_memory;
 
-        int rot = mJzParameters->getCameraParameters()
-            .getInt(CameraParameters::KEY_ROTATION);
-        CameraCompressor compressor(&params,mirror,rot);
-        ExifElementsTable* exif = new ExifElementsTable();
-        if (NULL != exif) {
-            mJzParameters->setUpEXIF(exif);
+        CameraCompressor compressor(&params);
+        if (NULL != job->exif) {
+            /* compress_to_jpeg takes the exif table over */
+            ExifElementsTable* exif = job->exif;
+            job->exif = NULL;
             ret = compressor.compress_to_jpeg(exif, jpeg_buff);
         }
 
-        if (captureHeap != NULL) {
-            dmmu_unmap_memory((uint8_t*)captureHeap->data,captureHeap->size);
-            captureHeap->release(captureHeap);
-            captureHeap = NULL;
-        }
         if (tmp_buf != NULL) {
             tmp_buf->release(tmp_buf);
             tmp_buf = NULL;
@@ -1996,6 +2509,50 @@ namespace android{
     }
 
 
+    void CameraHal1::completeFaceDetect(void) {
+
+        AutoMutex lock(mface_detect_lock);
+
+        if (!isSoftFaceDetectStart) {
+            return;
+        }
+
+        nsecs_t timestamp = 0;
+        int faceCount = mFaceDetect->detectPendingFrame(&timestamp);
+        if (faceCount < 0) {
+            return;
+        }
+
+        mFaceCount = faceCount;
+        if (systemTime(SYSTEM_TIME_MONOTONIC) - timestamp > FACE_DETECT_MAX_LATENCY) {
+            ALOGV("%s: drop faces of frame %lld, too late",__FUNCTION__, timestamp);
+            return;
+        }
+        sendFaceMetadata(faceCount, timestamp);
+    }
+
+    /* called on the face detect thread with mface_detect_lock held */
+    void CameraHal1::sendFaceMetadata(int faceCount, nsecs_t timestamp) {
+
+        ALOGV("%s: %d faces of frame %lld",__FUNCTION__, faceCount, timestamp);
+
+        if ((mMesgEnabled & CAMERA_MSG_PREVIEW_METADATA) && (isSoftFaceDetectStart == true)
+            && (faceCount > 0) && (mFaceMetadataHeap != NULL)) {
+            camera_frame_metadata_t frame_metadata;
+            /* faces come from the software detector, cap them with its key */
+            int maxFaces = mJzParameters->getCameraParameters()
+                .getInt(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_SW);
+            if ((maxFaces <= 0) || (maxFaces > FACE_DETECT_MAX_TRACKS))
+                maxFaces = FACE_DETECT_MAX_TRACKS;
+
+            frame_metadata.faces = mFaceMetadata;
+            frame_metadata.number_of_faces =
+                mFaceDetect->getFaces(mFaceMetadata, maxFaces);
+            mdata_cb(CAMERA_MSG_PREVIEW_METADATA, mFaceMetadataHeap, 0,
+                     &frame_metadata, mcamera_interface);
+        }
+    }
+
     status_t CameraHal1::softFaceDetectStart(int32_t detect_type) {
 
         int w = mRawPreviewWidth;
@@ -2029,7 +2586,11 @@ namespace android{
 
         ALOGV("%s: max Face = %d", __FUNCTION__,maxFaces);
 
-        res = CameraFaceDetect::getInstance()->initialize(w, h, maxFaces);
+        AutoMutex lock(mface_detect_lock);
+        if ((mFaceMetadataHeap == NULL) && (mget_memory != NULL)) {
+            mFaceMetadataHeap = mget_memory(-1, 1, 1, NULL);
+        }
+        res = mFaceDetect->initialize(w, h, maxFaces);
         if (res == NO_ERROR) {
             isSoftFaceDetectStart = true;
         } else {
@@ -2040,505 +2601,23 @@ namespace android{
     }
 
     status_t CameraHal1::softFaceDetectStop(void) {
+        AutoMutex lock(mface_detect_lock);
+        if (mFaceMetadataHeap != NULL) {
+            mFaceMetadataHeap->release(mFaceMetadataHeap);
+            mFaceMetadataHeap = NULL;
+        }
         if (isSoftFaceDetectStart) {
             isSoftFaceDetectStart = false;
-            CameraFaceDetect::getInstance()->deInitialize();
+            mFaceDetect->deInitialize();
         }
         return NO_ERROR;
     }
 
-    void CameraHal1::x2d_convert_dataformat(CameraYUVMeta* yuvMeta, 
-                                            uint8_t* dst_buf, buffer_handle_t *buffer) {
-
-        struct jz_x2d_config x2d_cfg;
-        IMG_native_handle_t* dst_handle = NULL;
-        int map_size = 0;
-        int ret = NO_ERROR;
-
-        if (x2d_fd < 0) {
-            ALOGE("%s: open %s error or not open it", __FUNCTION__, X2D_NAME);
-            return;
-        }
-
-        dst_handle = (IMG_native_handle_t*)(*buffer);
-        map_size = mPreviewWinWidth * mPreviewWinHeight * mPrebytesPerPixel;
-        dmmu_map_memory((uint8_t*)dst_buf,map_size);
-
-        mDevice->flushCache((void*)yuvMeta->yAddr, map_size);
-        /* set dst configs */
-        x2d_cfg.dst_address = (int)dst_buf;
-        x2d_cfg.dst_width = mPreviewWinWidth;//dst_handle->iWidth;
-        x2d_cfg.dst_height = mPreviewWinHeight;//dst_handle->iHeight;
-        if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGB_565)
-            x2d_cfg.dst_format = X2D_OUTFORMAT_RGB565;
-        else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGBA_8888
-                 || mPreviewWinFmt == HAL_PIXEL_FORMAT_RGBX_8888
-                 || mPreviewWinFmt == HAL_PIXEL_FORMAT_BGRA_8888)
-            x2d_cfg.dst_format = X2D_OUTFORMAT_XRGB888;
-        else if (mPreviewWinFmt == HAL_PIXEL_FORMAT_RGB_888)
-            x2d_cfg.dst_format = X2D_OUTFORMAT_ARGB888;
-        x2d_cfg.dst_stride = mPreviewWinWidth * mPrebytesPerPixel;
-        //dst_handle->iStride * (dst_handle->uiBpp >> 3);
-        x2d_cfg.dst_back_en = 0;
-        x2d_cfg.dst_glb_alpha_en = 1;
-        x2d_cfg.dst_preRGB_en = 0;
-        x2d_cfg.dst_mask_en = 1;
-        x2d_cfg.dst_alpha_val = 0x80;
-        x2d_cfg.dst_bcground = 0xff0ff0ff;
-
-        x2d_cfg.tlb_base = mDevice->getTlbBase();
-
-        /* layer num */
-        x2d_cfg.layer_num = 1;
-
-        /* src yuv address */
-        if (yuvMeta->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
-            x2d_cfg.lay[0].addr = yuvMeta->yAddr;
-            x2d_cfg.lay[0].u_addr = yuvMeta->yAddr + (yuvMeta->width*yuvMeta->height);
-
-            x2d_cfg.lay[0].v_addr = (int)(x2d_cfg.lay[0].u_addr);
-            x2d_cfg.lay[0].y_stride = yuvMeta->yStride/16;
-            x2d_cfg.lay[0].v_stride = yuvMeta->vStride/16;
-
-            /* src data format */
-            x2d_cfg.lay[0].format = X2D_INFORMAT_TILE420;
-        } else if (yuvMeta->format ==  HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
-            x2d_cfg.lay[0].addr = yuvMeta->yAddr;
-            x2d_cfg.lay[0].u_addr = yuvMeta->uAddr;
-            x2d_cfg.lay[0].v_addr = yuvMeta->vAddr;
-            x2d_cfg.lay[0].y_stride = yuvMeta->yStride;
-            x2d_cfg.lay[0].v_stride = yuvMeta->vStride;
-
-            /* src data format */
-            x2d_cfg.lay[0].format = X2D_INFORMAT_YUV420SP;
-        } else {
-            ALOGE("%s: preview format %d not support",__FUNCTION__, yuvMeta->format);
-            return;
-        }
-
-        /* src rotation degree */
-        x2d_cfg.lay[0].transform = X2D_ROTATE_0;
-
-        /* src input geometry && output geometry */
-        x2d_cfg.lay[0].in_width =  yuvMeta->width;
-        x2d_cfg.lay[0].in_height = yuvMeta->height;
-        x2d_cfg.lay[0].out_width = mPreviewWinWidth;//dst_handle->iWidth;
-        x2d_cfg.lay[0].out_height = mPreviewWinHeight;//dst_handle->iHeight;
-        x2d_cfg.lay[0].out_w_offset = 0;
-        x2d_cfg.lay[0].out_h_offset = 0;
-        x2d_cfg.lay[0].mask_en = 0;
-        x2d_cfg.lay[0].msk_val = 0xffffffff;
-        x2d_cfg.lay[0].glb_alpha_en = 1;
-        x2d_cfg.lay[0].global_alpha_val = 0xff;
-        x2d_cfg.lay[0].preRGB_en = 1;
-
-        /* src scale ratio set */
-        float v_scale, h_scale;
-        switch (x2d_cfg.lay[0].transform) {
-        case X2D_H_MIRROR:
-        case X2D_V_MIRROR:
-        case X2D_ROTATE_0:
-        case X2D_ROTATE_180:
-            h_scale = (float)x2d_cfg.lay[0].in_width / (float)x2d_cfg.lay[0].out_width;
-            v_scale = (float)x2d_cfg.lay[0].in_height / (float)x2d_cfg.lay[0].out_height;
-            x2d_cfg.lay[0].h_scale_ratio = (int)(h_scale * X2D_SCALE_FACTOR);
-            x2d_cfg.lay[0].v_scale_ratio = (int)(v_scale * X2D_SCALE_FACTOR);
-            break;
-        case X2D_ROTATE_90:
-        case X2D_ROTATE_270:
-            h_scale = (float)x2d_cfg.lay[0].in_width / (float)x2d_cfg.lay[0].out_height;
-            v_scale = (float)x2d_cfg.lay[0].in_height / (float)x2d_cfg.lay[0].out_width;
-            x2d_cfg.lay[0].h_scale_ratio = (int)(h_scale * X2D_SCALE_FACTOR);
-            x2d_cfg.lay[0].v_scale_ratio = (int)(v_scale * X2D_SCALE_FACTOR);
-            break;
-        default:
-            dmmu_unmap_memory((uint8_t*)dst_buf,map_size);
-            ALOGE("%s %s %d:undefined rotation degree!!!!", __FILE__, __FUNCTION__, __LINE__);
-            return;
-        }
-
-        /* ioctl set configs */
-        ret = ioctl(x2d_fd, IOCTL_X2D_SET_CONFIG, &x2d_cfg);
-        if (ret < 0) {
-            dmmu_unmap_memory((uint8_t*)dst_buf,map_size);
-            ALOGE("%s %s %d: IOCTL_X2D_SET_CONFIG failed", __FILE__, __FUNCTION__, __LINE__);
-            return ;
-        }
-
-        /* ioctl start compose */
-        ret = ioctl(x2d_fd, IOCTL_X2D_START_COMPOSE);
-        if (ret < 0) {
-            dmmu_unmap_memory((uint8_t*)dst_buf,map_size);
-            ALOGE("%s %s %d: IOCTL_X2D_START_COMPOSE failed", __FILE__, __FUNCTION__, __LINE__);
-            return ;
-        }
-        dmmu_unmap_memory((uint8_t*)dst_buf,map_size);
-    }
-
-    void CameraHal1::ipu_convert_dataformat(CameraYUVMeta* yuvMeta,
-                                            uint8_t* dst_buf, buffer_handle_t *buffer) {
-
-        struct source_data_info *srcInfo;
-        struct ipu_data_buffer* srcBuf;
-        struct dest_data_info* dstInfo;
-        struct ipu_data_buffer* dstBuf;
-
-        int err = 0;
-        static int oldzoomval = 0;
-        int must_do = 0;
-        int bytes_per_pixel = 2;
-        int cropLeft = 0;
-        int cropTop = 0;
-        int offset = 0;
-        int map_size = 0;
-
-        if (ipu_open_status == false) {
-            ALOGE("%s: open ipu error or not open it", __FUNCTION__);
-            return;
-        }
-
-        map_size = mPreviewWinWidth * mPreviewWinHeight * mPrebytesPerPixel;
-        dmmu_map_memory((uint8_t*)dst_buf,map_size);
-
-        mDevice->flushCache((void*)yuvMeta->yAddr, map_size);
-        mzoomVal = mJzParameters->getCameraParameters().getInt(CameraParameters::KEY_ZOOM);
-        switch(mzoomVal){
-        case 0:
-            mzoomRadio = 100;
-            break;
-        case 1:
-            mzoomRadio = 200;
-            break;
-        case 2:
-            mzoomRadio = 250;
-            break;
-        case 3:
-            mzoomRadio = 250;
-            break;
-        case 4:
-            mzoomRadio = 400;
-            break;
-        }
-
-        if(mzoomVal != oldzoomval){
-            oldzoomval = mzoomVal;
-            must_do = 1;
-        }
-
-        srcInfo = &(mipu->src_info);
-        srcBuf = &(mipu->src_info.srcBuf);
-        memset(srcInfo, 0, sizeof(struct source_data_info));
-        srcInfo->fmt = yuvMeta->format;
-        srcInfo->is_virt_buf = 1;
-        srcInfo->width = num2even(yuvMeta->width * 100 / mzoomRadio);
-        srcInfo->height = num2even(yuvMeta->height * 100 / mzoomRadio);
-        srcInfo->stlb_base = mDevice->getTlbBase();
-
-        cropLeft = num2even((mPreviewWinWidth - srcInfo->width) / 2);
-        cropLeft = (cropLeft < 0) ? 0 : cropLeft;
-        cropTop = num2even((mPreviewWinHeight - srcInfo->height) / 2);
-        cropTop = (cropTop < 0) ? 0 : cropTop;
-        offset = (cropTop * mPreviewWinWidth + cropLeft) * bytes_per_pixel;
-        offset = (offset < 0) ? 0 : offset;
-        ALOGV("srcInfo->width = %d, srcInfo->height = %d, cropLeft =%d, cropTop = %d, offset = %d, mzoomRadio: %d",
-               srcInfo->width, srcInfo->height, cropLeft, cropTop, offset, mzoomRadio);
-
-        if (yuvMeta->format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
-            srcBuf->y_buf_v = (void*)(yuvMeta->yAddr + offset);
-            srcBuf->u_buf_v = (void*)(yuvMeta->yAddr + offset);
-            srcBuf->v_buf_v = (void*)(yuvMeta->yAddr + offset);
-
-            if (mDevice->usePmem()) {
-                srcBuf->y_buf_phys = yuvMeta->yPhy + offset; 
-                srcBuf->u_buf_phys = 0;
-                srcBuf->v_buf_phys = 0;
-            } else {
-                srcBuf->y_buf_phys = 0;
-                srcBuf->u_buf_phys = 0;
-                srcBuf->v_buf_phys = 0;
-            }
-
-            srcBuf->y_stride = yuvMeta->yStride;
-            srcBuf->u_stride = yuvMeta->uStride;
-            srcBuf->v_stride = yuvMeta->vStride;
-        } else if (yuvMeta->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
-            srcBuf->y_buf_v = (void*)yuvMeta->yAddr;
-            srcBuf->u_buf_v = (void*)(yuvMeta->yAddr + (yuvMeta->width*yuvMeta->height)) ;
-            srcBuf->v_buf_v = (void*)srcBuf->u_buf_v;
-            srcBuf->y_stride = yuvMeta->yStride;
-            srcBuf->u_stride = yuvMeta->uStride;
-            srcBuf->v_stride = yuvMeta->vStride;
-        } else if (yuvMeta->format ==  HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
-            srcBuf->y_buf_v = (void*)yuvMeta->yAddr;
-            srcBuf->u_buf_v = (void*)yuvMeta->uAddr;
-            srcBuf->v_buf_v = (void*)yuvMeta->vAddr;
-
-            if (mDevice->usePmem()) {
-                srcBuf->y_buf_phys = yuvMeta->yPhy;
-                srcBuf->u_buf_phys = yuvMeta->uPhy;
-                srcBuf->v_buf_phys = yuvMeta->vPhy;
-            } else {
-                srcBuf->y_buf_phys = 0;
-                srcBuf->u_buf_phys = 0;
-                srcBuf->v_buf_phys = 0;
-            }
-
-            srcBuf->y_stride = yuvMeta->yStride;
-            srcBuf->u_stride = yuvMeta->uStride;
-            srcBuf->v_stride = yuvMeta->vStride;
-        } else {
-            ALOGE("%s: preview format %d not support",__FUNCTION__, mCurrentFrame->format);
-            dmmu_unmap_memory((uint8_t*)dst_buf,map_size);
-            return;
-        }
-
-        dstInfo = &(mipu->dst_info);
-        dstBuf = &(dstInfo->dstBuf);
-        memset(dstInfo, 0, sizeof(struct dest_data_info));
-
-        dstInfo->dst_mode = IPU_OUTPUT_TO_FRAMEBUFFER | IPU_OUTPUT_BLOCK_MODE;
-        dstInfo->fmt = mPreviewWinFmt;
-        dstInfo->dtlb_base = mDevice->getTlbBase();
-
-        dstInfo->left = 0;
-        dstInfo->top = 0;
-        dstInfo->width = mPreviewWinWidth;
-        dstInfo->height = mPreviewWinHeight;
-
-        dstInfo->out_buf_v = dst_buf;
-        dstBuf->y_buf_v = (void*)(dst_buf);
-        dstBuf->y_stride = mPreviewWinWidth * mPrebytesPerPixel;
-        err = init_ipu_dev(yuvMeta->width, yuvMeta->height, yuvMeta->format, must_do);
-        if (err < 0) {
-            ALOGE("ipu init failed ipuHalder = %p", mipu);
-            dmmu_unmap_memory((uint8_t*)dst_buf,map_size);
-            return;
-        }
-        ipu_postBuffer(mipu);
-        dmmu_unmap_memory((uint8_t*)dst_buf,map_size);
-    }
-
     status_t CameraHal1::ipu_zoomIn_scale(uint8_t* dest, int dest_width, int dest_height,
                                           uint8_t* src, int src_width, int src_height, int src_format,
                                           int stride_mul, int src_stride) {
-
-        struct source_data_info *srcInfo;
-        struct ipu_data_buffer* srcBuf;
-        struct dest_data_info* dstInfo;
-        struct ipu_data_buffer* dstBuf;
-
-        int err = 0;
-        int stride_shift = 0;
-        int must_do = 0;
-        int map_size = 0;
-        static int oldzoomval = 0;
-
-        if (ipu_open_status == false) {
-            ALOGE("%s: open ipu error or not open it", __FUNCTION__);
-            return BAD_VALUE;
-        }
-
-        if (src_format != HAL_PIXEL_FORMAT_YCbCr_422_I
-            && src_format != HAL_PIXEL_FORMAT_JZ_YUV_420_P
-            && src_format != HAL_PIXEL_FORMAT_YV12
-            && src_format != HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
-            ALOGE("%s: don't support format 0x%x for up scale",__FUNCTION__,
-                  src_format);
-            return BAD_VALUE;
-        }
-
-        if(stride_mul == 2){
-            stride_shift = 1;
-            must_do = 1;
-        }else{
-            stride_shift = 0;
-            if((mzoomVal == 1) && (dest_width == 1600)) {
-                must_do = 1;
-            } else {
-                must_do = 0;
-            }
-        }
-
-        srcInfo = &(mipu->src_info);
-        srcBuf = &(mipu->src_info.srcBuf);
-        memset(srcInfo, 0, sizeof(struct source_data_info));
-        srcInfo->fmt = src_format;
-        srcInfo->is_virt_buf = 1;
-        srcInfo->width = src_width;
-        srcInfo->height = src_height;
-        srcInfo->stlb_base = mDevice->getTlbBase();
-
-        if (src_format == HAL_PIXEL_FORMAT_YV12
-            || src_format == HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
-            srcBuf->y_buf_v = (void*)src;
-            srcBuf->u_buf_v = (void*)(src + src_width*src_height);
-            srcBuf->v_buf_v = (void*)((uint8_t*)srcBuf->u_buf_v + (src_width*src_height>>2));
-            srcBuf->y_stride = src_width;
-            srcBuf->u_stride = src_width>>1;
-            srcBuf->v_stride = src_width>>1;
-        } else if (src_format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
-            srcBuf->y_buf_v = (void*)src;
-            srcBuf->u_buf_v = (void*)src;
-            srcBuf->v_buf_v = (void*)src;
-            srcBuf->y_stride = src_stride<<1 << stride_shift;
-            srcBuf->u_stride = src_stride<<1 << stride_shift;
-            srcBuf->v_stride = src_stride<<1 << stride_shift;
-        } else if (src_format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
-            srcBuf->y_buf_v = (void*)src;
-            srcBuf->u_buf_v = (void*)(src + (src_width*src_height));
-            srcBuf->v_buf_v = srcBuf->u_buf_v;
-            srcBuf->y_stride = src_width;
-            srcBuf->u_stride = src_width>>1;
-            srcBuf->v_stride = src_width>>1;
-        }
-        //-----------------------------
-        map_size = dest_width * dest_height * 2;
-        dmmu_map_memory((uint8_t*)dest,map_size);
-
-        mDevice->flushCache((void*)src, map_size);
-
-        dstInfo = &(mipu->dst_info);
-        dstBuf = &(dstInfo->dstBuf);
-        memset(dstInfo, 0, sizeof(struct dest_data_info));
-        dstInfo->dst_mode = IPU_OUTPUT_TO_FRAMEBUFFER
-            | IPU_OUTPUT_BLOCK_MODE;
-        dstInfo->fmt = src_format;
-        dstInfo->dtlb_base = mDevice->getTlbBase();
-
-        dstInfo->left = 0;
-        dstInfo->top = 0;
-        dstInfo->width = dest_width;
-        dstInfo->height = dest_height;
-        dstInfo->out_buf_v = dest;
-        if (src_format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
-            dstBuf->y_buf_v = (void*)(dest);
-            dstBuf->u_buf_v = (void*)(dest);
-            dstBuf->v_buf_v = (void*)(dest);
-            dstBuf->y_stride = dest_width<<1 << stride_shift;
-            dstBuf->u_stride = dest_width<<1 << stride_shift;
-            dstBuf->v_stride = dest_width<<1 << stride_shift;
-        } else if (src_format == HAL_PIXEL_FORMAT_JZ_YUV_420_P
-                   || src_format == HAL_PIXEL_FORMAT_YV12) {
-            dstBuf->y_buf_v = (void*)(dest);
-            dstBuf->u_buf_v = (void*)(dest + dest_width*dest_height);
-            dstBuf->v_buf_v = (void*)((uint8_t*)dstBuf->u_buf_v + (dest_width*dest_height>>2));
-            dstBuf->y_stride = dest_width;
-            dstBuf->u_stride = dest_width>>1;
-            dstBuf->v_stride = dest_width>>1;
-        } else if (src_format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) {
-            dstBuf->y_buf_v = (void*)(dest);
-            dstBuf->u_buf_v = (void*)(dest + dest_width*dest_height);
-            dstBuf->v_buf_v = dstBuf->u_buf_v;
-            dstBuf->y_stride = dest_width;
-            dstBuf->u_stride = dest_width>>1;
-            dstBuf->v_stride = dest_width>>1;
-        }
-
-        err = init_ipu_dev(src_width,src_height,src_format, must_do);
-        if (err < 0) {
-            ALOGE("ipu init failed ipuHalder = %p", mipu);
-            dmmu_unmap_memory((uint8_t*)dest,map_size);
-            return BAD_VALUE;
-        }
-
-        ipu_postBuffer(mipu);
-        dmmu_unmap_memory((uint8_t*)dest,map_size);
-        return NO_ERROR;
-    }
-
-    void CameraHal1::open_ipu_dev(void) {
-
-        if (ipu_open_status)
-            return;
-
-        if (ipu_open(&mipu) < 0) {
-            ALOGE("ipu_open() failed ipuHandler");
-            if (mipu != NULL) ipu_close(&mipu);
-            mipu = NULL;
-            ipu_open_status = false;
-            init_ipu_first = true;
-            return ;
-        }
-
-        ipu_open_status = true;
-        init_ipu_first = true;
-        return ;
-    }
-
-    int CameraHal1::init_ipu_dev(int w, int h, int mat, int must_do) {
-
-        static int width = 0;
-        static int height= 0;
-        static int format = 0;
-
-        if (!ipu_open_status)
-            return -1;
-
-        if (init_ipu_first) {
-            init_ipu_first = false;
-            width = 0;
-            height = 0;
-            format = 0;
-        }
-
-        if (w != width || h != height || mat != format || must_do != 0) {
-
-            width = w;
-            height = h;
-            format = mat;
-
-            ALOGV("%s: width: %d, height: %d, format: 0x%x,must_do: %d",
-                  __FUNCTION__, width, height, format,must_do);
-
-            if((mzoomVal == 1) && (must_do == 1) && (w == 800))
-                init_ipu_first = true;
-
-            if (ipu_init(mipu) < 0) {
-                if (mipu != NULL) ipu_close(&mipu);
-                mipu = NULL;
-                ipu_open_status = false;
-                init_ipu_first = true;
-                ALOGE("%s: ipu init fail",__FUNCTION__);
-                return -1;
-            }
-        }
-        return 0;
-    }
-
-    void CameraHal1::close_ipu_dev(void) {
-
-        AutoMutex lock(mlock);
-
-        if (ipu_open_status == false)
-            return;
-
-        int err = 0;
-        if (mipu != NULL) err = ipu_close(&mipu);
-        if (err < 0) {
-            ALOGE("ipu_close failed ipuHalder = %p", mipu);
-        }
-        mipu = NULL;
-        ipu_open_status = false;
-        init_ipu_first = true;
-    }
-
-    void CameraHal1::open_x2d_dev(void) {
-
-        x2d_fd = open (X2D_NAME, O_RDWR);
-        if (x2d_fd < 0) {
-            ALOGE("%s: open %s error, %s",
-                  __FUNCTION__, X2D_NAME, strerror(errno));
-        }
-    }
-
-    void CameraHal1::close_x2d_dev(void) {
-
-        AutoMutex lock(mlock);
-
-        if (x2d_fd > 0) {
-            close(x2d_fd);
-            x2d_fd = -1;
-        }
+        return mConverter->scale(dest, dest_width, dest_height, src, src_width, src_height,
+                                 src_format, stride_mul, src_stride, mzoomRadio);
     }
 
     void CameraHal1::dump_data(bool isdump) {
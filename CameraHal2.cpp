@@ -25,8 +25,19 @@ namespace android{
          mCamera2_notify_callback(NULL),
          mNotifyUserPtr(NULL),
          mActive(false), 
-         mRequestCount(0),
-         mRequest(NULL) {
+         mRequest(NULL),
+         ccc(NULL),
+         mFrameCache(NULL),
+         mCaptureLock("CameraHal2::CaptureLock"),
+         mCaptureRunning(false),
+         mCaptureWidth(0),
+         mCaptureHeight(0),
+         mJpegQuality(JPEG_DEFAULT_QUALITY),
+         mOutputLock("CameraHal2::OutputLock"),
+         mFlushing(false),
+         mReprocessAllocated(false),
+         mResultTemplate(NULL),
+         mResultTimestampIndex(0) {
 
         mDevice = device;
         if (mDevice != NULL) {
@@ -48,7 +59,12 @@ namespace android{
                 mVendorTagOps.get_camera_vendor_tag_name = CameraHal2::get_camera_vendor_tag_name;
                 mVendorTagOps.get_camera_vendor_tag_type = CameraHal2::get_camera_vendor_tag_type;
             }
+
+            ccc = new CameraColorConvert();
+            mFrameCache = new CameraFrameCache(ccc);
         }
+        memset(&mReprocessParameters, 0, sizeof(reprocess_parameters_t));
+        mReprocessParameters.sourceStreamId = -1;
     }
      
     CameraHal2::~CameraHal2() {
@@ -62,6 +78,21 @@ namespace android{
             delete mCameraModuleDev;
             mCameraModuleDev = NULL;
         }
+
+        if (NULL != mFrameCache) {
+            delete mFrameCache;
+            mFrameCache = NULL;
+        }
+
+        if (NULL != ccc) {
+            delete ccc;
+            ccc = NULL;
+        }
+
+        if (NULL != mResultTemplate) {
+            free_camera_metadata(mResultTemplate);
+            mResultTemplate = NULL;
+        }
     }
 
     void CameraHal2::update_device(CameraDeviceCommon* device) {
@@ -91,6 +122,34 @@ namespace android{
     int CameraHal2::device_Close(void) {
 
         if (mModuleOpened) {
+            for (int i = 0; i < NUM_MAX_STREAM_THREAD; ++i) {
+                sp<StreamThread> stream = NULL;
+                {
+                    AutoMutex lock(mLock);
+                    stream = m_streamThreads[i];
+                    m_streamThreads[i].clear();
+                }
+                if (stream != NULL) {
+                    releaseStreamThread(stream);
+                }
+            }
+
+            if (m_mainThread != NULL) {
+                m_mainThread->release();
+                m_mainThread->requestExitAndWait();
+                m_mainThread.clear();
+            }
+
+            {
+                AutoMutex lock(mCaptureLock);
+                stopCapture();
+            }
+            mDevice->disConnectDevice();
+
+            {
+                AutoMutex lock(mInputMutex);
+                mActive = false;
+            }
             mCameraModuleDev->ops = NULL;
             mCameraModuleDev->priv = NULL;
             mModuleOpened = false;
@@ -128,10 +187,861 @@ namespace android{
         return ret;
     }
 
+    void CameraHal2::notifyDeviceRemoved(void) {
+
+        ALOGE("%s: camera %d device removed",__FUNCTION__, mcamera_id);
+        if (mCamera2_notify_callback != NULL) {
+            mCamera2_notify_callback(CAMERA2_MSG_ERROR, CAMERA2_MSG_ERROR_HARDWARE,
+                                     0, 0, mNotifyUserPtr);
+        }
+    }
+
     void CameraHal2::initialize(void) {
         ALOGV("Enter %s : line=%d",__FUNCTION__,__LINE__);
         mDevice->connectDevice(mcamera_id);
         mJzParameters2->initDefaultParameters(mirror?CAMERA_FACING_FRONT:CAMERA_FACING_BACK);
+
+        if (m_mainThread == NULL) {
+            m_mainThread = new MainThread(this);
+            m_mainThread->m_releasing = false;
+            m_mainThread->Start("CameraHal2Main", PRIORITY_DEFAULT, 0);
+        }
+    }
+
+    //------------------------------ memory -------------------------------
+
+    camera_memory_t* CameraHal2::get_memory(int fd, size_t buf_size,
+                                            unsigned int num_bufs, void* user) {
+
+        HeapMemory* mem = new HeapMemory();
+        size_t size = buf_size * num_bufs;
+
+        if (mem == NULL) {
+            return NULL;
+        }
+
+        if (fd >= 0) {
+            mem->heap = new MemoryHeapBase(fd, size);
+        } else {
+            mem->heap = new MemoryHeapBase(size, 0, "CameraHal2");
+        }
+
+        if ((mem->heap == NULL) || (mem->heap->getHeapID() < 0)) {
+            ALOGE("%s: alloc %d bytes fail",__FUNCTION__, size);
+            delete mem;
+            return NULL;
+        }
+
+        mem->handle.data = mem->heap->getBase();
+        mem->handle.size = size;
+        mem->handle.handle = mem;
+        mem->handle.release = CameraHal2::put_memory;
+        return &(mem->handle);
+    }
+
+    void CameraHal2::put_memory(camera_memory_t* data) {
+
+        if (data == NULL) {
+            return;
+        }
+
+        HeapMemory* mem = reinterpret_cast<HeapMemory*>(data->handle);
+        mem->heap.clear();
+        delete mem;
+    }
+
+    //------------------------------ threads ------------------------------
+
+    CameraHal2::MainThread::~MainThread() {
+        ALOGV("%s",__FUNCTION__);
+    }
+
+    void CameraHal2::MainThread::release(void) {
+        m_releasing = true;
+        SetSignal(SIGNAL_THREAD_RELEASE);
+    }
+
+    CameraHal2::StreamThread::~StreamThread() {
+        ALOGV("%s: stream %d",__FUNCTION__, m_index);
+    }
+
+    void CameraHal2::StreamThread::setParameters(void* new_parameters) {
+        memcpy(&m_parameters, new_parameters, sizeof(stream_parameters_t));
+    }
+
+    void CameraHal2::StreamThread::release(void) {
+        m_releasing = true;
+        SetSignal(SIGNAL_THREAD_RELEASE);
+    }
+
+    int CameraHal2::StreamThread::findBufferIndex(buffer_handle_t* bufHandle) {
+        for (int i = 0; i < m_parameters.numSvcBuffers; ++i) {
+            if (m_parameters.svcBufHandle[i] == *bufHandle) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void CameraHal2::releaseStreamThread(sp<StreamThread>& stream) {
+        stream->release();
+        stream->requestExitAndWait();
+        stream.clear();
+    }
+
+    static int32_t request_int32(const camera_metadata_t* request, uint32_t tag, int32_t def) {
+
+        camera_metadata_ro_entry_t entry;
+
+        if ((find_camera_metadata_ro_entry(request, tag, &entry) != OK) || (entry.count == 0)) {
+            return def;
+        }
+
+        switch (entry.type) {
+        case TYPE_BYTE:
+            return entry.data.u8[0];
+        case TYPE_INT32:
+            return entry.data.i32[0];
+        default:
+            return def;
+        }
+    }
+
+    void CameraHal2::mainThreadFunc(SignalDrivenThread* self) {
+
+        uint32_t signal = self->GetProcessingSignal();
+
+        if (signal & SIGNAL_THREAD_RELEASE) {
+            ALOGV("%s: main thread release",__FUNCTION__);
+            self->SetSignal(SIGNAL_THREAD_TERMINATE);
+            return;
+        }
+
+        if (signal & SIGNAL_MAIN_REQ_Q_NOT_EMPTY) {
+            while (!m_mainThread->m_releasing && (processNextRequest() == NO_ERROR))
+                ;
+        }
+    }
+
+    status_t CameraHal2::processNextRequest(void) {
+
+        camera_metadata_t* request = NULL;
+        status_t res = NO_ERROR;
+
+        {
+            /* held across the dequeue so a notify racing with an empty queue
+               is never lost, the flush kicks us again once it is done */
+            AutoMutex lock(mInputMutex);
+            if (isFlushing()) {
+                mActive = false;
+                return NOT_ENOUGH_DATA;
+            }
+            res = mRequest_src_ops->dequeue_request(mRequest_src_ops, &request);
+            if ((res != OK) || (request == NULL)) {
+                mActive = false;
+                return NOT_ENOUGH_DATA;
+            }
+        }
+
+        res = processRequest(request);
+        if (res != NO_ERROR) {
+            ALOGE("%s: request fail, ret = %d",__FUNCTION__, res);
+            if (mCamera2_notify_callback != NULL) {
+                mCamera2_notify_callback(CAMERA2_MSG_ERROR, CAMERA2_MSG_ERROR_REQUEST,
+                                         request_int32(request, ANDROID_REQUEST_ID, 0),
+                                         0, mNotifyUserPtr);
+            }
+        }
+        mRequest_src_ops->free_request(mRequest_src_ops, request);
+
+        if (res != NO_ERROR) {
+            /* wait for the next notify instead of spinning on a dead device */
+            AutoMutex lock(mInputMutex);
+            mActive = false;
+        }
+        return res;
+    }
+
+    status_t CameraHal2::processRequest(camera_metadata_t* request) {
+
+        camera_metadata_ro_entry_t streams;
+        sp<StreamThread> outputs[NUM_MAX_STREAM_THREAD];
+        inflight_request_t inflight;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        int num = 0;
+        status_t res = NO_ERROR;
+
+        res = find_camera_metadata_ro_entry(request, ANDROID_REQUEST_OUTPUT_STREAMS, &streams);
+        if (res != OK) {
+            ALOGE("%s: request without output streams",__FUNCTION__);
+            return BAD_VALUE;
+        }
+
+        {
+            AutoMutex lock(mLock);
+            for (size_t i = 0; i < streams.count; ++i) {
+                int id = (streams.type == TYPE_BYTE) ? streams.data.u8[i] : streams.data.i32[i];
+                if ((id < 0) || (id >= NUM_MAX_STREAM_THREAD) || (m_streamThreads[id] == NULL)
+                    || !m_streamThreads[id]->m_isBufferInit) {
+                    ALOGE("%s: stream %d not ready",__FUNCTION__, id);
+                    continue;
+                }
+                outputs[num++] = m_streamThreads[id];
+            }
+
+            /*
+             * The largest configured stream decides the capture size, so
+             * the sensor only restarts when the streams change and not
+             * with the outputs of each request. Every output is scaled
+             * to its own size from there.
+             */
+            for (int id = 0; id < NUM_MAX_STREAM_THREAD; ++id) {
+                if ((m_streamThreads[id] == NULL) || !m_streamThreads[id]->m_isBufferInit) {
+                    continue;
+                }
+                stream_parameters_t* params = &(m_streamThreads[id]->m_parameters);
+                if (params->width * params->height > width * height) {
+                    width = params->width;
+                    height = params->height;
+                }
+            }
+        }
+
+        if (num == 0) {
+            return BAD_VALUE;
+        }
+
+        memset(&inflight, 0, sizeof(inflight_request_t));
+        inflight.requestId = request_int32(request, ANDROID_REQUEST_ID, 0);
+        inflight.frameCount = request_int32(request, ANDROID_REQUEST_FRAME_COUNT, 0);
+        for (int i = 0; i < num; ++i) {
+            inflight.streamMask |= (1 << outputs[i]->m_index);
+        }
+        {
+            AutoMutex output_lock(mOutputLock);
+            mInFlight.replaceValueFor(inflight.frameCount, inflight);
+        }
+
+        if (request_int32(request, ANDROID_REQUEST_TYPE, ANDROID_REQUEST_TYPE_CAPTURE)
+            == ANDROID_REQUEST_TYPE_REPROCESS) {
+            res = reprocessRequest(request, outputs, num, &inflight);
+        } else {
+            res = captureRequest(request, outputs, num, width, height, &inflight);
+        }
+
+        {
+            AutoMutex output_lock(mOutputLock);
+            mInFlight.removeItem(inflight.frameCount);
+            mOutputCondition.broadcast();
+        }
+        return res;
+    }
+
+    status_t CameraHal2::captureRequest(camera_metadata_t* request, sp<StreamThread>* outputs,
+                                        int num, uint32_t width, uint32_t height,
+                                        inflight_request_t* inflight) {
+
+        status_t res = NO_ERROR;
+
+        if (isFlushing()) {
+            ALOGV("%s: flushing, drop request %d",__FUNCTION__, inflight->requestId);
+            return NO_ERROR;
+        }
+
+        mJzParameters2->setParameters2(request);
+        mJpegQuality = request_int32(request, ANDROID_JPEG_QUALITY, JPEG_DEFAULT_QUALITY);
+
+        AutoMutex lock(mCaptureLock);
+
+        res = configureCapture(width, height);
+        if (res != NO_ERROR) {
+            return res;
+        }
+
+        /* a held frame stays out of the driver until the outputs are done */
+        CameraYUVMeta* frame = (CameraYUVMeta*)mDevice->getHeldFrame();
+        bool held = (frame != NULL);
+        if (!held) {
+            frame = (CameraYUVMeta*)mDevice->getCurrentFrame();
+        }
+        if (frame == NULL) {
+            ALOGE("%s: no frame from device",__FUNCTION__);
+            return UNKNOWN_ERROR;
+        }
+        int frameIndex = frame->index;
+
+        /* every stream here is filled by the cpu, so the dequeued frame is all it reads */
+        mDevice->flushCache(NULL,0);
+
+        if ((frame->format == HAL_PIXEL_FORMAT_JZ_YUV_420_B) && ccc) {
+            ccc->cimyuv420b_to_tile420(frame);
+        }
+        /* outputs only reach the frame through the cache, until setFrame(NULL) */
+        mFrameCache->setFrame(frame);
+
+        nsecs_t timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+        {
+            AutoMutex output_lock(mOutputLock);
+            ssize_t index = mInFlight.indexOfKey(inflight->frameCount);
+            if (index >= 0) {
+                mInFlight.editValueAt(index).shutterTimestamp = timestamp;
+            }
+        }
+        if (mCamera2_notify_callback != NULL) {
+            mCamera2_notify_callback(CAMERA2_MSG_SHUTTER, inflight->frameCount,
+                                     (int32_t)(timestamp & 0xffffffff),
+                                     (int32_t)(timestamp >> 32), mNotifyUserPtr);
+        }
+
+        for (int i = 0; i < num; ++i) {
+            outputs[i]->m_srcFrame = frame;
+            outputs[i]->m_frameTimeStamp = timestamp;
+            outputs[i]->m_frameCount = inflight->frameCount;
+            outputs[i]->SetSignal(SIGNAL_STREAM_DATA_COMING);
+        }
+
+        bool timedOut = false;
+        {
+            /*
+             * Unless the device could hold it, the driver already has the
+             * buffer back and may be refilling it. Outputs still only read
+             * it through mFrameCache, which setFrame() below waits out.
+             */
+            AutoMutex output_lock(mOutputLock);
+            nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC)
+                + ms2ns(STREAM_OUTPUT_TIMEOUT_MS);
+            for (;;) {
+                ssize_t index = mInFlight.indexOfKey(inflight->frameCount);
+                if (index < 0) {
+                    break;
+                }
+                *inflight = mInFlight.valueAt(index);
+                if (inflight->doneMask == inflight->streamMask) {
+                    break;
+                }
+                nsecs_t remaining = deadline - systemTime(SYSTEM_TIME_MONOTONIC);
+                if (remaining <= 0) {
+                    ALOGE("%s: outputs 0x%x of frame %d still busy after %d ms",__FUNCTION__,
+                          inflight->streamMask & ~inflight->doneMask, inflight->frameCount,
+                          STREAM_OUTPUT_TIMEOUT_MS);
+                    /* a late output finds its request gone and fills nothing */
+                    mInFlight.removeItem(inflight->frameCount);
+                    timedOut = true;
+                    break;
+                }
+                mOutputCondition.waitRelative(mOutputLock, remaining);
+            }
+        }
+
+        /* no output reads the frame after this, the driver can have it */
+        mFrameCache->setFrame(NULL);
+        if (held) {
+            mDevice->releaseFrame(frameIndex);
+        }
+
+        if (timedOut) {
+            return TIMED_OUT;
+        }
+
+        /* a flushed capture that placed nothing anywhere leaves no trace */
+        if (isFlushing() && (inflight->filledMask == 0)) {
+            ALOGV("%s: frame %d flushed",__FUNCTION__, inflight->frameCount);
+            return NO_ERROR;
+        }
+
+        sendFrameMetadata(request, timestamp);
+        return NO_ERROR;
+    }
+
+    /*
+     * A reprocess request skips the sensor: the frame picked by the app
+     * comes back through the reprocess stream and only goes through the
+     * encoder, straight into the jpeg outputs of the request.
+     */
+    status_t CameraHal2::reprocessRequest(camera_metadata_t* request, sp<StreamThread>* outputs,
+                                          int num, inflight_request_t* inflight) {
+
+        reprocess_parameters_t reprocess;
+        buffer_handle_t* buffer = NULL;
+        camera_memory_t* tmp_buf = NULL;
+        camera_memory_t* jpeg_buff = NULL;
+        compress_params_t params;
+        void* img = NULL;
+        status_t res = NO_ERROR;
+
+        {
+            AutoMutex lock(mLock);
+            if (!mReprocessAllocated
+                || (request_int32(request, ANDROID_REQUEST_INPUT_STREAMS, -1)
+                    != STREAM_ID_JPEG_REPROCESS)) {
+                ALOGE("%s: request %d has no reprocess input",__FUNCTION__, inflight->requestId);
+                return BAD_VALUE;
+            }
+            reprocess = mReprocessParameters;
+        }
+
+        if (isFlushing()) {
+            ALOGV("%s: flushing, drop request %d",__FUNCTION__, inflight->requestId);
+            return NO_ERROR;
+        }
+
+        mJpegQuality = request_int32(request, ANDROID_JPEG_QUALITY, JPEG_DEFAULT_QUALITY);
+
+        /* the result carries the timestamp of the frame being reprocessed */
+        nsecs_t timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+        camera_metadata_ro_entry_t entry;
+        if ((find_camera_metadata_ro_entry(request, ANDROID_SENSOR_TIMESTAMP, &entry) == OK)
+            && (entry.count > 0)) {
+            timestamp = entry.data.i64[0];
+        }
+
+        const camera2_stream_in_ops_t* ops = reprocess.streamOps;
+        res = ops->acquire_buffer(ops, &buffer);
+        if ((res != NO_ERROR) || (buffer == NULL)) {
+            ALOGE("%s: acquire reprocess buffer fail, ret = %d",__FUNCTION__, res);
+            return (res != NO_ERROR) ? res : NO_MEMORY;
+        }
+
+        GraphicBufferMapper& mapper(GraphicBufferMapper::get());
+        res = mapper.lock(*buffer, GRALLOC_USAGE_SW_READ_OFTEN,
+                          Rect(reprocess.width, reprocess.height), &img);
+        if (res != NO_ERROR) {
+            ALOGE("%s: lock reprocess buffer fail, ret = %d",__FUNCTION__, res);
+            ops->release_buffer(ops, buffer);
+            return res;
+        }
+
+        memset(&params, 0, sizeof(compress_params_t));
+        params.src = (uint8_t*)img;
+        params.format = reprocess.format;
+        if (reprocess.format == HAL_PIXEL_FORMAT_JZ_YUV_420_P) {
+            int size = (reprocess.width * reprocess.height * 3) >> 1;
+            tmp_buf = get_memory(-1, size, 1, NULL);
+            if ((tmp_buf == NULL) || (ccc == NULL)) {
+                res = NO_MEMORY;
+            } else {
+                ccc->yuv420p_to_yuv420sp((uint8_t*)img, (uint8_t*)(tmp_buf->data),
+                                         reprocess.width, reprocess.height);
+                params.src = (uint8_t*)(tmp_buf->data);
+                params.format = HAL_PIXEL_FORMAT_YCrCb_420_SP;
+            }
+        }
+        params.pictureWidth = reprocess.width;
+        params.pictureHeight = reprocess.height;
+        params.pictureQuality = mJpegQuality;
+        params.requiredMem = CameraHal2::get_memory;
+
+        if (res == NO_ERROR) {
+            res = encodeJpeg(&params, &jpeg_buff);
+        }
+
+        if (tmp_buf != NULL) {
+            tmp_buf->release(tmp_buf);
+            tmp_buf = NULL;
+        }
+        mapper.unlock(*buffer);
+        ops->release_buffer(ops, buffer);
+
+        if (res != NO_ERROR) {
+            return res;
+        }
+
+        for (int i = 0; i < num; ++i) {
+            status_t ret = BAD_VALUE;
+            if (outputs[i]->m_activated && (outputs[i]->streamType == STREAM_ID_JPEG)) {
+                ret = writeJpegBuffer(outputs[i].get(), jpeg_buff, timestamp);
+            } else {
+                ALOGE("%s: stream %d can't take a reprocessed frame",__FUNCTION__,
+                      outputs[i]->m_index);
+            }
+            streamOutputDone(inflight->frameCount, outputs[i]->m_index, ret == NO_ERROR);
+        }
+        jpeg_buff->release(jpeg_buff);
+
+        sendFrameMetadata(request, timestamp);
+        return NO_ERROR;
+    }
+
+    status_t CameraHal2::configureCapture(uint32_t width, uint32_t height) {
+
+        status_t res = NO_ERROR;
+
+        if (mCaptureRunning && (width == mCaptureWidth) && (height == mCaptureHeight)) {
+            return NO_ERROR;
+        }
+
+        stopCapture();
+
+        ALOGV("%s: capture %dx%d",__FUNCTION__, width, height);
+        res = mDevice->allocateStream(PREVIEW_BUFFER, CameraHal2::get_memory,
+                                      width, height, mDevice->getPreviewFormat());
+        if (res != NO_ERROR) {
+            ALOGE("%s: allocate capture stream error",__FUNCTION__);
+            return res;
+        }
+
+        res = mDevice->startDevice();
+        if (res != NO_ERROR) {
+            ALOGE("%s: start device error",__FUNCTION__);
+            mDevice->freeStream(PREVIEW_BUFFER);
+            return res;
+        }
+
+        mCaptureWidth = width;
+        mCaptureHeight = height;
+        mCaptureRunning = true;
+        return NO_ERROR;
+    }
+
+    /* called with mCaptureLock held */
+    void CameraHal2::stopCapture(void) {
+
+        if (!mCaptureRunning) {
+            return;
+        }
+
+        mDevice->stopDevice();
+        mDevice->freeStream(PREVIEW_BUFFER);
+        mFrameCache->clear();
+        mCaptureRunning = false;
+        mCaptureWidth = 0;
+        mCaptureHeight = 0;
+    }
+
+    /*
+     * The dynamic result tags live in a template allocated once with a fixed
+     * layout, so each frame only rewrites values in place and appends the
+     * template after the request settings.
+     */
+    status_t CameraHal2::initResultTemplate(void) {
+
+        camera_metadata_entry_t entry;
+        int64_t timestamp = 0;
+
+        if (mResultTemplate != NULL) {
+            return NO_ERROR;
+        }
+
+        mResultTemplate = allocate_camera_metadata(RESULT_TEMPLATE_ENTRIES,
+                              calculate_camera_metadata_entry_data_size(TYPE_INT64, 1));
+        if (mResultTemplate == NULL) {
+            ALOGE("%s: allocate result template fail",__FUNCTION__);
+            return NO_MEMORY;
+        }
+
+        if ((add_camera_metadata_entry(mResultTemplate, ANDROID_SENSOR_TIMESTAMP, &timestamp, 1) != OK)
+            || (find_camera_metadata_entry(mResultTemplate, ANDROID_SENSOR_TIMESTAMP, &entry) != OK)) {
+            free_camera_metadata(mResultTemplate);
+            mResultTemplate = NULL;
+            return UNKNOWN_ERROR;
+        }
+        mResultTimestampIndex = entry.index;
+        return NO_ERROR;
+    }
+
+    void CameraHal2::sendFrameMetadata(const camera_metadata_t* request, nsecs_t timestamp) {
+
+        camera_metadata_t* frame = NULL;
+        status_t res = NO_ERROR;
+
+        if ((mFrame_dst_ops == NULL) || (initResultTemplate() != NO_ERROR)) {
+            return;
+        }
+
+        update_camera_metadata_entry(mResultTemplate, mResultTimestampIndex, &timestamp, 1, NULL);
+
+        size_t entries = get_camera_metadata_entry_count(request)
+            + get_camera_metadata_entry_count(mResultTemplate);
+        size_t data = get_camera_metadata_data_count(request)
+            + get_camera_metadata_data_count(mResultTemplate);
+
+        res = mFrame_dst_ops->dequeue_frame(mFrame_dst_ops, entries, data, &frame);
+        if ((res != OK) || (frame == NULL)) {
+            ALOGE("%s: dequeue frame fail, ret = %d",__FUNCTION__, res);
+            return;
+        }
+
+        res = append_camera_metadata(frame, request);
+        if (res == OK) {
+            res = append_camera_metadata(frame, mResultTemplate);
+        }
+
+        if (res != OK) {
+            ALOGE("%s: build frame metadata fail, ret = %d",__FUNCTION__, res);
+            mFrame_dst_ops->cancel_frame(mFrame_dst_ops, frame);
+            return;
+        }
+        mFrame_dst_ops->enqueue_frame(mFrame_dst_ops, frame);
+    }
+
+    void CameraHal2::streamOutputDone(int32_t frameCount, int streamId, bool filled) {
+        AutoMutex lock(mOutputLock);
+        ssize_t index = mInFlight.indexOfKey(frameCount);
+        if (index < 0) {
+            return;
+        }
+        inflight_request_t& inflight = mInFlight.editValueAt(index);
+        inflight.doneMask |= (1 << streamId);
+        if (filled) {
+            inflight.filledMask |= (1 << streamId);
+        }
+        mOutputCondition.broadcast();
+    }
+
+    bool CameraHal2::isFlushing(void) {
+        AutoMutex lock(mOutputLock);
+        return mFlushing;
+    }
+
+    bool CameraHal2::isInFlight(int32_t frameCount) {
+        AutoMutex lock(mOutputLock);
+        return (mInFlight.indexOfKey(frameCount) >= 0);
+    }
+
+    void CameraHal2::streamThreadFunc(SignalDrivenThread* self) {
+
+        StreamThread* stream = static_cast<StreamThread*>(self);
+        uint32_t signal = self->GetProcessingSignal();
+
+        if (signal & SIGNAL_THREAD_RELEASE) {
+            ALOGV("%s: stream %d release",__FUNCTION__, stream->m_index);
+            stream->m_activated = false;
+            /* a capture may be waiting on the frame this stream never took */
+            if (signal & SIGNAL_STREAM_DATA_COMING) {
+                stream->m_srcFrame = NULL;
+                streamOutputDone(stream->m_frameCount, stream->m_index, false);
+            }
+            self->SetSignal(SIGNAL_THREAD_TERMINATE);
+            return;
+        }
+
+        if (signal & SIGNAL_STREAM_DATA_COMING) {
+            status_t res = NOT_ENOUGH_DATA;
+            /* a capture that timed out may hand over the next frame meanwhile */
+            CameraYUVMeta* frame = stream->m_srcFrame;
+            nsecs_t timestamp = stream->m_frameTimeStamp;
+            stream->m_processingCount = stream->m_frameCount;
+            /* once a flush starts, outputs not yet placed are skipped */
+            if (stream->m_activated && (frame != NULL) && !isFlushing()
+                && isInFlight(stream->m_processingCount)) {
+                res = subStreamFunc(stream, frame, stream->streamType, timestamp);
+            }
+            streamOutputDone(stream->m_processingCount, stream->m_index, res == NO_ERROR);
+        }
+    }
+
+    status_t CameraHal2::subStreamFunc(StreamThread* self, void* srcImageBuf,
+                                       int stream_id, nsecs_t frameTimeStamp) {
+
+        switch (stream_id) {
+        case STREAM_ID_PREVIEW:
+        case STREAM_ID_PRVCB:
+            return previewCreator(self, srcImageBuf, frameTimeStamp);
+        case STREAM_ID_RECORD:
+            return recordCreator(self, srcImageBuf, frameTimeStamp);
+        case STREAM_ID_JPEG:
+            return jpegCreator(self, srcImageBuf, frameTimeStamp);
+        default:
+            ALOGE("%s: unknown stream %d",__FUNCTION__, stream_id);
+            break;
+        }
+        return BAD_VALUE;
+    }
+
+    status_t CameraHal2::lockStreamBuffer(StreamThread* stream, buffer_handle_t** buffer,
+                                          void** img) {
+
+        stream_parameters_t* params = &(stream->m_parameters);
+        const camera2_stream_ops_t* ops = params->streamOps;
+        status_t res = NO_ERROR;
+
+        res = ops->dequeue_buffer(ops, buffer);
+        if ((res != NO_ERROR) || (*buffer == NULL)) {
+            ALOGE("%s: stream %d dequeue buffer fail",__FUNCTION__, stream->m_index);
+            return (res != NO_ERROR) ? res : NO_MEMORY;
+        }
+
+        const Rect rect(params->width, params->height);
+        GraphicBufferMapper& mapper(GraphicBufferMapper::get());
+        res = mapper.lock(**buffer, GRALLOC_USAGE_SW_WRITE_OFTEN, rect, img);
+        if (res != NO_ERROR) {
+            ALOGE("%s: stream %d lock buffer fail",__FUNCTION__, stream->m_index);
+            ops->cancel_buffer(ops, *buffer);
+            return res;
+        }
+        return NO_ERROR;
+    }
+
+    void CameraHal2::unlockStreamBuffer(StreamThread* stream, buffer_handle_t* buffer,
+                                        bool filled, nsecs_t timestamp) {
+
+        const camera2_stream_ops_t* ops = stream->m_parameters.streamOps;
+
+        GraphicBufferMapper::get().unlock(*buffer);
+        if (filled) {
+            ops->enqueue_buffer(ops, timestamp, buffer);
+        } else {
+            ops->cancel_buffer(ops, buffer);
+        }
+    }
+
+    /* streams asking for the same format and size share one conversion */
+    status_t CameraHal2::fillStreamBuffer(CameraYUVMeta* frame, stream_parameters_t* params,
+                                          uint8_t* dst) {
+
+        if (mFrameCache == NULL) {
+            return NO_INIT;
+        }
+
+        status_t res = mFrameCache->copyTo(params->format, params->width, params->height, dst);
+        if (res != NO_ERROR) {
+            ALOGE("%s: can't fill 0x%x %dx%d from 0x%x %dx%d",__FUNCTION__,
+                  params->format, params->width, params->height,
+                  frame->format, frame->width, frame->height);
+        }
+        return res;
+    }
+
+    status_t CameraHal2::previewCreator(StreamThread* selfThread, void* srcImageBuf,
+                                        nsecs_t frameTimeStamp) {
+
+        buffer_handle_t* buffer = NULL;
+        void* img = NULL;
+        status_t res = lockStreamBuffer(selfThread, &buffer, &img);
+
+        if (res != NO_ERROR) {
+            return res;
+        }
+
+        /* the capture gave up while this waited for a buffer */
+        if (!isInFlight(selfThread->m_processingCount)) {
+            unlockStreamBuffer(selfThread, buffer, false, frameTimeStamp);
+            return TIMED_OUT;
+        }
+
+        res = fillStreamBuffer((CameraYUVMeta*)srcImageBuf,
+                               &(selfThread->m_parameters), (uint8_t*)img);
+        unlockStreamBuffer(selfThread, buffer, res == NO_ERROR, frameTimeStamp);
+        return res;
+    }
+
+    status_t CameraHal2::recordCreator(StreamThread* selfThread, void* srcImageBuf,
+                                       nsecs_t frameTimeStamp) {
+        return previewCreator(selfThread, srcImageBuf, frameTimeStamp);
+    }
+
+    status_t CameraHal2::jpegCreator(StreamThread* selfThread, void* srcImageBuf,
+                                     nsecs_t frameTimeStamp) {
+
+        CameraYUVMeta* frame = (CameraYUVMeta*)srcImageBuf;
+        stream_parameters_t* stream = &(selfThread->m_parameters);
+        camera_memory_t* jpeg_buff = NULL;
+        compress_params_t params;
+        status_t res = NO_ERROR;
+
+        if (mFrameCache == NULL) {
+            return NO_INIT;
+        }
+
+        /* at the stream size, the nv21 a preview or record stream may have made already */
+        memset(&params, 0, sizeof(compress_params_t));
+        params.format = (frame->format == HAL_PIXEL_FORMAT_YCbCr_422_I)
+            ? HAL_PIXEL_FORMAT_YCbCr_422_I : HAL_PIXEL_FORMAT_YCrCb_420_SP;
+        params.src = (uint8_t*)mFrameCache->get(params.format, stream->width, stream->height);
+        if (params.src == NULL) {
+            return NO_MEMORY;
+        }
+        params.pictureWidth = stream->width;
+        params.pictureHeight = stream->height;
+        params.pictureQuality = mJpegQuality;
+        params.requiredMem = CameraHal2::get_memory;
+
+        res = encodeJpeg(&params, &jpeg_buff);
+        mFrameCache->put();
+
+        if (res != NO_ERROR) {
+            return res;
+        }
+
+        if (!isInFlight(selfThread->m_processingCount)) {
+            jpeg_buff->release(jpeg_buff);
+            return TIMED_OUT;
+        }
+
+        res = writeJpegBuffer(selfThread, jpeg_buff, frameTimeStamp);
+        jpeg_buff->release(jpeg_buff);
+        return res;
+    }
+
+    status_t CameraHal2::encodeJpeg(compress_params_t* params, camera_memory_t** jpeg) {
+
+        status_t res = NO_ERROR;
+        camera_memory_t* mirrored = NULL;
+        compress_params_t encodeParams = *params;
+
+        /*
+         * src may be the shared frame or a reprocess input, so the mirror
+         * goes into a copy instead of being done in place
+         */
+        if (mirror && ccc != NULL && params->format == HAL_PIXEL_FORMAT_YCbCr_422_I) {
+            int stride = params->pictureWidth << 1;
+            mirrored = get_memory(-1, stride * params->pictureHeight, 1, NULL);
+            if (mirrored == NULL) {
+                return NO_MEMORY;
+            }
+            ccc->yuyv_transform((uint8_t*)mirrored->data, stride, params->src, stride,
+                                params->pictureWidth, params->pictureHeight,
+                                HAL_TRANSFORM_FLIP_H);
+            encodeParams.src = (uint8_t*)mirrored->data;
+        }
+
+        *jpeg = NULL;
+        {
+            CameraCompressor compressor(&encodeParams);
+            res = compressor.compress_to_jpeg(NULL, jpeg);
+        }
+
+        if (mirrored != NULL) {
+            mirrored->release(mirrored);
+            mirrored = NULL;
+        }
+
+        if ((res != NO_ERROR) || (*jpeg == NULL)) {
+            ALOGE("%s: compress fail, ret = %d",__FUNCTION__, res);
+            if (*jpeg != NULL) {
+                (*jpeg)->release(*jpeg);
+                *jpeg = NULL;
+            }
+            return (res != NO_ERROR) ? res : NO_MEMORY;
+        }
+        return NO_ERROR;
+    }
+
+    status_t CameraHal2::writeJpegBuffer(StreamThread* stream, camera_memory_t* jpeg,
+                                         nsecs_t timestamp) {
+
+        buffer_handle_t* buffer = NULL;
+        void* img = NULL;
+        status_t res = lockStreamBuffer(stream, &buffer, &img);
+
+        if (res != NO_ERROR) {
+            return res;
+        }
+
+        /* a blob buffer is iWidth x iHeight bytes */
+        IMG_native_handle_t* handle = (IMG_native_handle_t*)(*buffer);
+        size_t capacity = handle->iWidth * handle->iHeight;
+        bool filled = (jpeg->size <= capacity);
+
+        if (filled) {
+            memcpy(img, jpeg->data, jpeg->size);
+        } else {
+            ALOGE("%s: jpeg %d bytes, buffer only %d",__FUNCTION__,
+                  (int)jpeg->size, (int)capacity);
+        }
+        unlockStreamBuffer(stream, buffer, filled, timestamp);
+        return filled ? NO_ERROR : NO_MEMORY;
     }
 
     //-------------android 4.2 camera 2.0 api ----------
@@ -162,41 +1072,60 @@ namespace android{
         ALOGE("%s: queue ops NULL, ignoring request",__FUNCTION__);
         return BAD_VALUE;
       }
+
+      AutoMutex lock(mInputMutex);
+      if (!mActive && (m_mainThread != NULL)) {
+        mActive = true;
+        m_mainThread->SetSignal(SIGNAL_MAIN_REQ_Q_NOT_EMPTY);
+      }
       return NO_ERROR;
     }
 
     int CameraHal2::get_In_progress_count(void) {
-        AutoMutex lock(mLock);
-        ALOGV("%s: ",__FUNCTION__); 
-        return mRequestCount;
+        AutoMutex lock(mOutputLock);
+        ALOGV("%s: %d",__FUNCTION__, mInFlight.size());
+        return mInFlight.size();
     }
 
     int CameraHal2::flush_Captures_in_progress(void) {
-        return NO_ERROR;
+        ALOGV("%s: %d in flight",__FUNCTION__, get_In_progress_count());
+        status_t res = NO_ERROR;
+
+        {
+            AutoMutex lock(mOutputLock);
+            mFlushing = true;
+            mOutputCondition.broadcast();
+
+            /* the stream threads cancel what they have not filled yet, so
+               this only waits for outputs already being written */
+            while (!mInFlight.isEmpty()) {
+                if (mOutputCondition.waitRelative(mOutputLock,
+                          ms2ns(STREAM_OUTPUT_TIMEOUT_MS)) == TIMED_OUT) {
+                    ALOGE("%s: %d requests still in flight",__FUNCTION__, mInFlight.size());
+                    res = TIMED_OUT;
+                    break;
+                }
+            }
+            mFlushing = false;
+        }
+
+        /* requests queued behind the flush are picked up again */
+        AutoMutex lock(mInputMutex);
+        if (!mActive && (m_mainThread != NULL)) {
+            mActive = true;
+            m_mainThread->SetSignal(SIGNAL_MAIN_REQ_Q_NOT_EMPTY);
+        }
+        return res;
     }
 
     int CameraHal2::construct_Default_request(int request_template,
                                               camera_metadata_t **request) {
-        status_t res;
-
         if (request == NULL) return BAD_VALUE;
         if ((request_template < 0) || request_template >= CAMERA2_TEMPLATE_COUNT) {
           return BAD_VALUE;
         }
 
-        res = mJzParameters2->constructDefaultRequest(request_template,
-              request, true);
-        if (res != OK) {
-          return res;
-        }
-
-        res = mJzParameters2->constructDefaultRequest(request_template,
-              request, false);
-        if (res != OK) {
-          ALOGE("%s: Unable to po;ulate new request for tmeplate %d",
-                __FUNCTION__, request_template);
-        }
-        return res;
+        return mJzParameters2->getDefaultRequest(request_template, request);
     }
 
     /**********************************************************************
@@ -215,31 +1144,131 @@ namespace android{
                                     uint32_t *max_buffers) {
         ALOGV("%s: stream %dx%d format: 0x%x", __FUNCTION__, width, height, format);
 
+        AutoMutex lock(mLock);
+        int id = -1;
+
         if (((format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED) || (format == CAMERA2_HAL_PIXEL_FORMAT_OPAQUE)) &&
             mJzParameters2->isSupportedResolution(width, height)) {
+          /* the first one is the preview, a second one feeds the encoder */
+          id = (m_streamThreads[STREAM_ID_PREVIEW] == NULL) ? STREAM_ID_PREVIEW : STREAM_ID_RECORD;
           *format_actual = HAL_PIXEL_FORMAT_RGB_565;
           *usage = GRALLOC_USAGE_SW_WRITE_OFTEN;
-          *max_buffers = 5;
+          *max_buffers = NUM_STREAM_BUFFERS;
 
         } else if ((format == CAMERA2_HAL_PIXEL_FORMAT_ZSL) &&
             mJzParameters2->isAvaliableSensorSize(width, height)) {
+          ALOGE("%s: zsl stream not supported",__FUNCTION__);
+          return BAD_VALUE;
 
-        } else if (mJzParameters2->isAvaliablePreviewFormat(format)) {
+        } else if ((mJzParameters2->isAvaliablePreviewFormat(format)
+                    || (format == HAL_PIXEL_FORMAT_YCrCb_420_SP)
+                    || (format == HAL_PIXEL_FORMAT_YV12)) &&
+                   mJzParameters2->isSupportedResolution(width, height)) {
+          id = STREAM_ID_PRVCB;
+          *format_actual = format;
+          *usage = GRALLOC_USAGE_SW_WRITE_OFTEN;
+          *max_buffers = NUM_STREAM_BUFFERS;
 
         } else if ((format == HAL_PIXEL_FORMAT_BLOB) &&
             mJzParameters2->isSupportedJpegResolution(width, height)) {
+          id = STREAM_ID_JPEG;
+          *format_actual = HAL_PIXEL_FORMAT_BLOB;
+          *usage = GRALLOC_USAGE_SW_WRITE_OFTEN;
+          *max_buffers = NUM_JPEG_STREAM_BUFFERS;
+
+        } else {
+          ALOGE("%s: unsupported stream %dx%d format: 0x%x",__FUNCTION__, width, height, format);
+          return BAD_VALUE;
         }
-        
+
+        if (m_streamThreads[id] != NULL) {
+          ALOGE("%s: stream %d already allocated",__FUNCTION__, id);
+          return INVALID_OPERATION;
+        }
+
+        sp<StreamThread> stream = new StreamThread(this, id);
+        stream->m_parameters.width = width;
+        stream->m_parameters.height = height;
+        stream->m_parameters.format = format;
+        stream->m_parameters.streamOps = stream_ops;
+        stream->m_parameters.usage = *usage;
+        stream->m_parameters.numHwBuffers = *max_buffers;
+        stream->m_numRegisteredStream = 1;
+        stream->m_activated = true;
+        stream->Start("CameraHal2Stream", PRIORITY_DEFAULT, 0);
+
+        m_streamThreads[id] = stream;
+        if (id == STREAM_ID_RECORD) {
+          mStreamType = RECORD;
+        }
+        *stream_id = id;
         return NO_ERROR;
     }
 
     int CameraHal2::register_Stream_buffers(uint32_t stream_id,
                                             int num_buffers,
                                             buffer_handle_t *buffers) {
+        AutoMutex lock(mLock);
+
+        if ((stream_id >= NUM_MAX_STREAM_THREAD) || (m_streamThreads[stream_id] == NULL)) {
+            ALOGE("%s: invalid stream %d",__FUNCTION__, stream_id);
+            return BAD_VALUE;
+        }
+
+        if ((num_buffers <= 0) || (num_buffers > NUM_MAX_CAMERA_BUFFERS) || (buffers == NULL)) {
+            ALOGE("%s: stream %d can't take %d buffers",__FUNCTION__, stream_id, num_buffers);
+            return BAD_VALUE;
+        }
+
+        stream_parameters_t* params = &(m_streamThreads[stream_id]->m_parameters);
+        for (int i = 0; i < num_buffers; ++i) {
+            params->svcBufHandle[i] = buffers[i];
+        }
+        params->numSvcBuffers = num_buffers;
+        params->bufIndex = 0;
+
+        /* gralloc picked the real format of an implementation defined stream */
+        if ((params->format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED)
+            || (params->format == CAMERA2_HAL_PIXEL_FORMAT_OPAQUE)) {
+            params->format = ((IMG_native_handle_t*)buffers[0])->iFormat;
+        }
+
+        m_streamThreads[stream_id]->m_isBufferInit = true;
+        ALOGV("%s: stream %d, %d buffers, format 0x%x",__FUNCTION__,
+              stream_id, num_buffers, params->format);
         return NO_ERROR;
     }
 
     int CameraHal2::release_Stream(uint32_t stream_id) {
+
+        sp<StreamThread> stream = NULL;
+        bool last = true;
+
+        {
+            AutoMutex lock(mLock);
+            if ((stream_id >= NUM_MAX_STREAM_THREAD) || (m_streamThreads[stream_id] == NULL)) {
+                ALOGE("%s: invalid stream %d",__FUNCTION__, stream_id);
+                return BAD_VALUE;
+            }
+            stream = m_streamThreads[stream_id];
+            m_streamThreads[stream_id].clear();
+
+            for (int i = 0; i < NUM_MAX_STREAM_THREAD; ++i) {
+                if (m_streamThreads[i] != NULL) {
+                    last = false;
+                }
+            }
+            if (stream_id == STREAM_ID_RECORD) {
+                mStreamType = PREVIEW;
+            }
+        }
+
+        releaseStreamThread(stream);
+
+        if (last) {
+            AutoMutex lock(mCaptureLock);
+            stopCapture();
+        }
         return NO_ERROR;
     }
 
@@ -251,6 +1280,33 @@ namespace android{
                                               uint32_t *stream_id,
                                               uint32_t *consumer_usage,
                                               uint32_t *max_buffers) {
+        ALOGV("%s: stream %dx%d format: 0x%x", __FUNCTION__, width, height, format);
+
+        AutoMutex lock(mLock);
+
+        if ((reprocess_stream_ops == NULL) || !isReprocessFormat(format)
+            || !mJzParameters2->isSupportedJpegResolution(width, height)) {
+            ALOGE("%s: unsupported reprocess stream %dx%d format: 0x%x",__FUNCTION__,
+                  width, height, format);
+            return BAD_VALUE;
+        }
+
+        if (mReprocessAllocated) {
+            ALOGE("%s: reprocess stream already allocated",__FUNCTION__);
+            return INVALID_OPERATION;
+        }
+
+        mReprocessParameters.width = width;
+        mReprocessParameters.height = height;
+        mReprocessParameters.format = format;
+        mReprocessParameters.streamOps = reprocess_stream_ops;
+        mReprocessParameters.sourceStreamId = -1;
+        mReprocessAllocated = true;
+
+        *stream_id = STREAM_ID_JPEG_REPROCESS;
+        *consumer_usage = GRALLOC_USAGE_SW_READ_OFTEN;
+        /* the input is released as soon as it is encoded */
+        *max_buffers = 1;
         return NO_ERROR;
     }
 
@@ -258,14 +1314,67 @@ namespace android{
                                                           const camera2_stream_in_ops_t *reprocess_stream_ops,
                                                           // outputs
                                                           uint32_t *stream_id) {
+        ALOGV("%s: from stream %d", __FUNCTION__, output_stream_id);
+
+        AutoMutex lock(mLock);
+
+        if ((output_stream_id >= NUM_MAX_STREAM_THREAD)
+            || (m_streamThreads[output_stream_id] == NULL) || (reprocess_stream_ops == NULL)) {
+            ALOGE("%s: invalid stream %d",__FUNCTION__, output_stream_id);
+            return BAD_VALUE;
+        }
+
+        /* the buffers come back as they were filled, so only yuv the
+           encoder reads directly can be reprocessed */
+        stream_parameters_t* params = &(m_streamThreads[output_stream_id]->m_parameters);
+        if (!isReprocessFormat(params->format)) {
+            ALOGE("%s: stream %d format 0x%x can't be reprocessed",__FUNCTION__,
+                  output_stream_id, params->format);
+            return BAD_VALUE;
+        }
+
+        if (mReprocessAllocated) {
+            ALOGE("%s: reprocess stream already allocated",__FUNCTION__);
+            return INVALID_OPERATION;
+        }
+
+        mReprocessParameters.width = params->width;
+        mReprocessParameters.height = params->height;
+        mReprocessParameters.format = params->format;
+        mReprocessParameters.streamOps = reprocess_stream_ops;
+        mReprocessParameters.sourceStreamId = output_stream_id;
+        mReprocessAllocated = true;
+
+        *stream_id = STREAM_ID_JPEG_REPROCESS;
         return NO_ERROR;
     }
 
     int CameraHal2::release_Reprocess_stream(
                                              uint32_t stream_id) {
+        AutoMutex lock(mLock);
+
+        if ((stream_id != STREAM_ID_JPEG_REPROCESS) || !mReprocessAllocated) {
+            ALOGE("%s: invalid reprocess stream %d",__FUNCTION__, stream_id);
+            return BAD_VALUE;
+        }
+
+        memset(&mReprocessParameters, 0, sizeof(reprocess_parameters_t));
+        mReprocessParameters.sourceStreamId = -1;
+        mReprocessAllocated = false;
         return NO_ERROR;
     }
 
+    bool CameraHal2::isReprocessFormat(int format) {
+        switch (format) {
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        case HAL_PIXEL_FORMAT_JZ_YUV_420_P:
+            return true;
+        default:
+            return false;
+        }
+    }
+
     /**********************************************************************
      * Miscellaneous methods
      */
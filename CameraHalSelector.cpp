@@ -18,6 +18,7 @@
 namespace android {
     CameraHalSelector::CameraHalSelector()
         :mLock("CameraHalSelector::Lock"),
+         mOpenLock("CameraHalSelector::OpenLock"),
          mCameraNum(0),
          mCurrentId(-1),
          mversion(1),
@@ -38,7 +39,7 @@ namespace android {
             return;
         }
 
-        if (device_selector->selectDevice() != NO_ERROR) {
+        if (device_selector->selectDevice() == NULL) {
             delete device_selector;
             device_selector = NULL;
             ALOGE("select device error");
@@ -84,6 +85,9 @@ namespace android {
         }
 #endif
 
+        if (device_selector->startMonitor(this) != NO_ERROR) {
+            ALOGE("%s: no hotplug monitor, fall back to scanning on open",__FUNCTION__);
+        }
     }
 
     CameraHalSelector::~CameraHalSelector() {
@@ -106,6 +110,33 @@ namespace android {
         }
     }
 
+    void CameraHalSelector::onDeviceAdded(const char* path) {
+        ALOGV("%s: %s",__FUNCTION__, path);
+    }
+
+    /* called from the hotplug thread when a video node disappears */
+    void CameraHalSelector::onDeviceRemoved(const char* path) {
+
+        CameraHalCommon* opened[MAX_CAMERAS];
+        int num = 0;
+
+        {
+            AutoMutex lock(mLock);
+            for (int i = 0; (mHal != NULL) && (i < mCameraNum); ++i) {
+                if ((mHal[i] != NULL) && mHal[i]->getModuleInit()
+                    && (mNodeName[i] == path)) {
+                    ALOGE("%s: %s removed under camera %d",__FUNCTION__, path, i);
+                    opened[num++] = mHal[i];
+                }
+            }
+        }
+
+        /* the error callback may close the camera, do not hold mLock */
+        for (int i = 0; i < num; ++i) {
+            opened[i]->notifyDeviceRemoved();
+        }
+    }
+
     int CameraHalSelector::getNumberCamera(void) {
         AutoMutex lock(mLock);
 
@@ -151,30 +182,60 @@ namespace android {
         }
         int tmp_id = atoi(id);
 
-        if (tmp_id >= gCameraHalSelector.getNumberCamera()) {
+        AutoMutex lock(gCameraHalSelector.mOpenLock);
+
+        if (tmp_id < 0 || tmp_id >= gCameraHalSelector.getNumberCamera()) {
             ALOGE("%s: don't exist %d camera",__FUNCTION__,tmp_id);
             return INVALID_OPERATION;
         }
 
-        for (int i = 0; i < gCameraHalSelector.getNumberCamera(); ++i) {
-            if (gCameraHalSelector.mHal[i] != NULL
-                && gCameraHalSelector.mHal[i]->getModuleInit()) {
-                ALOGE("%s: camera %d already open",__FUNCTION__, i);
-                if (tmp_id == i) {
-                    return OK;
-                } else {
-                    return INVALID_OPERATION;
-                }
-            }
+        CameraHalCommon* hal = gCameraHalSelector.mHal[tmp_id];
+        if (hal == NULL) {
+            return INVALID_OPERATION;
+        }
+
+        if (hal->getModuleInit()) {
+            ALOGE("%s: camera %d already open",__FUNCTION__, tmp_id);
+            return OK;
+        }
+
+        /*
+         * Other cameras may stay open, each HAL has its own device, threads
+         * and buffers. Only refuse when the node is already streaming.
+         */
+        CameraDeviceSelector* selector = gCameraHalSelector.getDeviceSelector();
+        String8 node;
+        selector->tryAddDevice();
+        CameraDeviceCommon* camera_device = selector->selectDevice(tmp_id, &node);
+        if (camera_device == NULL) {
+            ALOGE("%s: no device for camera %d",__FUNCTION__, tmp_id);
+            return INVALID_OPERATION;
         }
 
-        if (tmp_id < gCameraHalSelector.getNumberCamera()
-            && gCameraHalSelector.mHal[tmp_id] != NULL) {
-            gCameraHalSelector.getDeviceSelector()->update_device(gCameraHalSelector.mHal[tmp_id], tmp_id);
-            return gCameraHalSelector.mHal[tmp_id]->module_open(module, id, device);
+        if (gCameraHalSelector.isNodeBusy(tmp_id, node)) {
+            ALOGE("%s: %s busy, camera %d not opened",__FUNCTION__, node.string(), tmp_id);
+            return -EBUSY;
         }
 
-        return INVALID_OPERATION;
+        hal->update_device(camera_device);
+        {
+            AutoMutex hal_lock(gCameraHalSelector.mLock);
+            gCameraHalSelector.mNodeName[tmp_id] = node;
+        }
+        ALOGV("%s: camera %d on %s",__FUNCTION__, tmp_id, node.string());
+        return hal->module_open(module, id, device);
+    }
+
+    bool CameraHalSelector::isNodeBusy(int id, const String8& node) {
+        AutoMutex lock(mLock);
+
+        for (int i = 0; (mHal != NULL) && (i < mCameraNum); ++i) {
+            if ((i != id) && (mHal[i] != NULL) && mHal[i]->getModuleInit()
+                && (mNodeName[i] == node)) {
+                return true;
+            }
+        }
+        return false;
     }
 
     hw_module_methods_t CameraHalSelector::mCameraModuleMethods = {
@@ -0,0 +1,268 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LOG_TAG "CameraHotplugMonitor"
+//#define LOG_NDEBUG 0
+#include "CameraHotplugMonitor.h"
+
+#include <poll.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/inotify.h>
+#include <linux/netlink.h>
+
+namespace android {
+
+    CameraHotplugMonitor::CameraHotplugMonitor()
+        :Thread(false),
+         mListener(NULL),
+         mEventFd(-1),
+         mUseUevent(false) {
+        mWakeFd[0] = -1;
+        mWakeFd[1] = -1;
+    }
+
+    CameraHotplugMonitor::~CameraHotplugMonitor() {
+        stop();
+    }
+
+    status_t CameraHotplugMonitor::start(Listener* listener) {
+
+        if (mEventFd >= 0) {
+            return NO_ERROR;
+        }
+
+        mListener = listener;
+        mUseUevent = true;
+        mEventFd = openUevent();
+        if (mEventFd < 0) {
+            mUseUevent = false;
+            mEventFd = openInotify();
+        }
+        if (mEventFd < 0) {
+            ALOGE("%s: no uevent or inotify source, hotplug disabled",__FUNCTION__);
+            return NO_INIT;
+        }
+
+        if (pipe(mWakeFd) < 0) {
+            ALOGE("%s: create wake pipe error: %s",__FUNCTION__, strerror(errno));
+            close(mEventFd);
+            mEventFd = -1;
+            return NO_INIT;
+        }
+
+        status_t ret = run("CameraHotplug", PRIORITY_BACKGROUND, 0);
+        if (ret != NO_ERROR) {
+            ALOGE("%s: start monitor thread fail, ret = %d",__FUNCTION__, ret);
+            stop();
+            return ret;
+        }
+        ALOGV("%s: watching %s",__FUNCTION__, mUseUevent ? "uevent" : "/dev");
+        return NO_ERROR;
+    }
+
+    void CameraHotplugMonitor::stop(void) {
+
+        requestExit();
+        if (mWakeFd[1] >= 0) {
+            write(mWakeFd[1], "x", 1);
+        }
+        requestExitAndWait();
+
+        for (int i = 0; i < 2; ++i) {
+            if (mWakeFd[i] >= 0) {
+                close(mWakeFd[i]);
+                mWakeFd[i] = -1;
+            }
+        }
+        if (mEventFd >= 0) {
+            close(mEventFd);
+            mEventFd = -1;
+        }
+    }
+
+    int CameraHotplugMonitor::openUevent(void) {
+
+        struct sockaddr_nl addr;
+        int fd = -1;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        addr.nl_pid = 0;
+        addr.nl_groups = 0xffffffff;
+
+        fd = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+        if (fd < 0) {
+            ALOGV("%s: netlink socket error: %s",__FUNCTION__, strerror(errno));
+            return -1;
+        }
+
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            ALOGV("%s: netlink bind error: %s",__FUNCTION__, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    int CameraHotplugMonitor::openInotify(void) {
+
+        int fd = inotify_init();
+        if (fd < 0) {
+            ALOGE("%s: inotify init error: %s",__FUNCTION__, strerror(errno));
+            return -1;
+        }
+
+        if (inotify_add_watch(fd, "/dev", IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+            ALOGE("%s: watch /dev error: %s",__FUNCTION__, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool CameraHotplugMonitor::threadLoop() {
+
+        char buf[HOTPLUG_UEVENT_BUFFER_SIZE];
+        struct pollfd fds[2];
+
+        fds[0].fd = mEventFd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = mWakeFd[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        if (poll(fds, 2, -1) < 0) {
+            return (errno == EINTR);
+        }
+
+        if (exitPending() || (fds[1].revents & POLLIN)) {
+            return false;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int len = read(mEventFd, buf, sizeof(buf) - 1);
+            if (len <= 0) {
+                return true;
+            }
+            buf[len] = '\0';
+            if (mUseUevent) {
+                handleUevent(buf, len);
+            } else {
+                handleInotify(buf, len);
+            }
+        }
+        return true;
+    }
+
+    /* "add@/devices/...\0ACTION=add\0SUBSYSTEM=video4linux\0DEVNAME=video1\0" */
+    void CameraHotplugMonitor::handleUevent(char* msg, int len) {
+
+        const char* action = NULL;
+        const char* subsystem = NULL;
+        const char* devname = NULL;
+        const char* devpath = NULL;
+        char* end = msg + len;
+
+        while (msg < end) {
+            if (strncmp(msg, "ACTION=", 7) == 0) {
+                action = msg + 7;
+            } else if (strncmp(msg, "SUBSYSTEM=", 10) == 0) {
+                subsystem = msg + 10;
+            } else if (strncmp(msg, "DEVNAME=", 8) == 0) {
+                devname = msg + 8;
+            } else if (strncmp(msg, "DEVPATH=", 8) == 0) {
+                devpath = msg + 8;
+            }
+            msg += strlen(msg) + 1;
+        }
+
+        if ((action == NULL) || (subsystem == NULL)
+            || strcmp(subsystem, "video4linux")) {
+            return;
+        }
+
+        /* older kernels leave DEVNAME out, the node is the last path element */
+        if ((devname == NULL) && (devpath != NULL)) {
+            devname = strrchr(devpath, '/');
+            devname = (devname != NULL) ? devname + 1 : devpath;
+        }
+        if (devname == NULL) {
+            return;
+        }
+
+        if (strcmp(action, "add") == 0) {
+            dispatch(true, devname);
+        } else if (strcmp(action, "remove") == 0) {
+            dispatch(false, devname);
+        }
+    }
+
+    void CameraHotplugMonitor::handleInotify(char* buf, int len) {
+
+        int offset = 0;
+
+        while (offset + (int)sizeof(struct inotify_event) <= len) {
+            struct inotify_event* event = (struct inotify_event*)(buf + offset);
+
+            if ((event->len > 0) && (strncmp(event->name, "video", 5) == 0)) {
+                if (event->mask & IN_DELETE) {
+                    dispatch(false, event->name);
+                } else if (event->mask & (IN_CREATE | IN_ATTRIB)) {
+                    dispatch(true, event->name);
+                }
+            }
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    void CameraHotplugMonitor::dispatch(bool add, const char* node) {
+
+        char path[PATH_MAX];
+
+        if (strncmp(node, "video", 5)) {
+            return;
+        }
+
+        snprintf(path, sizeof(path), "/dev/%s", node);
+        ALOGV("%s: %s %s",__FUNCTION__, add ? "add" : "remove", path);
+
+        if (mListener == NULL) {
+            return;
+        }
+
+        if (add) {
+            if (waitForNode(path)) {
+                mListener->onDeviceAdded(path);
+            } else {
+                ALOGE("%s: %s never became accessible",__FUNCTION__, path);
+            }
+        } else {
+            mListener->onDeviceRemoved(path);
+        }
+    }
+
+    bool CameraHotplugMonitor::waitForNode(const char* path) {
+
+        for (int waited = 0; waited <= HOTPLUG_NODE_WAIT_MS; waited += 10) {
+            if (access(path, R_OK|W_OK) == 0) {
+                return true;
+            }
+            if (exitPending()) {
+                break;
+            }
+            usleep(10000);
+        }
+        return false;
+    }
+};
@@ -0,0 +1,212 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LOG_TAG "CameraJpegEncodePool"
+//#define LOG_NDEBUG 0
+#include "CameraJpegEncodePool.h"
+
+namespace android {
+
+    CameraJpegEncodePool::CameraJpegEncodePool(int workers, int maxJobs)
+        :mLock("CameraJpegEncodePool::lock"),
+         mWorkerNum(workers > 0 ? workers : 1),
+         mMaxJobs(maxJobs > 0 ? maxJobs : 1),
+         mRunningJobs(0),
+         mNextSequence(0),
+         mDelivering(false),
+         mDeliveringTid(0),
+         mExiting(false) {
+    }
+
+    CameraJpegEncodePool::~CameraJpegEncodePool() {
+        stop();
+    }
+
+    status_t CameraJpegEncodePool::start(void) {
+        AutoMutex lock(mLock);
+
+        if (!mWorkers.isEmpty()) {
+            return NO_ERROR;
+        }
+
+        mExiting = false;
+        for (int i = 0; i < mWorkerNum; ++i) {
+            sp<EncodeWorker> worker = new EncodeWorker(this);
+            status_t ret = worker->run("CameraJpegEncode", PRIORITY_DEFAULT, 0);
+            if (ret != NO_ERROR) {
+                ALOGE("%s: start encode worker %d fail, ret = %d",__FUNCTION__, i, ret);
+                continue;
+            }
+            mWorkers.push_back(worker);
+        }
+        ALOGV("%s: %d encode workers started",__FUNCTION__, mWorkers.size());
+        return mWorkers.isEmpty() ? UNKNOWN_ERROR : NO_ERROR;
+    }
+
+    void CameraJpegEncodePool::stop(void) {
+
+        cancelAll();
+
+        Vector<sp<EncodeWorker> > workers;
+        {
+            AutoMutex lock(mLock);
+            mExiting = true;
+            mJobAvailable.broadcast();
+            workers = mWorkers;
+            mWorkers.clear();
+        }
+
+        for (size_t i = 0; i < workers.size(); ++i) {
+            workers[i]->requestExitAndWait();
+        }
+    }
+
+    status_t CameraJpegEncodePool::schedule(const sp<Job>& job, int priority) {
+        AutoMutex lock(mLock);
+
+        if (job == NULL) {
+            return BAD_VALUE;
+        }
+
+        if (mExiting || mWorkers.isEmpty()) {
+            ALOGE("%s: encode pool is not running",__FUNCTION__);
+            return INVALID_OPERATION;
+        }
+
+        if ((int)mOrderedJobs.size() >= mMaxJobs) {
+            ALOGE("%s: %d jobs in flight, drop new job",__FUNCTION__, mOrderedJobs.size());
+            return WOULD_BLOCK;
+        }
+
+        job->mSequence = mNextSequence++;
+        job->mPriority = priority;
+        job->mStatus = NO_ERROR;
+        job->mEncoded = false;
+        job->mCancelled = false;
+
+        List<sp<Job> >::iterator it = mPendingJobs.begin();
+        for (; it != mPendingJobs.end(); ++it) {
+            if ((*it)->mPriority < priority)
+                break;
+        }
+        mPendingJobs.insert(it, job);
+        mOrderedJobs.push_back(job);
+        mJobAvailable.signal();
+
+        ALOGV("%s: job %u priority %d, %d in flight",__FUNCTION__,
+              job->mSequence, priority, mOrderedJobs.size());
+        return NO_ERROR;
+    }
+
+    void CameraJpegEncodePool::cancelAll(void) {
+        AutoMutex lock(mLock);
+
+        if (mOrderedJobs.empty()) {
+            return;
+        }
+
+        List<sp<Job> >::iterator it = mPendingJobs.begin();
+        for (; it != mPendingJobs.end(); ++it) {
+            (*it)->mEncoded = true;
+        }
+        mPendingJobs.clear();
+
+        for (it = mOrderedJobs.begin(); it != mOrderedJobs.end(); ++it) {
+            (*it)->mCancelled = true;
+        }
+
+        deliverCompletedJobsLocked();
+
+        /*
+         * Called from a deliver() or discard() callback: that thread owns
+         * the delivery loop, waiting here would never return. The loop
+         * and the workers discard whatever is left.
+         */
+        if (mDelivering && (mDeliveringTid == gettid())) {
+            ALOGV("%s: called from a callback, not waiting",__FUNCTION__);
+            return;
+        }
+
+        /* jobs still on a worker are discarded as soon as they finish */
+        while (!mOrderedJobs.empty()) {
+            mJobRetired.wait(mLock);
+        }
+        ALOGV("%s: all jobs cancelled",__FUNCTION__);
+    }
+
+    int CameraJpegEncodePool::getJobCount(void) {
+        AutoMutex lock(mLock);
+        return mOrderedJobs.size();
+    }
+
+    bool CameraJpegEncodePool::processNextJob(void) {
+        sp<Job> job = NULL;
+
+        mLock.lock();
+        while (!mExiting && mPendingJobs.empty()) {
+            mJobAvailable.wait(mLock);
+        }
+
+        if (mExiting) {
+            mLock.unlock();
+            return false;
+        }
+
+        job = *(mPendingJobs.begin());
+        mPendingJobs.erase(mPendingJobs.begin());
+        mRunningJobs++;
+        mLock.unlock();
+
+        ALOGV("%s: encode job %u",__FUNCTION__, job->mSequence);
+        status_t ret = job->encode();
+
+        mLock.lock();
+        mRunningJobs--;
+        job->mStatus = ret;
+        job->mEncoded = true;
+        deliverCompletedJobsLocked();
+        mLock.unlock();
+
+        return true;
+    }
+
+    /* called with mLock held, drops it around each callback */
+    void CameraJpegEncodePool::deliverCompletedJobsLocked(void) {
+
+        if (mDelivering) {
+            return;
+        }
+
+        mDelivering = true;
+        mDeliveringTid = gettid();
+        while (!mOrderedJobs.empty()) {
+            sp<Job> job = *(mOrderedJobs.begin());
+            if (!job->mEncoded) {
+                break;
+            }
+            mOrderedJobs.erase(mOrderedJobs.begin());
+
+            mLock.unlock();
+            if (job->mCancelled) {
+                job->discard();
+            } else {
+                job->deliver(job->mStatus);
+            }
+            job.clear();
+            mLock.lock();
+
+            mJobRetired.broadcast();
+        }
+        mDelivering = false;
+        mDeliveringTid = 0;
+    }
+};
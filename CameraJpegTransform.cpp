@@ -0,0 +1,270 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LOG_TAG "CameraJpegTransform"
+//#define LOG_NDEBUG 0
+
+#include "CameraJpegTransform.h"
+#include "SkJpegUtility.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <jpeglib.h>
+
+#ifdef __cplusplus
+}
+#endif
+
+namespace android {
+
+    /* the 2x2 matrix of a transform, flips first and then the 90 degree turn */
+    static void transform_matrix(int transform, int m[4]) {
+        int a = (transform & HAL_TRANSFORM_FLIP_H) ? -1 : 1;
+        int b = (transform & HAL_TRANSFORM_FLIP_V) ? -1 : 1;
+
+        if (transform & HAL_TRANSFORM_ROT_90) {
+            m[0] = 0; m[1] = -b;
+            m[2] = a; m[3] = 0;
+        } else {
+            m[0] = a; m[1] = 0;
+            m[2] = 0; m[3] = b;
+        }
+    }
+
+    int CameraJpegTransform::fromDegrees(int degrees) {
+        switch (degrees) {
+        case 90:
+            return HAL_TRANSFORM_ROT_90;
+        case 180:
+            return HAL_TRANSFORM_ROT_180;
+        case 270:
+            return HAL_TRANSFORM_ROT_270;
+        }
+        return 0;
+    }
+
+    int CameraJpegTransform::compose(int first, int second) {
+        int m1[4], m2[4], m[4], t[4];
+
+        transform_matrix(first, m1);
+        transform_matrix(second, m2);
+        m[0] = m2[0] * m1[0] + m2[1] * m1[2];
+        m[1] = m2[0] * m1[1] + m2[1] * m1[3];
+        m[2] = m2[2] * m1[0] + m2[3] * m1[2];
+        m[3] = m2[2] * m1[1] + m2[3] * m1[3];
+
+        for (int i = 0; i < 8; ++i) {
+            transform_matrix(i, t);
+            if (memcmp(m, t, sizeof(t)) == 0)
+                return i;
+        }
+        return 0;
+    }
+
+    static void source_init(j_decompress_ptr cinfo) {
+    }
+
+    static boolean source_fill(j_decompress_ptr cinfo) {
+        /* a truncated stream ends here instead of reading past the buffer */
+        static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+
+        cinfo->src->next_input_byte = eoi;
+        cinfo->src->bytes_in_buffer = 2;
+        return TRUE;
+    }
+
+    static void source_skip(j_decompress_ptr cinfo, long num_bytes) {
+        if (num_bytes <= 0)
+            return;
+        if ((size_t)num_bytes > cinfo->src->bytes_in_buffer)
+            num_bytes = cinfo->src->bytes_in_buffer;
+        cinfo->src->next_input_byte += num_bytes;
+        cinfo->src->bytes_in_buffer -= num_bytes;
+    }
+
+    static void source_term(j_decompress_ptr cinfo) {
+    }
+
+    /*
+     * dst is the block at the transformed position. Mirroring an axis
+     * negates the odd frequencies along it, a transpose swaps u and v.
+     */
+    static void transform_block(JCOEFPTR src, JCOEFPTR dst, bool swap, bool fx, bool fy) {
+        for (int v = 0; v < DCTSIZE; ++v) {
+            for (int u = 0; u < DCTSIZE; ++u) {
+                int su = swap ? v : u;
+                int sv = swap ? u : v;
+                JCOEF coef = src[sv * DCTSIZE + su];
+                if ((fx && (su & 1)) != (fy && (sv & 1)))
+                    coef = -coef;
+                dst[v * DCTSIZE + u] = coef;
+            }
+        }
+    }
+
+    status_t CameraJpegTransform::transform(const uint8_t* jpeg, size_t size, int transform,
+                                            SkDynamicMemoryWStream* out) {
+
+        struct jpeg_decompress_struct srcinfo;
+        struct jpeg_compress_struct dstinfo;
+        struct jpeg_source_mgr source;
+        skjpeg_error_mgr jerr;
+        skjpeg_destination_mgr dest(out);
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        if (jpeg == NULL || size == 0 || out == NULL) {
+            return BAD_VALUE;
+        }
+
+        memset(&srcinfo, 0, sizeof(srcinfo));
+        memset(&dstinfo, 0, sizeof(dstinfo));
+        srcinfo.err = jpeg_std_error(&jerr);
+        dstinfo.err = &jerr;
+        jerr.error_exit = skjpeg_error_exit;
+        if (setjmp(jerr.fJmpBuf)) {
+            ALOGE("%s: transform %d fail",__FUNCTION__, transform);
+            jpeg_destroy_compress(&dstinfo);
+            jpeg_destroy_decompress(&srcinfo);
+            return UNKNOWN_ERROR;
+        }
+
+        jpeg_create_decompress(&srcinfo);
+        jpeg_create_compress(&dstinfo);
+
+        source.next_input_byte = jpeg;
+        source.bytes_in_buffer = size;
+        source.init_source = source_init;
+        source.fill_input_buffer = source_fill;
+        source.skip_input_data = source_skip;
+        source.resync_to_restart = jpeg_resync_to_restart;
+        source.term_source = source_term;
+        srcinfo.src = &source;
+
+        jpeg_read_header(&srcinfo, TRUE);
+        jvirt_barray_ptr* src_coefs = jpeg_read_coefficients(&srcinfo);
+        jpeg_copy_critical_parameters(&srcinfo, &dstinfo);
+
+        /* walk the destination, (swap, fx, fy) is where each block comes from */
+        bool swap = (transform & HAL_TRANSFORM_ROT_90) != 0;
+        bool fx = (transform & HAL_TRANSFORM_FLIP_H) != 0;
+        bool fy = ((transform & HAL_TRANSFORM_FLIP_V) != 0) != swap;
+
+        int mcu_w = srcinfo.max_h_samp_factor * DCTSIZE;
+        int mcu_h = srcinfo.max_v_samp_factor * DCTSIZE;
+        JDIMENSION width = srcinfo.image_width;
+        JDIMENSION height = srcinfo.image_height;
+        if (fx)
+            width -= width % mcu_w;
+        if (fy)
+            height -= height % mcu_h;
+        if (width == 0 || height == 0) {
+            ALOGE("%s: %dx%d is smaller than one mcu",__FUNCTION__,
+                  srcinfo.image_width, srcinfo.image_height);
+            jpeg_destroy_compress(&dstinfo);
+            jpeg_destroy_decompress(&srcinfo);
+            return BAD_VALUE;
+        }
+
+        int max_h = srcinfo.max_h_samp_factor;
+        int max_v = srcinfo.max_v_samp_factor;
+        dstinfo.image_width = swap ? height : width;
+        dstinfo.image_height = swap ? width : height;
+        if (swap) {
+            for (int ci = 0; ci < dstinfo.num_components; ++ci) {
+                jpeg_component_info* comp = dstinfo.comp_info + ci;
+                int h_samp = comp->h_samp_factor;
+                comp->h_samp_factor = comp->v_samp_factor;
+                comp->v_samp_factor = h_samp;
+            }
+            max_h = srcinfo.max_v_samp_factor;
+            max_v = srcinfo.max_h_samp_factor;
+
+            /* the blocks get transposed, so must the tables dequantizing them */
+            for (int tbl = 0; tbl < NUM_QUANT_TBLS; ++tbl) {
+                JQUANT_TBL* qtbl = dstinfo.quant_tbl_ptrs[tbl];
+                if (qtbl == NULL)
+                    continue;
+                for (int v = 0; v < DCTSIZE; ++v) {
+                    for (int u = v + 1; u < DCTSIZE; ++u) {
+                        UINT16 qval = qtbl->quantval[v * DCTSIZE + u];
+                        qtbl->quantval[v * DCTSIZE + u] = qtbl->quantval[u * DCTSIZE + v];
+                        qtbl->quantval[u * DCTSIZE + v] = qval;
+                    }
+                }
+            }
+        }
+
+        jvirt_barray_ptr* dst_coefs = (jvirt_barray_ptr*)
+            (*dstinfo.mem->alloc_small)((j_common_ptr)&dstinfo, JPOOL_IMAGE,
+                                        sizeof(jvirt_barray_ptr) * dstinfo.num_components);
+        for (int ci = 0; ci < dstinfo.num_components; ++ci) {
+            jpeg_component_info* comp = dstinfo.comp_info + ci;
+            int h_samp = comp->h_samp_factor;
+            int v_samp = comp->v_samp_factor;
+            /* the sizes jpeg_write_coefficients works out, rounded to whole mcus */
+            int blocks_w = (dstinfo.image_width * h_samp + max_h * DCTSIZE - 1) / (max_h * DCTSIZE);
+            int blocks_h = (dstinfo.image_height * v_samp + max_v * DCTSIZE - 1) / (max_v * DCTSIZE);
+            dst_coefs[ci] = (*dstinfo.mem->request_virt_barray)
+                ((j_common_ptr)&dstinfo, JPOOL_IMAGE, FALSE,
+                 (blocks_w + h_samp - 1) / h_samp * h_samp,
+                 (blocks_h + v_samp - 1) / v_samp * v_samp, v_samp);
+        }
+
+        dstinfo.dest = &dest;
+        jpeg_write_coefficients(&dstinfo, dst_coefs);
+
+        for (int ci = 0; ci < dstinfo.num_components; ++ci) {
+            jpeg_component_info* dcomp = dstinfo.comp_info + ci;
+            jpeg_component_info* scomp = srcinfo.comp_info + ci;
+            int src_w = fx ? (int)(width / mcu_w) * scomp->h_samp_factor
+                : (int)scomp->width_in_blocks;
+            int src_h = fy ? (int)(height / mcu_h) * scomp->v_samp_factor
+                : (int)scomp->height_in_blocks;
+
+            /* a whole mcu row at a time, the encoder reads the padding rows too */
+            for (JDIMENSION dby = 0; dby < dcomp->height_in_blocks; dby += dcomp->v_samp_factor) {
+                JBLOCKARRAY drows = (*dstinfo.mem->access_virt_barray)
+                    ((j_common_ptr)&dstinfo, dst_coefs[ci], dby, dcomp->v_samp_factor, TRUE);
+
+                for (int row = 0; row < dcomp->v_samp_factor; ++row) {
+                    JDIMENSION y = dby + row;
+                    if (y >= dcomp->height_in_blocks) {
+                        memset(drows[row], 0, sizeof(JBLOCK) * dcomp->width_in_blocks);
+                        continue;
+                    }
+                    for (JDIMENSION x = 0; x < dcomp->width_in_blocks; ++x) {
+                        int sbx = swap ? y : x;
+                        int sby = swap ? x : y;
+                        if (fx)
+                            sbx = src_w - 1 - sbx;
+                        if (fy)
+                            sby = src_h - 1 - sby;
+                        JBLOCKARRAY srows = (*srcinfo.mem->access_virt_barray)
+                            ((j_common_ptr)&srcinfo, src_coefs[ci], sby, 1, FALSE);
+                        transform_block(srows[0][sbx], drows[row][x], swap, fx, fy);
+                    }
+                }
+            }
+        }
+
+        jpeg_finish_compress(&dstinfo);
+        jpeg_finish_decompress(&srcinfo);
+        jpeg_destroy_compress(&dstinfo);
+        jpeg_destroy_decompress(&srcinfo);
+
+        ALOGV("%s: transform %d, %d bytes -> %d bytes in %lld us",__FUNCTION__, transform,
+              size, out->getOffset(), (systemTime(SYSTEM_TIME_MONOTONIC) - start) / 1000LL);
+        return NO_ERROR;
+    }
+};
@@ -0,0 +1,103 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LOG_TAG "CameraPrefault"
+//#define LOG_NDEBUG 0
+#include "CameraPrefault.h"
+
+#include <pthread.h>
+
+namespace android {
+
+    void CameraPrefault::mapBuffer(struct dmmu_mem_info* info, bool populated) {
+
+        nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        uint8_t* addr = (uint8_t*)(info->vaddr);
+        int size = (int)(info->size);
+
+        if ((addr == NULL) || (size <= 0)) {
+            ALOGE("%s: invalid buffer %p, size: %d",__FUNCTION__, addr, size);
+            return;
+        }
+
+        /*
+         * A populated pool should not fault any more, the single pass is
+         * left in for drivers whose mmap ignores MAP_POPULATE.
+         */
+        if (populated) {
+            touch(addr, size);
+        } else {
+            /* every page is faulted in by a write, nothing cheaper does it for ashmem */
+            int threads = 1;
+            if (size >= PREFAULT_PARALLEL_SIZE) {
+                threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+                if (threads > PREFAULT_MAX_THREADS) {
+                    threads = PREFAULT_MAX_THREADS;
+                }
+                if (threads < 1) {
+                    threads = 1;
+                }
+            }
+
+            touch_range_t ranges[PREFAULT_MAX_THREADS];
+            pthread_t helpers[PREFAULT_MAX_THREADS];
+            bool started[PREFAULT_MAX_THREADS];
+            int chunk = ((size / threads) + PREFAULT_PAGE_SIZE - 1) & ~(PREFAULT_PAGE_SIZE - 1);
+            int offset = 0;
+
+            for (int i = 0; i < threads; ++i) {
+                ranges[i].addr = addr + offset;
+                ranges[i].size = (i == threads - 1) ? (size - offset) : chunk;
+                offset += ranges[i].size;
+                started[i] = false;
+            }
+
+            /* this thread takes the first range itself */
+            for (int i = 1; i < threads; ++i) {
+                started[i] = (pthread_create(&helpers[i], NULL, touchThread, &ranges[i]) == 0);
+                if (!started[i]) {
+                    touch(ranges[i].addr, ranges[i].size);
+                }
+            }
+            touch(ranges[0].addr, ranges[0].size);
+            for (int i = 1; i < threads; ++i) {
+                if (started[i]) {
+                    pthread_join(helpers[i], NULL);
+                }
+            }
+        }
+
+        dmmu_map_user_memory(info);
+
+        ALOGV("%s: %p %fMib %s in %lld us",__FUNCTION__, addr,
+              size / (1024.0 * 1024.0), populated ? "populated" : "touched",
+              (systemTime(SYSTEM_TIME_MONOTONIC) - startTime) / 1000LL);
+    }
+
+    void CameraPrefault::touch(uint8_t* addr, int size) {
+
+        if (size <= 0) {
+            return;
+        }
+        for (int i = 0; i < size; i += PREFAULT_PAGE_SIZE) {
+            addr[i] = 0xff;
+        }
+        addr[size - 1] = 0xff;
+    }
+
+    void* CameraPrefault::touchThread(void* data) {
+        touch_range_t* range = (touch_range_t*)data;
+
+        touch(range->addr, range->size);
+        return NULL;
+    }
+};
@@ -21,19 +21,6 @@
 
 namespace android {
 
-    Mutex CameraV4L2Device::sLock;
-    CameraV4L2Device* CameraV4L2Device::sInstance = NULL;
-
-    CameraV4L2Device* CameraV4L2Device::getInstance() {
-        Mutex::Autolock _l(sLock);
-        CameraV4L2Device* instance = sInstance;
-        if (instance == 0) {
-            instance = new CameraV4L2Device();
-            sInstance = instance;
-        }
-        return instance;
-    }
-
     CameraV4L2Device::CameraV4L2Device()
         :CameraDeviceCommon(),
          mlock("CameraV4L2Device::lock"),
@@ -61,7 +48,10 @@ namespace android {
          io(IO_METHOD_USERPTR),
          isChangedSize(false),
          isSupportHighResuPre(false),
-         mReqLostFrameNum(LOST_FRAME_NUM) {
+         mReqLostFrameNum(LOST_FRAME_NUM),
+         mHoldLock("CameraV4L2Device::HoldLock"),
+         mHoldFrame(false),
+         mHeldFrames(0) {
         videoIn = (struct vdIn*)calloc(1, sizeof(struct vdIn));
         memset(&mglobal_info, 0, sizeof(struct global_info));
         memset(device_name, 0, 256);
@@ -72,11 +62,14 @@ namespace android {
         for (int i = 0; i < NB_BUFFER; ++i) {
             mPreviewBuffer[i] = NULL;
         }
+        memset(mHeldBuffer, 0, sizeof(mHeldBuffer));
         initGlobalInfo();
         s.control_list = NULL;
         s.num_controls = 0;
         s.width_req = 0;
         s.height_req = 0;
+        memset(mModeControls, 0, sizeof(mModeControls));
+        mBatchControls = false;
     }
 
     void CameraV4L2Device::setDeviceCount(int num)
@@ -103,6 +96,15 @@ namespace android {
 
     CameraV4L2Device::~CameraV4L2Device()
     {
+        for (size_t i = 0; i < mDeviceCaps.size(); ++i) {
+            DeviceCaps* caps = mDeviceCaps.valueAt(i);
+            if (caps->control_list != NULL) {
+                free_control_list(caps->control_list);
+            }
+            delete caps;
+        }
+        mDeviceCaps.clear();
+
         if (videoIn != NULL) {
             free(videoIn);
             videoIn = NULL;
@@ -139,6 +141,14 @@ namespace android {
     int CameraV4L2Device::init_read (unsigned int buffer_size,
                                      camera_request_memory get_memory) {
 
+        /* same size again, the buffer is still faulted in and mapped */
+        if (videoIn->read_write_buffers != NULL) {
+            if (videoIn->read_write_buffers->size == buffer_size) {
+                return NO_ERROR;
+            }
+            freeReadWritePreviewBuffer();
+        }
+
         videoIn->read_write_buffers = get_memory(-1, buffer_size, 1, NULL);
         if (videoIn->read_write_buffers == NULL) {
             ALOGE("Out of memory");
@@ -199,20 +209,22 @@ namespace android {
             }
             videoIn->mem_length[i] = videoIn->buf.length;
             videoIn->mem_num++;
+            /* the driver owns these pages, let mmap fault them all in at once */
             videoIn->mem[i] = mmap(NULL,
                                    videoIn->buf.length,
                                    PROT_READ|PROT_WRITE,
-                                   MAP_SHARED,
+                                   MAP_SHARED | MAP_POPULATE,
                                    device_fd,
                                    videoIn->buf.m.offset);
-            memset(&dmmu_info, 0, sizeof(struct dmmu_mem_info));
-            dmmu_info.vaddr = videoIn->mem[i];
-            dmmu_info.size = videoIn->mem_length[i];
-            dmmu_map_buffer(&dmmu_info);
             if (videoIn->mem[i] == MAP_FAILED) {
                 ALOGE("Init: Unable to map buffer (%s)", strerror(errno));
+                videoIn->mem[i] = NULL;
                 return -1;
             }
+            memset(&dmmu_info, 0, sizeof(struct dmmu_mem_info));
+            dmmu_info.vaddr = videoIn->mem[i];
+            dmmu_info.size = videoIn->mem_length[i];
+            dmmu_map_buffer(&dmmu_info, true);
             ret = ::ioctl(device_fd, VIDIOC_QBUF, &videoIn->buf);
             if (ret < 0) {
                 ALOGE("Init: VIDIOC_QBUF failed, err: %s",strerror(errno));
@@ -270,6 +282,14 @@ namespace android {
                  + (i * preview_buffer.size);
             }
 
+            preview_buffer.paddr = 0;
+            if (preview_use_pmem) {
+                struct pmem_region region;
+                if (::ioctl(preview_buffer.fd, PMEM_GET_PHYS, &region) == 0) {
+                    preview_buffer.paddr = region.offset;
+                }
+            }
+
             preview_buffer.dmmu_info.vaddr = preview_buffer.common->data;
             preview_buffer.dmmu_info.size = preview_buffer.common->size;
             dmmu_map_buffer(&preview_buffer.dmmu_info);
@@ -280,6 +300,7 @@ namespace android {
 
     reqbuf:
         mCurrentFrameIndex = 0;
+        clearHeldFrames();
         memset(&videoIn->rb, 0, sizeof(videoIn->rb));
         videoIn->rb.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         videoIn->rb.memory = V4L2_MEMORY_USERPTR;
@@ -320,12 +341,8 @@ namespace android {
         return NO_ERROR;
     }
 
-    void CameraV4L2Device::dmmu_map_buffer(struct dmmu_mem_info *dmmu_info) {
-        for (int i = 0; i < (int)(dmmu_info->size); i += 0x1000) {
-            ((uint8_t*)(dmmu_info->vaddr))[i] = 0xff;
-        }
-        ((uint8_t*)(dmmu_info->vaddr))[dmmu_info->size - 1] = 0xff;
-        dmmu_map_user_memory(dmmu_info);
+    void CameraV4L2Device::dmmu_map_buffer(struct dmmu_mem_info *dmmu_info, bool populated) {
+        CameraPrefault::mapBuffer(dmmu_info, populated);
     }
 
     void CameraV4L2Device::freeStream(BufferType type) {
@@ -453,6 +470,9 @@ namespace android {
                     } else {
                         mReqLostFrameNum++;
                         ALOGD("lost %d frame.",mReqLostFrameNum);
+                        if (mHoldFrame) {
+                            releaseFrame(mCurrentFrameIndex);
+                        }
                         continue;
                     }
                 }
@@ -467,6 +487,76 @@ namespace android {
         return (void*)yuvMeta;
     }
 
+    int CameraV4L2Device::getHeldFrameMax(void) {
+        return (io == IO_METHOD_READ) ? 0 : NB_HELD_BUFFER;
+    }
+
+    /*
+     * getCurrentFrame() without giving the buffer back to the driver,
+     * so whoever reads it later sees the frame and not a newer one.
+     * NULL when NB_HELD_BUFFER frames are already held.
+     */
+    void* CameraV4L2Device::getHeldFrame(void) {
+
+        if (getHeldFrameMax() == 0) {
+            return NULL;
+        }
+
+        {
+            AutoMutex lock(mHoldLock);
+            int held = 0;
+            for (int i = 0; i < NB_BUFFER; ++i) {
+                if (mHeldFrames & (1 << i))
+                    held++;
+            }
+            if (held >= NB_HELD_BUFFER) {
+                return NULL;
+            }
+        }
+
+        mHoldFrame = true;
+        void* frame = getCurrentFrame();
+        mHoldFrame = false;
+        return frame;
+    }
+
+    void CameraV4L2Device::releaseFrame(int index) {
+
+        AutoMutex lock(mHoldLock);
+        if ((index < 0) || (index >= NB_BUFFER) || !(mHeldFrames & (1 << index))) {
+            return;
+        }
+        mHeldFrames &= ~(1 << index);
+
+        if (device_fd < 0) {
+            return;
+        }
+        struct v4l2_buffer buf = mHeldBuffer[index];
+        if (::ioctl(device_fd, VIDIOC_QBUF, &buf) < 0) {
+            ALOGE("%s: VIDIOC_QBUF %d failed,err: %s",__FUNCTION__, index, strerror(errno));
+        }
+    }
+
+    /* called on the frame just dequeued into videoIn->buf */
+    bool CameraV4L2Device::holdDequeuedFrame(int index) {
+
+        if (!mHoldFrame || (index < 0) || (index >= NB_BUFFER)) {
+            return false;
+        }
+
+        AutoMutex lock(mHoldLock);
+        mHeldBuffer[index] = videoIn->buf;
+        mHeldFrames |= (1 << index);
+        return true;
+    }
+
+    /* the driver owns every buffer again after REQBUFS or STREAMOFF */
+    void CameraV4L2Device::clearHeldFrames(void) {
+
+        AutoMutex lock(mHoldLock);
+        mHeldFrames = 0;
+    }
+
     void* CameraV4L2Device::read_frame(void)
     {
         switch (io) {
@@ -574,9 +664,17 @@ namespace android {
             yuvMeta->vAddr = yuvMeta->uAddr;
         }
 
-        ret = ::ioctl(device_fd, VIDIOC_QBUF, &videoIn->buf);
-        if (ret < 0) {
-            ALOGE("%s : VIDIOC_QBUF failed,err: %s",__FUNCTION__,strerror(errno));
+        if (preview_buffer.paddr != 0) {
+            yuvMeta->yPhy = preview_buffer.paddr + mCurrentFrameIndex * preview_buffer.size;
+            yuvMeta->uPhy = yuvMeta->yPhy + (yuvMeta->uAddr - yuvMeta->yAddr);
+            yuvMeta->vPhy = yuvMeta->yPhy + (yuvMeta->vAddr - yuvMeta->yAddr);
+        }
+
+        if (!holdDequeuedFrame(mCurrentFrameIndex)) {
+            ret = ::ioctl(device_fd, VIDIOC_QBUF, &videoIn->buf);
+            if (ret < 0) {
+                ALOGE("%s : VIDIOC_QBUF failed,err: %s",__FUNCTION__,strerror(errno));
+            }
         }
         return (void*)yuvMeta;
     }
@@ -622,7 +720,8 @@ namespace android {
             return NULL;
         }
 
-        if (-1 == ::ioctl (device_fd, VIDIOC_QBUF, &videoIn->buf)) {
+        if (!holdDequeuedFrame(mCurrentFrameIndex)
+            && (-1 == ::ioctl (device_fd, VIDIOC_QBUF, &videoIn->buf))) {
             ALOGE("%s: qbuf error: %s",__FUNCTION__, strerror(errno));
         }
         return (void*)yuvMeta;
@@ -649,13 +748,17 @@ namespace android {
         int size = 0;
         int flag = 1;
 
-        if ((buffer == NULL) && (preview_buffer.yuvMeta[0].yAddr > 0)) {
+        /* NULL is the frame last dequeued, it always sits in yuvMeta[0] */
+        if (buffer == NULL) {
             addr = preview_buffer.yuvMeta[0].yAddr;
-            size = preview_buffer.size * preview_buffer.nr;
+            size = preview_buffer.size;
         } else {
             addr = (uint32_t)buffer;
             size = buffer_size;
         }
+        if ((addr == 0) || (size <= 0)) {
+            return;
+        }
         cacheflush((long int)addr, (long int)((unsigned int)addr+size), flag);
     }
 
@@ -712,7 +815,6 @@ namespace android {
     int CameraV4L2Device::setCommonMode(CommonMode mode_type, unsigned short mode_value)
     {
         status_t res = NO_ERROR;
-        const char* control_name = NULL;
         const mode_map_t *table = NULL;
         int table_len = 0;
 
@@ -720,45 +822,39 @@ namespace android {
             {
             case WHITE_BALANCE:
                 ALOGV("set white balance mode");
-                control_name = CameraParameters::KEY_WHITE_BALANCE;
                 table = JZCameraParameters::wb_map;
                 table_len = JZCameraParameters::num_wb;
-                return set_menu_ctrl(control_name, table, table_len, mode_value);
+                return set_menu_ctrl(mModeControls[mode_type], table, table_len, mode_value);
                 break;
             case EFFECT_MODE:
                 ALOGV("set effect mode");
-                control_name = CameraParameters::KEY_EFFECT;
                 table = JZCameraParameters::effect_map;
                 table_len = JZCameraParameters::num_eb;
-                return set_menu_ctrl(control_name, table, table_len, mode_value);
+                return set_menu_ctrl(mModeControls[mode_type], table, table_len, mode_value);
                 break;
             case FOCUS_MODE:
                 ALOGV("set focus mode");
-                control_name = CameraParameters::KEY_FOCUS_MODE;
                 table = JZCameraParameters::focus_map;
                 table_len = JZCameraParameters::num_fb;
-                return set_menu_ctrl(control_name, table, table_len, mode_value);
+                return set_menu_ctrl(mModeControls[mode_type], table, table_len, mode_value);
                 break;
             case FLASH_MODE:
                 ALOGV("set flash mode");
-                control_name = CameraParameters::KEY_FLASH_MODE;
                 table = JZCameraParameters::flash_map;
                 table_len = JZCameraParameters::num_flb;
-                return set_menu_ctrl(control_name, table, table_len, mode_value);
+                return set_menu_ctrl(mModeControls[mode_type], table, table_len, mode_value);
                 break;
             case SCENE_MODE:
                 ALOGV("set scene mode");
-                control_name = CameraParameters::KEY_SCENE_MODE;
                 table = JZCameraParameters::scene_map;
                 table_len = JZCameraParameters::num_sb;
-                return set_menu_ctrl(control_name, table, table_len, mode_value);
+                return set_menu_ctrl(mModeControls[mode_type], table, table_len, mode_value);
                 break;
             case ANTIBAND_MODE:
                 ALOGV("set antiband mode");
-                control_name = CameraParameters::KEY_ANTIBANDING;
                 table = JZCameraParameters::antibanding_map;
                 table_len = JZCameraParameters::num_ab;
-                return set_menu_ctrl(control_name, table, table_len, mode_value);
+                return set_menu_ctrl(mModeControls[mode_type], table, table_len, mode_value);
                 break;
             case FLIP_HORIZONTALLY:
                 {
@@ -818,11 +914,9 @@ namespace android {
 
         Control *current_control = s->control_list;
         if (ctrl_id != -1) {
-            for (int i=0; i<s->num_controls; ++i) {
-                if ((int)current_control->control.id == ctrl_id) {
-                    return current_control;
-                }
-                current_control = current_control->next;
+            ssize_t index = mControlIndex.indexOfKey((uint32_t)ctrl_id);
+            if (index >= 0) {
+                return mControlIndex.valueAt(index);
             }
         } else if ((ctrl_name != NULL)
                    && (strlen(ctrl_name) > 0)) {
@@ -859,13 +953,12 @@ namespace android {
         return BAD_VALUE;
     }
 
-    int CameraV4L2Device::set_menu_ctrl(const char* ctrl_name, const mode_map_t table[],
+    int CameraV4L2Device::set_menu_ctrl(Control* current_control, const mode_map_t table[],
                                     int table_len, unsigned short mode_value) {
 
         int res = BAD_VALUE;
         const char* menu_name = NULL;
         struct v4l2_control control;
-        Control * current_control = NULL;
         memset (&control, 0, sizeof (control));
 
         /* find mode menu name */
@@ -900,7 +993,7 @@ namespace android {
         }
 #endif
 
-        current_control = find_control(ctrl_name, -1);
+        res = BAD_VALUE;
         if (current_control != NULL) {
             control.id = current_control->control.id;
             res = find_menu(current_control,menu_name,&control.value);
@@ -912,15 +1005,119 @@ namespace android {
         }
 
         ALOGV( "%s: id: %d, ctrl name: %s, menu name: %s, mode value: %d, value: %d",
-               __FUNCTION__,control.id, ctrl_name, menu_name, mode_value,control.value);
-        if ((device_fd > 0) && (-1 == ioctl (device_fd, VIDIOC_S_CTRL, &control))) {
-            ALOGE("%s: device fd: %d, set %d id, mode value: %d, value: %d error: %s",__FUNCTION__,
-                  device_fd,control.id, mode_value,control.value, strerror(errno));
-            return BAD_VALUE;
+               __FUNCTION__,control.id, (const char*)current_control->control.name,
+               menu_name, mode_value,control.value);
+        return queue_ctrl(current_control, control.value);
+    }
+
+    void CameraV4L2Device::beginControlBatch(void) {
+        mPendingControls.clear();
+        mBatchControls = true;
+    }
+
+    int CameraV4L2Device::commitControlBatch(void) {
+
+        int res = NO_ERROR;
+
+        mBatchControls = false;
+        if (mPendingControls.isEmpty()) {
+            return NO_ERROR;
+        }
+
+        res = apply_ctrls(mPendingControls.editArray(), mPendingControls.size());
+        mPendingControls.clear();
+        return res;
+    }
+
+    /* skip values the sensor already has, defer the rest while batching */
+    int CameraV4L2Device::queue_ctrl(Control* control, int value) {
+
+        struct v4l2_ext_control ext_ctrl;
+
+        if (control->cached && control->value == value) {
+            ALOGV("%s: id: %x already %d",__FUNCTION__, control->control.id, value);
+            return NO_ERROR;
         }
+
+        memset(&ext_ctrl, 0, sizeof(ext_ctrl));
+        ext_ctrl.id = control->control.id;
+        ext_ctrl.value = value;
+
+        if (!mBatchControls) {
+            return apply_ctrls(&ext_ctrl, 1);
+        }
+
+        for (size_t i = 0; i < mPendingControls.size(); ++i) {
+            if (mPendingControls[i].id == ext_ctrl.id) {
+                mPendingControls.editItemAt(i).value = value;
+                return NO_ERROR;
+            }
+        }
+        mPendingControls.push_back(ext_ctrl);
         return NO_ERROR;
     }
 
+    /*
+     * One VIDIOC_S_EXT_CTRLS per control class, falling back to S_CTRL
+     * for drivers that only implement the single control ioctl.
+     */
+    int CameraV4L2Device::apply_ctrls(struct v4l2_ext_control* ctrls, int count) {
+
+        int res = NO_ERROR;
+        int start = 0;
+
+        if (device_fd < 0) {
+            return NO_ERROR;
+        }
+
+        while (start < count) {
+            struct v4l2_ext_controls ext_ctrls;
+            unsigned int ctrl_class = V4L2_CTRL_ID2CLASS(ctrls[start].id);
+            int end = start + 1;
+
+            /* keep same-class controls together so they go out in one call */
+            for (int i = start + 1; i < count; ++i) {
+                if (V4L2_CTRL_ID2CLASS(ctrls[i].id) == ctrl_class) {
+                    struct v4l2_ext_control tmp = ctrls[end];
+                    ctrls[end] = ctrls[i];
+                    ctrls[i] = tmp;
+                    end++;
+                }
+            }
+
+            memset(&ext_ctrls, 0, sizeof(ext_ctrls));
+            ext_ctrls.ctrl_class = ctrl_class;
+            ext_ctrls.count = end - start;
+            ext_ctrls.controls = &ctrls[start];
+
+            if ((count == 1) || (::ioctl(device_fd, VIDIOC_S_EXT_CTRLS, &ext_ctrls) < 0)) {
+                for (int i = start; i < end; ++i) {
+                    struct v4l2_control control;
+                    control.id = ctrls[i].id;
+                    control.value = ctrls[i].value;
+                    if (::ioctl(device_fd, VIDIOC_S_CTRL, &control) < 0) {
+                        ALOGE("%s: device fd: %d, set %x id, value: %d error: %s",__FUNCTION__,
+                              device_fd, control.id, control.value, strerror(errno));
+                        res = BAD_VALUE;
+                        ctrls[i].id = 0;
+                    }
+                }
+            }
+
+            for (int i = start; i < end; ++i) {
+                ssize_t index = mControlIndex.indexOfKey(ctrls[i].id);
+                if ((ctrls[i].id != 0) && (index >= 0)) {
+                    Control* control = mControlIndex.valueAt(index);
+                    control->value = ctrls[i].value;
+                    control->cached = true;
+                }
+            }
+            ALOGV("%s: class %x, %d controls applied",__FUNCTION__, ctrl_class, end - start);
+            start = end;
+        }
+        return res;
+    }
+
     int CameraV4L2Device::set_boolean_ctrl(struct v4l2_queryctrl *queryctrl) {
 
         int res = NO_ERROR;
@@ -1528,8 +1725,7 @@ namespace android {
 
             if (id != currentId) {
                 currentId = id;
-                initDefaultControls();
-                EnumFrameFormats();
+                loadDeviceCaps();
             }
             V4L2DeviceState = 0;
             V4L2DeviceState |= DEVICE_CONNECTED;
@@ -1548,10 +1744,10 @@ namespace android {
               __FUNCTION__,currentId,V4L2DeviceState);
 
         struct VidState* s = &(this->s);
-        if (s->control_list != NULL) {
-            free_control_list(s->control_list);
-            s->control_list = NULL;
-        }
+        /* the list itself stays in mDeviceCaps for the next open */
+        clear_control_index();
+        s->control_list = NULL;
+        s->num_controls = 0;
 
         if (device_fd > 0) {
             close(device_fd);
@@ -1641,6 +1837,7 @@ namespace android {
                     videoIn->isStreaming = false;
                 }
             }
+            clearHeldFrames();
             close(device_fd);
             device_fd = -1;
             V4L2DeviceState &= ~DEVICE_CONNECTED;
@@ -1886,10 +2083,6 @@ namespace android {
     void CameraV4L2Device::initDefaultControls(void) {
 
         struct VidState* s = &(this->s);
-        if (s->control_list != NULL) {
-            free_control_list(s->control_list);
-            s->control_list = NULL;
-        }
 
         s->num_controls = 0;
         s->control_list = get_control_list(device_fd, &(s->num_controls));
@@ -1901,6 +2094,102 @@ namespace android {
         return;
     }
 
+    /*
+     * QUERYCTRL/QUERYMENU per control and ENUM_FMT/FRAMESIZES/FRAMEINTERVALS
+     * per format are slow on these sensors; do them once per sensor identity
+     * and reuse the result on every later open. QUERYCAP has already run in
+     * init_device(), so checking the key costs nothing extra.
+     */
+    void CameraV4L2Device::loadDeviceCaps(void) {
+
+        char key[160];
+        DeviceCaps* caps = NULL;
+        ssize_t index = -1;
+
+        clear_control_index();
+        s.control_list = NULL;
+        s.num_controls = 0;
+
+        snprintf(key, sizeof(key), "%s:%s:%s:%u",
+                 (const char*)videoIn->cap.driver, (const char*)videoIn->cap.card,
+                 (const char*)videoIn->cap.bus_info, videoIn->cap.version);
+
+        if (device_fd >= 0) {
+            index = mDeviceCaps.indexOfKey(String8(key));
+        }
+
+        if (index >= 0) {
+            caps = mDeviceCaps.valueAt(index);
+            ALOGV("%s: reuse capabilities of %s",__FUNCTION__, key);
+        } else {
+            initDefaultControls();
+            EnumFrameFormats();
+            if (device_fd < 0) {
+                return;
+            }
+
+            caps = new DeviceCaps();
+            caps->fmts = m_AllFmts;
+            caps->best_preview = m_BestPreviewFmt;
+            caps->best_picture = m_BestPictureFmt;
+            caps->control_list = s.control_list;
+            caps->num_controls = s.num_controls;
+            mDeviceCaps.add(String8(key), caps);
+            ALOGV("%s: cache capabilities of %s",__FUNCTION__, key);
+        }
+
+        m_AllFmts = caps->fmts;
+        m_BestPreviewFmt = caps->best_preview;
+        m_BestPictureFmt = caps->best_picture;
+        s.control_list = caps->control_list;
+        s.num_controls = caps->num_controls;
+
+        /* the driver may reset its controls on open */
+        Control* current_control = s.control_list;
+        for (int i = 0; (i < s.num_controls) && (current_control != NULL); ++i) {
+            current_control->cached = false;
+            current_control = current_control->next;
+        }
+        index_controls();
+    }
+
+    void CameraV4L2Device::index_controls(void) {
+
+        static const struct {
+            CommonMode type;
+            const char* name;
+        } mode_controls[] = {
+            { WHITE_BALANCE, CameraParameters::KEY_WHITE_BALANCE },
+            { EFFECT_MODE,   CameraParameters::KEY_EFFECT },
+            { FLASH_MODE,    CameraParameters::KEY_FLASH_MODE },
+            { FOCUS_MODE,    CameraParameters::KEY_FOCUS_MODE },
+            { SCENE_MODE,    CameraParameters::KEY_SCENE_MODE },
+            { ANTIBAND_MODE, CameraParameters::KEY_ANTIBANDING },
+        };
+
+        clear_control_index();
+
+        Control* current_control = s.control_list;
+        for (int i = 0; (i < s.num_controls) && (current_control != NULL); ++i) {
+            mControlIndex.add(current_control->control.id, current_control);
+            for (size_t j = 0; j < sizeof(mode_controls)/sizeof(mode_controls[0]); ++j) {
+                if (strcmp(mode_controls[j].name,
+                           (const char*)current_control->control.name) == 0) {
+                    mModeControls[mode_controls[j].type] = current_control;
+                }
+            }
+            current_control = current_control->next;
+        }
+        ALOGV("%s: %d controls indexed",__FUNCTION__, mControlIndex.size());
+    }
+
+    void CameraV4L2Device::clear_control_index(void) {
+        mControlIndex.clear();
+        memset(mModeControls, 0, sizeof(mModeControls));
+        mPendingControls.clear();
+        mBatchControls = false;
+    }
+
     void CameraV4L2Device::free_control_list(Control* control_list)
     {
         Control* first = control_list;
@@ -0,0 +1,142 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LOG_TAG "CameraZoomEngine"
+//#define LOG_NDEBUG 0
+#include "CameraZoomEngine.h"
+
+namespace android {
+
+    CameraZoomEngine::CameraZoomEngine()
+        :mLock("CameraZoomEngine::lock"),
+         mRatio(ZOOM_RATIO_MIN),
+         mIndex(0),
+         mTargetIndex(0),
+         mSmooth(false) {
+    }
+
+    int CameraZoomEngine::getMaxZoom(void) {
+        return (ZOOM_RATIO_MAX - ZOOM_RATIO_MIN) / ZOOM_RATIO_STEP;
+    }
+
+    int CameraZoomEngine::ratioOf(int index) {
+
+        if (index < 0) {
+            index = 0;
+        } else if (index > getMaxZoom()) {
+            index = getMaxZoom();
+        }
+        return ZOOM_RATIO_MIN + index * ZOOM_RATIO_STEP;
+    }
+
+    String8 CameraZoomEngine::getZoomRatios(void) {
+        String8 ratios;
+
+        for (int i = 0; i <= getMaxZoom(); ++i) {
+            ratios.appendFormat(i == 0 ? "%d" : ",%d", ratioOf(i));
+        }
+        return ratios;
+    }
+
+    /* the last index passed when moving up, or down */
+    int CameraZoomEngine::indexOf(int ratio, bool up) {
+        int offset = ratio - ZOOM_RATIO_MIN;
+
+        if (up) {
+            return offset / ZOOM_RATIO_STEP;
+        }
+        return (offset + ZOOM_RATIO_STEP - 1) / ZOOM_RATIO_STEP;
+    }
+
+    void CameraZoomEngine::setZoom(int index) {
+        AutoMutex lock(mLock);
+
+        mRatio = ratioOf(index);
+        mIndex = (mRatio - ZOOM_RATIO_MIN) / ZOOM_RATIO_STEP;
+        mTargetIndex = mIndex;
+        mSmooth = false;
+    }
+
+    status_t CameraZoomEngine::startSmoothZoom(int index) {
+        AutoMutex lock(mLock);
+
+        if ((index < 0) || (index > getMaxZoom())) {
+            ALOGE("%s: zoom %d out of range 0-%d",__FUNCTION__, index, getMaxZoom());
+            return BAD_VALUE;
+        }
+
+        ALOGV("%s: %d -> %d",__FUNCTION__, mIndex, index);
+        mTargetIndex = index;
+        mSmooth = true;
+        return NO_ERROR;
+    }
+
+    void CameraZoomEngine::stopSmoothZoom(void) {
+        AutoMutex lock(mLock);
+
+        if (!mSmooth) {
+            return;
+        }
+
+        /* settle on the next index ahead rather than between two */
+        int target = ratioOf(mTargetIndex);
+        if (target > mRatio) {
+            mTargetIndex = indexOf(mRatio, false);
+        } else if (target < mRatio) {
+            mTargetIndex = indexOf(mRatio, true);
+        }
+    }
+
+    bool CameraZoomEngine::isSmoothZooming(void) {
+        AutoMutex lock(mLock);
+        return mSmooth;
+    }
+
+    bool CameraZoomEngine::advance(int* index, bool* stopped) {
+        AutoMutex lock(mLock);
+
+        if (!mSmooth) {
+            return false;
+        }
+
+        int target = ratioOf(mTargetIndex);
+        bool up = (target >= mRatio);
+
+        if (up) {
+            mRatio = (mRatio + ZOOM_SMOOTH_STEP > target) ? target : mRatio + ZOOM_SMOOTH_STEP;
+        } else {
+            mRatio = (mRatio - ZOOM_SMOOTH_STEP < target) ? target : mRatio - ZOOM_SMOOTH_STEP;
+        }
+
+        int passed = indexOf(mRatio, up);
+        *stopped = (mRatio == target);
+        if (*stopped) {
+            mSmooth = false;
+        } else if (passed == mIndex) {
+            return false;
+        }
+
+        mIndex = passed;
+        *index = mIndex;
+        return true;
+    }
+
+    int CameraZoomEngine::getZoom(void) {
+        AutoMutex lock(mLock);
+        return mIndex;
+    }
+
+    int CameraZoomEngine::getRatio(void) {
+        AutoMutex lock(mLock);
+        return mRatio;
+    }
+};
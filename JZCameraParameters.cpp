@@ -13,6 +13,7 @@
 //#define LOG_NDEBUG 0
 
 #include "JZCameraParameters.h"
+#include "CameraZoomEngine.h"
 #include <media/MediaProfiles.h>
 
 namespace android {
@@ -20,6 +21,10 @@ namespace android {
      const char JZCameraParameters::KEY_LUMA_ADAPTATION[] = "luma-adaptation"; 
      const char JZCameraParameters::KEY_NIGHTSHOT_MODE[]  = "nightshot-mode";
      const char JZCameraParameters::KEY_ORIENTATION[]     = "orientation";
+     const char JZCameraParameters::KEY_PICTURE_ORIENTATION[] = "picture-orientation";
+     const char JZCameraParameters::KEY_SUPPORTED_PICTURE_ORIENTATIONS[] = "picture-orientation-values";
+     const char JZCameraParameters::PICTURE_ORIENTATION_EXIF[] = "exif";
+     const char JZCameraParameters::PICTURE_ORIENTATION_PIXELS[] = "pixels";
      const char JZCameraParameters::PIXEL_FORMAT_JZ__YUV420T[] = "jzyuv420t"; // ingenic yuv420tile
      const char JZCameraParameters::PIXEL_FORMAT_JZ__YUV420P[] = "jzyuv420p"; // ingenic yuv420p
 
@@ -116,7 +121,38 @@ namespace android {
          maxcapture_height(0),
          isPreviewSizeChange(false),
          isPictureSizeChange(false),
-         isVideoSizeChange(false) {
+         isVideoSizeChange(false),
+         mSupportedFormats(0),
+         mFlattened(),
+         mFlattenedValid(false),
+         mAppliedParams() {
+
+        static const struct {
+            const char* key;
+            CommonMode type;
+        } mode_keys[NUM_MODE_PARAMS] = {
+            { CameraParameters::KEY_WHITE_BALANCE, WHITE_BALANCE },
+            { CameraParameters::KEY_EFFECT,        EFFECT_MODE },
+            { CameraParameters::KEY_FOCUS_MODE,    FOCUS_MODE },
+            { CameraParameters::KEY_FLASH_MODE,    FLASH_MODE },
+            { CameraParameters::KEY_SCENE_MODE,    SCENE_MODE },
+            { CameraParameters::KEY_ANTIBANDING,   ANTIBAND_MODE },
+        };
+        const mode_map_t* maps[NUM_MODE_PARAMS] = {
+            wb_map, effect_map, focus_map, flash_map, scene_map, antibanding_map
+        };
+        const int nums[NUM_MODE_PARAMS] = {
+            num_wb, num_eb, num_fb, num_flb, num_sb, num_ab
+        };
+
+        for (int i = 0; i < NUM_MODE_PARAMS; ++i) {
+            mModeParams[i].key = mode_keys[i].key;
+            mModeParams[i].type = mode_keys[i].type;
+            mModeParams[i].map = maps[i];
+            mModeParams[i].num = nums[i];
+            mModeParams[i].supported = 0;
+            mModeParams[i].current = 0;
+        }
     }
 
     JZCameraParameters::~JZCameraParameters() {
@@ -212,11 +248,19 @@ namespace android {
             return NO_MEMORY;
         }
 
+        AutoMutex lock(mMutex);
+
+        /* apps commonly write back exactly what they read */
+        if (!mAppliedParams.isEmpty() && params == mAppliedParams) {
+            ALOGV("%s: (%d) parameters unchanged", __FUNCTION__, mCameraId);
+            return NO_ERROR;
+        }
+        invalidateFlattened();
+
         CameraParameters tempParam(params);
 
         valstr = tempParam.getPreviewFormat();
-        if((valstr != NULL)
-           && isParameterValid(valstr,mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FORMATS))) {
+        if((valstr != NULL) && (formatIndex(valstr) >= 0)) {
             const char* s1 = mParameters.getPreviewFormat();
             if (strcmp(valstr,s1) != 0) {
                 mParameters.setPreviewFormat(valstr);
@@ -236,8 +280,14 @@ namespace android {
 
         const int preview_frame_rate = tempParam.getPreviewFrameRate();
         valstr = tempParam.get(CameraParameters::KEY_PREVIEW_FRAME_RATE);
-        if(isParameterValid(valstr,mParameters
-                            .get(CameraParameters::KEY_SUPPORTED_PREVIEW_FRAME_RATES))) {
+        bool rate_supported = false;
+        for (size_t i = 0; i < mSupportedFrameRates.size(); ++i) {
+            if (mSupportedFrameRates[i] == preview_frame_rate) {
+                rate_supported = true;
+                break;
+            }
+        }
+        if(rate_supported) {
             if(mParameters.getPreviewFrameRate() != preview_frame_rate)
                 mParameters.setPreviewFrameRate(preview_frame_rate);
         } else {
@@ -251,17 +301,19 @@ namespace android {
 
         int min_fps, max_fps;
         int old_min_fps, old_max_fps;
-        char tmp_fps_range[16];
-        int offset_range = 0;
-        memset(tmp_fps_range, 0, 16);
+        bool range_supported = false;
         tempParam.getPreviewFpsRange(&min_fps, &max_fps);
         mParameters.getPreviewFpsRange(&old_min_fps, &old_max_fps);
-        offset_range = snprintf(tmp_fps_range, 16, "(%d,%d)", min_fps, max_fps);
-        tmp_fps_range[offset_range+1] = '\0';
-        if (!isParameterValid(tmp_fps_range,
-                              mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE))) {
-            ALOGE("%s: support fps range = %s, error fps_range = %s",__FUNCTION__,
-                  mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE), tmp_fps_range);
+        for (size_t i = 0; i < mSupportedFpsRanges.size(); ++i) {
+            if (mSupportedFpsRanges[i].min == min_fps
+                && mSupportedFpsRanges[i].max == max_fps) {
+                range_supported = true;
+                break;
+            }
+        }
+        if (!range_supported) {
+            ALOGE("%s: support fps range = %s, error fps_range = (%d,%d)",__FUNCTION__,
+                  mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE), min_fps, max_fps);
             return BAD_VALUE;
         } else if (old_min_fps != min_fps || old_max_fps != max_fps) {
             char tt_fps_range[16];
@@ -287,9 +339,7 @@ namespace android {
         if (strcmp(valstr, "true") == 0) {
             mParameters.set(CameraParameters::KEY_ZOOM_SUPPORTED,"false");
             valstr = tempParam.get(CameraParameters::KEY_VIDEO_FRAME_FORMAT);
-            if (valstr != NULL &&
-                isParameterValid(valstr, 
-                                 mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FORMATS))) {
+            if (valstr != NULL && (formatIndex(valstr) >= 0)) {
                 const char* s1 = mParameters.get(CameraParameters::KEY_VIDEO_FRAME_FORMAT);
                 if (strcmp(valstr,s1) != 0) {
                     mParameters.set(CameraParameters::KEY_VIDEO_FRAME_FORMAT,valstr);
@@ -342,103 +392,52 @@ namespace android {
 
         ALOGV("%s: set focus areas: %s",__FUNCTION__, mParameters.get(CameraParameters::KEY_FOCUS_AREAS));
 
-        valstr = tempParam.get(CameraParameters::KEY_WHITE_BALANCE);
-        if ((valstr != NULL) && (mParameters.get(CameraParameters::KEY_SUPPORTED_WHITE_BALANCE) != NULL)
-            && strcmp(valstr, mParameters.get(CameraParameters::KEY_WHITE_BALANCE)) != 0) {
-            if (!isParameterValid(valstr, mParameters.get(CameraParameters::KEY_SUPPORTED_WHITE_BALANCE))) {
-                ALOGE("%s: white mode invalid,support: %s",__FUNCTION__,
-                 mParameters.get(CameraParameters::KEY_SUPPORTED_WHITE_BALANCE));
-                return BAD_VALUE;
-            }
-            mParameters.set(CameraParameters::KEY_WHITE_BALANCE,valstr);
-            int num_wb = JZCameraParameters::num_wb;
-            ret = mCameraDevice->setCommonMode(WHITE_BALANCE,string_to_mode(valstr,JZCameraParameters::wb_map, num_wb));
-            if (ret != NO_ERROR) {
-                ALOGE("%s: (%d) set white balance error",__FUNCTION__, mCameraId);
-                return BAD_VALUE;
-            }
-        }
+        /* validate every mode first, then push only the ones that changed */
+        unsigned short new_modes[NUM_MODE_PARAMS];
+        unsigned int dirty_modes = 0;
+        for (int i = 0; i < NUM_MODE_PARAMS; ++i) {
+            mode_param_t* mp = &mModeParams[i];
+            unsigned short mode = 0;
 
-        valstr = tempParam.get(CameraParameters::KEY_EFFECT);
-        if ((valstr != NULL) && (mParameters.get(CameraParameters::KEY_SUPPORTED_EFFECTS) != NULL)
-            && strcmp(valstr, mParameters.get(CameraParameters::KEY_EFFECT)) != 0) {
-            if (!isParameterValid(valstr, mParameters.get(CameraParameters::KEY_SUPPORTED_EFFECTS))) {
-                ALOGE("%s: effect mode invalid,support: %s",__FUNCTION__,
-                     mParameters.get(CameraParameters::KEY_SUPPORTED_EFFECTS));
-                return BAD_VALUE;
+            valstr = tempParam.get(mp->key);
+            if ((valstr == NULL) || (mp->supported == 0)) {
+                continue;
             }
-            mParameters.set(CameraParameters::KEY_EFFECT,valstr);
-            int num_ef = JZCameraParameters::num_eb;
-            ret = mCameraDevice->setCommonMode(EFFECT_MODE,string_to_mode(valstr,JZCameraParameters::effect_map,num_ef));
-            if (ret != NO_ERROR) {
-                ALOGE("%s: (%d) set effect mode error",__FUNCTION__, mCameraId);
+            if (!lookup_mode(valstr, mp->map, mp->num, &mode)
+                || !(mode & mp->supported)) {
+                ALOGE("%s: (%d) %s = %s invalid, support: %s",__FUNCTION__, mCameraId,
+                      mp->key, valstr, modes_to_string(mp->supported, mp->map, mp->num));
                 return BAD_VALUE;
             }
-        }
-
-        valstr = tempParam.get(CameraParameters::KEY_FOCUS_MODE);
-        if ((valstr != NULL) && (mParameters.get(CameraParameters::KEY_SUPPORTED_FOCUS_MODES) != NULL)
-            && (strcmp(valstr, mParameters.get(CameraParameters::KEY_FOCUS_MODE)) != 0)) {
-            if (!isParameterValid(valstr, mParameters.get(CameraParameters::KEY_SUPPORTED_FOCUS_MODES))) {
-                ALOGE("%s: focus mode invalid,support: %s",__FUNCTION__,mParameters.get(CameraParameters::KEY_SUPPORTED_FOCUS_MODES));
-                return BAD_VALUE;
-            }
-            mParameters.set(CameraParameters::KEY_FOCUS_MODE,valstr);
-            int num_fo = JZCameraParameters::num_fb;
-            ret = mCameraDevice->setCommonMode(FOCUS_MODE,string_to_mode(valstr,JZCameraParameters::focus_map,num_fo));
-            if (ret != NO_ERROR) {
-                ALOGE("%s: (%d) set focus mode error",__FUNCTION__, mCameraId);
-                return BAD_VALUE;
+            if (mode != mp->current) {
+                new_modes[i] = mode;
+                dirty_modes |= (1 << i);
             }
         }
 
-        valstr = tempParam.get(CameraParameters::KEY_FLASH_MODE);
-        if ((valstr != NULL) && (mParameters.get(CameraParameters::KEY_SUPPORTED_FLASH_MODES) != NULL)
-            && (strcmp(valstr, mParameters.get(CameraParameters::KEY_FLASH_MODE)) != 0)) {
-            if (!isParameterValid(valstr, mParameters.get(CameraParameters::KEY_SUPPORTED_FLASH_MODES))) {
-                ALOGE("%s: flash mode invalid,support: %s",__FUNCTION__,mParameters.get(CameraParameters::KEY_SUPPORTED_FLASH_MODES));
-                return BAD_VALUE;
-            }
-            mParameters.set(CameraParameters::KEY_FLASH_MODE,valstr);
-            int num_fl = JZCameraParameters::num_flb;
-            ret = mCameraDevice->setCommonMode(FLASH_MODE,string_to_mode(valstr, JZCameraParameters::flash_map,num_fl));
-            if (ret != NO_ERROR) {
-                ALOGE("%s: (%d) set flash mode error",__FUNCTION__, mCameraId);
-                return BAD_VALUE;
-            }
-        }
-
-        valstr = tempParam.get(CameraParameters::KEY_SCENE_MODE);
-        if ((valstr != NULL) && (mParameters.get(CameraParameters::KEY_SUPPORTED_SCENE_MODES) != NULL)
-            && strcmp(valstr, mParameters.get(CameraParameters::KEY_SCENE_MODE)) != 0) {
-            if (!isParameterValid(valstr, mParameters.get(CameraParameters::KEY_SUPPORTED_SCENE_MODES))) {
-                ALOGE("%s: scene mode invalid,support: %s",__FUNCTION__,mParameters.get(CameraParameters::KEY_SUPPORTED_SCENE_MODES));
-                return BAD_VALUE;
+        if (dirty_modes != 0) {
+            mCameraDevice->beginControlBatch();
+            for (int i = 0; i < NUM_MODE_PARAMS; ++i) {
+                if (!(dirty_modes & (1 << i))) {
+                    continue;
+                }
+                ret = mCameraDevice->setCommonMode(mModeParams[i].type, new_modes[i]);
+                if (ret != NO_ERROR) {
+                    ALOGE("%s: (%d) set %s error",__FUNCTION__, mCameraId, mModeParams[i].key);
+                    break;
+                }
             }
-            mParameters.set(CameraParameters::KEY_SCENE_MODE,valstr);
-            int num_sc = JZCameraParameters::num_sb;
-            ret = mCameraDevice->setCommonMode(SCENE_MODE,string_to_mode(valstr,JZCameraParameters::scene_map,num_sc));
-            if (ret != NO_ERROR) {
-                ALOGE("%s: (%d) set scene mode error",__FUNCTION__, mCameraId);
+            if (mCameraDevice->commitControlBatch() != NO_ERROR || ret != NO_ERROR) {
+                ALOGE("%s: (%d) apply mode controls error",__FUNCTION__, mCameraId);
                 return BAD_VALUE;
             }
-        }
 
-        valstr = tempParam.get(CameraParameters::KEY_ANTIBANDING);
-        if ((valstr != NULL) && (mParameters.get(CameraParameters::KEY_SUPPORTED_ANTIBANDING) != NULL)
-            && strcmp(valstr,mParameters.get(CameraParameters::KEY_ANTIBANDING)) != 0) {
-            if (!isParameterValid(valstr, mParameters.get(CameraParameters::KEY_SUPPORTED_ANTIBANDING))) {
-                ALOGE("%s: antibanding mode invalid,support: %s",__FUNCTION__,mParameters
-                 .get(CameraParameters::KEY_SUPPORTED_ANTIBANDING));
-                return BAD_VALUE;
-            }
-            mParameters.set(CameraParameters::KEY_ANTIBANDING,valstr);
-            int num_an = JZCameraParameters::num_ab;
-            ret = mCameraDevice->setCommonMode(ANTIBAND_MODE,
-                                               string_to_mode(valstr,JZCameraParameters::antibanding_map,num_an));
-            if (ret != NO_ERROR) {
-                ALOGE("%s: (%d) set antibanding mode error",__FUNCTION__, mCameraId);
-                return BAD_VALUE;
+            for (int i = 0; i < NUM_MODE_PARAMS; ++i) {
+                mode_param_t* mp = &mModeParams[i];
+                if (dirty_modes & (1 << i)) {
+                    mp->current = new_modes[i];
+                    mParameters.set(mp->key, mode_to_string(mp->current, mp->map, mp->num));
+                }
             }
         }
 
@@ -452,15 +451,10 @@ namespace android {
         mParameters.getPreviewSize(&temp_old_W,&temp_old_H);
 
         if(temp_preview_W != temp_old_W || temp_preview_H != temp_old_H) {
-            char tmp_preview_size[16];
-            int offset = 0;
-            memset(tmp_preview_size, 0, 16);
-            offset = snprintf(tmp_preview_size, 16, "%dx%d", temp_preview_W, temp_preview_H);
-            tmp_preview_size[offset+1] = '\0';
-            if (!isParameterValid(tmp_preview_size, mParameters.
-                                  get(CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES))) {
-                ALOGE("%s: support preview sizes = %s, error size = %s",__FUNCTION__,
-                      mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES), tmp_preview_size);
+            if (!isSizeSupported(mSupportedPreviewSizes, temp_preview_W, temp_preview_H)) {
+                ALOGE("%s: support preview sizes = %s, error size = %dx%d",__FUNCTION__,
+                      mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES),
+                      temp_preview_W, temp_preview_H);
                 return BAD_VALUE;
             }
             isPreviewSizeChange = false;
@@ -484,15 +478,10 @@ namespace android {
         tempParam.getPictureSize(&temp_picture_W,&temp_picture_H);
         mParameters.getPictureSize(&temp_old_W,&temp_old_H);
         if(temp_picture_W != temp_old_W || temp_picture_H != temp_old_H) {
-            char tmp_picture_size[16];
-            int offset = 0;
-            memset(tmp_picture_size, 0, 16);
-            offset = snprintf(tmp_picture_size, 16, "%dx%d", temp_picture_W, temp_picture_H);
-            tmp_picture_size[offset+1] = '\0';
-            if (!isParameterValid(tmp_picture_size, mParameters.
-                                  get(CameraParameters::KEY_SUPPORTED_PICTURE_SIZES))) {
-                ALOGE("%s: supported picture sizes = %s, error size = %s",__FUNCTION__,
-                      mParameters.get(CameraParameters::KEY_SUPPORTED_PICTURE_SIZES), tmp_picture_size);
+            if (!isSizeSupported(mSupportedPictureSizes, temp_picture_W, temp_picture_H)) {
+                ALOGE("%s: supported picture sizes = %s, error size = %dx%d",__FUNCTION__,
+                      mParameters.get(CameraParameters::KEY_SUPPORTED_PICTURE_SIZES),
+                      temp_picture_W, temp_picture_H);
                 return BAD_VALUE;
             }
 
@@ -520,15 +509,10 @@ namespace android {
         tempParam.getVideoSize(&temp_video_W,&temp_video_H);
         mParameters.getVideoSize(&temp_old_W,&temp_old_H);
         if((temp_video_W != temp_old_W) || (temp_video_H != temp_old_H)) {
-            char tmp_video_size[16];
-            int offset = 0;
-            memset (tmp_video_size, 0, 16);
-            offset = snprintf(tmp_video_size, 16, "%dx%d", temp_video_W, temp_video_H);
-            tmp_video_size[offset+1] = '\0';
-            if (!isParameterValid(tmp_video_size, mParameters
-                                  .get(CameraParameters::KEY_SUPPORTED_VIDEO_SIZES))) {
-                ALOGE("%s: supported video sizes  = %s, error video size = %s",__FUNCTION__,
-                      mParameters.get(CameraParameters::KEY_SUPPORTED_VIDEO_SIZES), tmp_video_size);
+            if (!isSizeSupported(mSupportedVideoSizes, temp_video_W, temp_video_H)) {
+                ALOGE("%s: supported video sizes  = %s, error video size = %dx%d",__FUNCTION__,
+                      mParameters.get(CameraParameters::KEY_SUPPORTED_VIDEO_SIZES),
+                      temp_video_W, temp_video_H);
                 return BAD_VALUE;
             }
 
@@ -561,22 +545,27 @@ namespace android {
         ALOGV("%s: (%d) set picture rotation = %d",__FUNCTION__, mCameraId,
                  mParameters.getInt(CameraParameters::KEY_ROTATION));
 
+        valstr = tempParam.get(KEY_PICTURE_ORIENTATION);
+        if (valstr != NULL) {
+            if (!isParameterValid(valstr, mParameters.get(KEY_SUPPORTED_PICTURE_ORIENTATIONS))) {
+                ALOGE("%s: invalid picture orientation %s",__FUNCTION__, valstr);
+                return BAD_VALUE;
+            }
+            mParameters.set(KEY_PICTURE_ORIENTATION, valstr);
+        }
+
         valstr = tempParam.get(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
         valstr2 = tempParam.get(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
         if (valstr != NULL && valstr2 != NULL) {
-            char thumb_sizes[16];
-            memset(thumb_sizes, 0, 16);
-            snprintf(thumb_sizes, 16, "%sx%s",valstr,valstr2);
-            if (isParameterValid(thumb_sizes,mParameters.
-                                 get(CameraParameters::KEY_SUPPORTED_JPEG_THUMBNAIL_SIZES))) {
-
-                valint = tempParam.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
-                mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH, valint);
-                valint = tempParam.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
-                mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT,valint);
+            int thumb_w = tempParam.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
+            int thumb_h = tempParam.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
+            if (isSizeSupported(mSupportedThumbnailSizes, thumb_w, thumb_h)) {
+                mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH, thumb_w);
+                mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT, thumb_h);
             } else {
-                ALOGE("%s: support thumbnail sizes = %s, error size = %s", __FUNCTION__, thumb_sizes,
-                      mParameters.get(CameraParameters::KEY_SUPPORTED_JPEG_THUMBNAIL_SIZES));
+                ALOGE("%s: support thumbnail sizes = %s, error size = %dx%d", __FUNCTION__,
+                      mParameters.get(CameraParameters::KEY_SUPPORTED_JPEG_THUMBNAIL_SIZES),
+                      thumb_w, thumb_h);
                 return BAD_VALUE;
             }
         }
@@ -616,9 +605,125 @@ namespace android {
             mParameters.remove(CameraParameters::KEY_GPS_PROCESSING_METHOD);
         }
 
+        mAppliedParams = params;
         return NO_ERROR;
     }
 
+    void JZCameraParameters::setParameter(const char* key, const char* value) {
+        AutoMutex lock(mMutex);
+        mParameters.set(key, value);
+        invalidateFlattened();
+    }
+
+    String8 JZCameraParameters::getFlattenedParameters(void) {
+        AutoMutex lock(mMutex);
+        if (!mFlattenedValid) {
+            mFlattened = mParameters.flatten();
+            mFlattenedValid = true;
+        }
+        return mFlattened;
+    }
+
+    /* call with mMutex held whenever mParameters may change */
+    void JZCameraParameters::invalidateFlattened(void) {
+        mFlattenedValid = false;
+        mAppliedParams.clear();
+    }
+
+    void JZCameraParameters::setupModeParam(int index, unsigned short modes) {
+
+        mode_param_t* mp = &mModeParams[index];
+        const char* valstr = mParameters.get(mp->key);
+
+        mp->supported = 0;
+        for (int i = 0; i < mp->num; ++i) {
+            if (modes & mp->map[i].mode)
+                mp->supported |= mp->map[i].mode;
+        }
+
+        mp->current = 0;
+        if ((mp->supported != 0) && (valstr != NULL)) {
+            lookup_mode(valstr, mp->map, mp->num, &mp->current);
+        }
+    }
+
+    void JZCameraParameters::parseSupportedTables(void) {
+
+        const char* valstr = NULL;
+
+        mSupportedFormats = 0;
+        valstr = mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FORMATS);
+        for (int i = 0; (valstr != NULL) && (i < num_pfb); ++i) {
+            int len = strlen(pix_format_map[i].dsc);
+            const char* pos = valstr;
+            while ((pos = strstr(pos, pix_format_map[i].dsc)) != NULL) {
+                if (((pos == valstr) || (pos[-1] == ','))
+                    && ((pos[len] == ',') || (pos[len] == '\0'))) {
+                    mSupportedFormats |= (1 << i);
+                    break;
+                }
+                pos += len;
+            }
+        }
+
+        mParameters.getSupportedPreviewSizes(mSupportedPreviewSizes);
+        mParameters.getSupportedPictureSizes(mSupportedPictureSizes);
+        mParameters.getSupportedVideoSizes(mSupportedVideoSizes);
+
+        mSupportedThumbnailSizes.clear();
+        valstr = mParameters.get(CameraParameters::KEY_SUPPORTED_JPEG_THUMBNAIL_SIZES);
+        while (valstr != NULL && *valstr != '\0') {
+            char* end = NULL;
+            Size size;
+            size.width = strtol(valstr, &end, 10);
+            if (*end != 'x')
+                break;
+            size.height = strtol(end + 1, &end, 10);
+            mSupportedThumbnailSizes.push_back(size);
+            valstr = (*end == ',') ? end + 1 : NULL;
+        }
+
+        mSupportedFrameRates.clear();
+        valstr = mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FRAME_RATES);
+        while (valstr != NULL && *valstr != '\0') {
+            char* end = NULL;
+            mSupportedFrameRates.push_back(strtol(valstr, &end, 10));
+            valstr = (*end == ',') ? end + 1 : NULL;
+        }
+
+        mSupportedFpsRanges.clear();
+        valstr = mParameters.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE);
+        while (valstr != NULL && (valstr = strchr(valstr, '(')) != NULL) {
+            char* end = NULL;
+            fps_range_t range;
+            range.min = strtol(valstr + 1, &end, 10);
+            if (*end != ',')
+                break;
+            range.max = strtol(end + 1, &end, 10);
+            mSupportedFpsRanges.push_back(range);
+            valstr = end;
+        }
+    }
+
+    int JZCameraParameters::formatIndex(const char* format) {
+
+        for (int i = 0; i < num_pfb; ++i) {
+            if ((mSupportedFormats & (1 << i))
+                && (strcmp(format, pix_format_map[i].dsc) == 0))
+                return i;
+        }
+        return -1;
+    }
+
+    bool JZCameraParameters::isSizeSupported(const Vector<Size>& sizes, int width, int height) {
+
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            if ((sizes[i].width == width) && (sizes[i].height == height))
+                return true;
+        }
+        return false;
+    }
+
     void JZCameraParameters::clearGpsData(void) {
         mParameters.remove(CameraParameters::KEY_GPS_ALTITUDE);
         mParameters.remove(CameraParameters::KEY_GPS_LATITUDE);
@@ -627,7 +732,12 @@ namespace android {
         mParameters.remove(CameraParameters::KEY_GPS_PROCESSING_METHOD);
     }
 
-    status_t  JZCameraParameters::setUpEXIF(ExifElementsTable* exifTable) {
+    /*
+     * viewTransform is what a viewer still has to do to show the picture
+     * upright, sizeSwapped says the stored picture was turned sideways.
+     */
+    status_t  JZCameraParameters::setUpEXIF(ExifElementsTable* exifTable, int viewTransform,
+                                            bool sizeSwapped) {
 
         status_t ret = NO_ERROR;
         struct timeval sTv;
@@ -682,6 +792,11 @@ namespace android {
         if (NO_ERROR == ret) {
             int width, height;
             mParameters.getPictureSize(&width,&height);
+            if (sizeSwapped) {
+                int tmp = width;
+                width = height;
+                height = tmp;
+            }
             char temp_value[5];
             snprintf(temp_value, sizeof(temp_value)/sizeof(char),"%d",width);
             ret = exifTable->insertElement(TAG_IMAGE_WIDTH, temp_value);
@@ -781,10 +896,9 @@ namespace android {
             }
         }
 
-        valInt = mParameters.getInt(CameraParameters::KEY_ROTATION);
-        if ((NO_ERROR == ret) && (valInt >= 0)) {
+        if (NO_ERROR == ret) {
             const char* exif_orient = 
-                ExifElementsTable::degreesToExifOrientation((unsigned int)valInt);
+                ExifElementsTable::transformToExifOrientation(viewTransform);
             if (exif_orient) {
 
                 ret = exifTable->insertElement(TAG_ORIENTATION, exif_orient);
@@ -873,6 +987,8 @@ namespace android {
         mParameters.setPictureFormat(CameraParameters::PIXEL_FORMAT_JPEG);
         mParameters.set(CameraParameters::KEY_JPEG_QUALITY,75);
         mParameters.set(CameraParameters::KEY_ROTATION,0);
+        mParameters.set(KEY_SUPPORTED_PICTURE_ORIENTATIONS, "exif,pixels");
+        mParameters.set(KEY_PICTURE_ORIENTATION, PICTURE_ORIENTATION_EXIF);
 
         mParameters.set(CameraParameters::KEY_SUPPORTED_JPEG_THUMBNAIL_SIZES,"176x144,320x240,0x0");
         mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY, 75);
@@ -880,10 +996,10 @@ namespace android {
         mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT, 144);
 
         mParameters.set(CameraParameters::KEY_ZOOM_SUPPORTED,"true");
-        mParameters.set(CameraParameters::KEY_SMOOTH_ZOOM_SUPPORTED,"false");
+        mParameters.set(CameraParameters::KEY_SMOOTH_ZOOM_SUPPORTED,"true");
         mParameters.set(CameraParameters::KEY_ZOOM, "0");
-        mParameters.set(CameraParameters::KEY_ZOOM_RATIOS, "100,200,250,300,400");
-        mParameters.set(CameraParameters::KEY_MAX_ZOOM,"4");
+        mParameters.set(CameraParameters::KEY_ZOOM_RATIOS, CameraZoomEngine::getZoomRatios().string());
+        mParameters.set(CameraParameters::KEY_MAX_ZOOM, CameraZoomEngine::getMaxZoom());
 
         mParameters.set(CameraParameters::KEY_VIDEO_STABILIZATION_SUPPORTED,"false");
         mParameters.set(CameraParameters::KEY_AUTO_EXPOSURE_LOCK_SUPPORTED,"false");
@@ -894,10 +1010,10 @@ namespace android {
 
         if (facing == CAMERA_FACING_BACK) {
             mParameters.set(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_HW,atoi(CAMERA_FACEDETECT));
-            mParameters.set(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_SW,0);
+            mParameters.set(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_SW,atoi(CAMERA_FACEDETECT));
         } else if (facing == CAMERA_FACING_FRONT) {
             mParameters.set(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_HW,atoi(CAMERA_FACEDETECT));
-            mParameters.set(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_SW,0);
+            mParameters.set(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_SW,atoi(CAMERA_FACEDETECT));
         }
 
         mParameters.set(CameraParameters::KEY_SUPPORTED_PREVIEW_FRAME_RATES,"15,20,25,30");
@@ -1107,6 +1223,17 @@ namespace android {
         param.cmd = CPCMD_SET_RESOLUTION;
         mParameters.getPreviewSize((int*)&(param.param.ptable[0].w),(int*)&(param.param.ptable[0].h));
         mCameraDevice->setCameraParam(param,mParameters.getPreviewFrameRate());
+
+        setupModeParam(MODE_WHITE_BALANCE, sinfo.modes.balance);
+        setupModeParam(MODE_EFFECT, sinfo.modes.effect);
+        setupModeParam(MODE_FOCUS, sinfo.modes.focus_mode);
+        setupModeParam(MODE_FLASH, sinfo.modes.flash_mode);
+        setupModeParam(MODE_SCENE, sinfo.modes.scene_mode);
+        setupModeParam(MODE_ANTIBANDING, sinfo.modes.antibanding);
+        parseSupportedTables();
+
+        AutoMutex lock(mMutex);
+        invalidateFlattened();
     }
 
     bool JZCameraParameters::if_need_picture_upscale(void) {
@@ -1250,6 +1377,11 @@ namespace android {
     }
 
 
+    bool JZCameraParameters::is_picture_orientation_exif() {
+        const char* valstr = mParameters.get(KEY_PICTURE_ORIENTATION);
+        return (valstr == NULL) || (strcmp(valstr, PICTURE_ORIENTATION_PIXELS) != 0);
+    }
+
     bool JZCameraParameters::is_video_size_change() {
         return isVideoSizeChange;
     }
@@ -1265,6 +1397,8 @@ namespace android {
         const char* string;
     };
 
+    Mutex ExifElementsTable::sJheadLock;
+
     static integer_string_pair degrees_to_exif_lut[] = {
         {0,   "1"},
         {90,  "6"},
@@ -1281,6 +1415,18 @@ namespace android {
         return NULL;
     }
 
+    /* indexed by HAL_TRANSFORM_*, flips applied before the turn */
+    static const char* transform_to_exif_lut[] = {
+        "1", "2", "4", "3", "6", "7", "5", "8",
+    };
+
+    const char* ExifElementsTable::transformToExifOrientation(int transform) {
+
+        if (transform < 0 || transform > 7)
+            return NULL;
+        return transform_to_exif_lut[transform];
+    }
+
     void ExifElementsTable::stringToRational(const char* str, unsigned int* num, unsigned int* den) {
 
         int len;
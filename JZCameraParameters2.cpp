@@ -106,6 +106,22 @@ namespace android {
         { HAL_PIXEL_FORMAT_JZ_YUV_420_P, PIXEL_FORMAT_JZ_YUV420P}
     };
 
+#define NUM_REQUEST_CONTROLS 6
+    const JZCameraParameters2::request_control_t JZCameraParameters2::request_controls[] = {
+        { ANDROID_CONTROL_AWB_MODE,            WHITE_BALANCE, wb_map,          WHITE_BALANCEVALUES_NUM,
+          &JZCameraParameters2::mwbMode },
+        { ANDROID_CONTROL_EFFECT_MODE,         EFFECT_MODE,   effect_map,      EFFECTVALUES_NUM,
+          &JZCameraParameters2::meffectMode },
+        { ANDROID_CONTROL_AE_ANTIBANDING_MODE, ANTIBAND_MODE, antibanding_map, ANTIBANVALUES_NUM,
+          &JZCameraParameters2::mantibandingMode },
+        { ANDROID_CONTROL_SCENE_MODE,          SCENE_MODE,    scene_map,       SCENEVALUES_NUM,
+          &JZCameraParameters2::msceneMode },
+        { ANDROID_CONTROL_AE_MODE,             FLASH_MODE,    flash_map,       FLASHMODE_NUM,
+          &JZCameraParameters2::mflashMode },
+        { ANDROID_CONTROL_AF_MODE,             FOCUS_MODE,    focus_map,       FOCUSMODE_NUM,
+          &JZCameraParameters2::mfocusMode }
+    };
+
     unsigned short JZCameraParameters2::tag_to_mode (const int tag, const mode_map_t map_table[], int len) {
         unsigned short mode = map_table[0].mode;
 
@@ -172,6 +188,7 @@ namespace android {
          mPreviewMetaDataBuffer(NULL),
          mRecordMetaDataBuffer(NULL) {
 
+        memset(mDefaultRequests, 0, sizeof(mDefaultRequests));
     }
 
     JZCameraParameters2::~JZCameraParameters2() {
@@ -186,6 +203,16 @@ namespace android {
             mRecordMetaDataBuffer = NULL;
         }
 
+        freeDefaultRequests();
+    }
+
+    void JZCameraParameters2::freeDefaultRequests(void) {
+        for (int i = 0; i < CAMERA2_TEMPLATE_COUNT; ++i) {
+            if (mDefaultRequests[i] != NULL) {
+                free_camera_metadata(mDefaultRequests[i]);
+                mDefaultRequests[i] = NULL;
+            }
+        }
     }
 
     const camera_metadata_t* JZCameraParameters2::get_camera_metadata(void) {
@@ -303,12 +330,14 @@ namespace android {
 
         ALOGV("%s: camera %d",__FUNCTION__, mCameraId);
 
+        mDevice->beginControlBatch();
         mDevice->setCommonMode(WHITE_BALANCE, mwbMode);
         mDevice->setCommonMode(EFFECT_MODE, meffectMode);
         mDevice->setCommonMode(ANTIBAND_MODE, mantibandingMode);
         mDevice->setCommonMode(SCENE_MODE, msceneMode);
         mDevice->setCommonMode(FLASH_MODE, mflashMode);
-        mDevice->setCommonMode(FLASH_MODE, mfocusMode);
+        mDevice->setCommonMode(FOCUS_MODE, mfocusMode);
+        mDevice->commitControlBatch();
 
     }
 
@@ -805,6 +834,9 @@ namespace android {
             mRecordMetaDataBuffer = NULL;
         }
 
+        /* templates carry the preview size, rebuild them on demand */
+        freeDefaultRequests();
+
         tmpInfo->sort();
         mPreviewMetaDataBuffer = tmpInfo->release();
         mRecordMetaDataBuffer = clone_camera_metadata(mPreviewMetaDataBuffer);
@@ -840,13 +872,46 @@ namespace android {
     }
 
     //Override parent method
+    /*
+     * Called for every request, so only the controls whose mode differs from
+     * the one last pushed to the device are sent, in a single batch. A
+     * repeating request costs a few lookups and no device access.
+     */
     int JZCameraParameters2::setParameters2(camera_metadata_t* params) {
 
-        ALOGV("%s: Id: %d, facing: %d",__FUNCTION__, mCameraId, mFacing);
-
+        AutoMutex lock(mLock);
+        camera_metadata_ro_entry_t entry;
         status_t ret = NO_ERROR;
-        String8 tmpParameters;
+        int changed = 0;
+
+        if (params == NULL) {
+            return BAD_VALUE;
+        }
+
+        for (int i = 0; i < NUM_REQUEST_CONTROLS; ++i) {
+            const request_control_t* ctrl = &request_controls[i];
+
+            if ((find_camera_metadata_ro_entry(params, ctrl->tag, &entry) != OK)
+                || (entry.count == 0)) {
+                continue;
+            }
+
+            unsigned short mode = tag_to_mode(entry.data.u8[0], ctrl->map, ctrl->num);
+            if (this->*(ctrl->current) == mode) {
+                continue;
+            }
+
+            if (changed++ == 0) {
+                mDevice->beginControlBatch();
+            }
+            mDevice->setCommonMode(ctrl->type, mode);
+            this->*(ctrl->current) = mode;
+        }
 
+        if (changed > 0) {
+            ret = mDevice->commitControlBatch();
+            ALOGV("%s: camera %d, %d controls changed",__FUNCTION__, mCameraId, changed);
+        }
         return ret;
     }
 
@@ -948,6 +1013,38 @@ namespace android {
     return entry;
   }
 
+    status_t JZCameraParameters2::getDefaultRequest(int request_template,
+             camera_metadata_t **request) {
+
+        AutoMutex lock(mLock);
+        status_t res = NO_ERROR;
+
+        if ((request_template < 0) || (request_template >= CAMERA2_TEMPLATE_COUNT)) {
+            return BAD_VALUE;
+        }
+
+        if (mDefaultRequests[request_template] == NULL) {
+            camera_metadata_t* tmpRequest = NULL;
+
+            res = constructDefaultRequest(request_template, &tmpRequest, true);
+            if (res != OK) {
+                return res;
+            }
+            res = constructDefaultRequest(request_template, &tmpRequest, false);
+            if (res != OK) {
+                ALOGE("%s: Unable to populate new request for template %d",
+                      __FUNCTION__, request_template);
+                free_camera_metadata(tmpRequest);
+                return res;
+            }
+            mDefaultRequests[request_template] = tmpRequest;
+        }
+
+        /* the framework takes ownership of what we return */
+        *request = clone_camera_metadata(mDefaultRequests[request_template]);
+        return (*request == NULL) ? NO_MEMORY : NO_ERROR;
+    }
+
     status_t JZCameraParameters2::constructDefaultRequest(int request_template,
              camera_metadata_t **request, bool sizeRequest) {
 
@@ -1294,6 +1391,8 @@ namespace android {
         const char* string;
     };
 
+    Mutex ExifElementsTable::sJheadLock;
+
     static integer_string_pair degrees_to_exif_lut[] = {
         {0,   "1"},
         {90,  "6"},
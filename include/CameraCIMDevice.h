@@ -14,6 +14,7 @@
 #define __CAMERA_CIM_DEVICE_H_
 
 #include "CameraDeviceCommon.h"
+#include "CameraPrefault.h"
 
 namespace android {
 
@@ -54,6 +55,8 @@ namespace android {
         int getPreviewFormat(void);
         int getCaptureFormat(void);
         int setCommonMode(CommonMode mode_type, unsigned short mode_value);
+        void beginControlBatch(void) { }
+        int commitControlBatch(void) { return NO_ERROR; }
         void setCameraFormat(int format);
         int setCameraParam(struct camera_param &param,int fps);
         void getSensorInfo(struct sensor_info* s_info,struct resolution_info* r_info );
@@ -73,12 +73,32 @@ namespace android {
         void yuyv_to_yvu422p(uint8_t *dst,int dstStride, int dstHeight, 
                              uint8_t *src, int srcStride, int width, int height);  
 
+        /*
+         * transform is a HAL_TRANSFORM_* value applied while writing dst,
+         * width and height stay the source size. src is never written.
+         */
         void yuyv_to_yvu420p(uint8_t *dst,int dstStride, int dstHeight,
-                             uint8_t *src, int srcStride, int width, int height);
+                             uint8_t *src, int srcStride, int width, int height,
+                             int transform = 0);
 
 
         void yuyv_to_yvu420sp(uint8_t *dst,int dstStride, int dstHeight, 
-                              uint8_t *src, int srcStride, int width, int height);
+                              uint8_t *src, int srcStride, int width, int height,
+                              int transform = 0);
+
+        void yuyv_transform(uint8_t *dst, int dstStride, uint8_t *src, int srcStride,
+                            int width, int height, int transform);
+
+        /* the flip a front camera preview needs at this display rotation */
+        static int mirror_transform(int rotation);
+
+        /* nearest neighbour, a pixel pair keeps the chroma it was read with */
+        void yuyv_scale(uint8_t *dst, int dstStride, int dstWidth, int dstHeight,
+                        uint8_t *src, int srcStride, int srcWidth, int srcHeight);
+
+        /* nearest neighbour between packed yuv420p frames */
+        void yuv420p_scale(uint8_t *dst, int dstWidth, int dstHeight,
+                           uint8_t *src, int srcWidth, int srcHeight);
 
         void tile420_to_yuv420p(CameraYUVMeta* yuvMeta, uint8_t* dest);
 
@@ -259,16 +279,24 @@ namespace android {
         sp<ColorConvertSMPThread> mCC_SMPThread;
     private:
 
+        enum TransformLayout {
+            LAYOUT_YUYV = 0,
+            LAYOUT_YVU420SP,
+            LAYOUT_YVU420P,
+        };
+
         void initClip (void);
 
+        void yuyv_to_transformed(uint8_t *dst, int dstStride, int dstHeight,
+                                 uint8_t *src, int srcStride, int width, int height,
+                                 int transform, int layout);
+
     private:
 
         const signed kClipMin;
         const signed kClipMax;
-        int mtmp_uv_size;
 
         uint8_t *mClip;
-        uint8_t* mtmp_uv;
         uint8_t* mtmp_sweap;
         uint8_t* msrc;
         const int csY_coeff_16;
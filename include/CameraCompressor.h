@@ -33,6 +33,8 @@ namespace android {
         int thumbnailQuality;
         int format;
         int jpegSize;
+        /* HAL_TRANSFORM_* done losslessly on the encoded jpegs */
+        int transform;
         camera_request_memory requiredMem;
     }compress_params_t;
 
@@ -48,51 +50,18 @@ namespace android {
         int mThumbnailHeight;
         int mThumbnailQuality;
         int mFormat;
+        int mTransform;
         camera_request_memory mRequiredMem;
         SkDynamicMemoryWStream mStream;
         YuvToJpegEncoder* mEncoder;
         int mStrides[2];
 
     private:
-          
-        void yuyv_mirror (uint8_t* src_frame , int width , int height)
-        {
-            int h = 0;
-            int w = 0;
-            int sizeline = width * 2; /* 2 bytes per pixel*/
-            uint8_t*pframe;
-            pframe = src_frame;
-            uint8_t line[sizeline - 1];
-            for (h = 0; h < height; h++) {
-                for (w = sizeline - 1; w > 0; w = w - 4) {
-                    line[w - 1] = *pframe++;
-                    line[w - 2] = *pframe++;
-                    line[w - 3] = *pframe++;
-                    line[w] = *pframe++;
-                }
-                memcpy(src_frame + (h * sizeline), line, sizeline);
-            }
-        }
-
-
-        void yuyv_upturn (uint8_t* src_frame , int width , int height)
-        {
-            int h = 0;
-            int sizeline = width * 2;
-            uint8_t* line1[sizeline - 1];
-            uint8_t* line2[sizeline - 1];
-            for (h = 0; h < height / 2; h++) {
-                memcpy(line1, src_frame + h * sizeline, sizeline);
-                memcpy(line2, src_frame + (height - 1 - h) * sizeline, sizeline);
-                memcpy(src_frame + h * sizeline, line2, sizeline);
-                memcpy(src_frame + (height - 1 - h) * sizeline, line1, sizeline);
-            }
-        }
-
-
 
         status_t compressRawImage(int width, int height, int quality);
 
+        status_t transformCompressedImage(void);
+
 
         void getCompressedImage(void* buff)
         {
@@ -112,7 +81,8 @@ namespace android {
  
     public:
 
-        CameraCompressor(compress_params_t* yuvImage, bool mirror,int rot);
+        /* src is only read, any mirror has to be applied by the caller */
+        CameraCompressor(compress_params_t* yuvImage);
 
         virtual ~CameraCompressor()
         {
@@ -0,0 +1,269 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __CAMERA_CONVERT_BACKEND_H_
+#define __CAMERA_CONVERT_BACKEND_H_
+
+#include <utils/KeyedVector.h>
+#include "CameraColorConvert.h"
+
+#define X2D_NAME "/dev/x2d"
+#define X2D_SCALE_FACTOR 512.0
+
+namespace android {
+
+    static inline size_t num2even(int num) {
+        size_t even;
+
+        even = num % 2 ? num-1 : num;
+        if(even == 682)
+            even = 708;
+        else if(even == 778)
+            even = 776;
+
+        return even;
+    }
+
+    static inline void dmmu_map_memory(uint8_t* addr, int size) {
+        struct dmmu_mem_info dmmu_info;
+
+        dmmu_info.vaddr = (void*)addr;
+        dmmu_info.size = size;
+        for (int i = 0; i < (int)size; i += 0x1000) {
+            addr[i] = 0;
+        }
+        addr[size - 1] = 0;
+        dmmu_map_user_memory(&dmmu_info);
+    }
+
+    static inline void dmmu_unmap_memory(uint8_t* addr, int size) {
+        struct dmmu_mem_info dmmu_info;
+
+        dmmu_info.vaddr = (void*)addr;
+        dmmu_info.size = size;
+        dmmu_unmap_user_memory(&dmmu_info);
+    }
+
+    /*
+     * cimyuv420b_to_tile420 rewrites the chroma plane in place, so only
+     * those bytes have to reach memory before the ipu or x2d reads them.
+     */
+    static inline void flush_repacked_chroma(CameraDeviceCommon* device, CameraYUVMeta* frame) {
+        int y_size = frame->width * frame->height;
+
+        device->flushCache((void*)(frame->yAddr + y_size), y_size >> 1);
+    }
+
+    /* one frame to put into a preview window buffer */
+    typedef struct convert_request {
+        CameraYUVMeta* src;
+        uint8_t* dst;
+        int dstFormat;
+        int dstWidth;
+        int dstHeight;
+        int dstStride;
+        /* zoom in percent, 100 is no zoom */
+        int zoomRatio;
+        /* dst is already in the dmmu, kept there by the caller */
+        bool dstMapped;
+    } convert_request_t;
+
+    class CameraConvertBackend {
+
+    public:
+        enum BackendType {
+            BACKEND_IPU = 0,
+            BACKEND_X2D,
+            BACKEND_SOFT,
+            BACKEND_COUNT,
+        };
+
+    public:
+        CameraConvertBackend(CameraDeviceCommon* device)
+            :mDevice(device) {
+        }
+
+        virtual ~CameraConvertBackend() { }
+
+        virtual const char* getName(void) = 0;
+
+        /* false when the accelerator is missing on this board */
+        virtual bool open(void) = 0;
+
+        virtual void close(void) = 0;
+
+        virtual bool isOpened(void) = 0;
+
+        virtual bool canConvert(int srcFormat, int dstFormat) = 0;
+
+        /* whether the zoom crop of a request is honoured */
+        virtual bool canZoom(void) {
+            return false;
+        }
+
+        virtual status_t convert(const convert_request_t* req) = 0;
+
+        void update_device(CameraDeviceCommon* device) {
+            mDevice = device;
+        }
+
+    protected:
+        void mapDst(const convert_request_t* req, int size) {
+            if (!req->dstMapped) {
+                dmmu_map_memory(req->dst, size);
+            }
+        }
+
+        void unmapDst(const convert_request_t* req, int size) {
+            if (!req->dstMapped) {
+                dmmu_unmap_memory(req->dst, size);
+            }
+        }
+
+    protected:
+        CameraDeviceCommon* mDevice;
+    };
+
+    class CameraIpuBackend : public CameraConvertBackend {
+
+    public:
+        CameraIpuBackend(CameraDeviceCommon* device);
+        ~CameraIpuBackend();
+
+    public:
+        const char* getName(void) {
+            return "ipu";
+        }
+        bool open(void);
+        void close(void);
+        bool isOpened(void) {
+            return mOpened;
+        }
+        bool canConvert(int srcFormat, int dstFormat);
+        bool canZoom(void) {
+            return true;
+        }
+        status_t convert(const convert_request_t* req);
+        status_t scale(uint8_t* dest, int dest_width, int dest_height,
+                       uint8_t* src, int src_width, int src_height, int src_format,
+                       int stride_mul, int src_stride, int zoomRatio);
+
+    private:
+        int init(int w, int h, int mat, int must_do, int zoomRatio);
+
+    private:
+        struct ipu_image_info * mipu;
+        bool mOpened;
+        bool mInitFirst;
+        /* last ipu setup, so an unchanged frame skips reconfiguring */
+        int mWidth;
+        int mHeight;
+        int mFormat;
+    };
+
+    class CameraX2dBackend : public CameraConvertBackend {
+
+    public:
+        CameraX2dBackend(CameraDeviceCommon* device)
+            :CameraConvertBackend(device),
+             mFd(-1) {
+        }
+
+        ~CameraX2dBackend() {
+            close();
+        }
+
+    public:
+        const char* getName(void) {
+            return "x2d";
+        }
+        bool open(void);
+        void close(void);
+        bool isOpened(void) {
+            return mFd >= 0;
+        }
+        bool canConvert(int srcFormat, int dstFormat);
+        status_t convert(const convert_request_t* req);
+
+    private:
+        int mFd;
+    };
+
+    class CameraSoftBackend : public CameraConvertBackend {
+
+    public:
+        CameraSoftBackend(CameraDeviceCommon* device, CameraColorConvert* convert)
+            :CameraConvertBackend(device),
+             ccc(convert) {
+        }
+
+    public:
+        const char* getName(void) {
+            return "soft";
+        }
+        bool open(void) {
+            return ccc != NULL;
+        }
+        void close(void) { }
+        bool isOpened(void) {
+            return ccc != NULL;
+        }
+        bool canConvert(int srcFormat, int dstFormat);
+        status_t convert(const convert_request_t* req);
+
+    private:
+        CameraColorConvert* ccc;
+    };
+
+    /*
+     * Owns every backend the board has and picks one per combination of
+     * formats and sizes. Each capable backend gets timed on a new
+     * combination and the fastest one is kept from then on. A backend
+     * that fails is dropped for that combination and the frame goes to
+     * the next one, so a missing or broken accelerator only costs speed.
+     */
+    class CameraConverter {
+
+    public:
+        CameraConverter(CameraDeviceCommon* device, CameraColorConvert* convert);
+        ~CameraConverter();
+
+    public:
+        void open(void);
+        void close(void);
+        void update_device(CameraDeviceCommon* device);
+        status_t convert(const convert_request_t* req);
+        status_t scale(uint8_t* dest, int dest_width, int dest_height,
+                       uint8_t* src, int src_width, int src_height, int src_format,
+                       int stride_mul, int src_stride, int zoomRatio);
+
+    private:
+        typedef struct convert_choice {
+            int backend;
+            uint32_t failedMask;
+            int runs[CameraConvertBackend::BACKEND_COUNT];
+            nsecs_t cost[CameraConvertBackend::BACKEND_COUNT];
+        } convert_choice_t;
+
+        bool isUsable(convert_choice_t* choice, int index,
+                      const convert_request_t* req, bool zoomOnly);
+        int pickBackend(convert_choice_t* choice, const convert_request_t* req);
+
+    private:
+        mutable Mutex mLock;
+        CameraIpuBackend* mIpu;
+        CameraConvertBackend* mBackends[CameraConvertBackend::BACKEND_COUNT];
+        KeyedVector<String8, convert_choice_t> mChoices;
+    };
+};
+
+#endif
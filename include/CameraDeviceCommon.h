@@ -93,6 +93,8 @@ namespace android {
         virtual camera_memory_t* getCaptureBufferHandle(void) = 0;
         virtual unsigned int getPreviewFrameIndex(void) = 0;
         virtual int setCommonMode(CommonMode mode_type, unsigned short mode_value)= 0;
+        virtual void beginControlBatch(void) = 0;
+        virtual int commitControlBatch(void) = 0;
         virtual void setCameraFormat(int format) = 0;
         virtual int setCameraParam(struct camera_param& param,int fps)= 0;
         virtual int getResolution(struct resolution_info* info)= 0;
@@ -117,6 +119,15 @@ namespace android {
         virtual void flushCache(void*,int)  = 0;
         virtual bool usePmem(void) = 0;
 
+        /*
+         * Frames a caller may keep away from the driver at once, 0 when
+         * every frame goes straight back. A frame from getHeldFrame()
+         * is only reused once releaseFrame() gets its index.
+         */
+        virtual int getHeldFrameMax(void) { return 0; }
+        virtual void* getHeldFrame(void) { return NULL; }
+        virtual void releaseFrame(int index) { }
+
     public:
         enum {
             DEVICE_CONNECTED = 1<<0, //1
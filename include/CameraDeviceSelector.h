@@ -18,9 +18,12 @@
 #include "CameraCIMDevice.h"
 #include "CameraV4L2Device.h"
 #include "CameraHalCommon.h"
+#include "CameraHotplugMonitor.h"
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
+#include <time.h>
 #include <string.h>
 
 #define MAX_CAMERA_DEVICES 8
@@ -28,17 +31,21 @@
 
 namespace android {
   
-    class CameraDeviceSelector {
+    class CameraDeviceSelector : public CameraHotplugMonitor::Listener {
     
     public:
         CameraDeviceSelector()
             :mDevice(NULL),
              current_device(NULL),
              device_count(0),
-             current_device_index(-1) {
+             current_device_index(-1),
+             last_scan_mtime(0),
+             last_scan_time(0),
+             observer(NULL) {
 
             for (int i=0; i<MAX_CAMERA_DEVICES; ++i) {
                 memset(deviceName[i], 0, MAX_DEVICE_DRIVER_NAME);
+                memset(idNode[i], 0, MAX_DEVICE_DRIVER_NAME);
             }
 
             if (access(CameraCIMDevice::path, R_OK|W_OK) == 0) {
@@ -51,15 +58,17 @@ namespace android {
         ~CameraDeviceSelector() {
 
             int i = 0;
+
+            if (monitor != NULL) {
+                monitor->stop();
+                monitor.clear();
+            }
                    
-            if (mDevice != NULL) {
-                for (i = 0; i < 1; ++i) {
-                    if (mDevice[i] != NULL) {
-                        delete mDevice[i];
-                        mDevice[i] = NULL;
-                    }
-                }
+            /* the CIM device is a singleton, every V4L2 node has its own */
+            for (i = 0; i < (int)v4l2_devices.size(); ++i) {
+                delete v4l2_devices.valueAt(i);
             }
+            v4l2_devices.clear();
 
             free(mDevice);
             device_count = 0;
@@ -69,61 +78,174 @@ namespace android {
         }
 
         CameraDeviceCommon* getDevice(void) {
+            AutoMutex lock(mlock);
             return current_device;
         }
 
+        /* node backing getDevice(), empty when nothing is selected */
+        String8 getDeviceName(void) {
+            AutoMutex lock(mlock);
+            if (current_device_index < 0) {
+                return String8();
+            }
+            return String8(deviceName[current_device_index]);
+        }
+
         void tryAddDevice(void) {
+            /* with the monitor running the list is already current */
+            if (monitor != NULL && monitor->isMonitoring()) {
+                return;
+            }
+            AutoMutex lock(mlock);
             add_v4l2_devices();
         }
 
+        /*
+         * Keep the device list up to date from hotplug events. The observer
+         * hears about every node that comes or goes; any of them may be
+         * streaming under one of the open HALs.
+         */
+        status_t startMonitor(CameraHotplugMonitor::Listener* listener) {
+            observer = listener;
+            if (monitor == NULL) {
+                monitor = new CameraHotplugMonitor();
+            }
+            {
+                AutoMutex lock(mlock);
+                last_scan_mtime = 0;
+                add_v4l2_devices();
+            }
+            return monitor->start(this);
+        }
+
+        void onDeviceAdded(const char* path) {
+            {
+                AutoMutex lock(mlock);
+                add_v4l2_device(path);
+                update_v4l2_device_count();
+            }
+            if (observer != NULL) {
+                observer->onDeviceAdded(path);
+            }
+        }
+
+        void onDeviceRemoved(const char* path) {
+            {
+                AutoMutex lock(mlock);
+                remove_device(path);
+                update_v4l2_device_count();
+            }
+            if (observer != NULL) {
+                observer->onDeviceRemoved(path);
+            }
+        }
+
         void resetDeviceIndex(void) {
+            AutoMutex lock(mlock);
             current_device_index = -1;
         }
 
         void update_device(CameraHalCommon* hal, int id = 0) {
             tryAddDevice();
-            if (selectDevice(id) == NO_ERROR) {
-                hal->update_device(getDevice());
-                getDevice()->update_device_name(deviceName[current_device_index], 
-                  strlen(deviceName[current_device_index]) + 1);
+            CameraDeviceCommon* device = selectDevice(id);
+            if (device != NULL) {
+                hal->update_device(device);
+            }
+        }
+
+        /*
+         * The device for camera id, NULL when there is none. node gets its
+         * path, both taken under the same lock the selection is made in.
+         */
+        CameraDeviceCommon* selectDevice(int id = 0, String8* node = NULL) {
+
+            AutoMutex lock(mlock);
+            int device_index = -1;
+            bool monitored = (monitor != NULL) && monitor->isMonitoring();
+
+            /*
+             * An id keeps the node it was first given for as long as that
+             * node is present, whatever comes or goes around it, so two
+             * HALs open at once never end up sharing one device by accident.
+             */
+            while (device_count > 0) {
+
+                device_index = find_bound_device(id);
+                if (device_index < 0) {
+                    device_index = pick_unbound_device(id);
+                }
+                if (monitored || access(deviceName[device_index],R_OK|W_OK) == 0) {
+                    current_device_index = device_index;
+                    current_device = mDevice[current_device_index];
+                    bind_device(id, device_index);
+                    if (node != NULL) {
+                        node->setTo(deviceName[device_index]);
+                    }
+                    return current_device;
+                }
+
+                ALOGE("remove device: %s",deviceName[device_index]);
+                last_scan_mtime = 0;
+                char name[MAX_DEVICE_DRIVER_NAME];
+                strcpy(name, deviceName[device_index]);
+                remove_device(name);
+                update_v4l2_device_count();
             }
+            return NULL;
         }
 
-        int selectDevice(int id = 0) {
+    private:
 
-            int ret = -1;
-            int device_index = current_device_index;
+        /* index of the present node id is bound to, -1 if none */
+        int find_bound_device(int id) {
 
-            if (device_count > 0) {
-                for (int i=0; i<device_count; ++i) {
+            if ((id < 0) || (id >= MAX_CAMERA_DEVICES) || (idNode[id][0] == '\0')) {
+                return -1;
+            }
+            for (int i = 0; i < device_count; ++i) {
+                if (strcmp(deviceName[i], idNode[id]) == 0) {
+                    return i;
+                }
+            }
+            return -1;
+        }
 
-                    if (device_count == 2) {
-                        device_index = (id == 0) ? 1 : 0;
-                    } else {
-                        device_index = (device_index+1)%device_count;
-                    }
-                    if (access(deviceName[device_index],R_OK|W_OK) == 0) {
-                        current_device_index = device_index;
-                        current_device = mDevice[current_device_index];
-                        ret = 0;
-                        break;
-                    } else {
-                        ALOGE("remove device: %s",deviceName[device_index]);
-                        memset(deviceName[device_index], 0, MAX_DEVICE_DRIVER_NAME);
-                        device_index = (device_index-1)%device_count;
-                        if (device_index < 0) {
-                            device_index = device_count;
-                            device_index = (device_index-1)%device_count;
-                        }
-                        device_count--;
-                        continue;
-                    }
+        bool is_bound_elsewhere(int id, int index) {
+
+            for (int i = 0; i < MAX_CAMERA_DEVICES; ++i) {
+                if ((i != id) && (strcmp(idNode[i], deviceName[index]) == 0)) {
+                    return true;
                 }
             }
-            return ret;
+            return false;
         }
 
-    private:
+        /* the node a new id gets, preferring one no other id holds */
+        int pick_unbound_device(int id) {
+
+            int device_index = 0;
+
+            if (device_count == 2) {
+                device_index = (id == 0) ? 1 : 0;
+            } else {
+                device_index = id % device_count;
+            }
+            for (int i = 0; i < device_count; ++i) {
+                int index = (device_index + i) % device_count;
+                if (!is_bound_elsewhere(id, index)) {
+                    return index;
+                }
+            }
+            return device_index;
+        }
+
+        void bind_device(int id, int index) {
+
+            if ((id < 0) || (id >= MAX_CAMERA_DEVICES)) {
+                return;
+            }
+            strcpy(idNode[id], deviceName[index]);
+        }
 
         void add_device(CameraDeviceCommon* device, const char* device_name) {
 
@@ -160,6 +282,79 @@ namespace android {
                         (device_count + 1) * sizeof(CameraDeviceCommon*));
         }
 
+        /* returns true when the removed node was the selected one */
+        bool remove_device(const char* device_name) {
+
+            int index = -1;
+            bool current = false;
+
+            for (int i = 0; i < device_count; ++i) {
+                if (strcmp(deviceName[i], device_name) == 0) {
+                    index = i;
+                    break;
+                }
+            }
+            if (index < 0) {
+                return false;
+            }
+
+            ALOGE("remove device path: %s", device_name);
+            current = (index == current_device_index);
+            for (int i = index; i < device_count - 1; ++i) {
+                strcpy(deviceName[i], deviceName[i + 1]);
+                mDevice[i] = mDevice[i + 1];
+            }
+            device_count--;
+            memset(deviceName[device_count], 0, MAX_DEVICE_DRIVER_NAME);
+            mDevice[device_count] = NULL;
+
+            if (current) {
+                current_device_index = -1;
+                current_device = NULL;
+            } else if (current_device_index > index) {
+                current_device_index--;
+            }
+            return current;
+        }
+
+        bool is_v4l2_device(int index) {
+            return strncmp(deviceName[index], "/dev/video", 10) == 0;
+        }
+
+        /* every node gets its own instance, kept across unplug and replug */
+        void add_v4l2_device(const char* device_name) {
+
+            CameraV4L2Device* device = NULL;
+            ssize_t index = v4l2_devices.indexOfKey(String8(device_name));
+
+            if (index >= 0) {
+                device = v4l2_devices.valueAt(index);
+            } else {
+                device = new CameraV4L2Device();
+                if (device == NULL) {
+                    ALOGE("%s: no memory for %s",__FUNCTION__, device_name);
+                    return;
+                }
+                device->update_device_name(device_name, strlen(device_name) + 1);
+                v4l2_devices.add(String8(device_name), device);
+            }
+            add_device(device, device_name);
+        }
+
+        void update_v4l2_device_count(void) {
+            int num = 0;
+            int i = 0;
+
+            for (i = 0; i < device_count; ++i) {
+                if (is_v4l2_device(i))
+                    num++;
+            }
+            for (i = 0; i < device_count; ++i) {
+                if (is_v4l2_device(i))
+                    static_cast<CameraV4L2Device*>(mDevice[i])->setDeviceCount(num);
+            }
+        }
+
         int findValidSlot(void) {
 
             int index = -1;
@@ -183,7 +378,22 @@ namespace android {
             struct v4l2_capability v4l2_cap;
             DIR* dir = NULL;
             struct dirent *ent;
-            int num = 0;
+
+            /*
+             * The directory mtime moves whenever a video node comes or goes,
+             * so skip the readdir while it is older than our last scan. A
+             * change in the same second as that scan still forces a rescan.
+             */
+            struct stat st;
+            if (stat(path, &st) == 0) {
+                if ((last_scan_mtime != 0) && (st.st_mtime == last_scan_mtime)
+                    && (last_scan_time > last_scan_mtime)) {
+                    ALOGV("%s unchanged, skip scan", path);
+                    return;
+                }
+                last_scan_mtime = st.st_mtime;
+                last_scan_time = time(NULL);
+            }
 
             memset (device_name, 0, MAX_DEVICE_DRIVER_NAME);
             dir = opendir(path);
@@ -201,8 +411,7 @@ namespace android {
                                   "/dev/%s",ent->d_name);
                 device_name[offset+1] = '\0';
                 if (access(device_name, R_OK|W_OK) == 0) {
-                    num++;
-                    add_device(CameraV4L2Device::getInstance(),device_name);
+                    add_v4l2_device(device_name);
                 } else {
                     ALOGE("could not open %s,error: %s",
                           device_name, strerror(errno));
@@ -211,15 +420,22 @@ namespace android {
             }
             closedir(dir);
             dir = NULL;
-            CameraV4L2Device::getInstance()->setDeviceCount(num);
+            update_v4l2_device_count();
         }
 
     private:
         CameraDeviceCommon** mDevice;
         CameraDeviceCommon* current_device;
         char deviceName[MAX_CAMERA_DEVICES][MAX_DEVICE_DRIVER_NAME];
+        /* node each camera id was last given, kept while it is unplugged */
+        char idNode[MAX_CAMERA_DEVICES][MAX_DEVICE_DRIVER_NAME];
         int device_count;
         int current_device_index;
+        time_t last_scan_mtime;
+        time_t last_scan_time;
+        KeyedVector<String8, CameraV4L2Device*> v4l2_devices;
+        sp<CameraHotplugMonitor> monitor;
+        CameraHotplugMonitor::Listener* observer;
         mutable Mutex mlock;
     };
 
@@ -25,6 +25,17 @@ extern "C" {
 
 #define MAX(x, y) (x)>(y) ? (x) : (y)
 
+/* the detector works on a downscaled luma plane of this width,
+   override with ro.board.camera.fd_width */
+#define FACE_DETECT_DEFAULT_WIDTH 320
+/* detection runs at most this often, override with ro.board.camera.fd_fps */
+#define FACE_DETECT_DEFAULT_FPS 10
+/* full search every N detections, only track known faces in between,
+   override with ro.board.camera.fd_track (1 disables tracking) */
+#define FACE_DETECT_TRACK_INTERVAL 5
+#define FACE_DETECT_MAX_TRACKS 8
+#define FACE_DETECT_MIN_EYE_DIST 20
+
 namespace android {
 
     struct face_detect_param {
@@ -41,54 +52,64 @@ namespace android {
         float midpointx;
         float midpointy;
         float eyedist;
+        float leftEyeX;
+        float leftEyeY;
+        float rightEyeX;
+        float rightEyeY;
+    };
+
+    struct FaceTrack {
+        int id;
+        FaceData data;
     };
 
     class CameraFaceDetect {
 
-    protected:
-        CameraFaceDetect();
-    public:
-        static Mutex sLock;
-        static CameraFaceDetect* sInstance;
-    public:
-        static CameraFaceDetect* getInstance();
     public:
+        CameraFaceDetect();
         virtual ~CameraFaceDetect();
     public:
         int initialize(int w, int h, int maxFaces=1);
-        int detect(uint16_t* imge);
-        void get_face(Rect* r, int index);
-        float get_confidence(void);
+        status_t postFrame(CameraYUVMeta* yuvMeta, nsecs_t timestamp);
+        int detectPendingFrame(nsecs_t* timestamp);
+        void setDetectRate(int fps);
+        int getFaces(camera_face_t* faces, int capacity);
+        void setTrackInterval(int interval);
         void deInitialize(void);
 
-
-        float getRightEyeX(void) {
-            return mRightEyeX;
-        }
-
-        float getRightEyeY(void) {
-            return mRightEyeY;
-        }
-
-        float getLeftEyeX(void) {
-            return mLeftEyeX;
-        }
-
-        float getLeftEyeY(void) {
-            return mLeftEyeY;
-        }
-
-
     private:
+        int detect(uint8_t* gray);
+        int fullDetect(uint8_t* gray);
+        int trackFaces(uint8_t* gray);
+        void updateTracks(FaceData* faces, int count);
         void getFaceData(btk_HDCR hdcr, FaceData* fdata);
+        void updateColumnTable(CameraYUVMeta* yuvMeta);
+        status_t downscaleLuma(CameraYUVMeta* yuvMeta);
 
     private:
         face_detect_param mparam;
-        float mConfidence;
-        float mRightEyeX;
-        float mRightEyeY;
-        float mLeftEyeX;
-        float mLeftEyeY;
+        /* detection sized gray images, the preview thread fills the
+           pending one while the detect thread works on mGrayBuffer */
+        mutable Mutex mFrameLock;
+        uint8_t* mGrayBuffer;
+        uint8_t* mPendingBuffer;
+        bool mFramePending;
+        nsecs_t mPendingTimestamp;
+        nsecs_t mLastPostTime;
+        nsecs_t mDetectInterval;
+        /* byte offset of each sampled source column inside a row */
+        int32_t* mColumnTable;
+        int mTableWidth;
+        int mTableHeight;
+        int mTableFormat;
+        /* faces of the last detection, ids stay with the same face */
+        FaceTrack mTracks[FACE_DETECT_MAX_TRACKS];
+        int mTrackCount;
+        int mNextFaceId;
+        int mTrackInterval;
+        int mFramesSinceFull;
+        bool mTrackLost;
+        uint8_t* mCropBuffer;
     };
 };
 
@@ -0,0 +1,90 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __CAMERA_FRAME_CACHE_H_
+#define __CAMERA_FRAME_CACHE_H_
+
+#include <utils/Vector.h>
+#include <utils/RWLock.h>
+#include "CameraColorConvert.h"
+
+namespace android {
+
+    /*
+     * The images derived from the current frame. A format and size is
+     * converted when the first consumer asks for it, every later consumer
+     * of the same frame gets that copy, and a format nobody asks for is
+     * never made. The buffers are kept from frame to frame until clear(),
+     * and setFrame() waits for whoever still reads one.
+     */
+    class CameraFrameCache {
+
+    public:
+        CameraFrameCache(CameraColorConvert* convert);
+        ~CameraFrameCache();
+
+    public:
+        /*
+         * A new frame, whatever was derived from the old one is stale.
+         * Blocks until every get() result has been put().
+         */
+        void setFrame(CameraYUVMeta* frame);
+
+        /* frees every buffer, blocks like setFrame */
+        void clear(void);
+
+        /*
+         * The current frame as format at width x height, scaled when that
+         * is not the frame size, NULL if it can't be made. A non NULL
+         * result stays valid until the caller put()s it, and must be put()
+         * from the same thread.
+         */
+        const uint8_t* get(int format, int width, int height);
+        void put(void);
+
+        /* get() copied into dst, which holds frameSize() bytes */
+        status_t copyTo(int format, int width, int height, uint8_t* dst);
+
+        /*
+         * Bytes of an image as the cache lays it out: yv12 with 16 aligned
+         * luma and chroma strides, every other format packed.
+         */
+        static int frameSize(int format, int width, int height);
+
+    private:
+        typedef struct cache_entry {
+            int format;
+            int width;
+            int height;
+            int size;
+            uint8_t* data;
+            /* mSerial of the frame data was made from */
+            uint32_t serial;
+            Mutex lock;
+        } cache_entry_t;
+
+        cache_entry_t* findEntry(int format, int width, int height);
+        const uint8_t* lookup(int format, int width, int height);
+        status_t derive(cache_entry_t* entry, CameraYUVMeta* frame);
+
+    private:
+        /* read held from get() to put(), written by setFrame and clear */
+        RWLock mFrameLock;
+        mutable Mutex mLock;
+        CameraColorConvert* ccc;
+        CameraYUVMeta* mFrame;
+        uint32_t mSerial;
+        Vector<cache_entry_t*> mEntries;
+    };
+};
+
+#endif
@@ -16,17 +16,56 @@
 #include "CameraHalCommon.h"
 #include "CameraColorConvert.h"
 #include "CameraFaceDetect.h"
-
-//#define USE_X2D
-#define X2D_NAME "/dev/x2d"
-#define X2D_SCALE_FACTOR 512.0
+#include "CameraJpegEncodePool.h"
+#include "CameraConvertBackend.h"
+#include "CameraZoomEngine.h"
+#include "CameraFrameCache.h"
+#include <MetadataBufferType.h>
 
 #define SIGNAL_RESET_PREVIEW     (SIGNAL_THREAD_COMMON_LAST<<1)
 #define SIGNAL_TAKE_PICTURE      (SIGNAL_THREAD_COMMON_LAST<<2)
 #define SIGNAL_RECORDING_START      (SIGNAL_THREAD_COMMON_LAST<<3)
+#define SIGNAL_FACE_DETECT       (SIGNAL_THREAD_COMMON_LAST<<4)
+
+/* face results older than this are not worth drawing any more */
+#define FACE_DETECT_MAX_LATENCY  (500000000LL)
+
+/* a window that keeps handing out new buffers gets its cache dropped */
+#define PREVIEW_BUFFER_CACHE_MAX (16)
+
+/*
+ * Vendor send_command ids, past the ones in system/camera.h. The stock
+ * framework never sends them: a vendor CameraClient has to forward them
+ * from its app API, and only when ro.board.camera.cb_return is true.
+ * With arg1 1 the app hands each preview callback slot back (arg1 of the
+ * return is the slot, the offset of the callback memory over its size)
+ * and frames arriving while it holds them all are dropped, with 0 the
+ * slots are reused in turn again. A slot not returned within
+ * PREVIEW_SLOT_TIMEOUT is taken back, so a client that forgets to
+ * return them only costs frames for that long.
+ */
+#define CAMERA_CMD_JZ_PREVIEW_CALLBACK_BUFFERS (0x1001)
+#define CAMERA_CMD_JZ_RETURN_PREVIEW_BUFFER    (0x1002)
+#define PREVIEW_SLOT_TIMEOUT     (1000000000LL)
 
 namespace android {
 
+    /* a preview window buffer, in the dmmu while it is cached */
+    typedef struct preview_buffer {
+        void* img;
+        int mapSize;
+    } preview_buffer_t;
+
+    /*
+     * A video frame in metadata mode, the type the encoder checks first and
+     * then where the frame sits in mRecordingHeap. The capture ring can't
+     * hold a buffer for the encoder, so every frame is converted there.
+     */
+    typedef struct recording_metadata {
+        uint32_t type;
+        CameraYUVMeta meta;
+    } recording_metadata_t;
+
     class CameraHal1 : public CameraHalCommon {
 
     public:
@@ -43,6 +82,7 @@ namespace android {
 
         int get_number_cameras(void);
         int get_cameras_info(int camera_id, struct camera_info* info);
+        void notifyDeviceRemoved(void);
 
     public:
         status_t initialize(void);
@@ -80,53 +120,22 @@ namespace android {
         bool NegotiatePreviewFormat(struct preview_stream_ops* win);
         void initVideoHeap(int w, int h);
         void initPreviewHeap(void);
+        int acquirePreviewSlot(void);
+        void finishPreviewSlot(int slot, bool delivered);
+        void resetPreviewSlots(void);
+        void initRecordingMetaHeap(void);
+        int acquireRecordingSlot(void);
+        void sendRecordingMetadata(int slot, const CameraYUVMeta* frame, nsecs_t timestamp);
+        bool useHeldRecordingFrames(void);
+        void finishHeldFrame(void);
+        void releaseHeldRecordingFrames(void);
         void resetPreview(void);
-        void open_ipu_dev(void);
-
-        int init_ipu_dev(int w, int h, int mat, int must_do);
-
-        void close_ipu_dev(void);
-
-        void open_x2d_dev(void);
-
-        void close_x2d_dev(void);
+        void update_zoom(void);
 
         CameraDeviceCommon* getDevice(void) {
             return mDevice;
         }
 
-        size_t num2even(int num){
-            size_t even;
-
-            even = num % 2 ? num-1 : num;
-            if(even == 682)
-                even = 708;
-            else if(even == 778)
-                even = 776;
-
-            return even;
-        }
-
-        void dmmu_map_memory(uint8_t* addr, int size) {
-            struct dmmu_mem_info dmmu_info;
-
-            dmmu_info.vaddr = (void*)addr;
-            dmmu_info.size = size;
-            for (int i = 0; i < (int)size; i += 0x1000) {
-                addr[i] = 0;
-            }
-            addr[size - 1] = 0;
-            dmmu_map_user_memory(&dmmu_info);
-        }
-
-        void dmmu_unmap_memory(uint8_t* addr, int size) {
-            struct dmmu_mem_info dmmu_info;
-
-            dmmu_info.vaddr = (void*)addr;
-            dmmu_info.size = size;
-            dmmu_unmap_user_memory(&dmmu_info);
-        }
-
         unsigned int GetTimer(void)
         {
             struct timeval tv;
@@ -137,14 +146,9 @@ namespace android {
 
         void do_zoom(uint8_t* dest, uint8_t* src);
 
-        void ipu_convert_dataformat(CameraYUVMeta* yuvMeta,
-             uint8_t* dst_buf, buffer_handle_t *buffer);
         status_t ipu_zoomIn_scale(uint8_t* dest, int dest_width, int dest_height,
                  uint8_t* src, int src_width, int src_height, int src_format, int stride_mul, int src_stride);
 
-        void x2d_convert_dataformat(CameraYUVMeta* yuvMeta, 
-                                    uint8_t* dst_buf, buffer_handle_t *buffer);
-
         void dump_data(bool isdump);
 
     private:
@@ -177,13 +181,26 @@ namespace android {
         int mPreviewFrameSize;
         camera_memory_t* mPreviewHeap;
         int mPreviewIndex;
-        mutable Mutex mcapture_lock;
-        List<camera_memory_t*> mListCaptureHeap;
+        /* slots of mPreviewHeap the app still reads, when it returns them */
+        Mutex mPreviewSlotLock;
+        bool mPreviewCallbackBuffers;
+        uint32_t mPreviewSlotBusy;
+        nsecs_t mPreviewSlotTime[PREVIEW_BUFFER_CONUT];
+        int mPreviewFrameDrops;
+        mutable Mutex mhwjpeg_lock;
 
         bool mPreviewEnabled;
         int mRecordingFrameSize;
         camera_memory_t* mRecordingHeap;
         int mRecordingindex;
+        /* metadata mode, the encoder holds the slots it has not released */
+        bool mUseMetaDataBufferMode;
+        camera_memory_t* mRecordingMetaHeap;
+        Mutex mRecordingSlotLock;
+        uint32_t mRecordingSlotBusy;
+        /* capture buffer index each slot lends the encoder, -1 for none */
+        int mRecordingSlotFrame[RECORDING_BUFFER_NUM];
+        int mRecordingFrameDrops;
         bool mVideoRecEnabled;
         int mtotaltime;
         int mtotalnum;
@@ -196,38 +213,62 @@ namespace android {
         int mPreviewWinHeight;
 
         nsecs_t mCurFrameTimestamp;
+        /* set by startPreview, cleared once the first frame is logged */
+        nsecs_t mPreviewStartTime;
         nsecs_t mLastFrameTimestamp;
         CameraYUVMeta* mCurrentFrame;
+        /* mCurrentFrame chroma is tile420 already */
+        bool mFrameRepacked;
+        /* mCurrentFrame is kept from the driver until finishHeldFrame() */
+        bool mCurrentFrameHeld;
         int mFaceCount;
         int mzoomVal;
         int mzoomRadio;
 
         bool isSoftFaceDetectStart;
-        struct ipu_image_info * mipu;
-        bool ipu_open_status;
-        bool init_ipu_first;
-        int x2d_fd;
+        camera_memory_t* mFaceMetadataHeap;
+        camera_face_t mFaceMetadata[FACE_DETECT_MAX_TRACKS];
+        CameraFaceDetect* mFaceDetect;
+        CameraConverter* mConverter;
+        CameraFrameCache* mFrameCache;
+        CameraZoomEngine mZoomEngine;
+
+        /* preview loop state, one set per camera */
+        int mWorkErrors;
+        int mDropFrames;
+        int64_t mWorkTimeout;
+        int mWorkState;
 
         volatile bool mreceived_cmd;
         mutable Mutex cmd_lock;
         Condition mreceivedCmdCondition;
 
         sp<SensorListener> mSensorListener;
+
+        /* window buffers seen so far and the one dequeued ahead, only
+           valid for the current window and geometry */
+        Mutex mPreviewBufferLock;
+        KeyedVector<buffer_handle_t, preview_buffer_t> mPreviewBuffers;
+        buffer_handle_t* mNextPreviewBuffer;
     private:
         bool thread_body(void);
         void postFrameForPreview(void);
         void postFrameForNotify(void);
-        void postJpegDataToApp(void);
-        void softCompressJpeg(void);
-        void hardCompressJpeg(void);
+        void repackCurrentFrame(void);
         status_t fillCurrentFrame(uint8_t* img,buffer_handle_t* buffer);
-        status_t convertCurrentFrameToJpeg(camera_memory_t** jpeg_buff);
+        status_t dequeuePreviewBuffer(buffer_handle_t** buffer);
+        preview_buffer_t* mapPreviewBuffer(buffer_handle_t* buffer);
+        void clearPreviewBufferCache(void);
+        void releasePreviewBuffers(void);
+        void swapPreviewWindow(struct preview_stream_ops* window);
         status_t softFaceDetectStart(int32_t detect_type);
         status_t softFaceDetectStop(void);
         status_t do_takePictureWithPreview(void);
         status_t do_takePicture(void);
         status_t completeTakePicture(void);
         void completeRecordingVideo(void);
+        void completeFaceDetect(void);
+        void sendFaceMetadata(int faceCount, nsecs_t timestamp);
         int getCurrentFrameSize(void);
 
     private:
@@ -307,6 +348,46 @@ namespace android {
 
     private:
         sp<Hal1SignalRecordingVideo> mHal1SignalRecordingVideo;
+
+    private:
+        friend class Hal1SignalFaceDetect;
+        class Hal1SignalFaceDetect : public SignalDrivenThread {
+
+        private:
+            CameraHal1* signalHal1;
+
+        public:
+            Hal1SignalFaceDetect(CameraHal1* hal)
+                : SignalDrivenThread() {
+                signalHal1 = hal;
+            }
+
+            ~Hal1SignalFaceDetect() {
+            }
+
+            void release() {
+                SetSignal(SIGNAL_THREAD_TERMINATE);
+            }
+
+            status_t readyToRunInternal(void) {
+                return NO_ERROR;
+            }
+
+            void threadFuntionInternal(void) {
+                uint32_t signal = GetProcessingSignal();
+                if (signal & SIGNAL_THREAD_TERMINATE) {
+                    SetSignal(SIGNAL_THREAD_TERMINATE);
+                } else if (signal & SIGNAL_FACE_DETECT) {
+                    signalHal1->completeFaceDetect();
+                }
+                return;
+            }
+        };
+
+    private:
+        sp<Hal1SignalFaceDetect> mHal1SignalFaceDetect;
+        /* held while the detector is used, set up or torn down */
+        mutable Mutex mface_detect_lock;
         Vector<camera_memory_t*> mRecordingDataQueue;
         mutable Mutex recordingDataQueueLock;
 
@@ -399,11 +480,7 @@ namespace android {
                 if (pipe(thread_fds) == 0) {
                     mThreadControl = thread_fds[1]; //write
                     mControlFd = thread_fds[0]; //read
-#ifdef USE_X2D
-                    mCameraHal->open_x2d_dev();
-#else
-                    mCameraHal->open_ipu_dev();
-#endif
+                    mCameraHal->mConverter->open();
                     changed = true;
                     start = 0;
                     timeout = 3000000000LL;
@@ -525,49 +602,72 @@ namespace android {
         sp<AutoFocusThread> mFocusThread;
 
     private:
-        friend class PostJpegUnit;
-        class PostJpegUnit : public WorkQueue::WorkUnit {
+        friend class JpegEncodeJob;
+        class JpegEncodeJob : public CameraJpegEncodePool::Job {
 
         private:
             CameraHal1* mhal;
 
         public:
-            PostJpegUnit(CameraHal1* hal):
-                WorkQueue::WorkUnit(),mhal(hal)
+            camera_memory_t* captureHeap;
+            camera_memory_t* jpegHeap;
+            ExifElementsTable* exif;
+            int width;
+            int height;
+            int format;
+            int pictureQuality;
+            int thumbnailWidth;
+            int thumbnailHeight;
+            int thumbnailQuality;
+            int rotation;
+            /* HAL_TRANSFORM_* done losslessly on the encoded jpeg */
+            int transform;
+
+        public:
+            JpegEncodeJob(CameraHal1* hal):
+                CameraJpegEncodePool::Job(),
+                mhal(hal),
+                captureHeap(NULL),
+                jpegHeap(NULL),
+                exif(NULL),
+                width(0),
+                height(0),
+                format(0),
+                pictureQuality(0),
+                thumbnailWidth(0),
+                thumbnailHeight(0),
+                thumbnailQuality(0),
+                rotation(0),
+                transform(0)
             {
             }
 
-            bool run() {
-
-                if (mhal != NULL) {
-                    mhal->postJpegDataToApp();
-                }
-                return true;
+            status_t encode() {
+                return mhal->encodeJpegJob(this);
             }
-        };
-    private:
-        friend class completeTakePictureUnit;
-        class completeTakePictureUnit : public WorkQueue::WorkUnit {
 
-        private:
-            CameraHal1* mhal;
-
-        public:
-            completeTakePictureUnit(CameraHal1* hal):
-                WorkQueue::WorkUnit(),mhal(hal)
-            {
+            void deliver(status_t status) {
+                mhal->deliverJpegJob(this, status);
             }
 
-            bool run() {
-                if (mhal != NULL) {
-                    mhal->completeTakePicture();
-                }
-                return true;
+            void discard() {
+                mhal->releaseJpegJob(this);
             }
         };
 
     private:
-        WorkQueue* mWorkerQueue;
+        int pictureTransform(void);
+        sp<JpegEncodeJob> createJpegJob(camera_memory_t* captureHeap, bool mirrored);
+        status_t scheduleJpegJob(const sp<JpegEncodeJob>& job, int priority);
+        status_t encodeJpegJob(JpegEncodeJob* job);
+        void deliverJpegJob(JpegEncodeJob* job, status_t status);
+        void releaseJpegJob(JpegEncodeJob* job);
+        status_t softCompressJpeg(JpegEncodeJob* job);
+        status_t hardCompressJpeg(JpegEncodeJob* job);
+        status_t convertFrameToJpeg(JpegEncodeJob* job, camera_memory_t** jpeg_buff);
+
+    private:
+        CameraJpegEncodePool* mJpegEncodePool;
 
     public:
         static camera_device_ops_t mCamera1Ops;
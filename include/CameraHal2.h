@@ -16,6 +16,7 @@
 #include "CameraHalCommon.h"
 #include "CameraColorConvert.h"
 #include "CameraFaceDetect.h"
+#include "CameraFrameCache.h"
 
 //#define USE_X2D
 #define X2D_NAME "/dev/x2d"
@@ -53,6 +54,13 @@
 
 #define SIG_WAITING_TICK            (5000)
 
+#define NUM_STREAM_BUFFERS          (5)
+#define NUM_JPEG_STREAM_BUFFERS     (2)
+/* a capture whose outputs take longer fails, room for a jpeg encode */
+#define STREAM_OUTPUT_TIMEOUT_MS    (3000)
+#define JPEG_DEFAULT_QUALITY        (90)
+#define RESULT_TEMPLATE_ENTRIES     (1)
+
 namespace android{
 
 typedef struct stream_parameters {
@@ -73,6 +81,25 @@ typedef struct stream_parameters {
             bool                    needsIonMap;
 } stream_parameters_t;
 
+/* the input side of a reprocess request, only ever fed to the encoder */
+typedef struct reprocess_parameters {
+            uint32_t                width;
+            uint32_t                height;
+            int                     format;
+            const   camera2_stream_in_ops_t*   streamOps;
+            int                     sourceStreamId;
+} reprocess_parameters_t;
+
+/* a request between dequeue and its frame metadata, keyed by frame count */
+typedef struct inflight_request {
+    int32_t                 requestId;
+    int32_t                 frameCount;
+    nsecs_t                 shutterTimestamp;
+    uint32_t                streamMask;
+    uint32_t                doneMask;
+    uint32_t                filledMask;
+} inflight_request_t;
+
 typedef struct substream_entry {
     int                     priority;
     int                     streamId;
@@ -107,14 +134,39 @@ typedef struct substream_entry {
         camera2_notify_callback mCamera2_notify_callback;
         void* mNotifyUserPtr;
 
-        Mutex mInputMutex; // Protects mActive, mRequestCount
+        Mutex mInputMutex; // Protects mActive
         Condition mInputSignal;
         bool mActive; // Whether we're waiting for input requests or actively
                       // working on them
-        size_t mRequestCount;
 
         camera_metadata_t *mRequest;
 
+        CameraColorConvert* ccc;
+        /* what the streams of the current capture derived from its frame */
+        CameraFrameCache* mFrameCache;
+
+        /* capture state, owned by the main thread while a request runs */
+        Mutex mCaptureLock;
+        bool mCaptureRunning;
+        uint32_t mCaptureWidth;
+        uint32_t mCaptureHeight;
+        int mJpegQuality;
+
+        /* requests in flight and their per-stream state, a flush drops every
+           output not yet filled */
+        Mutex mOutputLock;
+        Condition mOutputCondition;
+        KeyedVector<int32_t, inflight_request_t> mInFlight;
+        bool mFlushing;
+
+        /* the one reprocess stream, protected by mLock */
+        bool mReprocessAllocated;
+        reprocess_parameters_t mReprocessParameters;
+
+        /* dynamic result tags appended to every frame */
+        camera_metadata_t* mResultTemplate;
+        size_t mResultTimestampIndex;
+
     public:
           
         void update_device(CameraDeviceCommon* device);
@@ -129,6 +181,8 @@ typedef struct substream_entry {
 
         int get_cameras_info(int camera_id, struct camera_info* info);    
 
+        void notifyDeviceRemoved(void);
+
     private:
 
         void initialize(void);     
@@ -232,7 +286,14 @@ typedef struct substream_entry {
             CameraHal2* mhal2;
         public:
             StreamThread(CameraHal2* hw, uint8_t new_index)
-                :SignalDrivenThread(), mhal2(hw), m_index(new_index) {  }
+                :SignalDrivenThread(), mhal2(hw), m_index(new_index),
+                 m_activated(false), m_isBufferInit(false), m_releasing(false),
+                 streamType(new_index), m_numRegisteredStream(0),
+                 m_srcFrame(NULL), m_frameTimeStamp(0), m_frameCount(0),
+                 m_processingCount(0) {
+                memset(&m_parameters, 0, sizeof(stream_parameters_t));
+                memset(attachedSubStreams, 0, sizeof(attachedSubStreams));
+            }
 
             ~StreamThread();
 
@@ -255,6 +316,12 @@ typedef struct substream_entry {
             int m_numRegisteredStream;
             stream_parameters_t m_parameters;
             substream_entry_t attachedSubStreams[NUM_MAX_SUBSTREAM];
+            /* frame handed over by the main thread for this request */
+            CameraYUVMeta* m_srcFrame;
+            nsecs_t m_frameTimeStamp;
+            int32_t m_frameCount;
+            /* frame this thread is filling, the fields above may be the next one */
+            int32_t m_processingCount;
         };
         friend class StreamThread;
 
@@ -263,14 +330,49 @@ typedef struct substream_entry {
 
         void mainThreadFunc (SignalDrivenThread* self);
         void streamThreadFunc (SignalDrivenThread* self);
-        void subStreamFunc(StreamThread* self, void* srcImageBuf,
+        status_t subStreamFunc(StreamThread* self, void* srcImageBuf,
              int stream_id, nsecs_t frameTimeStamp);
-        void jpegCreator(StreamThread* selfThread, void* srcImageBuf,
-                         nsecs_t frameTimeStamp);
-        void recordCreator(StreamThread* selfThread, void* srcImageBuf,
-                           nsecs_t frameTimeStamp);
-        void previewCreator(StreamThread* selfThread, void* srcImageBuf,
-                            nsecs_t frameTimeStamp);
+        status_t jpegCreator(StreamThread* selfThread, void* srcImageBuf,
+                             nsecs_t frameTimeStamp);
+        status_t recordCreator(StreamThread* selfThread, void* srcImageBuf,
+                               nsecs_t frameTimeStamp);
+        status_t previewCreator(StreamThread* selfThread, void* srcImageBuf,
+                                nsecs_t frameTimeStamp);
+
+        status_t processNextRequest(void);
+        status_t processRequest(camera_metadata_t* request);
+        status_t captureRequest(camera_metadata_t* request, sp<StreamThread>* outputs,
+                                int num, uint32_t width, uint32_t height,
+                                inflight_request_t* inflight);
+        status_t reprocessRequest(camera_metadata_t* request, sp<StreamThread>* outputs,
+                                  int num, inflight_request_t* inflight);
+        bool isReprocessFormat(int format);
+        status_t encodeJpeg(compress_params_t* params, camera_memory_t** jpeg);
+        status_t writeJpegBuffer(StreamThread* stream, camera_memory_t* jpeg,
+                                 nsecs_t timestamp);
+        status_t configureCapture(uint32_t width, uint32_t height);
+        void stopCapture(void);
+        status_t initResultTemplate(void);
+        void sendFrameMetadata(const camera_metadata_t* request, nsecs_t timestamp);
+        void streamOutputDone(int32_t frameCount, int streamId, bool filled);
+        bool isFlushing(void);
+        bool isInFlight(int32_t frameCount);
+        status_t lockStreamBuffer(StreamThread* stream, buffer_handle_t** buffer, void** img);
+        void unlockStreamBuffer(StreamThread* stream, buffer_handle_t* buffer,
+                                bool filled, nsecs_t timestamp);
+        status_t fillStreamBuffer(CameraYUVMeta* frame, stream_parameters_t* params,
+                                  uint8_t* dst);
+        void releaseStreamThread(sp<StreamThread>& stream);
+
+        /* camera_request_memory for the device and the compressor, there is
+           no service side get_memory in the camera2 api */
+        struct HeapMemory {
+            camera_memory_t handle;
+            sp<MemoryHeapBase> heap;
+        };
+        static camera_memory_t* get_memory(int fd, size_t buf_size,
+                                           unsigned int num_bufs, void* user);
+        static void put_memory(camera_memory_t* data);
 
     public:
 
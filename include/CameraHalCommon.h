@@ -43,6 +43,9 @@ namespace android {
         virtual int get_number_cameras(void) = 0;
 
         virtual int get_cameras_info(int camera_id, struct camera_info* info) = 0;   
+
+        /* the sensor node went away while this camera was open */
+        virtual void notifyDeviceRemoved(void) = 0;
     };
 
 #define SIGNAL_THREAD_TERMINATE   (1<<0)
@@ -26,7 +26,7 @@
 
 namespace android {
 
-    class CameraHalSelector {
+    class CameraHalSelector : public CameraHotplugMonitor::Listener {
 
     public:
         CameraHalSelector();
@@ -58,12 +58,21 @@ namespace android {
 
         static int get_camera_info(int camera_id, struct camera_info* info);
 
+        void onDeviceAdded(const char* path);
+        void onDeviceRemoved(const char* path);
+
     private:
         static int hw_module_open(const hw_module_t* module,
                                   const char* id,
                                   hw_device_t** device);
+        bool isNodeBusy(int id, const String8& node);
+
     private :
         mutable Mutex mLock;
+        /* serializes opens, kept apart from mLock which the hotplug thread takes */
+        mutable Mutex mOpenLock;
+        /* node each camera id was opened on */
+        String8 mNodeName[MAX_CAMERAS];
         int mCameraNum;
         int mCurrentId;
         int mversion;
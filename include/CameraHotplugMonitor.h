@@ -0,0 +1,67 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __CAMERA_HOTPLUG_MONITOR_H_
+#define __CAMERA_HOTPLUG_MONITOR_H_
+
+#include "CameraCore.h"
+
+#define HOTPLUG_UEVENT_BUFFER_SIZE 2048
+/* ueventd creates and chmods the node a little after the kernel add event */
+#define HOTPLUG_NODE_WAIT_MS 1000
+
+namespace android {
+
+    /*
+     * Watches for video4linux nodes coming and going, from kernel uevents
+     * when the netlink socket is available to us, otherwise from inotify
+     * on /dev. Listeners are called on the monitor thread.
+     */
+    class CameraHotplugMonitor : public Thread {
+
+    public:
+        class Listener {
+        public:
+            virtual ~Listener() { }
+            virtual void onDeviceAdded(const char* path) = 0;
+            virtual void onDeviceRemoved(const char* path) = 0;
+        };
+
+    public:
+        CameraHotplugMonitor();
+        ~CameraHotplugMonitor();
+
+    public:
+        status_t start(Listener* listener);
+        void stop(void);
+        bool isMonitoring(void) {
+            return mEventFd >= 0;
+        }
+
+    private:
+        bool threadLoop();
+        int  openUevent(void);
+        int  openInotify(void);
+        void handleUevent(char* msg, int len);
+        void handleInotify(char* buf, int len);
+        void dispatch(bool add, const char* node);
+        bool waitForNode(const char* path);
+
+    private:
+        Listener* mListener;
+        int mEventFd;
+        int mWakeFd[2];
+        bool mUseUevent;
+    };
+};
+
+#endif
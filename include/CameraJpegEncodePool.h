@@ -0,0 +1,128 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __CAMERA_JPEG_ENCODE_POOL_H_
+#define __CAMERA_JPEG_ENCODE_POOL_H_
+
+#include <utils/Vector.h>
+#include "CameraCore.h"
+
+#define JPEG_ENCODE_WORKERS  2
+#define JPEG_ENCODE_MAX_JOBS 4
+
+namespace android {
+
+    /*
+     * A small pool of encode threads. Jobs are picked by priority, so a
+     * still capture does not wait behind a video snapshot, but they are
+     * always delivered in the order they were scheduled (shutter order),
+     * whichever worker happens to finish first.
+     */
+    class CameraJpegEncodePool {
+
+    public:
+        enum JobPriority {
+            PRIORITY_VIDEO_SNAPSHOT = 0,
+            PRIORITY_STILL = 1,
+        };
+
+        class Job : public virtual RefBase {
+
+            friend class CameraJpegEncodePool;
+
+        public:
+            Job():
+                mSequence(0),
+                mPriority(PRIORITY_STILL),
+                mStatus(NO_ERROR),
+                mEncoded(false),
+                mCancelled(false) {
+            }
+
+            virtual ~Job() { }
+
+            /* run on a pool worker, no pool lock held */
+            virtual status_t encode(void) = 0;
+
+            /*
+             * run in shutter order, at most one deliver() at a time. It may
+             * call cancelAll(), which then returns without waiting.
+             */
+            virtual void deliver(status_t status) = 0;
+
+            /* the job was cancelled, release everything it holds */
+            virtual void discard(void) = 0;
+
+        private:
+            uint32_t mSequence;
+            int mPriority;
+            status_t mStatus;
+            bool mEncoded;
+            bool mCancelled;
+        };
+
+    public:
+        CameraJpegEncodePool(int workers = JPEG_ENCODE_WORKERS,
+                             int maxJobs = JPEG_ENCODE_MAX_JOBS);
+        ~CameraJpegEncodePool();
+
+    public:
+        status_t start(void);
+        void stop(void);
+        status_t schedule(const sp<Job>& job, int priority);
+        void cancelAll(void);
+        int getJobCount(void);
+
+    private:
+        friend class EncodeWorker;
+        class EncodeWorker : public Thread {
+
+        private:
+            CameraJpegEncodePool* mPool;
+
+        public:
+            EncodeWorker(CameraJpegEncodePool* pool):
+                Thread(false),
+                mPool(pool) {
+            }
+
+        private:
+            bool threadLoop() {
+                return mPool->processNextJob();
+            }
+        };
+
+    private:
+        bool processNextJob(void);
+        void deliverCompletedJobsLocked(void);
+
+    private:
+        Mutex mLock;
+        Condition mJobAvailable;
+        Condition mJobRetired;
+        /* jobs waiting for a worker, highest priority first */
+        List<sp<Job> > mPendingJobs;
+        /* every job not yet delivered, in shutter order */
+        List<sp<Job> > mOrderedJobs;
+        Vector<sp<EncodeWorker> > mWorkers;
+        int mWorkerNum;
+        int mMaxJobs;
+        int mRunningJobs;
+        uint32_t mNextSequence;
+        bool mDelivering;
+        /* thread running the delivery loop, for cancelAll() reentry */
+        pid_t mDeliveringTid;
+        bool mExiting;
+    };
+};
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __CAMERA_JPEG_TRANSFORM_H_
+#define __CAMERA_JPEG_TRANSFORM_H_
+
+#include "CameraDeviceCommon.h"
+#include <SkStream.h>
+
+namespace android {
+
+    /*
+     * Flips and rotates a finished baseline jpeg by moving its DCT blocks
+     * around, so nothing is decoded to pixels or quantized again. Edges
+     * that do not fill a whole MCU cannot move losslessly and are trimmed
+     * on the flipped axis, the same as jpegtran -trim.
+     */
+    class CameraJpegTransform {
+
+    public:
+        /* HAL_TRANSFORM_* value for a KEY_ROTATION in degrees */
+        static int fromDegrees(int degrees);
+
+        /* the single transform doing first and then second */
+        static int compose(int first, int second);
+
+        static status_t transform(const uint8_t* jpeg, size_t size, int transform,
+                                  SkDynamicMemoryWStream* out);
+    };
+};
+
+#endif
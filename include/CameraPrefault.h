@@ -0,0 +1,49 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __CAMERA_PREFAULT_H_
+#define __CAMERA_PREFAULT_H_
+
+#include "CameraCore.h"
+
+#define PREFAULT_PAGE_SIZE 0x1000
+/* below this one thread touches the pool faster than starting helpers */
+#define PREFAULT_PARALLEL_SIZE (2 * 1024 * 1024)
+#define PREFAULT_MAX_THREADS 4
+
+namespace android {
+
+    /*
+     * The dmmu only picks up pages that are already present in our page
+     * tables, so every pool has to be faulted in before it is mapped.
+     * Pools from mmap(MAP_POPULATE) arrive populated and only need one
+     * fault-free pass, big pools from get_memory are touched by one
+     * thread per cpu.
+     */
+    class CameraPrefault {
+
+    public:
+        /* logs the time spent, the callers only time whole allocations */
+        static void mapBuffer(struct dmmu_mem_info* info, bool populated = false);
+
+    private:
+        typedef struct touch_range {
+            uint8_t* addr;
+            int size;
+        } touch_range_t;
+
+        static void touch(uint8_t* addr, int size);
+        static void* touchThread(void* data);
+    };
+};
+
+#endif
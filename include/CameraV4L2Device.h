@@ -14,13 +14,17 @@
 #define __CAMERA_V4L2_DEVICE_H_
 
 #include <utils/SortedVector.h>
+#include <utils/KeyedVector.h>
 #include "CameraDeviceCommon.h"
+#include "CameraPrefault.h"
 #include "CameraColorConvert.h"
 #include "JZCameraParameters.h"
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 
 #define NB_BUFFER 3
+/* at least two buffers stay with the driver while frames are held */
+#define NB_HELD_BUFFER (NB_BUFFER - 2)
 
 namespace android {
 
@@ -126,6 +130,7 @@ namespace android {
         int32_t value;
         int64_t value64;
         char* str;
+        bool cached;        /* value holds what the sensor was last set to */
         struct _Control* next;
     }Control;
 
@@ -136,12 +141,19 @@ namespace android {
         int height_req;
     };
 
+    /* what enumeration found on one sensor, kept across open/close */
+    struct DeviceCaps {
+        SortedVector<frameInterval> fmts;
+        frameInterval best_preview;
+        frameInterval best_picture;
+        Control* control_list;
+        int num_controls;
+    };
+
     class CameraV4L2Device : public CameraDeviceCommon {
 
+    /* one instance per /dev/videoN node, created by CameraDeviceSelector */
     public:
-        static CameraV4L2Device* getInstance();
-
-    protected:
         CameraV4L2Device();
         ~CameraV4L2Device();
 
@@ -152,6 +164,9 @@ namespace android {
                            int format);
         void freeStream(BufferType type);
         void* getCurrentFrame(void);
+        int getHeldFrameMax(void);
+        void* getHeldFrame(void);
+        void releaseFrame(int index);
         int getPreviewFrameSize(void);
         int getCaptureFrameSize(void);
         void getPreviewSize(int* w, int* h);
@@ -163,6 +178,8 @@ namespace android {
         int getCaptureFormat(void);
         int getPreviewFormat(void);
         int setCommonMode(CommonMode mode_type, unsigned short mode_value);
+        void beginControlBatch(void);
+        int commitControlBatch(void);
         void setCameraFormat(int format);
         int setCameraParam(struct camera_param &param, int fps);
         int getResolution(struct resolution_info* info);
@@ -208,20 +225,25 @@ namespace android {
         Control* get_control_list(int hdevice, int* num_ctrls);
         void free_control_list(Control* control_list);
         void initDefaultControls(void);
+        void loadDeviceCaps(void);
+        void index_controls(void);
+        void clear_control_index(void);
+        int queue_ctrl(Control* control, int value);
+        int apply_ctrls(struct v4l2_ext_control* ctrls, int count);
         bool EnumFrameIntervals(int pixfmt, int width, int height);
         bool EnumFrameSizes(int pixfmt);
         void EnumFrameFormats();
         int set_boolean_ctrl(struct v4l2_queryctrl *queryctrl);
         int set_integer_ctrl_up(struct v4l2_queryctrl *queryctrl);
         int set_integer_ctrl_down(struct v4l2_queryctrl *queryctrl);
-        int set_menu_ctrl(const char* name, const mode_map_t table[],
+        int set_menu_ctrl(Control* control, const mode_map_t table[],
                   int table_len, unsigned short mode_value);
         int open_device(void);
         int stop_device(void);
         int start_device(void);
         int init_device(void);
         int init_read(unsigned int buffer_size,camera_request_memory get_memory);
-        void dmmu_map_buffer(struct dmmu_mem_info *dmmu_info);
+        void dmmu_map_buffer(struct dmmu_mem_info *dmmu_info, bool populated = false);
         int init_mmap(camera_request_memory get_memory);
         int init_userp(uint32_t width, uint32_t height,
                        camera_request_memory get_memory,int format);
@@ -231,6 +253,8 @@ namespace android {
         void* getReadWriteCurrentFrame(void);
         void* getUserPtrCurrentFrame(void);
         void* getMmapCurrentFrame(void);
+        bool holdDequeuedFrame(int index);
+        void clearHeldFrames(void);
         void  setMmapFormat(int format);
         void  setUserPtrFormat(int format);
         Control* find_control(const char* ctrl_name,int ctrl_id);
@@ -251,6 +275,14 @@ namespace android {
         int mCurrentFrameIndex;
         SortedVector<frameInterval> m_AllFmts;
         struct VidState s;
+        /* control list indexed by id, menu controls resolved per mode */
+        KeyedVector<uint32_t, Control*> mControlIndex;
+        Control* mModeControls[ANTIBAND_MODE + 1];
+        /* changes queued between begin/commitControlBatch */
+        Vector<struct v4l2_ext_control> mPendingControls;
+        bool mBatchControls;
+        /* keyed by driver, card, bus info and driver version */
+        KeyedVector<String8, DeviceCaps*> mDeviceCaps;
         frameInterval m_BestPreviewFmt;
         frameInterval m_BestPictureFmt;
         struct camera_buffer preview_buffer;
@@ -274,9 +306,11 @@ namespace android {
         bool isChangedSize;
         bool isSupportHighResuPre;
         int mReqLostFrameNum;
-    public:
-        static Mutex sLock;
-        static CameraV4L2Device* sInstance;
+        /* dequeued frames the driver gets back in releaseFrame() */
+        Mutex mHoldLock;
+        bool mHoldFrame;
+        unsigned int mHeldFrames;
+        struct v4l2_buffer mHeldBuffer[NB_BUFFER];
     };
 };
 #endif
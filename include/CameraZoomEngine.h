@@ -0,0 +1,77 @@
+/*
+ * Camera HAL for Ingenic android 4.1
+ *
+ * Copyright 2012 Ingenic Semiconductor LTD.
+ *
+ * author:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __CAMERA_ZOOM_ENGINE_H_
+#define __CAMERA_ZOOM_ENGINE_H_
+
+#include "CameraCore.h"
+
+/* zoom index i is ZOOM_RATIO_MIN + i * ZOOM_RATIO_STEP percent */
+#define ZOOM_RATIO_MIN 100
+#define ZOOM_RATIO_MAX 400
+#define ZOOM_RATIO_STEP 10
+/* percent the crop moves per preview frame during a smooth zoom */
+#define ZOOM_SMOOTH_STEP 4
+/*
+ * a new ipu crop size costs an ipu_init, so the ipu only takes crops on
+ * this grid and a smooth zoom reprograms it once per index passed
+ */
+#define ZOOM_IPU_RATIO_STEP ZOOM_RATIO_STEP
+
+namespace android {
+
+    /*
+     * Keeps the zoom of the preview as a ratio in percent. A zoom set
+     * through the parameters jumps there at once, a smooth zoom walks
+     * the ratio a little every frame so the crop window slides instead
+     * of stepping, and reports each zoom index it passes.
+     */
+    class CameraZoomEngine {
+
+    public:
+        CameraZoomEngine();
+        ~CameraZoomEngine() { }
+
+    public:
+        static int getMaxZoom(void);
+        static int ratioOf(int index);
+        /* comma separated ratios for KEY_ZOOM_RATIOS */
+        static String8 getZoomRatios(void);
+
+        /* jump to index, cancels a running smooth zoom */
+        void setZoom(int index);
+        status_t startSmoothZoom(int index);
+        void stopSmoothZoom(void);
+        bool isSmoothZooming(void);
+
+        /*
+         * Call once per frame. Returns true when a smooth zoom reached a
+         * new index, which is put in *index, *stopped is set on the last one.
+         */
+        bool advance(int* index, bool* stopped);
+
+        int getZoom(void);
+        int getRatio(void);
+
+    private:
+        int indexOf(int ratio, bool up);
+
+    private:
+        mutable Mutex mLock;
+        int mRatio;
+        int mIndex;
+        int mTargetIndex;
+        bool mSmooth;
+    };
+};
+
+#endif
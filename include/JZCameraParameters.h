@@ -36,12 +36,22 @@ namespace android {
         unsigned short mode;
     }mode_map_t;
 
+    typedef struct fps_range {
+        int min;
+        int max;
+    }fps_range_t;
+
     class JZCameraParameters {
 
     public:
         static const char KEY_LUMA_ADAPTATION[]; 
         static const char KEY_NIGHTSHOT_MODE[];
         static const char KEY_ORIENTATION[];
+        /* whether stills are turned in the file or only tagged in exif */
+        static const char KEY_PICTURE_ORIENTATION[];
+        static const char KEY_SUPPORTED_PICTURE_ORIENTATIONS[];
+        static const char PICTURE_ORIENTATION_EXIF[];
+        static const char PICTURE_ORIENTATION_PIXELS[];
 
         static const char PIXEL_FORMAT_JZ__YUV420T[]; // ingenic yuv420tile
         static const char PIXEL_FORMAT_JZ__YUV420P[]; // ingenic yuv420p
@@ -73,6 +83,19 @@ namespace android {
             return -1;
         }
 
+        bool lookup_mode(const char* string, const mode_map_t map_table[], int len,
+                         unsigned short* mode) {
+
+            int i;
+            for (i = 0; i < len; i++) {
+                if (strcmp(string, map_table[i].dsc) == 0) {
+                    *mode = map_table[i].mode;
+                    return true;
+                }
+            }
+            return false;
+        }
+
         const char* mode_to_string(unsigned short mode, const mode_map_t map_table[], int len) {
 
             unsigned int i;
@@ -115,11 +138,17 @@ namespace android {
         bool   is_preview_size_change(void);
         bool   is_video_size_change(void);
         bool   is_picture_size_change(void);
+        bool   is_picture_orientation_exif(void);
         void   initDefaultParameters(int facing);
         int    getPropertyPictureSize(int* width, int* height);          
-        status_t setUpEXIF(ExifElementsTable* exifTable);
+        status_t setUpEXIF(ExifElementsTable* exifTable, int viewTransform, bool sizeSwapped);
         void update_device(CameraDeviceCommon* device) {
             mCameraDevice = device;
+            mAppliedParams.clear();
+            /* 0 is no mode, so the next setParameters pushes every one again */
+            for (int i = 0; i < NUM_MODE_PARAMS; ++i) {
+                mModeParams[i].current = 0;
+            }
         }
         void resetSizeChanged(void) {
             isPreviewSizeChange = false;
@@ -127,16 +156,24 @@ namespace android {
             isVideoSizeChange = false;
         }
 
-        CameraParameters& getCameraParameters() {
+        const CameraParameters& getCameraParameters() const {
             return mParameters;
         }
 
+        void setParameter(const char* key, const char* value);
+        String8 getFlattenedParameters(void);
+
     private:
         int  getPropertyValue(const char* property);
         bool if_need_picture_upscale(void);          
         bool isParameterValid(const char *param, const char *supportedParams);
         bool isValidFocusAreas(const char* areas);
         void clearGpsData(void);
+        void invalidateFlattened(void);
+        void setupModeParam(int index, unsigned short modes);
+        void parseSupportedTables(void);
+        int  formatIndex(const char* format);
+        bool isSizeSupported(const Vector<Size>& sizes, int width, int height);
     public:
         void getMaxPreviewSize(unsigned int* width, unsigned int* height) {
             if ((maxpreview_width > 0) && (maxpreview_height > 0)) {
@@ -159,6 +196,28 @@ namespace android {
         }
 
 
+    private:
+        enum {
+            MODE_WHITE_BALANCE = 0,
+            MODE_EFFECT,
+            MODE_FOCUS,
+            MODE_FLASH,
+            MODE_SCENE,
+            MODE_ANTIBANDING,
+            NUM_MODE_PARAMS,
+        };
+
+        /* one enumerated control, the supported set is parsed once from
+           the sensor info so setParameters never scans support strings */
+        typedef struct mode_param {
+            const char* key;
+            CommonMode type;
+            const mode_map_t* map;
+            int num;
+            unsigned short supported;
+            unsigned short current;
+        }mode_param_t;
+
     private:
         CameraParameters mParameters;
         CameraDeviceCommon *mCameraDevice;
@@ -176,6 +235,21 @@ namespace android {
         bool isPreviewSizeChange;
         bool isPictureSizeChange;
         bool isVideoSizeChange;
+
+        mode_param_t mModeParams[NUM_MODE_PARAMS];
+        unsigned int mSupportedFormats;  /* bit i -> pix_format_map[i] */
+        Vector<Size> mSupportedPreviewSizes;
+        Vector<Size> mSupportedPictureSizes;
+        Vector<Size> mSupportedVideoSizes;
+        Vector<Size> mSupportedThumbnailSizes;
+        Vector<int> mSupportedFrameRates;
+        Vector<fps_range_t> mSupportedFpsRanges;
+
+        /* flatten() of mParameters, rebuilt lazily after a change */
+        String8 mFlattened;
+        bool mFlattenedValid;
+        /* last string setParameters accepted, the same string again is a no-op */
+        String8 mAppliedParams;
     
     };
 
@@ -235,9 +309,14 @@ namespace android {
         status_t insertExifThumbnailImage(const char*, int);
         void saveJpeg(unsigned char* picture, size_t jpeg_size);
         static const char* degreesToExifOrientation(unsigned int);
+        static const char* transformToExifOrientation(int transform);
         static void stringToRational(const char*, unsigned int *, unsigned int *);
         static bool isAsciiTag(const char* tag);   
 
+        /* jhead keeps the parsed sections in globals, hold this from
+           insertExifToJpeg() until saveJpeg() when encoding in parallel */
+        static Mutex sJheadLock;
+
     };
 };
 
@@ -41,6 +41,15 @@ namespace android {
 
     private:
 
+        /* a request control and the member holding the mode last pushed for it */
+        typedef struct request_control {
+            uint32_t          tag;
+            CommonMode        type;
+            const mode_map_t* map;
+            int               num;
+            int JZCameraParameters2::* current;
+        } request_control_t;
+
         static const char KEY_LUMA_ADAPTATION[]; 
         static const char KEY_NIGHTSHOT_MODE[];
         static const char KEY_ORIENTATION[];
@@ -52,6 +61,7 @@ namespace android {
         static const mode_map_t scene_map[];
         static const mode_map_t focus_map[];
         static const mode_map_t pix_format_map[];
+        static const request_control_t request_controls[];
 
         unsigned short tag_to_mode (const int tag, const mode_map_t map_table[], int len);
         int mode_to_tag (unsigned short mode, const mode_map_t map_table[], int len);
@@ -114,6 +124,9 @@ namespace android {
        status_t constructDefaultRequest(int request_template,
           camera_metadata_t **request, bool sizeRequest);
 
+       /* a copy of the template, built once per open */
+       status_t getDefaultRequest(int request_template, camera_metadata_t **request);
+
     private:
         mutable Mutex mLock;
         CameraDeviceCommon* mDevice;
@@ -140,6 +153,9 @@ namespace android {
 
         camera_metadata_t * mPreviewMetaDataBuffer;
         camera_metadata_t * mRecordMetaDataBuffer;
+        camera_metadata_t * mDefaultRequests[CAMERA2_TEMPLATE_COUNT];
+
+        void freeDefaultRequests(void);
 
     };
 
@@ -202,6 +218,10 @@ namespace android {
         static void stringToRational(const char*, unsigned int *, unsigned int *);
         static bool isAsciiTag(const char* tag);   
 
+        /* jhead keeps the parsed sections in globals, hold this from
+           insertExifToJpeg() until saveJpeg() when encoding in parallel */
+        static Mutex sJheadLock;
+
     };
 };
 